@@ -1,200 +1,614 @@
 #include "cache.h"
 #include <errno.h>
 #include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 // 캐시 엔트리 구조체
 typedef struct cache_entry {
     char *key;                // 식별자(URI)
-    char *data;               // 응답 원본 데이터(헤더 포함)
-    size_t size;              // 데이터 바이트 수
+    uint64_t hash;            // key의 해시(삽입 시 한 번 계산, 인덱스 탐색/비교에 재사용)
+    cache_obj_t *obj;         // 응답 원본 데이터(헤더 포함), 캐시가 참조 1개를 가짐
+    size_t charge;            // 예산에서 차지하는 바이트: 데이터 + 키 + 엔트리/객체 구조체
+    atomic_uchar referenced;  // CLOCK 정책의 참조 비트(HIT가 읽기 락 아래에서 세움, 방출기가 지움)
     struct cache_entry *prev; // LRU 리스트 이전 노드
     struct cache_entry *next; // LRU 리스트 다음 노드
 } cache_entry_t;
 
+// 해시 인덱스: key 해시 -> 엔트리 포인터의 개방 주소법(선형 탐사) 테이블
+// - LRU 순서는 기존 이중 연결 리스트가 그대로 담당하고, 인덱스는 "어디 있는지"만 O(1)로 알려줌
+// - 삭제된 칸은 TOMBSTONE으로 표시해 뒤쪽 탐사 사슬이 끊기지 않게 함
+#define INDEX_INIT_CAP 64                               // 초기 칸 수(2의 거듭제곱 유지)
+#define INDEX_TOMBSTONE ((cache_entry_t *)(uintptr_t)1) // 삭제 표시
+
+// TinyLFU 빈도 스케치(count-min sketch)
+// - 행마다 다른 해시로 고른 카운터 하나씩을 올리고, 추정치는 행들 중 최솟값(과대 추정만 가능)
+// - 카운터는 15에서 포화(4비트), 추가가 SKETCH_SAMPLE번 쌓이면 전부 절반으로 줄여 오래된 인기를 잊음
+// - 카운터는 원자 변수라 HIT/MISS 경로에서 락 없이 갱신 가능(노화 중 경쟁은 근사치로 허용)
+#define SKETCH_DEPTH 4                     // 행 수
+#define SKETCH_WIDTH 4096                  // 행당 카운터 수(2의 거듭제곱)
+#define SKETCH_MAX 15                      // 카운터 포화값
+#define SKETCH_SAMPLE (SKETCH_WIDTH * 8)   // 노화 주기(추가 횟수)
+typedef struct {
+    atomic_uchar counters[SKETCH_DEPTH][SKETCH_WIDTH];
+    atomic_size_t additions; // 마지막 노화 이후 추가 횟수
+} sketch_t;
+
+// 샤드: 키 해시로 고른 캐시의 한 조각. 락/LRU 리스트/해시 인덱스/용량 몫을 각자 가짐
+// - 서로 다른 샤드의 조회/삽입은 락을 공유하지 않으므로 코어 수만큼 병행
+typedef struct {
+    // 타입 : pthread_rwlock_t는 POSIX 스레드의 읽기-쓰기 락 타입
+    // 여러 스레드가 동시에 읽기는 가능하고, 쓰기는 하나의 스레드만 단독으로 들어갈 수 있게 보장함.
+    // 캐시 조회는 빈번하고 읽기 비중이 높기 때문에 mutex 대신 RWLock을 쓰면 성능상 유리(동시 읽기 병행)
+    pthread_rwlock_t lock;
+    cache_entry_t *head;         // LRU의 처음 : 가장 최근 사용 캐시
+    cache_entry_t *tail;         // LRU의 마지막 : 가장 오래된 캐시
+    size_t current_size;         // 이 샤드 엔트리들의 charge 총 합
+    size_t capacity;             // 이 샤드의 용량 몫(모든 샤드 합 = 총 메모리 예산)
+    cache_entry_t **index_slots; // 해시 인덱스 칸 배열
+    size_t index_cap;            // 칸 수
+    size_t index_used;           // 살아있는 엔트리 수
+    size_t index_tombs;          // 삭제 표시 칸 수
+    sketch_t *sketch;            // TinyLFU 빈도 스케치(입장 정책이 TINYLFU일 때만 할당)
+    // 통계 카운터: 전역 하나로 두면 모든 HIT가 같은 캐시 라인을 두드리므로 샤드별로 두고 조회 시 합산
+    atomic_ullong hits, misses, inserts, evictions, rejected, filling, expired, stale;
+    // 인접 샤드의 락이 같은 캐시 라인을 공유해 서로 무효화하지 않도록 패딩
+    char pad[64];
+} cache_shard_t;
+
 // 전역 캐시 상태
-static cache_entry_t *head = NULL; // LRU의 처음 : 가장 최근 사용 캐시
-static cache_entry_t *tail = NULL; // LRU의 마지막 : 가장 오래된 캐시
-static size_t current_size = 0;    // 현재 저장된 캐시 크기의 총 합
+static cache_shard_t *shards = NULL;       // 샤드 배열(cache_init에서 할당)
+static size_t nshards = 0;                 // 실제 사용하는 샤드 수(cache_init에서 결정)
+static size_t max_object_size = MAX_OBJECT_SIZE; // 단일 객체 한도
+
+// 샤드 수를 정할 때 객체 한도에 더해 둘 키/메타데이터 여유분
+#define ENTRY_SLACK 4096
+static cache_policy_t policy = CACHE_POLICY_LRU; // 방출 정책
+static cache_admission_t admission = CACHE_ADMIT_NONE; // 입장 정책
+static cache_evict_fn evict_hook = NULL;               // 방출 객체를 넘겨받을 쪽(디스크 계층)
+
+// FNV-1a 64비트 해시: "http://host:port/path" 키 문자열용
+static uint64_t hash_key(const char *key) {
+    uint64_t h = 1469598103934665603ULL;
+    for (const unsigned char *p = (const unsigned char *)key; *p; p++) {
+        h ^= *p;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// 해시로 샤드 선택. 인덱스 칸은 하위 비트를 쓰므로 샤드는 상위 비트로 골라 서로 독립적으로 분산
+// - FNV-1a의 중간 비트는 비슷한 키(".../1", ".../2")끼리 잘 섞이지 않으므로 곱셈으로 한 번 더 섞은 뒤 사용
+static cache_shard_t *shard_of(uint64_t hash) {
+    uint64_t h = (hash ^ (hash >> 31)) * 0x9E3779B97F4A7C15ULL;
+    return &shards[(h >> 32) % nshards];
+}
+
+// 스케치 i번째 행의 카운터 위치: 키 해시를 행마다 다른 상수로 섞은 뒤 상위 비트 사용
+static size_t sketch_slot(uint64_t hash, int row) {
+    uint64_t h = (hash + (uint64_t)row * 0x9E3779B97F4A7C15ULL) * 0xBF58476D1CE4E5B9ULL;
+    return (size_t)(h >> 40) & (SKETCH_WIDTH - 1);
+}
+
+// 키의 빈도 추정치(행들 중 최솟값)
+static unsigned sketch_estimate(const sketch_t *sk, uint64_t hash) {
+    unsigned est = SKETCH_MAX;
+    for (int r = 0; r < SKETCH_DEPTH; r++) {
+        unsigned v = atomic_load_explicit(&sk->counters[r][sketch_slot(hash, r)], memory_order_relaxed);
+        if (v < est)
+            est = v;
+    }
+    return est;
+}
+
+// 키의 요청을 한 번 기록. 주기가 차면 모든 카운터를 절반으로(노화)
+static void sketch_increment(sketch_t *sk, uint64_t hash) {
+    for (int r = 0; r < SKETCH_DEPTH; r++) {
+        atomic_uchar *c = &sk->counters[r][sketch_slot(hash, r)];
+        unsigned char v = atomic_load_explicit(c, memory_order_relaxed);
+        // 포화 전까지만 CAS로 1 증가(실패하면 v가 최신값으로 갱신되어 재시도)
+        while (v < SKETCH_MAX && !atomic_compare_exchange_weak_explicit(c, &v, (unsigned char)(v + 1),
+                                                                        memory_order_relaxed, memory_order_relaxed))
+            ;
+    }
+    // 정확히 주기에 도달한 한 스레드만 노화 수행
+    if (atomic_fetch_add_explicit(&sk->additions, 1, memory_order_relaxed) + 1 == SKETCH_SAMPLE) {
+        for (int r = 0; r < SKETCH_DEPTH; r++)
+            for (size_t i = 0; i < SKETCH_WIDTH; i++) {
+                unsigned char v = atomic_load_explicit(&sk->counters[r][i], memory_order_relaxed);
+                atomic_store_explicit(&sk->counters[r][i], (unsigned char)(v >> 1), memory_order_relaxed);
+            }
+        atomic_store_explicit(&sk->additions, 0, memory_order_relaxed);
+    }
+}
 
-// 타입 : pthread_rwlock_t는 POSIX 스레드의 읽기-쓰기 락 타입
-// 여러 스레드가 동시에 읽기는 가능하고, 쓰기는 하나의 스레드만 단독으로 들어갈 수 있게 보장함.
-// 캐시 조회는 빈번하고 읽기 비중이 높기 때문에 mutex 대신 RWLock을 쓰면 성능상 유리(동시 읽기 병행)
-static pthread_rwlock_t cache_lock = PTHREAD_RWLOCK_INITIALIZER;
+// 칸 배열을 ncap 크기로 새로 만들고 살아있는 엔트리만 다시 넣는다(삭제 표시 정리 포함)
+static int index_rehash(cache_shard_t *s, size_t ncap) {
+    cache_entry_t **slots = (cache_entry_t **)calloc(ncap, sizeof(cache_entry_t *));
+    if (!slots)
+        return -1;
+    for (size_t i = 0; i < s->index_cap; i++) {
+        cache_entry_t *e = s->index_slots[i];
+        if (!e || e == INDEX_TOMBSTONE)
+            continue;
+        size_t j = (size_t)e->hash & (ncap - 1);
+        while (slots[j])
+            j = (j + 1) & (ncap - 1);
+        slots[j] = e;
+    }
+    free(s->index_slots);
+    s->index_slots = slots;
+    s->index_cap = ncap;
+    s->index_tombs = 0;
+    return 0;
+}
+
+// 해시가 같고 문자열도 같은 엔트리를 찾는다(없으면 NULL)
+static cache_entry_t *index_find(cache_shard_t *s, const char *key, uint64_t hash) {
+    if (!s->index_cap)
+        return NULL;
+    for (size_t i = (size_t)hash & (s->index_cap - 1);; i = (i + 1) & (s->index_cap - 1)) {
+        cache_entry_t *e = s->index_slots[i];
+        if (!e) // 빈 칸을 만나면 사슬 끝 -> 없음
+            return NULL;
+        if (e != INDEX_TOMBSTONE && e->hash == hash && strcmp(e->key, key) == 0)
+            return e;
+    }
+}
+
+// 엔트리를 인덱스에 등록. 사용 칸(살아있는 + 삭제 표시)이 3/4를 넘으면 먼저 확장/정리
+static int index_insert(cache_shard_t *s, cache_entry_t *entry) {
+    if ((s->index_used + s->index_tombs + 1) * 4 > s->index_cap * 3) {
+        size_t ncap = s->index_cap ? s->index_cap : INDEX_INIT_CAP;
+        while ((s->index_used + 1) * 2 > ncap) // 정리 후에도 절반 이상 차 있으면 두 배로
+            ncap *= 2;
+        if (index_rehash(s, ncap) < 0)
+            return -1;
+    }
+    size_t i = (size_t)entry->hash & (s->index_cap - 1);
+    while (s->index_slots[i] && s->index_slots[i] != INDEX_TOMBSTONE)
+        i = (i + 1) & (s->index_cap - 1);
+    if (s->index_slots[i] == INDEX_TOMBSTONE)
+        s->index_tombs--;
+    s->index_slots[i] = entry;
+    s->index_used++;
+    return 0;
+}
+
+// 엔트리를 인덱스에서 빼고 그 칸을 삭제 표시로 남김
+static void index_remove(cache_shard_t *s, cache_entry_t *entry) {
+    for (size_t i = (size_t)entry->hash & (s->index_cap - 1); s->index_slots[i]; i = (i + 1) & (s->index_cap - 1)) {
+        if (s->index_slots[i] == entry) {
+            s->index_slots[i] = INDEX_TOMBSTONE;
+            s->index_used--;
+            s->index_tombs++;
+            return;
+        }
+    }
+}
 
 // LRU 리스트 앞에 삽입
-static void insert_head(cache_entry_t *entry) {
-    entry->prev = NULL;     // head가 되면 prev가 null임
-    entry->next = head;     // next를 기존의 head로 -> 맨 앞이됨
-    if (head)               // 기존 리스트가 비어있지 않았다면
-        head->prev = entry; // 기존 head의 이전 노드로 entry가 됨
-    else                    // 비어있었다면
-        tail = entry;       // 첫 노드로써 추가되므로 tail도 entry가 됨
+static void insert_head(cache_shard_t *s, cache_entry_t *entry) {
+    entry->prev = NULL;        // head가 되면 prev가 null임
+    entry->next = s->head;     // next를 기존의 head로 -> 맨 앞이됨
+    if (s->head)               // 기존 리스트가 비어있지 않았다면
+        s->head->prev = entry; // 기존 head의 이전 노드로 entry가 됨
+    else                       // 비어있었다면
+        s->tail = entry;       // 첫 노드로써 추가되므로 tail도 entry가 됨
     // LRU 리스트의 head는 새로 삽입한 entry가 됨
-    head = entry;
+    s->head = entry;
 }
 
 // LRU 리스트에서 제거
-static void list_remove(cache_entry_t *e) {
+static void list_remove(cache_shard_t *s, cache_entry_t *e) {
     if (e->prev)                 // 제거 대상 이전이 있다면
         e->prev->next = e->next; // e 이전을 다음으로 바로 연결 (자신이 빠짐)
     else                         // 이전 없었으면
-        head = e->next;          // head였단 의미이므로 다음을 head로 갱신
+        s->head = e->next;       // head였단 의미이므로 다음을 head로 갱신
     if (e->next)                 // 다음이 있었다면
         e->next->prev = e->prev; // 다음의 이전을 본인이 아닌 prev로 변경 (자신이 빠짐)
     else                         // 다음이 없었다면 -> tail이란 뜻
-        tail = e->prev;          // tail로 이전을 연결
+        s->tail = e->prev;       // tail로 이전을 연결
     e->prev = e->next = NULL;    // 자신의 양방향 포인터 초기화
 }
 
+// 참조 하나를 내려놓고, 마지막이었으면 객체 해제
+void cache_release(cache_obj_t *obj) {
+    if (!obj)
+        return;
+    // acq_rel: 다른 리더들의 사용이 끝난 뒤에만 free가 일어나도록 순서 보장
+    if (atomic_fetch_sub_explicit(&obj->refs, 1, memory_order_acq_rel) == 1)
+        free(obj);
+}
+
+void cache_retain(cache_obj_t *obj) {
+    atomic_fetch_add_explicit(&obj->refs, 1, memory_order_relaxed);
+}
+
+// 엔트리 메모리 해제
+// - 객체는 캐시의 참조만 내려놓음. 아직 전송 중인 리더가 있으면 그 리더의 release에서 해제됨
+static void entry_free(cache_entry_t *e) {
+    free(e->key);          // key 해제
+    cache_release(e->obj);  // 데이터 참조 반납
+    free(e);               // 엔트리 구조체 자체를 해제
+}
+
 // LRU 리스트에서 가장 오래된 항목 제거(필요 시 반복)
-static void remove_tail(size_t need) {
-    // 1. 현재 크기 + 필요 크기 > 최대 크기 이고,
+// - CLOCK 정책이면 tail이 참조 비트를 갖고 있을 때 비트를 지우고 head로 보내 한 번 더 기회를 줌.
+//   한 바퀴 돌면 모든 비트가 지워지므로 반드시 방출 대상이 나옴
+static void remove_tail(cache_shard_t *s, size_t need) {
+    // 1. 현재 크기 + 필요 크기 > 샤드 용량 이고,
     // 2. 제거할 대상이 있을 때(tail 존재) 반복
-    while ((current_size + need > MAX_CACHE_SIZE) && tail) {
+    while ((s->current_size + need > s->capacity) && s->tail) {
         // 가장 마지막 캐시 데이터부터 제거
-        cache_entry_t *entry = tail;
-        list_remove(entry);
-        current_size -= entry->size; // 현재 크기에서 제거될 엔트리 크기만큼 차감
-        free(entry->key);            // key 해제
-        free(entry->data);           // 데이터 해제
-        free(entry);                 // 엔트리 구조체 자체를 해제
+        cache_entry_t *entry = s->tail;
+        if (policy == CACHE_POLICY_CLOCK && atomic_exchange_explicit(&entry->referenced, 0, memory_order_relaxed)) {
+            list_remove(s, entry); // 최근에 쓰였음 -> 비트만 지우고 head로(second chance)
+            insert_head(s, entry);
+            continue;
+        }
+        list_remove(s, entry);
+        index_remove(s, entry);
+        s->current_size -= entry->charge; // 현재 크기에서 제거될 엔트리 크기만큼 차감
+        if (evict_hook && !atomic_load_explicit(&entry->obj->filling, memory_order_acquire))
+            evict_hook(entry->key, entry->obj); // 완성된 객체만 다음 계층으로(채우는 중이면 그냥 버림)
+        entry_free(entry);
+        atomic_fetch_add_explicit(&s->evictions, 1, memory_order_relaxed);
+    }
+}
+
+// TinyLFU 입장 판정: need 바이트를 비우기 위해 tail부터 밀려날 희생자들과 빈도를 비교
+// - 공간이 이미 충분하면 항상 입장
+// - 희생자 중 하나라도 새 객체(hash)보다 빈도가 같거나 높으면 거절(더 인기 있을 때만 교체)
+// - CLOCK 정책의 second chance는 무시하고 tail 순서로 근사
+static int admit(cache_shard_t *s, uint64_t hash, size_t need) {
+    if (admission != CACHE_ADMIT_TINYLFU || !s->sketch || s->current_size + need <= s->capacity)
+        return 1;
+    unsigned cand = sketch_estimate(s->sketch, hash);
+    size_t freed = 0;
+    for (cache_entry_t *v = s->tail; v && s->current_size - freed + need > s->capacity; v = v->prev) {
+        if (sketch_estimate(s->sketch, v->hash) >= cand)
+            return 0;
+        freed += v->charge;
     }
+    return 1;
 }
 
 // 프로세스 시작 시 캐시 전역 상태를 깨끗한 초기 상태로 만든다
-void cache_init(void) {
-    // rw락을 기본 속성으로 초기화
-    pthread_rwlock_init(&cache_lock, NULL);
-    head = tail = NULL; // LRU 이중 연결 리스트 초기화
-    current_size = 0;   // 캐시에 저장된 객체 바이트 합계 초기화
+// - 샤드 수는 샤드 하나의 몫이 단일 객체 한도(+여유분) 이상이 되도록 줄여서 결정(큰 객체도 어느 샤드엔 들어가도록)
+// - 총 예산을 샤드 수로 나누고, 나머지는 앞쪽 샤드에 1바이트씩 더 줘 합계를 정확히 맞춤
+int cache_init(const cache_config_t *cfg) {
+    size_t total = (cfg && cfg->max_cache_size) ? cfg->max_cache_size : MAX_CACHE_SIZE;
+    size_t want = (cfg && cfg->shards) ? cfg->shards : CACHE_SHARDS;
+    policy = cfg ? cfg->policy : CACHE_POLICY_LRU;
+    admission = cfg ? cfg->admission : CACHE_ADMIT_NONE;
+    max_object_size = (cfg && cfg->max_object_size) ? cfg->max_object_size : MAX_OBJECT_SIZE;
+    if (max_object_size > total)
+        return -1;
+    nshards = want;
+    while (nshards > 1 && total / nshards < max_object_size + ENTRY_SLACK)
+        nshards--;
+    shards = (cache_shard_t *)calloc(nshards, sizeof(cache_shard_t));
+    if (!shards) {
+        nshards = 0;
+        return -1;
+    }
+    for (size_t i = 0; i < nshards; i++) {
+        cache_shard_t *s = &shards[i];
+        memset(s, 0, sizeof(*s));
+        // rw락을 기본 속성으로 초기화
+        pthread_rwlock_init(&s->lock, NULL);
+        s->head = s->tail = NULL; // LRU 이중 연결 리스트 초기화
+        s->current_size = 0;      // 캐시에 저장된 객체 바이트 합계 초기화
+        s->capacity = total / nshards + (i < total % nshards ? 1 : 0);
+        index_rehash(s, INDEX_INIT_CAP); // 빈 해시 인덱스 준비(실패 시 첫 삽입에서 다시 시도)
+        if (admission == CACHE_ADMIT_TINYLFU)
+            s->sketch = (sketch_t *)calloc(1, sizeof(sketch_t)); // 실패하면 입장 정책 없이 동작
+    }
+    return 0;
+}
+
+void cache_foreach(cache_visit_fn fn, void *arg) {
+    for (size_t i = 0; i < nshards; i++) {
+        cache_shard_t *s = &shards[i];
+        pthread_rwlock_rdlock(&s->lock);
+        for (cache_entry_t *e = s->tail; e; e = e->prev) // 다시 넣을 때 LRU 순서가 유지되도록 오래된 것부터
+            if (!atomic_load_explicit(&e->obj->filling, memory_order_acquire))
+                fn(e->key, e->obj, arg);
+        pthread_rwlock_unlock(&s->lock);
+    }
+}
+
+void cache_set_evict_hook(cache_evict_fn fn) {
+    evict_hook = fn;
+}
+
+size_t cache_max_object_size(void) {
+    return max_object_size;
 }
 
 // 종료 시 캐시에 남은 모든 엔트리를 해제하고 동기화 자원을 파괴
 void cache_destroy(void) {
-    // 쓰기 락으로 단독 진입, 다른 스레드가 캐시를 만지지 못하도록 막음(파괴 중 경쟁 방지)
-    pthread_rwlock_wrlock(&cache_lock);
-    // LRU 리스트를 순회하며 모든 엔트리를 해제
-    for (cache_entry_t *p = head; p;) {
-        cache_entry_t *nxt = p->next;
-        free(p->key);
-        free(p->data);
-        free(p);
-        p = nxt;
-    }
-    // 리스트 비우기
-    head = tail = NULL;
-    current_size = 0;
-    // 파괴 직전 잠금해제
-    pthread_rwlock_unlock(&cache_lock);
-    // 락 자체를 파괴. 사용불가 상태가 됨
-    pthread_rwlock_destroy(&cache_lock);
-}
-
-// LRU 리스트를 head부터 순회하며 key를 통해 캐시 엔트리를 찾는다
-static cache_entry_t *find_cache(const char *key) {
-    for (cache_entry_t *entry = head; entry; entry = entry->next) {
-        if (strcmp(entry->key, key) == 0)
-            return entry;
-    }
-    return NULL;
+    for (size_t i = 0; i < nshards; i++) {
+        cache_shard_t *s = &shards[i];
+        // 쓰기 락으로 단독 진입, 다른 스레드가 캐시를 만지지 못하도록 막음(파괴 중 경쟁 방지)
+        pthread_rwlock_wrlock(&s->lock);
+        // LRU 리스트를 순회하며 모든 엔트리를 해제
+        for (cache_entry_t *p = s->head; p;) {
+            cache_entry_t *nxt = p->next;
+            entry_free(p);
+            p = nxt;
+        }
+        // 리스트와 인덱스 비우기
+        s->head = s->tail = NULL;
+        s->current_size = 0;
+        free(s->index_slots);
+        s->index_slots = NULL;
+        s->index_cap = s->index_used = s->index_tombs = 0;
+        free(s->sketch);
+        s->sketch = NULL;
+        // 파괴 직전 잠금해제
+        pthread_rwlock_unlock(&s->lock);
+        // 락 자체를 파괴. 사용불가 상태가 됨
+        pthread_rwlock_destroy(&s->lock);
+    }
+    free(shards);
+    shards = NULL;
+    nshards = 0;
+}
+
+// 해시 인덱스로 key의 캐시 엔트리를 찾는다(리스트 순회 없이 O(1))
+// - hash는 호출자가 락 밖에서 hash_key(key)로 미리 계산해 전달
+static cache_entry_t *find_cache(cache_shard_t *s, const char *key, uint64_t hash) {
+    return index_find(s, key, hash);
 }
 
 // 캐시에 key로 저장된 웹 객체가 있는지 조회
-// -> 있으면 그 바이트 데이터를 새로 할당한 복사본으로 되돌려줌
+// -> 있으면 복사 없이 참조 카운트만 올린 캐시 객체를 되돌려줌
 // key : 정규화된 URI 식별자
-// data_out : HIT 시, 캐시된 객체 바이트를 새로 malloc한 포인터
-// size_out : 해당 바이트 길이
+// obj_out : HIT 시, 참조가 하나 올라간 캐시 객체(사용 후 cache_release)
 // 반환값 : 1(HIT), 0(MISS), 음수(에러)
-int cache_get(const char *key, char **data_out, size_t *size_out) {
-    if (!key || !data_out || !size_out)
+// probe면 MISS/STALE을 세지 않고 STALE도 pin하지 않음(cache_probe)
+static int lookup(const char *key, cache_obj_t **obj_out, int probe) {
+    if (!key || !obj_out)
+        return -1;
+    *obj_out = NULL;
+    if (!nshards)
         return -1;
-    *data_out = NULL;
-    *size_out = 0;
+    uint64_t hash = hash_key(key); // 락 밖에서 한 번만 계산
+    cache_shard_t *s = shard_of(hash);
+
+    // 입장 정책용 빈도 기록: HIT/MISS 모두 "요청 1회"로 셈(락 불필요)
+    if (s->sketch)
+        sketch_increment(s->sketch, hash);
 
-    // 읽기 락으로 탐색하고 데이터 복사본을 만든다(다중 리더 동시 허용)
-    if (pthread_rwlock_rdlock(&cache_lock) != 0)
+    // 읽기 락으로 탐색하고 참조를 하나 올린다(다중 리더 동시 허용)
+    if (pthread_rwlock_rdlock(&s->lock) != 0)
         return -1;
     // 키가 있는지 탐색
-    cache_entry_t *entry = find_cache(key);
+    cache_entry_t *entry = find_cache(s, key, hash);
     if (!entry) { // MISS라면 락을 풀고 0 반환
-        pthread_rwlock_unlock(&cache_lock);
+        pthread_rwlock_unlock(&s->lock);
+        if (!probe)
+            atomic_fetch_add_explicit(&s->misses, 1, memory_order_relaxed);
         return 0; // MISS
     }
-    // 엔트리 있으면 복사 시도
-    char *copy = (char *)malloc(entry->size);
-    if (!copy) {
-        pthread_rwlock_unlock(&cache_lock);
-        return -1; // OOM
+    cache_obj_t *obj = entry->obj;
+    long long expires = atomic_load_explicit(&obj->expires, memory_order_relaxed);
+    int expired = expires && expires <= (long long)time(NULL) && !atomic_load_explicit(&obj->filling, memory_order_relaxed);
+    if (expired && obj->revalidate && probe) {
+        pthread_rwlock_unlock(&s->lock);
+        return 0;
     }
-    memcpy(copy, entry->data, entry->size); // 캐시된 바이트 그대로 복사
-    size_t sz = entry->size;
-    pthread_rwlock_unlock(&cache_lock); // 락을 풀어 다른 rw가 접근 가능
+    if (expired && obj->revalidate) { // 조건부 요청으로 되살릴 수 있음: 호출자가 재검증(LRU 승격은 하지 않음)
+        atomic_fetch_add_explicit(&obj->refs, 1, memory_order_relaxed);
+        pthread_rwlock_unlock(&s->lock);
+        atomic_fetch_add_explicit(&s->stale, 1, memory_order_relaxed);
+        *obj_out = obj;
+        return CACHE_STALE;
+    }
+    if (expired) {
+        // 신선도가 지남: 쓰기 락으로 바꿔 그사이 교체되지 않았을 때만 거둠
+        pthread_rwlock_unlock(&s->lock);
+        pthread_rwlock_wrlock(&s->lock);
+        entry = find_cache(s, key, hash);
+        if (entry && entry->obj == obj) {
+            list_remove(s, entry);
+            index_remove(s, entry);
+            s->current_size -= entry->charge;
+            entry_free(entry);
+            atomic_fetch_add_explicit(&s->expired, 1, memory_order_relaxed);
+        }
+        pthread_rwlock_unlock(&s->lock);
+        if (!probe)
+            atomic_fetch_add_explicit(&s->misses, 1, memory_order_relaxed);
+        return 0; // MISS
+    }
+    atomic_fetch_add_explicit(&s->hits, 1, memory_order_relaxed);
+    // 락을 쥔 동안에는 캐시의 참조가 살아 있으므로 안전하게 pin 가능(복사/할당 없음)
+    atomic_fetch_add_explicit(&obj->refs, 1, memory_order_relaxed);
+    if (atomic_load_explicit(&obj->filling, memory_order_relaxed))
+        atomic_fetch_add_explicit(&s->filling, 1, memory_order_relaxed);
+    if (policy == CACHE_POLICY_CLOCK) {
+        // CLOCK: 참조 비트만 세우고 끝(쓰기 락 불필요). 이미 서 있으면 캐시 라인을 더럽히지 않도록 쓰지 않음
+        if (!atomic_load_explicit(&entry->referenced, memory_order_relaxed))
+            atomic_store_explicit(&entry->referenced, 1, memory_order_relaxed);
+        pthread_rwlock_unlock(&s->lock);
+        *obj_out = obj;
+        return 1; // HIT
+    }
+    pthread_rwlock_unlock(&s->lock); // 락을 풀어 다른 rw가 접근 가능
 
-    // LRU 갱신: 짧은 구간만 쓰기 락으로 잡고 리스트 앞으로 이동
-    if (pthread_rwlock_wrlock(&cache_lock) == 0) {
+    // LRU 갱신: 짧은 구간만 쓰기 락으로 잡고 리스트 앞으로 이동(같은 샤드의 쓰기만 직렬화)
+    if (pthread_rwlock_wrlock(&s->lock) == 0) {
         // 방금 쓴 캐시를 찾아서 "최신 사용"으로 갱신하기
-        cache_entry_t *used_entry = find_cache(key);
+        cache_entry_t *used_entry = find_cache(s, key, hash);
         if (used_entry) {
-            list_remove(used_entry); // 잠깐 지우고
-            insert_head(used_entry); // 다시 앞에 넣는다
+            list_remove(s, used_entry); // 잠깐 지우고
+            insert_head(s, used_entry); // 다시 앞에 넣는다
         }
-        pthread_rwlock_unlock(&cache_lock);
+        pthread_rwlock_unlock(&s->lock);
     }
 
-    *data_out = copy;
-    *size_out = sz;
-    return 1; // 성공적으로 복사했으면 1(HIT)반환
+    *obj_out = obj;
+    return 1; // HIT
+}
+
+int cache_get(const char *key, cache_obj_t **obj_out) {
+    return lookup(key, obj_out, 0);
+}
+
+int cache_probe(const char *key, cache_obj_t **obj_out) {
+    return lookup(key, obj_out, 1);
+}
+
+// 캐시 객체 하나를 할당(참조 1 = 호출자 몫). data는 호출자가 채운 뒤 cache_put_obj로 넘김
+cache_obj_t *cache_obj_alloc(size_t size) {
+    cache_obj_t *obj = (cache_obj_t *)malloc(sizeof(cache_obj_t) + size);
+    if (!obj)
+        return NULL;
+    atomic_init(&obj->refs, 1);
+    atomic_init(&obj->filling, 0);
+    atomic_init(&obj->compress_tried, 0);
+    obj->size = size;
+    obj->head_len = 0;
+    obj->chunked = obj->unsized = obj->vary = obj->revalidate = obj->compressible = obj->variant = 0;
+    obj->swr = 0;
+    atomic_init(&obj->expires, 0);
+    return obj;
 }
 
 // 크기가 알맞다면 캐시에 저장.
 // 같은 키가 이미 있으면 교체하고 공간이 모자라면 LRU로 공간 확보 후 삽입
 void cache_put(const char *key, const char *data, size_t size) {
-    if (!key || !data)
+    if (!key || !data || !nshards)
         return;
-    if (size == 0 || size > MAX_OBJECT_SIZE)
+    if (size == 0 || size > max_object_size)
         return; // 정책상 큰 객체는 캐시하지 않음
+    cache_obj_t *obj = cache_obj_alloc(size);
+    if (!obj)
+        return;
+    // 원본 바이트를 객체로 그대로 복사. 이후로는 바뀌지 않음
+    memcpy(obj->data, data, size);
+    cache_put_obj(key, obj);
+}
+
+// 이미 채워진 객체를 캐시에 넘김. 호출자의 참조는 캐시 자신의 참조가 됨(실패 시 여기서 해제)
+void cache_put_obj(const char *key, cache_obj_t *obj) {
+    if (!obj)
+        return;
+    if (!key || !nshards || obj->size == 0 || obj->size > max_object_size) {
+        cache_release(obj);
+        return;
+    }
+    size_t size = obj->size;
 
     // 새 캐시 엔트리 구조체 동적 할당
     cache_entry_t *entry = (cache_entry_t *)malloc(sizeof(cache_entry_t));
-    if (!entry)
-        return;
-    // 키 문자열을 복사하고 데이터 저장 공간을 size만큼 확보
+    // 키 문자열 복사
     char *k = strdup(key);
-    char *d = (char *)malloc(size);
-    if (!k || !d) {
+    if (!entry || !k) {
         free(entry);
         free(k);
-        free(d);
+        cache_release(obj);
         return;
     }
-    // 원본 바이트를 내부 버퍼 d로 그대로 복사
-    memcpy(d, data, size);
     // 엔트리 필드 초기화
     entry->key = k;
-    entry->data = d;
-    entry->size = size;
-    entry->prev = entry->next = NULL; // 아직 연결 전이므로 NULL
+    entry->hash = hash_key(k); // 락 밖에서 미리 계산
+    entry->obj = obj;
+    // 예산에는 데이터뿐 아니라 키 문자열과 엔트리/객체 구조체까지 포함
+    entry->charge = size + strlen(k) + 1 + sizeof(cache_entry_t) + sizeof(cache_obj_t);
+    atomic_init(&entry->referenced, 0); // 새 엔트리는 아직 참조된 적 없음
+    entry->prev = entry->next = NULL;   // 아직 연결 전이므로 NULL
+    cache_shard_t *s = shard_of(entry->hash);
+    size_t charge = entry->charge;
+    if (charge > s->capacity) { // 샤드 몫보다 크면 넣을 수 없음
+        entry_free(entry);
+        return;
+    }
     // 쓰기 락 획득. 삽입이나 교체는 모드 write-critical 영역이기 때문
-    pthread_rwlock_wrlock(&cache_lock);
+    pthread_rwlock_wrlock(&s->lock);
+    cache_entry_t *old = find_cache(s, key, entry->hash);
+    // 입장 정책: 공간을 내야 하는데 새 객체가 희생자보다 인기 없으면 넣지 않음
+    // - 같은 키의 교체(갱신/재검증/압축본)는 이미 입장한 키이므로 묻지 않음. 거절하면 기존 사본까지 잃음
+    if (!old && !admit(s, entry->hash, charge)) {
+        pthread_rwlock_unlock(&s->lock);
+        atomic_fetch_add_explicit(&s->rejected, 1, memory_order_relaxed);
+        entry_free(entry);
+        return;
+    }
     // 동일 키가 이미 존재하면 제거(간단 일관성 유지)
-    cache_entry_t *old = find_cache(key);
     if (old) {
         // 제거 후 메모리도 해제
-        list_remove(old);
-        current_size -= old->size;
-        free(old->key);
-        free(old->data);
-        free(old);
+        list_remove(s, old);
+        index_remove(s, old);
+        s->current_size -= old->charge;
+        entry_free(old);
     }
 
     // 캐시 공간 확보 후 삽입할 때
     // 새 엔트리 넣기 전 여유 공간 확보
-    remove_tail(size);
+    remove_tail(s, charge);
+    // 인덱스 등록(실패하면 조회할 수 없으므로 넣지 않음)
+    if (index_insert(s, entry) < 0) {
+        pthread_rwlock_unlock(&s->lock);
+        entry_free(entry);
+        return;
+    }
     // 맨 앞으로 삽입
-    insert_head(entry);
+    insert_head(s, entry);
     // 캐시 총 크기 갱신
-    current_size += size;
-    pthread_rwlock_unlock(&cache_lock); // 쓰기 락 해제 -> 다른 스레드의 읽기 + 쓰기 허용
+    s->current_size += charge;
+    pthread_rwlock_unlock(&s->lock); // 쓰기 락 해제 -> 다른 스레드의 읽기 + 쓰기 허용
+    atomic_fetch_add_explicit(&s->inserts, 1, memory_order_relaxed);
+}
+
+// key의 엔트리 제거. obj가 있으면 엔트리가 아직 그 객체일 때만
+static void remove_entry(const char *key, const cache_obj_t *obj) {
+    if (!key || !nshards)
+        return;
+    uint64_t hash = hash_key(key);
+    cache_shard_t *s = shard_of(hash);
+    pthread_rwlock_wrlock(&s->lock);
+    cache_entry_t *e = find_cache(s, key, hash);
+    if (e && (!obj || e->obj == obj)) {
+        list_remove(s, e);
+        index_remove(s, e);
+        s->current_size -= e->charge;
+        entry_free(e);
+    }
+    pthread_rwlock_unlock(&s->lock);
+}
+
+// 채우다 실패한 객체 제거: 같은 키가 그사이 새 객체로 교체됐으면 건드리지 않음
+void cache_remove_obj(const char *key, const cache_obj_t *obj) {
+    if (obj)
+        remove_entry(key, obj);
+}
+
+void cache_remove(const char *key) {
+    remove_entry(key, NULL);
+}
+
+// 샤드별 통계를 합산. 현재 크기/엔트리 수는 읽기 락으로 일관되게 읽음
+void cache_get_stats(cache_stats_t *out) {
+    memset(out, 0, sizeof(*out));
+    for (size_t i = 0; i < nshards; i++) {
+        cache_shard_t *s = &shards[i];
+        out->hits += atomic_load_explicit(&s->hits, memory_order_relaxed);
+        out->misses += atomic_load_explicit(&s->misses, memory_order_relaxed);
+        out->inserts += atomic_load_explicit(&s->inserts, memory_order_relaxed);
+        out->evictions += atomic_load_explicit(&s->evictions, memory_order_relaxed);
+        out->rejected += atomic_load_explicit(&s->rejected, memory_order_relaxed);
+        out->filling += atomic_load_explicit(&s->filling, memory_order_relaxed);
+        out->expired += atomic_load_explicit(&s->expired, memory_order_relaxed);
+        out->stale += atomic_load_explicit(&s->stale, memory_order_relaxed);
+        pthread_rwlock_rdlock(&s->lock);
+        out->bytes += s->current_size;
+        out->entries += s->index_used;
+        pthread_rwlock_unlock(&s->lock);
+    }
 }
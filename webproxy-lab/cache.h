@@ -1,24 +1,130 @@
 // Part III: Cache interface
 #pragma once        // 헤더가 한 번만 포함되도록 함. 같은 번역 단위에서 중복 포함되어도 재정의 에러가 나지 않음
-#include <stddef.h> // 표준 타입 size_t 등의 정의를 사용
+#include <stdatomic.h> // 캐시 객체 참조 카운트
+#include <stddef.h>    // 표준 타입 size_t 등의 정의를 사용
 
 #ifndef MAX_CACHE_SIZE           // 아직 MAX_CACHE_SIZE가 정의되지 않았다면
-#define MAX_CACHE_SIZE (1 << 20) // 1 MiB: 캐시 총 용량(객체 바이트만) -> 기본값으로 정의
+#define MAX_CACHE_SIZE (1 << 20) // 1 MiB: 캐시 총 용량(키/메타데이터 포함) -> 기본값으로 정의
 #endif
 // 다른 곳에서 정해둔 값이 있으면 그것을 쓰고, 없으면 이 것을 쓰자. 설정의 유연성 증가
+// 아래 세 매크로는 기본값일 뿐이고, 실행 시 cache_config_t(-C/-O/-S 옵션, 설정 파일)로 바꿀 수 있음
 
 #ifndef MAX_OBJECT_SIZE
 #define MAX_OBJECT_SIZE (100 << 10) // 100 KiB: 단일 객체 최대 크기
 #endif
 
-void cache_init(void);    // 캐시 전역 상태를 초기화
+#ifndef CACHE_SHARDS
+#define CACHE_SHARDS 8 // 샤드 수 상한: 키 해시로 샤드를 골라 샤드마다 락/LRU/용량 몫을 따로 둠
+#endif
+// 실제 샤드 수는 샤드 하나의 몫(총 용량 / 샤드 수)이 단일 객체 한도(+메타데이터) 이상이 되도록 줄여 씀
+
+// 캐시 객체: 한 번 만들어지면 바뀌지 않는(immutable) 응답 바이트 + 원자적 참조 카운트
+// - 캐시 자신이 1개, 조회해 간 각 리더가 1개씩 참조를 가짐
+// - 방출(evict)/교체는 캐시의 참조만 내려놓으므로, 전송 중인 리더가 있으면 마지막 release 때 해제됨
+// - 리더는 data/size(와 아래 응답 메타데이터)만 읽기 전용으로 사용
+// - 예외: 신선도(expires)는 304 재검증이 제자리에서 갱신하므로 원자 변수
+// - 예외: compress_tried는 압축 계층이 HIT 경로에서 한 번만 세우는 원자 변수
+// - 예외: 크기를 아는 응답은 원서버에서 받는 동안 "채우는 중"(filling)으로 먼저 들어갈 수 있음.
+//   filling이면 data가 아직 자라는 중이므로 HIT로 보내지 말고 같은 키의 single-flight를 따라 읽을 것
+typedef struct cache_obj {
+    atomic_size_t refs;    // 참조 수
+    atomic_int filling;    // 1이면 채우는 중(완성되면 0, 실패하면 캐시에서 빠짐)
+    size_t size;           // 데이터 바이트 수
+    size_t head_len;       // 헤더 줄 끝(마지막 빈 줄 시작) 위치. 0이면 헤더를 해석하지 못한 원본(연결 관리 헤더 불명)
+    unsigned char chunked; // 본문이 chunked 인코딩(HTTP/1.0 클라이언트에는 그대로 보낼 수 없음)
+    unsigned char unsized; // 본문 길이 헤더 없이 EOF로 끝난 응답(보낼 때 Content-Length를 붙여야 연결 유지 가능)
+    unsigned char vary;    // Vary 표시 객체: 응답이 아니라 data에 Vary 헤더 이름 목록(소문자, 쉼표 구분)을 담음
+    unsigned char revalidate; // 검증자(ETag/Last-Modified)가 있음: 만료돼도 버리지 않고 STALE로 돌려줌
+    unsigned char compressible; // 압축 계층이 압축본을 만들어도 되는 원래 응답(텍스트 계열 200, no-transform 없음)
+    unsigned char variant;   // 압축 계층이 만든 압축본(메모리 캐시에만 둠)
+    atomic_int compress_tried; // 압축 계층이 이 객체로 압축본을 이미 만들었거나 만드는 중(HIT마다 다시 압축하지 않음)
+    unsigned swr;          // 만료 뒤에도 낡은 사본을 바로 보내고 뒤에서 재검증해도 되는 시간(stale-while-revalidate 초)
+    atomic_llong expires;  // 신선도 만료 시각(UNIX 초), 0이면 만료 없음. 지나면 cache_get이 거두거나 STALE로 돌려줌
+    char data[];           // 응답 데이터(헤더 포함, hop-by-hop 연결 관리 헤더는 뗀 상태)
+} cache_obj_t;
+
+// 방출 정책
+// - LRU  : HIT마다 쓰기 락으로 엔트리를 리스트 head로 옮김(정확한 LRU)
+// - CLOCK: HIT는 엔트리의 참조 비트만 원자적으로 세움(읽기 락만 사용). 방출 시 tail부터 훑으며
+//          참조 비트가 선 엔트리는 비트를 지우고 head로 보내 한 번 더 기회를 주고(second chance),
+//          비트가 없는 엔트리를 방출(근사 LRU)
+typedef enum {
+    CACHE_POLICY_LRU = 0,
+    CACHE_POLICY_CLOCK = 1,
+} cache_policy_t;
+
+// 입장(admission) 정책
+// - NONE   : 크기만 맞으면 항상 삽입(기존 동작)
+// - TINYLFU: 샤드마다 4행 count-min sketch(4비트 포화 카운터, 표본이 차면 전체를 절반으로 노화)로
+//            키별 요청 빈도를 추정하고, 공간을 내야 할 때 새 객체의 빈도가 밀려날 희생자보다
+//            높을 때만 삽입. 고유 URL을 훑는 크롤러가 작업 집합을 밀어내지 못하게 함
+typedef enum {
+    CACHE_ADMIT_NONE = 0,
+    CACHE_ADMIT_TINYLFU = 1,
+} cache_admission_t;
+
+// cache_init에 넘기는 실행 시 설정(NULL이면 모두 기본값)
+typedef struct {
+    cache_policy_t policy;       // 방출 정책(기본 LRU)
+    cache_admission_t admission; // 입장 정책(기본 NONE)
+    size_t max_cache_size;       // 총 메모리 예산(객체 + 키 + 엔트리/객체 메타데이터), 0이면 MAX_CACHE_SIZE
+    size_t max_object_size;      // 캐시할 단일 객체 최대 바이트, 0이면 MAX_OBJECT_SIZE
+    size_t shards;               // 샤드 수 상한, 0이면 CACHE_SHARDS
+} cache_config_t;
+
+// 적중률 비교용 누적 통계(샤드별 카운터의 합)
+typedef struct {
+    unsigned long long hits;      // HIT 수
+    unsigned long long misses;    // MISS 수
+    unsigned long long inserts;   // 삽입된 객체 수
+    unsigned long long evictions; // 방출된 객체 수
+    unsigned long long rejected;  // 입장 정책이 거절한 객체 수
+    unsigned long long filling;   // HIT 중 채우는 중인 객체를 만난 수
+    unsigned long long expired;   // 조회 때 신선도가 지나 거둔 객체 수(MISS에도 포함)
+    unsigned long long stale;     // 조회 때 신선도가 지났지만 재검증하도록 돌려준 수(HIT/MISS 어느 쪽에도 넣지 않음)
+    size_t bytes;                 // 현재 차지한 바이트(키/메타데이터 포함, 예산과 같은 단위)
+    size_t entries;               // 현재 엔트리 수
+} cache_stats_t;
+
+// 캐시 전역 상태를 초기화. 설정이 모순되면(객체 한도 > 총 용량 등) -1
+int cache_init(const cache_config_t *cfg);
 void cache_destroy(void); // 캐시를 해제. 모든 엔트리 제거, 동적 메모리 해제, 동기화 객체(락) 파괴
-// key 문자열로 캐시 조회. HIT이면 data_out에 데이터 포인터, size_out에 크기를 채워 돌려줌
+#define CACHE_STALE 2 // cache_get: 신선도가 지난 객체(재검증 후 쓸 것)
+
+// key 문자열로 캐시 조회. HIT이면 obj_out에 참조를 하나 올린(pin) 캐시 객체를 돌려줌
 // - 반환값: HIT = 1, MISS = 0, 내부 오류 = -1
-// - data_out는 내부 캐시 버퍼 포인터를 가리키게 됨
-int cache_get(const char *key, char **data_out, size_t *size_out);
+// - expires가 지난 완성 객체는 검증자가 있으면 pin해서 CACHE_STALE, 없으면 그 자리에서 제거하고 MISS
+// - 복사 없이 obj->data를 그대로 소켓에 쓰고, 다 쓰면 반드시 cache_release로 참조를 내려놓을 것
+int cache_get(const char *key, cache_obj_t **obj_out);
+// 같은 응답의 다른 표현(압축본)을 원래 키보다 먼저 찾아볼 때: HIT면 cache_get과 같고(HIT로 셈),
+// 없거나 신선도가 지났으면 0(MISS/STALE로 세지 않고 pin하지 않음). 입장 정책 빈도는 cache_get처럼 기록
+int cache_probe(const char *key, cache_obj_t **obj_out);
+// cache_get으로 얻은 참조를 반납. 마지막 참조였다면(이미 방출된 객체) 메모리 해제
+void cache_release(cache_obj_t *obj);
+// 이미 가진 객체에 참조를 하나 더 올림(cache_put_obj로 넘긴 뒤에도 계속 채울 때)
+void cache_retain(cache_obj_t *obj);
 // key 문자열로 캐시에 새 객체 삽입. 기존 key가 있으면 교체
 // - data는 key에 대응하는 객체 데이터(바이트 버퍼), size는 그 크기
-// - size가 MAX_OBJECT_SIZE보다 크면 삽입하지 않고 무시
+// - size가 단일 객체 한도(cache_max_object_size)보다 크면 삽입하지 않고 무시
 // - 내부적으로는 data를 복사하여 보관함
 void cache_put(const char *key, const char *data, size_t size);
+// 복사 한 번을 아끼는 삽입 경로: cache_obj_alloc으로 받은 객체의 data(와 메타데이터)를 직접 채운 뒤 cache_put_obj로 넘김
+// - 넘긴 참조는 캐시가 가져가며, 삽입하지 못하면 cache_put_obj가 해제함
+cache_obj_t *cache_obj_alloc(size_t size);
+void cache_put_obj(const char *key, cache_obj_t *obj);
+// key의 엔트리가 아직 obj이면 제거(채우다 실패한 객체를 거둘 때. 그사이 교체됐으면 그대로 둠)
+void cache_remove_obj(const char *key, const cache_obj_t *obj);
+// key의 엔트리를 무엇이든 제거(원래 응답이 바뀌어 압축본을 거둘 때)
+void cache_remove(const char *key);
+// 용량 때문에 방출되는 완성 객체를 넘겨받을 훅(디스크 계층). 샤드 쓰기 락 안에서 불리므로 짧게 끝내야 하고,
+// 객체를 계속 쓰려면 cache_retain으로 참조를 올려 둘 것. NULL이면 해제
+typedef void (*cache_evict_fn)(const char *key, cache_obj_t *obj);
+void cache_set_evict_hook(cache_evict_fn fn);
+// 완성된 엔트리마다 fn(key, obj, arg)를 부름(샤드별로 오래된 것부터, 샤드 읽기 락 안에서)
+// - 락 안이므로 fn은 짧게 끝내야 함. 락 밖에서 객체를 쓰려면 cache_retain으로 참조를 올려 둘 것
+typedef void (*cache_visit_fn)(const char *key, cache_obj_t *obj, void *arg);
+void cache_foreach(cache_visit_fn fn, void *arg);
+// 실행 시 설정된 단일 객체 한도(응답 누적 버퍼 크기 결정용)
+size_t cache_max_object_size(void);
+// 현재까지의 통계를 out에 채움
+void cache_get_stats(cache_stats_t *out);
@@ -0,0 +1,256 @@
+#include "capbuf.h"
+#include "osdep.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// 빈 청크 풀: 기본 크기 청크를 단일 연결 리스트(스택)로 보관해 malloc/free 왕복을 줄임
+static capbuf_chunk_t *pool_head = NULL;
+static size_t pool_count = 0;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// 청크 하나 확보: 기본 크기면 풀에서 먼저 꺼내고, 그 외 크기(Content-Length 맞춤)는 바로 malloc
+static capbuf_chunk_t *chunk_get(size_t cap) {
+    capbuf_chunk_t *c = NULL;
+    if (cap == CAPBUF_CHUNK_SIZE) {
+        pthread_mutex_lock(&pool_lock);
+        if (pool_head) {
+            c = pool_head;
+            pool_head = c->next;
+            pool_count--;
+        }
+        pthread_mutex_unlock(&pool_lock);
+    }
+    if (!c) {
+        c = (capbuf_chunk_t *)malloc(sizeof(capbuf_chunk_t) + cap);
+        if (!c)
+            return NULL;
+        c->cap = cap;
+    }
+    c->next = NULL;
+    c->len = 0;
+    return c;
+}
+
+// 청크 반납: 기본 크기이고 풀에 자리가 있으면 보관, 아니면 free
+static void chunk_put(capbuf_chunk_t *c) {
+    if (c->cap == CAPBUF_CHUNK_SIZE) {
+        pthread_mutex_lock(&pool_lock);
+        if (pool_count < CAPBUF_POOL_MAX) {
+            c->next = pool_head;
+            pool_head = c;
+            pool_count++;
+            c = NULL;
+        }
+        pthread_mutex_unlock(&pool_lock);
+    }
+    free(c);
+}
+
+void capbuf_init(capbuf_t *cb, size_t limit) {
+    cb->head = cb->tail = NULL;
+    cb->len = 0;
+    cb->limit = limit;
+    cb->expect = 0;
+    cb->abandoned = 0;
+    cb->owner = NULL;
+    cb->ext = NULL;
+    cb->fd = -1;
+}
+
+void capbuf_free(capbuf_t *cb) {
+    for (capbuf_chunk_t *c = cb->head; c;) {
+        capbuf_chunk_t *nxt = c->next;
+        chunk_put(c);
+        c = nxt;
+    }
+    cb->head = cb->tail = NULL;
+    cb->ext = NULL;
+    cb->fd = -1;
+    cb->len = 0;
+}
+
+// 누적 포기: 이후 append는 모두 무시되고 메모리는 즉시 반납(공유 중이면 주인이 해제할 때)
+void capbuf_abandon(capbuf_t *cb) {
+    if (!cb->owner)
+        capbuf_free(cb);
+    cb->abandoned = 1;
+}
+
+// 청크를 끝에 연결
+static void link_chunk(capbuf_t *cb, capbuf_chunk_t *c) {
+    if (cb->tail)
+        cb->tail->next = c;
+    else
+        cb->head = c;
+    cb->tail = c;
+}
+
+void capbuf_expect(capbuf_t *cb, size_t total) {
+    if (cb->abandoned)
+        return;
+    if (total > cb->limit || total < cb->len) { // 한도 초과(또는 이미 더 받음) -> 처음부터 캐시 불가
+        capbuf_abandon(cb);
+        return;
+    }
+    cb->expect = total;
+    size_t room = cb->tail ? cb->tail->cap - cb->tail->len : 0;
+    size_t need = total - cb->len;
+    if (need <= room)
+        return;
+    capbuf_chunk_t *c = chunk_get(need - room); // 남은 바이트에 딱 맞는 청크 하나
+    if (!c) {
+        capbuf_abandon(cb);
+        return;
+    }
+    link_chunk(cb, c);
+}
+
+void capbuf_expect_into(capbuf_t *cb, char *dst, size_t total) {
+    if (cb->abandoned)
+        return;
+    if (total > cb->limit || cb->len > 0) { // 이미 청크에 받은 바이트가 있으면 옮기지 않음
+        capbuf_expect(cb, total);
+        return;
+    }
+    cb->expect = total;
+    cb->ext = dst;
+}
+
+void capbuf_expect_file(capbuf_t *cb, int fd, size_t total) {
+    if (cb->abandoned)
+        return;
+    if (total > cb->limit || cb->len > 0) {
+        capbuf_expect(cb, total);
+        return;
+    }
+    cb->expect = total;
+    cb->fd = fd;
+}
+
+// 파일에 채우는 중: data(또는 파이프 pipefd)의 n바이트를 파일 끝에 씀. 넘치게 쓰려 하거나 쓰기에 실패하면 포기하고 -1
+static int file_append(capbuf_t *cb, const char *data, int pipefd, size_t n) {
+    if (n > cb->expect - cb->len) {
+        capbuf_abandon(cb);
+        return -1;
+    }
+    while (n > 0) {
+        ssize_t w = data ? write(cb->fd, data, n) : os_splice(pipefd, cb->fd, n, 0);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0) {
+            capbuf_abandon(cb);
+            return -1;
+        }
+        if (data)
+            data += w;
+        cb->len += (size_t)w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+// 마지막 청크에 빈 자리가 없으면 기본 크기 청크를 하나 더 연결. 실패 시 포기하고 NULL
+static capbuf_chunk_t *tail_with_room(capbuf_t *cb) {
+    if (!cb->tail || cb->tail->len == cb->tail->cap) {
+        capbuf_chunk_t *c = chunk_get(CAPBUF_CHUNK_SIZE);
+        if (!c) {
+            capbuf_abandon(cb);
+            return NULL;
+        }
+        link_chunk(cb, c);
+    }
+    return cb->tail;
+}
+
+// 다음 바이트를 쓸 자리와 그 크기: 외부 버퍼면 채운 곳 뒤, 아니면 마지막 청크(꽉 찼으면 새 청크)
+// - 외부 버퍼를 넘치게 쓰려 하거나 청크를 얻지 못하면 포기하고 0
+static size_t next_room(capbuf_t *cb, char **dst) {
+    if (cb->ext) {
+        if (cb->len >= cb->expect) {
+            capbuf_abandon(cb);
+            return 0;
+        }
+        *dst = cb->ext + cb->len;
+        return cb->expect - cb->len;
+    }
+    capbuf_chunk_t *t = tail_with_room(cb);
+    if (!t)
+        return 0;
+    *dst = t->data + t->len;
+    return t->cap - t->len;
+}
+
+// next_room으로 얻은 자리에 k바이트를 채웠음
+static void filled(capbuf_t *cb, size_t k) {
+    if (!cb->ext)
+        cb->tail->len += k;
+    cb->len += k;
+}
+
+int capbuf_append(capbuf_t *cb, const void *data, size_t n) {
+    const char *p = (const char *)data;
+    if (cb->abandoned)
+        return -1;
+    if (cb->len + n > cb->limit) {
+        capbuf_abandon(cb);
+        return -1;
+    }
+    if (cb->fd >= 0)
+        return file_append(cb, p, -1, n);
+    while (n > 0) {
+        char *dst;
+        size_t k = next_room(cb, &dst);
+        if (k == 0)
+            return -1;
+        if (k > n)
+            k = n;
+        memcpy(dst, p, k);
+        filled(cb, k);
+        p += k;
+        n -= k;
+    }
+    return 0;
+}
+
+int capbuf_read(capbuf_t *cb, int fd, size_t n) {
+    if (cb->abandoned)
+        return -1;
+    if (cb->len + n > cb->limit) {
+        capbuf_abandon(cb);
+        return -1;
+    }
+    if (cb->fd >= 0)
+        return file_append(cb, NULL, fd, n);
+    while (n > 0) {
+        char *dst;
+        size_t k = next_room(cb, &dst);
+        if (k == 0)
+            return -1;
+        if (k > n)
+            k = n;
+        ssize_t r = read(fd, dst, k);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0) { // 약속한 바이트가 오지 않음
+            capbuf_abandon(cb);
+            return -1;
+        }
+        filled(cb, (size_t)r);
+        n -= (size_t)r;
+    }
+    return 0;
+}
+
+void capbuf_copyout(const capbuf_t *cb, char *dst) {
+    if (cb->ext) {
+        memcpy(dst, cb->ext, cb->len);
+        return;
+    }
+    for (const capbuf_chunk_t *c = cb->head; c; c = c->next) {
+        memcpy(dst, c->data, c->len);
+        dst += c->len;
+    }
+}
@@ -0,0 +1,51 @@
+// 캐시 후보 누적 버퍼(capture buffer)
+// - 캐시 MISS마다 단일 객체 한도만큼 미리 malloc하던 것을, 바이트가 실제로 도착할 때마다
+//   풀에서 꺼낸 고정 크기 청크를 이어붙이는 방식으로 바꿈(304/에러 페이지/작은 응답은 청크 1개 이하)
+// - 응답 헤더에 Content-Length가 있으면 capbuf_expect로 정확한 크기의 청크 하나만 잡음
+// - 한도를 넘거나 할당에 실패하면 누적을 포기(abandoned)하고 청크를 즉시 반납
+// - 크기를 알면 청크 대신 호출자가 준 버퍼(캐시 객체)에 바로 채울 수도 있음(capbuf_expect_into)
+//   메모리에 두지 않을 큰 응답은 호출자가 연 파일(디스크 계층 임시 파일)에 바로 씀(capbuf_expect_file)
+#pragma once
+#include <stddef.h>
+
+#define CAPBUF_CHUNK_SIZE (16 << 10) // 풀에서 관리하는 기본 청크 크기
+#define CAPBUF_POOL_MAX 256          // 풀에 보관할 최대 빈 청크 수(넘으면 free)
+
+typedef struct capbuf_chunk {
+    struct capbuf_chunk *next; // 다음 청크
+    size_t cap;                // data 용량
+    size_t len;                // data 사용량
+    char data[];               // 바이트
+} capbuf_chunk_t;
+
+typedef struct {
+    capbuf_chunk_t *head; // 첫 청크
+    capbuf_chunk_t *tail; // 마지막 청크(이어붙이는 위치)
+    size_t len;           // 지금까지 누적한 총 바이트
+    size_t limit;         // 누적 한도(단일 객체 한도)
+    size_t expect;        // capbuf_expect로 알려준 전체 크기(모르면 0)
+    int abandoned;        // 한도 초과/메모리 부족으로 누적을 포기했는지
+    void *owner;          // 다른 스레드와 공유하는 주인(single-flight의 flight_t). 있으면 포기해도 청크는 capbuf_free 때 반납
+    char *ext;            // capbuf_expect_into로 받은 외부 버퍼(있으면 청크 대신 여기에 expect 바이트까지 씀, 해제는 주인 몫)
+    int fd;               // capbuf_expect_file로 받은 파일(0 이상이면 현재 위치에 expect 바이트까지 씀, 닫기는 주인 몫)
+} capbuf_t;
+
+void capbuf_init(capbuf_t *cb, size_t limit); // 빈 버퍼로 초기화(아직 할당 없음)
+// 전체 크기를 미리 알 때(Content-Length) 호출: 한도를 넘으면 즉시 포기, 아니면 남은 만큼의 청크 하나를 확보
+void capbuf_expect(capbuf_t *cb, size_t total);
+// capbuf_expect와 같되 청크 대신 호출자의 버퍼 dst(total 바이트 이상)에 바로 채움(채우는 중인 캐시 객체)
+// - 이미 받은 바이트가 있으면 capbuf_expect로 대신함
+void capbuf_expect_into(capbuf_t *cb, char *dst, size_t total);
+// capbuf_expect_into와 같되 버퍼 대신 파일 fd의 현재 위치부터 씀(write, 파이프에서는 splice로 복사 없이)
+void capbuf_expect_file(capbuf_t *cb, int fd, size_t total);
+// n바이트를 이어붙임. 누적 중이면 0, 포기 상태(이번 호출로 포기한 경우 포함)면 -1
+int capbuf_append(capbuf_t *cb, const void *data, size_t n);
+// fd(파이프 등)에서 정확히 n바이트를 읽어 청크에 바로 채움(중간 스택 버퍼 없이 복사 1회, 파일에 채우는 중이면 splice)
+// - 한도를 넘거나 읽기/할당에 실패하면 포기하고 -1. 포기한 경우 fd에 남은 바이트는 호출자 몫
+int capbuf_read(capbuf_t *cb, int fd, size_t n);
+// 누적을 포기하고 청크를 즉시 반납(이후 append/read는 무시). owner가 있으면 따라 읽는 쪽이 있으므로 반납은 미룸
+void capbuf_abandon(capbuf_t *cb);
+// 누적한 바이트를 dst로 이어서 복사(dst는 cb->len 이상)
+void capbuf_copyout(const capbuf_t *cb, char *dst);
+// 청크를 모두 반납(풀 크기의 청크는 풀로, 그 외는 free)
+void capbuf_free(capbuf_t *cb);
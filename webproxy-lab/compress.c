@@ -0,0 +1,258 @@
+#include "compress.h"
+#include "http.h"
+#include <brotli/encode.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#define COMPRESS_HDR_EXTRA 512 // 압축본 헤더가 원래 헤더보다 늘어날 수 있는 몫(약한 ETag, Vary, Content-Encoding/Length)
+
+// 코딩별 이름(키 접미사와 Content-Encoding 값). 조회는 이 순서로(더 작은 br 우선)
+static const struct {
+    int bit;
+    const char *name;
+} coding_tab[] = {
+    {HTTP_ENC_BR, "br"},
+    {HTTP_ENC_GZIP, "gzip"},
+};
+#define NCODINGS (sizeof(coding_tab) / sizeof(coding_tab[0]))
+
+// 압축 큐 항목(원래 응답 참조 1개 보유)
+typedef struct compress_job {
+    char *key;
+    cache_obj_t *obj;
+    int cancelled; // 압축하는 사이 key의 원래 응답이 바뀜(compress_forget): 만든 압축본을 넣지 않음
+    struct compress_job *next;
+} compress_job_t;
+
+// 큐/통계 보호. 압축본 삽입도 이 락 안에서 해서 compress_forget과 엇갈려 옛 본문의 압축본이 남지 않게 함
+static pthread_mutex_t compress_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER; // 압축 큐에 일이 생김
+static compress_job_t *queue_head, *queue_tail;
+static compress_job_t *working; // 압축 스레드가 지금 맡은 작업
+static int enabled;                // 켜진 코딩(HTTP_ENC_*), 0이면 꺼짐
+static compress_stats_t stats;
+
+// key 뒤에 코딩 접미사를 붙인 압축본 키("키\n~gzip"). 접미사를 줄바꿈으로 시작해 URL/Vary 2차 키와 겹치지 않음
+static char *variant_key(const char *key, const char *name) {
+    size_t n = strlen(key) + strlen(name) + 3;
+    char *vkey = malloc(n);
+    if (vkey)
+        snprintf(vkey, n, "%s\n~%s", key, name);
+    return vkey;
+}
+
+// 본문 in[0..n)을 gzip으로. 반환: 압축 길이(*out은 malloc), 실패 0
+static size_t gzip_encode(const char *in, size_t n, char **out) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (n > UINT_MAX || deflateInit2(&zs, COMPRESS_GZIP_LEVEL, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return 0; // windowBits 15 + 16: zlib 대신 gzip 머리/꼬리
+    size_t cap = deflateBound(&zs, (uLong)n);
+    char *buf = malloc(cap);
+    size_t len = 0;
+    if (buf) {
+        zs.next_in = (Bytef *)in;
+        zs.avail_in = (uInt)n;
+        zs.next_out = (Bytef *)buf;
+        zs.avail_out = (uInt)cap;
+        if (deflate(&zs, Z_FINISH) == Z_STREAM_END) // 한도(deflateBound) 안이므로 한 번에 끝남
+            len = zs.total_out;
+    }
+    deflateEnd(&zs);
+    if (!len) {
+        free(buf);
+        return 0;
+    }
+    *out = buf;
+    return len;
+}
+
+// 본문 in[0..n)을 brotli로. 반환: 압축 길이(*out은 malloc), 실패 0
+static size_t brotli_encode(const char *in, size_t n, char **out) {
+    size_t len = BrotliEncoderMaxCompressedSize(n);
+    char *buf = len ? malloc(len) : NULL;
+    if (!buf || !BrotliEncoderCompress(COMPRESS_BROTLI_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, n,
+                                       (const uint8_t *)in, &len, (uint8_t *)buf)) {
+        free(buf);
+        return 0;
+    }
+    *out = buf;
+    return len;
+}
+
+// 원래 응답 obj의 본문을 coding으로 압축해 압축본 캐시 객체를 만듦. 충분히 줄지 않거나 실패하면 NULL
+static cache_obj_t *encode_obj(const cache_obj_t *obj, int coding, const char *name) {
+    const char *body = obj->data + obj->head_len + 2; // 헤더 줄 뒤 빈 줄 다음
+    size_t n = obj->size - obj->head_len - 2;
+    char *enc = NULL;
+    size_t len = coding == HTTP_ENC_BR ? brotli_encode(body, n, &enc) : gzip_encode(body, n, &enc);
+    if (!len)
+        return NULL;
+    cache_obj_t *v = NULL;
+    int gain = len <= n - n / 8;
+    char *head = gain ? malloc(obj->head_len + COMPRESS_HDR_EXTRA) : NULL;
+    int hn = head ? http_encoded_head(head, obj->head_len + COMPRESS_HDR_EXTRA, obj->data, obj->head_len, name, len)
+                  : -1;
+    if (hn > 0 && (v = cache_obj_alloc((size_t)hn + 2 + len))) {
+        memcpy(v->data, head, (size_t)hn);
+        memcpy(v->data + hn, "\r\n", 2);
+        memcpy(v->data + hn + 2, enc, len);
+        v->head_len = (size_t)hn;
+        v->variant = 1;
+        v->expires = atomic_load(&obj->expires); // 재검증하지 않음(revalidate 0): 만료되면 조회 때 거둠
+    }
+    pthread_mutex_lock(&compress_lock);
+    if (v) {
+        stats.variants++;
+        stats.in_bytes += n;
+        stats.out_bytes += len;
+    } else if (!gain) {
+        stats.skipped++;
+    } else {
+        stats.dropped++;
+    }
+    pthread_mutex_unlock(&compress_lock);
+    free(head);
+    free(enc);
+    return v;
+}
+
+static void compress_job(compress_job_t *job) {
+    for (size_t i = 0; i < NCODINGS; i++) {
+        if (!(enabled & coding_tab[i].bit))
+            continue;
+        cache_obj_t *v = encode_obj(job->obj, coding_tab[i].bit, coding_tab[i].name); // 락 밖에서 압축
+        char *vkey = v ? variant_key(job->key, coding_tab[i].name) : NULL;
+        pthread_mutex_lock(&compress_lock);
+        if (vkey && !job->cancelled) {
+            cache_put_obj(vkey, v); // 참조는 캐시로(입장 거절이면 해제)
+            v = NULL;
+        }
+        pthread_mutex_unlock(&compress_lock);
+        if (v)
+            cache_release(v);
+        free(vkey);
+    }
+    pthread_mutex_lock(&compress_lock);
+    stats.queued -= job->obj->size;
+    working = NULL;
+    pthread_mutex_unlock(&compress_lock);
+    cache_release(job->obj);
+    free(job->key);
+    free(job);
+}
+
+static void *compress_main(void *arg) {
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&compress_lock);
+        while (!queue_head)
+            pthread_cond_wait(&queue_cond, &compress_lock);
+        compress_job_t *job = queue_head;
+        queue_head = job->next;
+        if (!queue_head)
+            queue_tail = NULL;
+        working = job;
+        pthread_mutex_unlock(&compress_lock);
+        compress_job(job);
+    }
+    return NULL;
+}
+
+int compress_init(int codings) {
+    pthread_t tid;
+    enabled = codings;
+    if (pthread_create(&tid, NULL, compress_main, NULL) != 0) {
+        enabled = 0;
+        return -1;
+    }
+    pthread_detach(tid);
+    return 0;
+}
+
+int compress_codings(void) {
+    return enabled;
+}
+
+int compress_lookup(char *key, size_t keycap, int accept, cache_obj_t **obj_out) {
+    *obj_out = NULL;
+    size_t len = strlen(key);
+    if (!(accept & enabled) || len + 8 > keycap)
+        return 0;
+    for (size_t i = 0; i < NCODINGS; i++) {
+        if (!(accept & enabled & coding_tab[i].bit))
+            continue;
+        snprintf(key + len, keycap - len, "\n~%s", coding_tab[i].name); // 제자리에서 접미사만 바꿔 가며 찾음
+        if (cache_probe(key, obj_out) == 1)
+            return 1;
+    }
+    key[len] = '\0';
+    return 0;
+}
+
+void compress_offer(const char *key, cache_obj_t *obj) {
+    if (!enabled || !obj->compressible || obj->chunked || obj->variant || obj->head_len == 0 ||
+        obj->size < obj->head_len + 2 + COMPRESS_MIN_SIZE)
+        return;
+    // HIT마다 다시 들어오므로 객체당 한 번만(압축본이 덜 줄어 버렸거나 방출됐어도 같은 본문을 다시 압축하지 않음)
+    if (atomic_exchange(&obj->compress_tried, 1))
+        return;
+    compress_job_t *job = malloc(sizeof(*job));
+    if (job && !(job->key = strdup(key))) {
+        free(job);
+        job = NULL;
+    }
+    pthread_mutex_lock(&compress_lock);
+    if (!job || stats.queued + obj->size > COMPRESS_QUEUE_MAX) {
+        stats.dropped++;
+        pthread_mutex_unlock(&compress_lock);
+        atomic_store(&obj->compress_tried, 0); // 맡지 못했으니 다음 HIT가 다시 넣을 수 있게
+        if (job) {
+            free(job->key);
+            free(job);
+        }
+        return;
+    }
+    cache_retain(obj);
+    job->obj = obj;
+    job->cancelled = 0;
+    job->next = NULL;
+    if (queue_tail)
+        queue_tail->next = job;
+    else
+        queue_head = job;
+    queue_tail = job;
+    stats.queued += obj->size;
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&compress_lock);
+}
+
+void compress_forget(const char *key) {
+    if (!enabled)
+        return;
+    pthread_mutex_lock(&compress_lock);
+    // 이전 응답으로 압축 중이거나 대기 중인 작업이 뒤늦게 압축본을 넣지 않도록 표시
+    if (working && !strcmp(working->key, key))
+        working->cancelled = 1;
+    for (compress_job_t *j = queue_head; j; j = j->next)
+        if (!strcmp(j->key, key))
+            j->cancelled = 1;
+    for (size_t i = 0; i < NCODINGS; i++) {
+        char *vkey = variant_key(key, coding_tab[i].name);
+        if (vkey)
+            cache_remove(vkey);
+        free(vkey);
+    }
+    pthread_mutex_unlock(&compress_lock);
+}
+
+void compress_get_stats(compress_stats_t *out) {
+    pthread_mutex_lock(&compress_lock);
+    *out = stats;
+    pthread_mutex_unlock(&compress_lock);
+}
@@ -0,0 +1,40 @@
+// 캐시 응답 압축 계층(메모리 캐시의 텍스트 응답 옆에 압축본을 둠)
+// - 캐시에 새로 들어간 압축할 만한 응답(과 압축본이 없는 채로 HIT한 응답)을 큐에 받아 전용 스레드가 gzip/brotli로
+//   한 번 압축하고, 헤더를 고쳐(Content-Encoding, Content-Length, 약한 ETag, Vary: Accept-Encoding)
+//   "키\n~gzip" 같은 파생 키에 보통 캐시 객체로 넣음. 304/Range/스냅샷은 다른 캐시 객체와 똑같이 처리됨
+// - 조회는 Accept-Encoding이 받아들이는 압축본을 원래 응답보다 먼저 찾음(br 우선). 압축본 HIT는 원래 응답의
+//   LRU 위치를 올리지 않으므로, 압축을 받는 클라이언트만 오면 원래 응답은 밀려나고 작은 압축본만 남음
+// - 압축본은 원래 응답의 만료 시각을 물려받고 재검증하지 않음(만료되면 거두고, 원래 응답이 다시 채워지면 새로 만듦)
+// - 충분히 줄지 않으면(1/8 미만) 버림. 원래 응답마다 한 번만 시도(compress_tried). 큐가 넘치면 버림(다음 HIT가 다시 넣음)
+// - 압축하는 사이 원래 응답이 바뀌면(compress_forget) 옛 본문으로 만든 압축본은 넣지 않음
+#pragma once
+#include "cache.h"
+#include <stddef.h>
+
+#define COMPRESS_MIN_SIZE 256        // 이보다 작은 본문은 압축하지 않음(헤더가 늘어나는 몫이 더 큼)
+#define COMPRESS_QUEUE_MAX (8 << 20) // 압축 큐에 쌓아 둘 최대 원본 바이트(넘으면 버림)
+#define COMPRESS_GZIP_LEVEL 6        // zlib 압축 수준(기본값: 속도/크기 균형)
+#define COMPRESS_BROTLI_QUALITY 5    // brotli 품질(11은 너무 느림. 5면 gzip 6보다 작고 비슷하게 빠름)
+
+// 통계(SIGUSR1 출력용)
+typedef struct {
+    unsigned long long variants;  // 만들어 캐시에 넘긴 압축본 수
+    unsigned long long in_bytes;  // 압축한 원래 본문 바이트
+    unsigned long long out_bytes; // 만든 압축본 본문 바이트
+    unsigned long long skipped;   // 충분히 줄지 않아 버린 압축본 수
+    unsigned long long dropped;   // 큐가 넘치거나 메모리가 없어 버린 작업 수
+    size_t queued;                // 압축 대기 원본 바이트
+} compress_stats_t;
+
+// codings(HTTP_ENC_* 비트)만 만들도록 압축 계층을 켜고 압축 스레드를 띄움. 실패 시 -1
+int compress_init(int codings);
+// 켜진 코딩(HTTP_ENC_* 비트), 꺼져 있으면 0
+int compress_codings(void);
+// 받아들이는 코딩(accept, HTTP_ENC_*)의 압축본을 선호 순서(br, gzip)로 찾음
+// - HIT면 1과 pin한 객체, key에는 압축본 키를 덮어씀. 없거나 만료됐으면 0(key는 그대로, 캐시 통계에 세지 않음)
+int compress_lookup(char *key, size_t keycap, int accept, cache_obj_t **obj_out);
+// key의 원래 응답 obj로 압축본을 만들도록 큐에 넣음(압축할 만하지 않거나 이 객체로 이미 시도했으면 무시)
+void compress_offer(const char *key, cache_obj_t *obj);
+// key의 압축본을 모두 캐시에서 빼고 진행 중인 작업을 취소(원래 응답이 바뀌었거나 빠질 때)
+void compress_forget(const char *key);
+void compress_get_stats(compress_stats_t *out);
@@ -0,0 +1,733 @@
+#include "disk.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+#include "osdep.h"
+
+#define DISK_BUCKETS 4096        // 인덱스 해시 버킷 수
+#define DISK_MAGIC 0x32435044u   // 레코드 시작 표시("DPC2", 형식이 바뀌면 숫자를 올림)
+#define DISK_MAX_KEY 8192        // 재구성할 때 믿어 줄 최대 키 길이(넘으면 손상으로 봄)
+#define DISK_FLAG_CHUNKED 1u
+#define DISK_FLAG_UNSIZED 2u
+#define DISK_FLAG_VALIDATED 4u // 검증자가 있음(만료돼도 인덱스에 남겨 재검증)
+
+// 세그먼트 안 레코드 헤더(파일 형식. 뒤에 키 key_len바이트, 응답 바이트 size바이트가 이어짐)
+typedef struct {
+    uint32_t magic;
+    uint32_t key_len;
+    uint64_t size;
+    uint64_t head_len;
+    int64_t expires; // 신선도 만료 시각(UNIX 초, 0이면 없음)
+    uint32_t flags;
+    uint32_t check; // 이 필드를 0으로 둔 헤더 + 키의 FNV-1a
+} disk_rec_t;
+
+// 세그먼트 파일 하나. FIFO 목록이 참조 1개, HIT로 보내는 중인 쪽이 1개씩 가짐(마지막 참조가 fd를 닫음)
+struct disk_seg {
+    unsigned id;
+    int fd;
+    size_t len;               // 기록을 마친 길이(쓰기 스레드만 늘림)
+    int sealed;               // 더 덧붙이지 않음(재구성 때 망가진 꼬리를 잘라 내지 못함)
+    atomic_int refs;
+    struct disk_entry *entries; // 이 세그먼트의 레코드를 가리키는 인덱스 항목(지울 때 이것만 훑음)
+    struct disk_seg *next;    // FIFO 목록(오래된 것부터)
+};
+
+// 인덱스 항목(키 하나의 최신 레코드 위치)
+typedef struct disk_entry {
+    char *key;
+    unsigned hash;
+    disk_seg_t *seg;
+    off_t off; // 응답 바이트 시작 위치
+    size_t size;
+    size_t head_len;
+    long long expires;
+    unsigned flags;
+    struct disk_entry *next;                       // 버킷 체인
+    struct disk_entry *seg_prev, *seg_next;        // 세그먼트의 항목 목록
+} disk_entry_t;
+
+// 쓰기 큐 항목(캐시 객체 참조 1개, 다 받은 임시 파일 참조 1개, 재검증한 레코드의 세그먼트 참조 1개 중 하나 보유)
+typedef struct disk_job {
+    char *key;
+    cache_obj_t *obj;
+    disk_stream_t *st; // 있으면 obj 대신 이 임시 파일을 세그먼트로 들임
+    char *head;        // 둘 다 없으면 재검증한 레코드: 새 헤더 줄 + src의 빈 줄/본문으로 다시 씀
+    size_t head_len;
+    long long expires;
+    disk_obj_t src;
+    struct disk_job *next;
+} disk_job_t;
+
+static pthread_mutex_t disk_lock = PTHREAD_MUTEX_INITIALIZER; // 인덱스/세그먼트 목록/큐/통계 보호
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;  // 쓰기 큐에 일이 생김
+static disk_entry_t *buckets[DISK_BUCKETS];
+static disk_seg_t *seg_head, *seg_tail; // 세그먼트 FIFO(tail이 지금 덧붙이는 세그먼트)
+static disk_job_t *queue_head, *queue_tail;
+static char *disk_dir;      // NULL이면 디스크 계층 꺼짐
+static size_t disk_budget;  // 세그먼트 크기 합 상한
+static size_t disk_max_obj; // 단일 객체 상한
+static size_t seg_limit;    // 세그먼트를 닫는 크기(예산이 작으면 여러 세그먼트로 나눠 FIFO로 지울 수 있게 줄임)
+static unsigned next_id;    // 다음 세그먼트 번호
+static atomic_uint tmp_seq; // 임시 파일 이름 번호
+static disk_stats_t stats;
+
+static unsigned fnv1a(unsigned h, const void *p, size_t n) {
+    for (const unsigned char *s = p; n--; s++)
+        h = (h ^ *s) * 16777619u;
+    return h;
+}
+
+static unsigned hash_key(const char *key) {
+    return fnv1a(2166136261u, key, strlen(key));
+}
+
+static unsigned rec_check(disk_rec_t rec, const char *key) {
+    rec.check = 0;
+    return fnv1a(fnv1a(2166136261u, &rec, sizeof(rec)), key, rec.key_len);
+}
+
+static void seg_path(char *path, size_t n, unsigned id) {
+    snprintf(path, n, "%s/%08u.seg", disk_dir, id);
+}
+
+// 임시 파일 이름은 세그먼트와 겹치지 않는 "<번호>.tmp"(재시작 때 남아 있으면 쓰다 만 것이므로 지움)
+static void tmp_path(char *path, size_t n, unsigned seq) {
+    snprintf(path, n, "%s/%u.tmp", disk_dir, seq);
+}
+
+static void seg_put(disk_seg_t *seg) {
+    if (atomic_fetch_sub(&seg->refs, 1) != 1)
+        return;
+    close(seg->fd);
+    free(seg);
+}
+
+static disk_entry_t *find_entry(const char *key, unsigned h) {
+    for (disk_entry_t *e = buckets[h % DISK_BUCKETS]; e; e = e->next)
+        if (e->hash == h && !strcmp(e->key, key))
+            return e;
+    return NULL;
+}
+
+static void seg_link(disk_seg_t *seg, disk_entry_t *e) {
+    e->seg = seg;
+    e->seg_prev = NULL;
+    e->seg_next = seg->entries;
+    if (seg->entries)
+        seg->entries->seg_prev = e;
+    seg->entries = e;
+}
+
+static void seg_unlink(disk_entry_t *e) {
+    if (e->seg_prev)
+        e->seg_prev->seg_next = e->seg_next;
+    else
+        e->seg->entries = e->seg_next;
+    if (e->seg_next)
+        e->seg_next->seg_prev = e->seg_prev;
+}
+
+// 항목을 버킷 체인과 세그먼트 목록에서 빼고 해제(레코드는 세그먼트를 지울 때 같이 사라짐. disk_lock 보유)
+static void drop_entry(disk_entry_t *e) {
+    disk_entry_t **pp = &buckets[e->hash % DISK_BUCKETS];
+    while (*pp != e)
+        pp = &(*pp)->next;
+    *pp = e->next;
+    seg_unlink(e);
+    free(e->key);
+    free(e);
+    stats.entries--;
+}
+
+// key의 위치를 새 레코드로 바꿈(이전 레코드는 세그먼트에 죽은 채로 남음). key 소유권을 가져감(disk_lock 보유)
+static void index_put(char *key, disk_seg_t *seg, off_t off, const disk_rec_t *rec) {
+    unsigned h = hash_key(key);
+    disk_entry_t *e = find_entry(key, h);
+    if (e) {
+        free(key);
+        seg_unlink(e);
+    } else {
+        if (!(e = malloc(sizeof(*e)))) {
+            free(key);
+            return;
+        }
+        e->key = key;
+        e->hash = h;
+        e->next = buckets[h % DISK_BUCKETS];
+        buckets[h % DISK_BUCKETS] = e;
+        stats.entries++;
+    }
+    seg_link(seg, e);
+    e->off = off;
+    e->size = rec->size;
+    e->head_len = rec->head_len;
+    e->expires = rec->expires;
+    e->flags = rec->flags;
+}
+
+// 가장 오래된 세그먼트를 지움: 가리키는 인덱스 항목을 빼고 파일을 unlink(보내는 중인 쪽은 열린 fd로 마저 읽음)
+// (disk_lock 보유)
+static void purge_oldest(void) {
+    disk_seg_t *seg = seg_head;
+    seg_head = seg->next;
+    if (!seg_head)
+        seg_tail = NULL;
+    while (seg->entries)
+        drop_entry(seg->entries);
+    char path[PATH_MAX];
+    seg_path(path, sizeof(path), seg->id);
+    unlink(path);
+    stats.bytes -= seg->len;
+    stats.segments--;
+    stats.purged++;
+    seg_put(seg);
+}
+
+// 예산을 넘는 동안 오래된 세그먼트부터 지움. keep(덧붙이는 중)은 남김(disk_lock 보유)
+static void enforce_budget(const disk_seg_t *keep) {
+    while (stats.bytes > disk_budget && seg_head && seg_head != keep)
+        purge_oldest();
+}
+
+// 쓰기 큐 끝에 넣고 쓰기 스레드를 깨움(disk_lock 보유)
+static void queue_push(disk_job_t *job) {
+    job->next = NULL;
+    if (queue_tail)
+        queue_tail->next = job;
+    else
+        queue_head = job;
+    queue_tail = job;
+    pthread_cond_signal(&queue_cond);
+}
+
+static disk_seg_t *seg_new(unsigned id, int fd, size_t len) {
+    disk_seg_t *seg = calloc(1, sizeof(*seg));
+    if (!seg)
+        return NULL;
+    seg->id = id;
+    seg->fd = fd;
+    seg->len = len;
+    atomic_init(&seg->refs, 1);
+    if (seg_tail)
+        seg_tail->next = seg;
+    else
+        seg_head = seg;
+    seg_tail = seg;
+    stats.bytes += len;
+    stats.segments++;
+    return seg;
+}
+
+// 세그먼트 하나를 훑어 인덱스에 넣음. 검증에 실패한 지점부터는 쓰다 만 꼬리로 보고 잘라 냄
+// 반환: 유효한 길이
+static size_t scan_segment(unsigned id, int fd) {
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0)
+        return 0;
+    size_t len = (size_t)st.st_size;
+    char *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+        return 0;
+    disk_seg_t *seg = NULL;
+    size_t off = 0;
+    while (len - off >= sizeof(disk_rec_t)) {
+        disk_rec_t rec;
+        memcpy(&rec, map + off, sizeof(rec));
+        size_t room = len - off - sizeof(rec);
+        if (rec.magic != DISK_MAGIC || rec.key_len == 0 || rec.key_len > DISK_MAX_KEY || rec.key_len > room ||
+            rec.size > room - rec.key_len || rec.head_len > rec.size)
+            break;
+        const char *key = map + off + sizeof(rec);
+        if (rec_check(rec, key) != rec.check || memchr(key, '\0', rec.key_len))
+            break;
+        if (!seg && !(seg = seg_new(id, fd, 0)))
+            break;
+        char *k = strndup(key, rec.key_len);
+        if (k)
+            index_put(k, seg, (off_t)(off + sizeof(rec) + rec.key_len), &rec);
+        off += sizeof(rec) + rec.key_len + rec.size;
+    }
+    munmap(map, len);
+    if (!seg)
+        return 0;
+    if (off < len && ftruncate(fd, (off_t)off) < 0) {
+        // 꼬리가 남으면 여기 덧붙인 레코드 뒤에 옛 바이트가 이어져 다음 재구성이 어긋날 수 있으므로 읽기 전용으로 둠
+        fprintf(stderr, "disk: cannot truncate segment %08u to %zu bytes: %s (sealed)\n", id, off, strerror(errno));
+        seg->sealed = 1;
+    }
+    seg->len = off;
+    stats.bytes += off;
+    return off;
+}
+
+static int cmp_id(const void *a, const void *b) {
+    unsigned x = *(const unsigned *)a, y = *(const unsigned *)b;
+    return x < y ? -1 : x > y;
+}
+
+// 디렉터리의 세그먼트를 번호 순(= 기록 순)으로 훑어 인덱스 재구성. 뒤 레코드가 앞 레코드를 덮음
+static int rebuild(void) {
+    DIR *d = opendir(disk_dir);
+    if (!d)
+        return -1;
+    unsigned *ids = NULL;
+    size_t n = 0, cap = 0;
+    struct dirent *de;
+    while ((de = readdir(d))) {
+        unsigned id;
+        char tail;
+        size_t nlen = strlen(de->d_name);
+        if (nlen > 4 && !strcmp(de->d_name + nlen - 4, ".tmp")) { // 받다 만 임시 파일
+            char path[PATH_MAX];
+            snprintf(path, sizeof(path), "%s/%s", disk_dir, de->d_name);
+            unlink(path);
+            continue;
+        }
+        if (nlen != 12 || sscanf(de->d_name, "%8u.se%c", &id, &tail) != 2 || tail != 'g')
+            continue;
+        if (n == cap) {
+            unsigned *p = realloc(ids, (cap = cap ? cap * 2 : 64) * sizeof(*ids));
+            if (!p)
+                break;
+            ids = p;
+        }
+        ids[n++] = id;
+    }
+    closedir(d);
+    if (n)
+        qsort(ids, n, sizeof(*ids), cmp_id);
+    for (size_t i = 0; i < n; i++) {
+        char path[PATH_MAX];
+        seg_path(path, sizeof(path), ids[i]);
+        int fd = open(path, O_RDWR | O_CLOEXEC);
+        if (fd < 0)
+            continue;
+        if (scan_segment(ids[i], fd) == 0) { // 유효한 레코드가 없는(빈/앞부터 망가진) 세그먼트는 지움
+            close(fd);
+            unlink(path);
+        }
+        next_id = ids[i] + 1;
+    }
+    free(ids);
+    enforce_budget(NULL);
+    return 0;
+}
+
+// 레코드 하나를 덧붙일 세그먼트(지금 것에 자리가 없으면 새로 엶). 실패 시 NULL
+static disk_seg_t *seg_for(size_t rec_len) {
+    pthread_mutex_lock(&disk_lock);
+    disk_seg_t *seg = seg_tail;
+    unsigned id = next_id;
+    pthread_mutex_unlock(&disk_lock);
+    if (seg && !seg->sealed && (seg->len == 0 || seg->len + rec_len <= seg_limit))
+        return seg;
+    char path[PATH_MAX];
+    seg_path(path, sizeof(path), id);
+    int fd = open(path, O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return NULL;
+    pthread_mutex_lock(&disk_lock);
+    next_id = id + 1;
+    seg = seg_new(id, fd, 0);
+    pthread_mutex_unlock(&disk_lock);
+    if (!seg) {
+        close(fd);
+        unlink(path);
+    }
+    return seg;
+}
+
+// iov를 fd의 pos부터 끝까지 씀(부분 기록/시그널 중단 처리). 실패 시 -1
+static int pwritev_full(int fd, struct iovec *v, int cnt, off_t pos) {
+    while (cnt > 0) {
+        ssize_t w = pwritev(fd, v, cnt, pos);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return -1;
+        pos += w;
+        while (cnt > 0 && (size_t)w >= v->iov_len) {
+            w -= (ssize_t)v->iov_len;
+            v++;
+            cnt--;
+        }
+        if (cnt > 0) {
+            v->iov_base = (char *)v->iov_base + w;
+            v->iov_len -= (size_t)w;
+        }
+    }
+    return 0;
+}
+
+// 쓰기 스레드: 큐의 객체를 현재 세그먼트 끝에 [헤더][키][응답 바이트]로 기록하고 인덱스에 올림
+static void write_job(disk_job_t *job) {
+    cache_obj_t *obj = job->obj;
+    disk_rec_t rec = {.magic = DISK_MAGIC,
+                      .key_len = (uint32_t)strlen(job->key),
+                      .size = obj->size,
+                      .head_len = obj->head_len,
+                      .expires = obj->expires,
+                      .flags = (obj->chunked ? DISK_FLAG_CHUNKED : 0) | (obj->unsized ? DISK_FLAG_UNSIZED : 0) |
+                               (obj->revalidate ? DISK_FLAG_VALIDATED : 0)};
+    rec.check = rec_check(rec, job->key);
+    size_t rec_len = sizeof(rec) + rec.key_len + obj->size;
+    disk_seg_t *seg = seg_for(rec_len);
+    int ok = seg != NULL;
+    if (ok) {
+        struct iovec iov[3] = {{&rec, sizeof(rec)}, {job->key, rec.key_len}, {obj->data, obj->size}};
+        ok = pwritev_full(seg->fd, iov, 3, (off_t)seg->len) == 0; // 쓰다 만 꼬리는 다음 기록이 덮어씀(재시작 때는 검증에서 잘림)
+    }
+
+    pthread_mutex_lock(&disk_lock);
+    stats.queued -= obj->size;
+    if (ok) {
+        index_put(job->key, seg, (off_t)(seg->len + sizeof(rec) + rec.key_len), &rec);
+        job->key = NULL;
+        seg->len += rec_len;
+        stats.bytes += rec_len;
+        stats.writes++;
+        stats.write_bytes += rec_len;
+        enforce_budget(seg);
+    } else {
+        stats.dropped++;
+    }
+    pthread_mutex_unlock(&disk_lock);
+    cache_release(obj);
+    free(job->key);
+    free(job);
+}
+
+// 쓰기 스레드: 재검증한 레코드를 [헤더][키][새 헤더 줄][원래 레코드의 빈 줄 + 본문]으로 덧붙임(본문은 파일끼리 복사)
+static void refresh_job(disk_job_t *job) {
+    disk_obj_t *src = &job->src;
+    size_t body_len = src->size - src->head_len;
+    disk_rec_t rec = {.magic = DISK_MAGIC,
+                      .key_len = (uint32_t)strlen(job->key),
+                      .size = job->head_len + body_len,
+                      .head_len = job->head_len,
+                      .expires = job->expires,
+                      .flags = (src->chunked ? DISK_FLAG_CHUNKED : 0) | (src->unsized ? DISK_FLAG_UNSIZED : 0) |
+                               DISK_FLAG_VALIDATED};
+    rec.check = rec_check(rec, job->key);
+    size_t rec_len = sizeof(rec) + rec.key_len + rec.size;
+    disk_seg_t *seg = seg_for(rec_len);
+    int ok = seg != NULL;
+    if (ok) {
+        off_t pos = (off_t)seg->len;
+        struct iovec iov[3] = {{&rec, sizeof(rec)}, {job->key, rec.key_len}, {job->head, job->head_len}};
+        ok = pwritev_full(seg->fd, iov, 3, pos) == 0 &&
+             os_copy_range(src->fd, src->off + (off_t)src->head_len, seg->fd,
+                           pos + (off_t)(sizeof(rec) + rec.key_len + job->head_len), body_len) == 0;
+    }
+
+    pthread_mutex_lock(&disk_lock);
+    stats.queued -= job->head_len;
+    if (ok) {
+        disk_entry_t *e = find_entry(job->key, hash_key(job->key));
+        if (!e || (e->seg == src->seg && e->off == src->off)) { // 그사이 새 응답으로 바뀌었으면 그쪽을 둠
+            index_put(job->key, seg, (off_t)(seg->len + sizeof(rec) + rec.key_len), &rec);
+            job->key = NULL;
+        }
+        seg->len += rec_len;
+        stats.bytes += rec_len;
+        stats.writes++;
+        stats.write_bytes += rec_len;
+        stats.refreshed++;
+        enforce_budget(seg);
+    } else {
+        stats.dropped++;
+    }
+    pthread_mutex_unlock(&disk_lock);
+    disk_release(src);
+    free(job->head);
+    free(job->key);
+    free(job);
+}
+
+// 쓰기 스레드: 다 받은 임시 파일을 다음 번호의 세그먼트로 이름만 바꿔 들이고 인덱스에 올림
+// - 파일이 이미 [헤더][키][응답 바이트]이므로 다시 쓰지 않음. fd는 복제해 세그먼트가 따로 가짐(따라 읽던 쪽은 원래 fd로)
+static void adopt_job(disk_job_t *job) {
+    disk_stream_t *st = job->st;
+    disk_rec_t rec = {.magic = DISK_MAGIC,
+                      .key_len = (uint32_t)strlen(st->key),
+                      .size = st->size,
+                      .head_len = st->head_len,
+                      .expires = st->expires,
+                      .flags = st->revalidate ? DISK_FLAG_VALIDATED : 0};
+    size_t rec_len = (size_t)st->off + st->size;
+    pthread_mutex_lock(&disk_lock);
+    unsigned id = next_id;
+    pthread_mutex_unlock(&disk_lock);
+    char path[PATH_MAX];
+    seg_path(path, sizeof(path), id);
+    char *key = strdup(st->key);
+    int fd = key ? fcntl(st->fd, F_DUPFD_CLOEXEC, 0) : -1;
+    int renamed = fd >= 0 && rename(st->path, path) == 0;
+
+    pthread_mutex_lock(&disk_lock);
+    disk_seg_t *seg = NULL;
+    if (renamed && (seg = seg_new(id, fd, rec_len))) {
+        next_id = id + 1;
+        index_put(key, seg, st->off, &rec);
+        key = NULL;
+        st->adopted = 1;
+        stats.streaming -= st->size;
+        stats.writes++;
+        stats.write_bytes += rec_len;
+        enforce_budget(seg);
+    } else {
+        stats.dropped++;
+    }
+    pthread_mutex_unlock(&disk_lock);
+    if (!seg) {
+        if (renamed)
+            unlink(path);
+        if (fd >= 0)
+            close(fd);
+    }
+    free(key);
+    disk_stream_close(st);
+    free(job);
+}
+
+static void *writer_main(void *arg) {
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&disk_lock);
+        while (!queue_head)
+            pthread_cond_wait(&queue_cond, &disk_lock);
+        disk_job_t *job = queue_head;
+        queue_head = job->next;
+        if (!queue_head)
+            queue_tail = NULL;
+        pthread_mutex_unlock(&disk_lock);
+        if (job->st)
+            adopt_job(job);
+        else if (job->obj)
+            write_job(job);
+        else
+            refresh_job(job);
+    }
+    return NULL;
+}
+
+int disk_init(const char *dir, size_t budget, size_t max_object) {
+    if (mkdir(dir, 0755) < 0 && errno != EEXIST)
+        return -1;
+    if (!(disk_dir = strdup(dir)))
+        return -1;
+    disk_budget = budget;
+    disk_max_obj = max_object;
+    seg_limit = budget / 8 < DISK_SEGMENT_SIZE ? budget / 8 : DISK_SEGMENT_SIZE;
+    if (rebuild() < 0) {
+        free(disk_dir);
+        disk_dir = NULL;
+        return -1;
+    }
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, writer_main, NULL) != 0) {
+        free(disk_dir);
+        disk_dir = NULL;
+        return -1;
+    }
+    pthread_detach(tid);
+    return 0;
+}
+
+void disk_offer(const char *key, cache_obj_t *obj) {
+    if (!disk_dir || obj->size == 0 || obj->size > disk_max_obj || obj->size > disk_budget)
+        return;
+    if (obj->vary || obj->variant || (obj->expires && obj->expires <= (long long)time(NULL)))
+        return; // Vary 표시와 압축본은 메모리에만 두고, 신선도가 지난 객체는 옮길 가치가 없음
+    disk_job_t *job = malloc(sizeof(*job));
+    if (job && !(job->key = strdup(key))) {
+        free(job);
+        job = NULL;
+    }
+    pthread_mutex_lock(&disk_lock);
+    if (!job || stats.queued + obj->size > DISK_QUEUE_MAX) {
+        stats.dropped++;
+        pthread_mutex_unlock(&disk_lock);
+        if (job) {
+            free(job->key);
+            free(job);
+        }
+        return;
+    }
+    cache_retain(obj);
+    job->obj = obj;
+    job->st = NULL;
+    stats.queued += obj->size;
+    queue_push(job);
+    pthread_mutex_unlock(&disk_lock);
+}
+
+disk_stream_t *disk_stream_open(const char *key, size_t size, size_t head_len, long long expires, int revalidate) {
+    if (!disk_dir || size == 0 || size > disk_max_obj || size > disk_budget)
+        return NULL;
+    disk_stream_t *st = calloc(1, sizeof(*st));
+    if (!st)
+        return NULL;
+    pthread_mutex_lock(&disk_lock);
+    int room = stats.streaming + size <= disk_budget; // 받는 중인 파일도 디스크를 차지하므로 예산만큼만
+    if (room)
+        stats.streaming += size;
+    pthread_mutex_unlock(&disk_lock);
+    if (!room) {
+        free(st);
+        return NULL;
+    }
+    disk_rec_t rec = {.magic = DISK_MAGIC,
+                      .key_len = (uint32_t)strlen(key),
+                      .size = size,
+                      .head_len = head_len,
+                      .expires = expires,
+                      .flags = revalidate ? DISK_FLAG_VALIDATED : 0};
+    rec.check = rec_check(rec, key);
+    st->off = (off_t)(sizeof(rec) + rec.key_len);
+    st->size = size;
+    st->head_len = head_len;
+    st->expires = expires;
+    st->revalidate = revalidate;
+    atomic_init(&st->refs, 1);
+    char path[PATH_MAX];
+    tmp_path(path, sizeof(path), atomic_fetch_add(&tmp_seq, 1));
+    st->fd = open(path, O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644);
+    if (st->fd >= 0)
+        st->path = strdup(path); // 지금부터 닫을 때 지울 파일
+    // 레코드 헤더와 키를 먼저 써 두고, 응답 바이트는 그 뒤(파일의 현재 위치)부터 이어 씀
+    struct iovec iov[2] = {{&rec, sizeof(rec)}, {(char *)key, rec.key_len}};
+    if (!st->path || !(st->key = strdup(key)) || pwritev_full(st->fd, iov, 2, 0) < 0 ||
+        lseek(st->fd, st->off, SEEK_SET) != st->off) {
+        if (st->fd >= 0 && !st->path)
+            unlink(path);
+        disk_stream_close(st);
+        return NULL;
+    }
+    return st;
+}
+
+void disk_stream_commit(disk_stream_t *st) {
+    disk_job_t *job = calloc(1, sizeof(*job));
+    pthread_mutex_lock(&disk_lock);
+    if (!job) {
+        stats.dropped++;
+        pthread_mutex_unlock(&disk_lock);
+        return;
+    }
+    atomic_fetch_add(&st->refs, 1);
+    job->st = st;
+    queue_push(job);
+    pthread_mutex_unlock(&disk_lock);
+}
+
+void disk_stream_close(disk_stream_t *st) {
+    if (atomic_fetch_sub(&st->refs, 1) != 1)
+        return;
+    if (!st->adopted) { // 받다 실패했거나 세그먼트로 들이지 못함: 예산에서 빼고 파일을 지움
+        pthread_mutex_lock(&disk_lock);
+        stats.streaming -= st->size;
+        pthread_mutex_unlock(&disk_lock);
+        if (st->path)
+            unlink(st->path);
+    }
+    if (st->fd >= 0)
+        close(st->fd);
+    free(st->key);
+    free(st->path);
+    free(st);
+}
+
+int disk_get(const char *key, disk_obj_t *out) {
+    if (!disk_dir)
+        return 0;
+    unsigned h = hash_key(key);
+    pthread_mutex_lock(&disk_lock);
+    disk_entry_t *e = find_entry(key, h);
+    int stale = e && e->expires && e->expires <= (long long)time(NULL);
+    if (stale && !(e->flags & DISK_FLAG_VALIDATED)) {
+        drop_entry(e); // 신선도가 지났고 재검증할 수도 없음: 인덱스에서만 뺌
+        e = NULL;
+        stats.expired++;
+    }
+    if (!e) {
+        stats.misses++;
+        pthread_mutex_unlock(&disk_lock);
+        return 0;
+    }
+    atomic_fetch_add(&e->seg->refs, 1);
+    *out = (disk_obj_t){.seg = e->seg,
+                        .fd = e->seg->fd,
+                        .off = e->off,
+                        .size = e->size,
+                        .head_len = e->head_len,
+                        .chunked = (e->flags & DISK_FLAG_CHUNKED) != 0,
+                        .unsized = (e->flags & DISK_FLAG_UNSIZED) != 0,
+                        .stale = (unsigned char)stale};
+    if (stale)
+        stats.stale++;
+    else
+        stats.hits++;
+    pthread_mutex_unlock(&disk_lock);
+    return 1;
+}
+
+void disk_refresh(const char *key, const disk_obj_t *d, const char *head, size_t head_len, long long expires) {
+    if (!disk_dir || !d->seg)
+        return;
+    disk_job_t *job = calloc(1, sizeof(*job));
+    if (job && (!(job->key = strdup(key)) || !(job->head = malloc(head_len)))) {
+        free(job->key);
+        free(job);
+        job = NULL;
+    }
+    pthread_mutex_lock(&disk_lock);
+    if (!job) {
+        stats.dropped++;
+        pthread_mutex_unlock(&disk_lock);
+        return;
+    }
+    memcpy(job->head, head, head_len);
+    job->head_len = head_len;
+    job->expires = expires;
+    job->src = *d;
+    atomic_fetch_add(&d->seg->refs, 1); // 본문을 복사할 때까지(쓰기 스레드가 disk_release)
+    stats.queued += head_len;
+    queue_push(job);
+    pthread_mutex_unlock(&disk_lock);
+}
+
+void disk_remove(const char *key, const disk_obj_t *d) {
+    if (!disk_dir)
+        return;
+    pthread_mutex_lock(&disk_lock);
+    disk_entry_t *e = find_entry(key, hash_key(key));
+    if (e && e->seg == d->seg && e->off == d->off)
+        drop_entry(e);
+    pthread_mutex_unlock(&disk_lock);
+}
+
+void disk_release(disk_obj_t *d) {
+    if (!d->seg)
+        return;
+    seg_put(d->seg);
+    d->seg = NULL;
+}
+
+void disk_get_stats(disk_stats_t *out) {
+    pthread_mutex_lock(&disk_lock);
+    *out = stats;
+    pthread_mutex_unlock(&disk_lock);
+}
@@ -0,0 +1,94 @@
+// 디스크 2차 캐시(메모리 캐시 뒤의 계층)
+// - 메모리 캐시에서 용량 때문에 밀려난 객체와 메모리 단일 객체 한도를 넘는 응답을 디렉터리의 세그먼트 파일에
+//   로그처럼 덧붙여 저장(log-structured). 인덱스(키 -> 세그먼트/오프셋/응답 메타데이터)는 메모리 해시 표
+// - 레코드는 [레코드 헤더][키][응답 바이트(캐시 객체와 같은 형식)]로 연속 저장되므로, 시작할 때 세그먼트를
+//   mmap해 앞에서부터 훑기만 하면 인덱스를 다시 세움(재시작해도 디스크 계층은 남음)
+//   레코드 헤더와 키는 체크섬으로 검증하고, 쓰다 만 꼬리 레코드는 잘라 냄
+// - 파일 쓰기는 전용 쓰기 스레드만 함(중계 스레드/이벤트 루프는 큐에 넣기만). 큐가 넘치면 버림
+//   단, 메모리 객체 한도를 넘는 응답은 메모리에 모으지 않고 받는 대로 임시 파일에 레코드 형식으로 쓰고(disk_stream_open),
+//   완성되면 쓰기 스레드가 그 파일의 이름만 바꿔 새 세그먼트로 들임(다시 쓰지 않음)
+// - 예산을 넘으면 가장 오래된 세그먼트부터 통째로 지움(FIFO). 보내는 중인 세그먼트는 참조가 풀릴 때 닫힘
+// - HIT는 세그먼트 파일에서 sendfile로 클라이언트 소켓에 바로 보냄
+// - 신선도가 지난 레코드도 검증자(ETag/Last-Modified)가 있으면 돌려줘 원서버에 조건부 요청하게 함. 304면
+//   새 헤더로 레코드를 다시 씀(본문은 쓰기 스레드가 세그먼트끼리 복사, disk_refresh)
+#pragma once
+#include "cache.h"
+#include <stdatomic.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define DISK_DEFAULT_SIZE (256 << 20)       // 디스크 계층 총 예산(세그먼트 파일 크기 합)
+#define DISK_DEFAULT_OBJECT_SIZE (16 << 20) // 디스크 계층에 넣을 단일 객체 최대 크기
+#define DISK_SEGMENT_SIZE (16 << 20)        // 세그먼트 하나를 닫고 새로 여는 크기(예산의 1/8을 넘지 않음, 더 큰 레코드는 혼자 한 세그먼트)
+#define DISK_QUEUE_MAX (32 << 20)           // 쓰기 큐에 쌓아 둘 최대 바이트(넘으면 버림)
+
+typedef struct disk_seg disk_seg_t;
+
+// 받는 중인 응답을 곧장 쓰는 임시 파일([레코드 헤더][키]는 열 때 써 둠). 응답 바이트는 fd의 현재 위치에 이어 씀
+// - 여는 쪽과 쓰기 큐가 참조를 하나씩 가짐(마지막 참조가 fd를 닫고, 세그먼트로 들이지 못한 파일은 지움)
+typedef struct {
+    int fd;            // 임시 파일(따라 읽는 쪽은 off부터 sendfile)
+    off_t off;         // 응답 바이트 시작 위치
+    size_t size;       // 응답 바이트 수(Content-Length로 미리 앎)
+    size_t head_len;   // 캐시 객체의 head_len과 같음
+    long long expires; // 신선도 만료 시각
+    int revalidate;    // 검증자가 있음(만료돼도 버리지 않고 재검증)
+    char *key;
+    char *path;        // 임시 파일 경로
+    atomic_int refs;
+    int adopted;       // 세그먼트로 들였는지(쓰기 스레드만 바꿈)
+} disk_stream_t;
+
+// 디스크 HIT: 세그먼트에 참조를 하나 올린 채로 돌려줌(다 보내면 disk_release)
+typedef struct {
+    disk_seg_t *seg;       // 소속 세그먼트
+    int fd;                // 세그먼트 파일(sendfile 원본)
+    off_t off;             // 응답 바이트 시작 위치
+    size_t size;           // 응답 바이트 수
+    size_t head_len;       // 캐시 객체의 head_len과 같음(0이면 헤더를 해석하지 못한 원본)
+    unsigned char chunked; // 본문이 chunked
+    unsigned char unsized; // 길이 헤더 없이 EOF로 끝난 응답
+    unsigned char stale;   // 신선도가 지났지만 검증자가 있음(조건부 요청으로 재검증한 뒤에 보낼 것)
+} disk_obj_t;
+
+// 통계(SIGUSR1 출력용)
+typedef struct {
+    unsigned long long hits;        // 디스크 HIT(메모리 MISS 뒤 조회)
+    unsigned long long misses;      // 디스크에도 없음
+    unsigned long long writes;      // 기록한 레코드 수
+    unsigned long long write_bytes; // 기록한 바이트
+    unsigned long long dropped;     // 큐가 넘치거나 쓰기에 실패해 버린 객체 수
+    unsigned long long purged;      // 예산 때문에 지운 세그먼트 수
+    unsigned long long expired;     // 조회 때 신선도가 지나 인덱스에서 뺀 항목 수(MISS에도 포함)
+    unsigned long long stale;       // 신선도가 지났지만 검증자가 있어 재검증하도록 돌려준 수(HIT/MISS와 따로)
+    unsigned long long refreshed;   // 재검증(304) 뒤 새 헤더로 다시 쓴 레코드 수
+    size_t bytes;                   // 현재 세그먼트 파일 크기 합
+    size_t entries;                 // 인덱스 항목 수
+    size_t segments;                // 세그먼트 수
+    size_t queued;                  // 쓰기 대기 바이트
+    size_t streaming;               // 받는 중인 임시 파일 바이트(예산 밖, 세그먼트로 들이면 bytes로 옮김)
+} disk_stats_t;
+
+// dir의 세그먼트로 인덱스를 다시 세우고 쓰기 스레드를 띄움(dir이 없으면 만듦). 실패 시 -1
+int disk_init(const char *dir, size_t budget, size_t max_object);
+// 완성된 캐시 객체를 쓰기 큐에 넣음(참조를 하나 올려 보관, 자리가 없으면 버림). 캐시 방출 훅으로도 씀
+// - Vary 표시 객체, 압축본, 신선도가 이미 지난 객체는 넣지 않음. 만료 시각은 레코드에 함께 기록
+void disk_offer(const char *key, cache_obj_t *obj);
+// 크기 size인 응답을 받는 대로 임시 파일에 쓰기 시작(객체 한도 안이고 받는 중인 파일 합이 예산 안일 때). 못 하면 NULL
+disk_stream_t *disk_stream_open(const char *key, size_t size, size_t head_len, long long expires, int revalidate);
+// size바이트를 다 쓴 임시 파일을 쓰기 큐에 넘김(참조를 하나 올려 보관). 받다 실패했으면 부르지 않고 닫기만 함
+void disk_stream_commit(disk_stream_t *st);
+// 참조 반납. 마지막이면 fd를 닫고, 세그먼트로 들이지 못한 임시 파일은 지움
+void disk_stream_close(disk_stream_t *st);
+// key 조회. HIT = 1(out 채움, 세그먼트 pin), MISS = 0(디스크 계층이 꺼져 있어도 0)
+// - 신선도가 지난 항목은 검증자가 있으면 out->stale = 1로 돌려주고, 없으면 인덱스에서 빼고 MISS
+int disk_get(const char *key, disk_obj_t *out);
+// 재검증(304)한 레코드 d를 새 헤더 줄 head(빈 줄 제외)와 만료 시각으로 다시 쓰도록 쓰기 큐에 넣음
+// - 본문은 d의 세그먼트에서 복사하므로 그때까지 세그먼트에 참조를 하나 더 올려 둠. 그사이 key가 다른 레코드로
+//   바뀌었으면 다시 쓴 레코드는 인덱스에 올리지 않음
+void disk_refresh(const char *key, const disk_obj_t *d, const char *head, size_t head_len, long long expires);
+// 더는 저장할 수 없게 된 레코드 d를 인덱스에서 뺌(key가 이미 다른 레코드를 가리키면 그대로 둠)
+void disk_remove(const char *key, const disk_obj_t *d);
+// disk_get으로 얻은 세그먼트 참조 반납
+void disk_release(disk_obj_t *d);
+void disk_get_stats(disk_stats_t *out);
@@ -0,0 +1,345 @@
+#include "dns.h"
+#include <ctype.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DNS_BUCKETS 256 // 이름 해시 버킷 수
+
+// 결과를 기다리는 쪽 하나
+// - 비동기(notify_fd >= 0): 힙에 두고, 완료 시 out을 채운 뒤 notify_fd로 token을 보내고 해제
+// - 블로킹(notify_fd < 0): 호출자 스택에 두고, 완료 시 out을 채우고 done을 세운 뒤 done_cond로 깨움
+typedef struct dns_waiter {
+    dns_result_t *out;
+    int notify_fd;
+    void *token;
+    int done;
+    struct dns_waiter *next;
+} dns_waiter_t;
+
+// 캐시 항목(이름 하나)
+typedef struct dns_entry {
+    char *host;
+    int pending;             // 해석 스레드가 처리 중(또는 큐에서 대기 중)
+    long long expires_ms;    // 결과 유효 시각(단조 시계)
+    dns_result_t res;        // 마지막 결과(n == 0이면 음성)
+    dns_waiter_t *waiters;   // 결과를 기다리는 쪽
+    struct dns_entry *next;  // 버킷 체인
+    struct dns_entry *qnext; // 해석 큐 링크
+} dns_entry_t;
+
+static pthread_mutex_t dns_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER; // 해석 큐에 일이 생김
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;  // 어떤 해석이든 끝남(블로킹 대기자 깨움)
+static dns_entry_t *buckets[DNS_BUCKETS];
+static dns_entry_t *queue_head, *queue_tail; // 해석 대기 큐(FIFO)
+static int pos_ttl = DNS_DEFAULT_TTL;        // 초
+static int neg_ttl = DNS_DEFAULT_NEG_TTL;    // 초
+static size_t nentries;
+static dns_stats_t stats;
+
+static long long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static long long now_ms(void) {
+    return now_us() / 1000;
+}
+
+// 대소문자를 무시한 FNV-1a(DNS 이름은 대소문자 구분 없음)
+static unsigned bucket_of(const char *host) {
+    unsigned h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)host; *p; p++)
+        h = (h ^ (unsigned)tolower(*p)) * 16777619u;
+    return h % DNS_BUCKETS;
+}
+
+static dns_entry_t *find_entry(const char *host) {
+    for (dns_entry_t *e = buckets[bucket_of(host)]; e; e = e->next)
+        if (!strcasecmp(e->host, host))
+            return e;
+    return NULL;
+}
+
+static void unlink_entry(dns_entry_t *e) {
+    dns_entry_t **pp = &buckets[bucket_of(e->host)];
+    while (*pp != e)
+        pp = &(*pp)->next;
+    *pp = e->next;
+    nentries--;
+    free(e->host);
+    free(e);
+}
+
+// 항목 수가 상한에 닿으면 한 번 훑어 만료된 항목을 비우고, 만료된 것이 없으면 진행 중이 아닌 항목 중
+// 가장 먼저 만료될 하나만 비움(이름이 몰려 들어와도 캐시 전체가 한꺼번에 비지 않게)(dns_lock 보유)
+static void make_room(long long now) {
+    if (nentries < DNS_MAX_ENTRIES)
+        return;
+    dns_entry_t *victim = NULL;
+    for (int b = 0; b < DNS_BUCKETS; b++) {
+        for (dns_entry_t *e = buckets[b], *next; e; e = next) {
+            next = e->next;
+            if (e->pending)
+                continue;
+            if (e->expires_ms <= now)
+                unlink_entry(e);
+            else if (!victim || e->expires_ms < victim->expires_ms)
+                victim = e;
+        }
+    }
+    if (nentries >= DNS_MAX_ENTRIES && victim)
+        unlink_entry(victim);
+}
+
+// 새 항목을 만들어 해석 큐에 넣음(dns_lock 보유)
+static dns_entry_t *enqueue(const char *host, dns_entry_t *e) {
+    if (!e) {
+        make_room(now_ms());
+        e = calloc(1, sizeof(*e));
+        if (!e || !(e->host = strdup(host))) {
+            free(e);
+            return NULL;
+        }
+        unsigned b = bucket_of(host);
+        e->next = buckets[b];
+        buckets[b] = e;
+        nentries++;
+    }
+    e->pending = 1;
+    e->qnext = NULL;
+    if (queue_tail)
+        queue_tail->qnext = e;
+    else
+        queue_head = e;
+    queue_tail = e;
+    pthread_cond_signal(&queue_cond);
+    return e;
+}
+
+// 캐시에서 유효한 결과를 찾음: 1(out 채움), 0(해석이 필요하거나 진행 중, *ep에 항목), -1(메모리 부족)
+// (dns_lock 보유)
+static int lookup_locked(const char *host, dns_result_t *out, dns_entry_t **ep) {
+    dns_entry_t *e = find_entry(host);
+    if (e && !e->pending && e->expires_ms > now_ms()) {
+        *out = e->res;
+        stats.hits++;
+        if (e->res.n == 0)
+            stats.neg_hits++;
+        return 1;
+    }
+    stats.misses++;
+    if (!e || !e->pending) // 처음이거나 만료: 새로 해석(진행 중이면 그 해석에 합류)
+        e = enqueue(host, e);
+    *ep = e;
+    return e ? 0 : -1;
+}
+
+// getaddrinfo 결과를 주소 목록으로 복사(포트는 connect 직전에 붙임)
+// - happy eyeballs(RFC 8305 4절): getaddrinfo가 준 선호 순서는 유지하되 첫 주소의 계열부터 IPv6/IPv4를 번갈아 배치
+//   (한쪽 계열이 통째로 막혀 있어도 두 번째 시도에서 다른 계열로 넘어감)
+static void fill_result(struct addrinfo *list, dns_result_t *res) {
+    struct addrinfo *fam[2][DNS_MAX_ADDRS]; // [0]: 첫 주소와 같은 계열, [1]: 다른 계열
+    int cnt[2] = {0, 0};
+    int first = AF_UNSPEC;
+    for (struct addrinfo *p = list; p; p = p->ai_next) {
+        if ((p->ai_family != AF_INET && p->ai_family != AF_INET6) || p->ai_addrlen > sizeof(struct sockaddr_storage))
+            continue;
+        if (first == AF_UNSPEC)
+            first = p->ai_family;
+        int k = p->ai_family != first;
+        if (cnt[k] < DNS_MAX_ADDRS)
+            fam[k][cnt[k]++] = p;
+    }
+    res->n = 0;
+    for (int i = 0; res->n < DNS_MAX_ADDRS && (i < cnt[0] || i < cnt[1]); i++) {
+        for (int k = 0; k < 2 && res->n < DNS_MAX_ADDRS; k++) {
+            if (i >= cnt[k])
+                continue;
+            dns_addr_t *a = &res->addr[res->n++];
+            a->family = fam[k][i]->ai_family;
+            a->addrlen = fam[k][i]->ai_addrlen;
+            memcpy(&a->addr, fam[k][i]->ai_addr, fam[k][i]->ai_addrlen);
+        }
+    }
+}
+
+// IP 주소 문자열이면 해석 스레드/캐시를 거치지 않고 바로 채움(AI_NUMERICHOST는 네트워크 조회를 하지 않음)
+static int numeric_host(const char *host, dns_result_t *out) {
+    struct addrinfo hints, *list = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICHOST;
+    if (getaddrinfo(host, NULL, &hints, &list) != 0)
+        return 0;
+    fill_result(list, out);
+    freeaddrinfo(list);
+    return out->n > 0;
+}
+
+// 해석 스레드: 큐에서 이름을 꺼내 getaddrinfo(락 밖에서) 후 결과를 기록하고 기다리던 쪽에 알림
+static void *resolver_main(void *arg) {
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&dns_lock);
+        while (!queue_head)
+            pthread_cond_wait(&queue_cond, &dns_lock);
+        dns_entry_t *e = queue_head;
+        queue_head = e->qnext;
+        if (!queue_head)
+            queue_tail = NULL;
+        char *host = strdup(e->host); // 항목은 pending 동안 지워지지 않지만 락 밖에서 쓰므로 복사
+        pthread_mutex_unlock(&dns_lock);
+
+        struct addrinfo hints, *list = NULL;
+        dns_result_t res = {.n = 0};
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_ADDRCONFIG;
+        long long t0 = now_us();
+        if (host && getaddrinfo(host, NULL, &hints, &list) == 0) {
+            fill_result(list, &res);
+            freeaddrinfo(list);
+        }
+        long long t1 = now_us();
+        unsigned long long us = (unsigned long long)(t1 - t0);
+        free(host);
+
+        pthread_mutex_lock(&dns_lock);
+        stats.resolves++;
+        stats.failures += res.n == 0;
+        stats.resolve_us += us;
+        if (us > stats.resolve_us_max)
+            stats.resolve_us_max = us;
+        e->res = res;
+        e->pending = 0;
+        e->expires_ms = t1 / 1000 + (long long)(res.n ? pos_ttl : neg_ttl) * 1000;
+        dns_waiter_t *w = e->waiters, *async = NULL;
+        e->waiters = NULL;
+        while (w) { // 블로킹 대기자는 락 안에서 완료 표시, 비동기 대기자는 락 밖에서 통지
+            dns_waiter_t *next = w->next;
+            *w->out = res;
+            if (w->notify_fd < 0) {
+                w->done = 1;
+            } else {
+                w->next = async;
+                async = w;
+            }
+            w = next;
+        }
+        if (e->expires_ms <= t1 / 1000) // TTL 0: 보관하지 않음
+            unlink_entry(e);
+        pthread_cond_broadcast(&done_cond);
+        pthread_mutex_unlock(&dns_lock);
+
+        // 통지 파이프가 가득 차 막히더라도 dns_lock을 잡고 있지 않으므로 이벤트 루프가 비우며 진행 가능
+        while (async) {
+            dns_waiter_t *next = async->next;
+            ssize_t wr;
+            do {
+                wr = write(async->notify_fd, &async->token, sizeof(async->token));
+            } while (wr < 0 && errno == EINTR);
+            free(async);
+            async = next;
+        }
+    }
+    return NULL;
+}
+
+int dns_init(int ttl_sec, int neg_ttl_sec, int threads) {
+    pos_ttl = ttl_sec;
+    neg_ttl = neg_ttl_sec;
+    for (int i = 0; i < threads; i++) {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, resolver_main, NULL) != 0)
+            return -1;
+        pthread_detach(tid);
+    }
+    return 0;
+}
+
+int dns_resolve(const char *host, dns_result_t *out) {
+    dns_entry_t *e;
+    if (numeric_host(host, out))
+        return 0;
+    pthread_mutex_lock(&dns_lock);
+    int rc = lookup_locked(host, out, &e);
+    if (rc != 0) {
+        pthread_mutex_unlock(&dns_lock);
+        return (rc > 0 && out->n > 0) ? 0 : -1;
+    }
+    dns_waiter_t w = {.out = out, .notify_fd = -1, .next = e->waiters};
+    e->waiters = &w;
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline); // pthread_cond_timedwait 기본 시계
+    deadline.tv_sec += DNS_WAIT_MS / 1000;
+    deadline.tv_nsec += (long)(DNS_WAIT_MS % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    while (!w.done) {
+        if (pthread_cond_timedwait(&done_cond, &dns_lock, &deadline) == ETIMEDOUT && !w.done) {
+            // 포기: 아직 대기 목록에 있으므로(해석 스레드가 완료하면 목록째 비움) 스스로 빠짐
+            dns_waiter_t **pp = &e->waiters;
+            while (*pp != &w)
+                pp = &(*pp)->next;
+            *pp = w.next;
+            stats.timeouts++;
+            out->n = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&dns_lock);
+    return out->n > 0 ? 0 : -1;
+}
+
+int dns_resolve_async(const char *host, dns_result_t *out, int notify_fd, void *token) {
+    dns_entry_t *e;
+    if (numeric_host(host, out))
+        return DNS_OK;
+    pthread_mutex_lock(&dns_lock);
+    int rc = lookup_locked(host, out, &e);
+    if (rc != 0) {
+        pthread_mutex_unlock(&dns_lock);
+        return (rc > 0 && out->n > 0) ? DNS_OK : DNS_FAIL;
+    }
+    dns_waiter_t *w = malloc(sizeof(*w));
+    if (!w) {
+        pthread_mutex_unlock(&dns_lock);
+        return DNS_FAIL;
+    }
+    w->out = out;
+    w->notify_fd = notify_fd;
+    w->token = token;
+    w->done = 0;
+    w->next = e->waiters;
+    e->waiters = w;
+    pthread_mutex_unlock(&dns_lock);
+    return DNS_PENDING;
+}
+
+socklen_t dns_sockaddr(const dns_addr_t *a, int port, struct sockaddr_storage *ss) {
+    memcpy(ss, &a->addr, a->addrlen);
+    if (a->family == AF_INET6)
+        ((struct sockaddr_in6 *)ss)->sin6_port = htons((unsigned short)port);
+    else
+        ((struct sockaddr_in *)ss)->sin_port = htons((unsigned short)port);
+    return a->addrlen;
+}
+
+void dns_get_stats(dns_stats_t *out) {
+    pthread_mutex_lock(&dns_lock);
+    *out = stats;
+    out->entries = nentries;
+    pthread_mutex_unlock(&dns_lock);
+}
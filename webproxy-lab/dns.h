@@ -0,0 +1,58 @@
+// 원서버 이름 해석 캐시 + 해석 전용 스레드 풀
+// - 호스트 이름별로 getaddrinfo 결과(주소 목록)를 TTL 동안 보관하고, 실패도 짧은 TTL로 보관(음성 캐시)
+// - 실제 getaddrinfo는 해석 스레드들만 호출. 같은 이름을 동시에 찾는 요청은 진행 중인 해석 하나에 합류
+// - 블로킹 모델(thread/pool)은 dns_resolve로 결과를 기다리고(상한 DNS_WAIT_MS),
+//   이벤트 루프는 dns_resolve_async로 접수만 한 뒤 완료 통지(notify_fd로 token 포인터)를 받아 이어감
+// - IP 주소 문자열은 캐시/해석 스레드를 거치지 않고 바로 돌려줌
+// - getaddrinfo는 레코드의 TTL을 알려주지 않으므로 TTL은 설정값(-d/-e)을 씀
+#pragma once
+#include <stddef.h>
+#include <sys/socket.h>
+
+#define DNS_DEFAULT_TTL 60      // 성공한 해석을 보관할 시간(초), 0이면 캐시하지 않음(해석 스레드와 합류는 유지)
+#define DNS_DEFAULT_NEG_TTL 5   // 실패한 해석을 보관할 시간(초)
+#define DNS_DEFAULT_THREADS 4   // 해석 스레드 수
+#define DNS_MAX_ADDRS 8         // 이름 하나에서 보관할 최대 주소 수
+#define DNS_MAX_ENTRIES 4096    // 캐시할 최대 이름 수
+#define DNS_WAIT_MS 10000       // 블로킹 대기 상한(넘으면 실패 처리, 해석은 계속 진행되어 캐시를 채움)
+
+// dns_resolve_async 반환값
+enum { DNS_FAIL = -1, DNS_OK = 0, DNS_PENDING = 1 };
+
+// 해석된 주소 하나(포트는 비워 두고 connect 직전에 dns_sockaddr로 채움)
+typedef struct {
+    int family;                   // AF_INET / AF_INET6
+    socklen_t addrlen;            // addr 유효 길이
+    struct sockaddr_storage addr; // 주소
+} dns_addr_t;
+
+// 해석 결과. n == 0이면 실패. 주소는 connect 시도 순서(IPv6/IPv4 교차)로 정렬됨
+typedef struct {
+    int n;
+    dns_addr_t addr[DNS_MAX_ADDRS];
+} dns_result_t;
+
+// 통계(SIGUSR1 출력용)
+typedef struct {
+    unsigned long long hits;     // 유효한 캐시 항목으로 바로 답한 횟수(음성 포함)
+    unsigned long long neg_hits; // 그중 음성 캐시(실패 기억) 적중
+    unsigned long long misses;   // 해석을 기다려야 했던 횟수(진행 중인 해석에 합류 포함)
+    unsigned long long resolves; // 실제 getaddrinfo 호출 수
+    unsigned long long failures; // 그중 실패한 수
+    unsigned long long timeouts; // 블로킹 대기 상한을 넘긴 수
+    unsigned long long resolve_us;     // getaddrinfo 누적 소요 시간(us)
+    unsigned long long resolve_us_max; // getaddrinfo 최대 소요 시간(us)
+    size_t entries;              // 현재 캐시 항목 수
+} dns_stats_t;
+
+// 해석 스레드를 띄우고 캐시를 설정. 실패 시 -1
+int dns_init(int ttl_sec, int neg_ttl_sec, int threads);
+// 블로킹 해석: 캐시에 있으면 즉시, 없으면 해석 스레드의 결과를 기다림. 성공 0, 실패 -1
+int dns_resolve(const char *host, dns_result_t *out);
+// 비동기 해석: 캐시에 있으면 out을 채우고 DNS_OK/DNS_FAIL, 없으면 DNS_PENDING
+// - PENDING이면 완료 시 해석 스레드가 out을 채운 뒤 notify_fd에 token(포인터 크기)을 씀
+// - 통지가 올 때까지 out과 token이 가리키는 메모리를 유지해야 함
+int dns_resolve_async(const char *host, dns_result_t *out, int notify_fd, void *token);
+// 주소에 포트를 붙여 connect용 sockaddr를 만듦. 반환: 주소 길이
+socklen_t dns_sockaddr(const dns_addr_t *a, int port, struct sockaddr_storage *ss);
+void dns_get_stats(dns_stats_t *out);
@@ -0,0 +1,224 @@
+#include "flight.h"
+#include <stdlib.h>
+#include <string.h>
+
+static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER; // 표(버킷 체인)와 통계 보호
+static flight_t *buckets[FLIGHT_BUCKETS];
+static flight_stats_t stats;
+
+// 캐시 키 FNV-1a
+static unsigned bucket_of(const char *key) {
+    unsigned h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)key; *p; p++)
+        h = (h ^ *p) * 16777619u;
+    return h % FLIGHT_BUCKETS;
+}
+
+// 팔로워가 off 뒤로 읽을 것이 있는지(f->lock 보유)
+// - 길이를 아는 응답만 자라는 중에 따라 읽고, 나머지는 끝(DONE/FAILED)까지 기다림
+static int ready(const flight_t *f, size_t off) {
+    if (f->state == FLIGHT_DONE || f->state == FLIGHT_FAILED)
+        return 1;
+    return f->state == FLIGHT_STREAM && f->stream && f->avail > off;
+}
+
+// 기다리는 쪽을 모두 깨움(f->lock 보유). 논블로킹 대기자는 한 번 부르고 목록에서 뺌
+static void wake_all(flight_t *f) {
+    pthread_cond_broadcast(&f->cond);
+    flight_waiter_t *w = f->waiters;
+    f->waiters = NULL;
+    while (w) {
+        flight_waiter_t *next = w->next;
+        w->armed = 0;
+        w->wake(w->arg);
+        w = next;
+    }
+}
+
+flight_t *flight_join(const char *key, int *leader) {
+    unsigned b = bucket_of(key);
+    pthread_mutex_lock(&table_lock);
+    for (flight_t *f = buckets[b]; f; f = f->next) {
+        if (!strcmp(f->key, key)) {
+            atomic_fetch_add(&f->refs, 1); // 리더가 참조를 쥔 채로만 표에 있으므로 해제 경합 없음
+            stats.followers++;
+            pthread_mutex_unlock(&table_lock);
+            *leader = 0;
+            return f;
+        }
+    }
+    flight_t *f = calloc(1, sizeof(*f));
+    if (!f || !(f->key = strdup(key))) {
+        pthread_mutex_unlock(&table_lock);
+        free(f);
+        return NULL;
+    }
+    pthread_mutex_init(&f->lock, NULL);
+    pthread_cond_init(&f->cond, NULL);
+    f->state = FLIGHT_HEAD;
+    atomic_init(&f->refs, 1);
+    f->registered = 1;
+    f->next = buckets[b];
+    buckets[b] = f;
+    stats.leaders++;
+    stats.active++;
+    pthread_mutex_unlock(&table_lock);
+    *leader = 1;
+    return f;
+}
+
+void flight_head(flight_t *f, size_t head_len, int chunked, int unsized) {
+    pthread_mutex_lock(&f->lock);
+    f->head_len = head_len;
+    f->chunked = (unsigned char)chunked;
+    f->unsized = (unsigned char)unsized;
+    f->stream = head_len > 0 && !chunked && !unsized;
+    f->avail = f->cap.len;
+    f->state = f->cap.abandoned ? FLIGHT_FAILED : FLIGHT_STREAM;
+    wake_all(f);
+    pthread_mutex_unlock(&f->lock);
+}
+
+void flight_fill(flight_t *f, cache_obj_t *obj) {
+    cache_retain(obj);
+    f->obj = obj; // 팔로워는 flight_head(락) 뒤에야 읽으므로 락 없이 설정
+    capbuf_expect_into(&f->cap, obj->data, obj->size);
+}
+
+void flight_stream(flight_t *f, disk_stream_t *st) {
+    f->disk = st;
+    capbuf_expect_file(&f->cap, st->fd, st->size);
+}
+
+void flight_publish(flight_t *f) {
+    // 따라 읽는 팔로워가 없으면 건너뜀(나중에 붙은 팔로워는 flight_head/flight_end 또는 다음 publish에서 따라잡음)
+    if (atomic_load(&f->refs) == 1)
+        return;
+    pthread_mutex_lock(&f->lock);
+    if (f->state == FLIGHT_STREAM) {
+        f->avail = f->cap.len;
+        if (f->cap.abandoned)
+            f->state = FLIGHT_FAILED;
+        if (f->stream || f->state == FLIGHT_FAILED)
+            wake_all(f);
+    }
+    pthread_mutex_unlock(&f->lock);
+}
+
+void flight_end(flight_t *f, int ok) {
+    if (!f->registered) // registered는 리더만 바꾸므로 락 없이 확인
+        return;
+    pthread_mutex_lock(&f->lock);
+    ok = ok && !f->cap.abandoned && f->state == FLIGHT_STREAM;
+    pthread_mutex_unlock(&f->lock);
+    // 채우던 캐시 객체: 표에서 빠지기 전에 완성 표시(그 뒤로 조회한 요청은 바로 HIT), 실패면 캐시에서 거둠
+    if (f->obj) {
+        if (ok && f->cap.len == f->obj->size)
+            atomic_store_explicit(&f->obj->filling, 0, memory_order_release);
+        else {
+            ok = 0;
+            cache_remove_obj(f->key, f->obj);
+        }
+    } else if (f->disk && f->cap.len != f->disk->size) {
+        ok = 0; // 임시 파일을 다 채우지 못함(팔로워에게 잘린 응답을 끝까지 보내지 않음)
+    }
+
+    pthread_mutex_lock(&table_lock);
+    flight_t **pp = &buckets[bucket_of(f->key)];
+    while (*pp != f)
+        pp = &(*pp)->next;
+    *pp = f->next;
+    f->registered = 0;
+    stats.active--;
+    if (!ok && atomic_load(&f->refs) > 1)
+        stats.failed++;
+    pthread_mutex_unlock(&table_lock);
+
+    pthread_mutex_lock(&f->lock);
+    f->avail = f->cap.len;
+    f->state = ok ? FLIGHT_DONE : FLIGHT_FAILED;
+    wake_all(f);
+    pthread_mutex_unlock(&f->lock);
+}
+
+void flight_release(flight_t *f) {
+    if (atomic_fetch_sub(&f->refs, 1) != 1)
+        return;
+    capbuf_free(&f->cap);
+    cache_release(f->obj);
+    if (f->disk)
+        disk_stream_close(f->disk);
+    pthread_mutex_destroy(&f->lock);
+    pthread_cond_destroy(&f->cond);
+    free(f->key);
+    free(f);
+}
+
+flight_state_t flight_wait(flight_t *f, size_t off, size_t *avail) {
+    pthread_mutex_lock(&f->lock);
+    while (!ready(f, off))
+        pthread_cond_wait(&f->cond, &f->lock);
+    flight_state_t st = f->state;
+    *avail = f->avail;
+    pthread_mutex_unlock(&f->lock);
+    return st;
+}
+
+int flight_poll(flight_t *f, size_t off, flight_state_t *st, size_t *avail, flight_waiter_t *w) {
+    pthread_mutex_lock(&f->lock);
+    int r = ready(f, off);
+    if (r) {
+        *st = f->state;
+        *avail = f->avail;
+    } else if (!w->armed) {
+        w->armed = 1;
+        w->next = f->waiters;
+        f->waiters = w;
+    }
+    pthread_mutex_unlock(&f->lock);
+    return r;
+}
+
+void flight_unwait(flight_t *f, flight_waiter_t *w) {
+    pthread_mutex_lock(&f->lock);
+    if (w->armed) {
+        flight_waiter_t **pp = &f->waiters;
+        while (*pp != w)
+            pp = &(*pp)->next;
+        *pp = w->next;
+        w->armed = 0;
+    }
+    pthread_mutex_unlock(&f->lock);
+}
+
+// 리더가 청크를 이어붙이는 동안에도 읽을 수 있도록 공개된 범위(end 이전)만 따라감
+// - capbuf는 앞 청크를 가득 채운 뒤에만 다음 청크를 이으므로, end를 넘지 않는 한 청크 용량(cap)이 곧 채운 길이
+//   (리더가 고치는 중일 수 있는 마지막 청크의 len은 읽지 않음)
+int flight_iov(const flight_t *f, size_t off, size_t end, struct iovec *iov, int max, size_t *bytes) {
+    int n = 0;
+    size_t pos = 0;
+    *bytes = 0;
+    if (f->obj) { // 캐시 객체에 채우는 중: 연속된 한 덩어리
+        if (off >= end || max < 1)
+            return 0;
+        iov[0] = (struct iovec){f->obj->data + off, end - off};
+        *bytes = end - off;
+        return 1;
+    }
+    for (const capbuf_chunk_t *c = f->cap.head; c && pos < end && n < max; c = c->next) {
+        size_t clen = pos + c->cap < end ? c->cap : end - pos;
+        if (pos + clen > off) {
+            size_t skip = off > pos ? off - pos : 0;
+            iov[n++] = (struct iovec){(void *)(c->data + skip), clen - skip};
+            *bytes += clen - skip;
+        }
+        pos += clen;
+    }
+    return n;
+}
+
+void flight_get_stats(flight_stats_t *out) {
+    pthread_mutex_lock(&table_lock);
+    *out = stats;
+    pthread_mutex_unlock(&table_lock);
+}
@@ -0,0 +1,94 @@
+// 같은 캐시 키에 대한 동시 MISS를 원서버 요청 하나로 합치는 진행 중 요청 표(single-flight)
+// - 캐시 MISS인 첫 요청(리더)이 flight를 등록하고, 원서버 응답을 flight의 캐시 후보 버퍼(cap)에 누적
+//   (캐시 객체와 같은 형식: 연결 관리 헤더를 뗀 헤더 줄 + 빈 줄 + 본문)
+// - 같은 키로 뒤이어 MISS 난 요청(팔로워)은 원서버로 가지 않고 리더가 채우는 버퍼를 따라 읽어 보냄
+//   - 길이를 아는 응답(Content-Length/본문 없음): 헤더가 오는 즉시 자라는 버퍼를 스트리밍
+//   - chunked/EOF 응답: 한도를 넘으면 도중에 누적을 포기할 수 있으므로 끝까지 채워진 뒤 한 번에 보냄
+//   - 캐시하지 않을 응답(한도 초과 등)이거나 리더가 실패하면 FAILED: 아직 아무것도 보내지 않은 팔로워는
+//     직접 원서버로 가고, 이미 보내던 팔로워는 연결을 닫음(Content-Length로 잘림이 드러남)
+// - 리더는 캐시 삽입 뒤 flight를 표에서 빼므로 그 뒤에 온 요청은 캐시 HIT
+// - 버퍼는 참조 카운트로 보호: 리더가 끝난 뒤에도 마지막 팔로워가 놓을 때 청크를 반납
+// - 크기를 아는 응답은 청크 대신 "채우는 중"으로 캐시에 먼저 넣은 객체(obj)에 바로 채움(flight_fill)
+//   완성되면 그 객체가 그대로 캐시 HIT가 되고(복사 없음), 실패하면 캐시에서 거둠
+// - 메모리 객체 한도를 넘어 디스크 계층으로 갈 응답은 메모리 대신 디스크 계층 임시 파일에 채우고(flight_stream),
+//   팔로워는 그 파일에서 sendfile로 따라 읽음
+#pragma once
+#include "cache.h"
+#include "capbuf.h"
+#include "disk.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <sys/uio.h>
+
+#define FLIGHT_BUCKETS 256 // 진행 중 요청 표의 해시 버킷 수
+
+typedef enum {
+    FLIGHT_HEAD,   // 리더가 응답 헤더를 기다리는 중
+    FLIGHT_STREAM, // 헤더를 받았고 본문이 자라는 중
+    FLIGHT_DONE,   // 응답을 끝까지 받음(avail이 전체 크기)
+    FLIGHT_FAILED, // 리더가 실패했거나 캐시하지 않을 응답
+} flight_state_t;
+
+// 논블로킹 팔로워(이벤트 루프)의 깨움 요청. 읽을 것이 생기면 한 번 호출되고 해제됨(다시 기다리려면 재등록)
+// - wake는 flight 락 안에서 호출되므로 짧고 막히지 않아야 함
+typedef struct flight_waiter {
+    void (*wake)(void *arg);
+    void *arg;
+    struct flight_waiter *next;
+    int armed; // 대기 목록에 들어 있는지
+} flight_waiter_t;
+
+typedef struct flight {
+    capbuf_t cap;            // 리더가 채우는 응답 바이트(cap.owner = 이 flight, 포기해도 청크는 해제 때 반납)
+    pthread_mutex_t lock;    // 아래 상태 보호
+    pthread_cond_t cond;     // 블로킹 팔로워 깨움
+    flight_state_t state;    // 진행 단계
+    size_t avail;            // 팔로워가 읽어도 되는 앞쪽 바이트 수
+    size_t head_len;         // 헤더 줄 길이(캐시 객체의 head_len, 0이면 헤더를 해석하지 못한 원본)
+    unsigned char chunked;   // 본문이 chunked(HTTP/1.0 클라이언트에는 보낼 수 없음)
+    unsigned char unsized;   // 길이 헤더 없이 EOF로 끝나는 응답
+    unsigned char stream;    // 다 채워지기 전에 따라 읽어도 되는지(길이를 아는 응답)
+    flight_waiter_t *waiters; // 논블로킹 팔로워 대기 목록
+    cache_obj_t *obj;        // 채우는 중인 캐시 객체(참조 1개 보유, 없으면 NULL). 있으면 cap이 obj->data에 씀
+    disk_stream_t *disk;     // 채우는 중인 디스크 계층 임시 파일(참조 1개 보유, 없으면 NULL). 있으면 cap이 disk->fd에 씀
+    atomic_int refs;         // 리더 1 + 팔로워 수
+    int registered;          // 표에 들어 있는지(리더가 끝내면 빠짐)
+    char *key;               // 캐시 키
+    struct flight *next;     // 표 버킷 체인
+} flight_t;
+
+// 통계(SIGUSR1 출력용)
+typedef struct {
+    unsigned long long leaders;   // 원서버로 간 MISS(flight 생성) 수
+    unsigned long long followers; // 리더에 붙어 원서버 요청을 아낀 MISS 수
+    unsigned long long failed;    // 팔로워가 붙은 채 FAILED로 끝난 flight 수
+    size_t active;                // 현재 진행 중인 flight 수
+} flight_stats_t;
+
+// key에 대한 진행 중 flight에 참조를 올려 붙거나(팔로워, *leader = 0) 새로 등록(리더, *leader = 1)
+// - NULL이면 메모리 부족: 합치지 않고 직접 원서버로
+flight_t *flight_join(const char *key, int *leader);
+// 리더: 헤더를 cap에 넣은 뒤 호출. 응답 메타데이터를 알리고 팔로워를 깨움(cap을 포기했으면 FAILED)
+void flight_head(flight_t *f, size_t head_len, int chunked, int unsized);
+// 리더: 헤더 전에(flight_head 전) 호출. cap을 obj->data에 채우도록 묶고 참조를 하나 가짐
+// - obj는 filling = 1로 캐시에 넣어 두면, flight_end가 완성 시 filling을 내리고 실패 시 캐시에서 거둠
+void flight_fill(flight_t *f, cache_obj_t *obj);
+// 리더: flight_fill 대신 헤더 전에 호출. cap을 임시 파일 st에 채우도록 묶고 st를 넘겨받음(flight_release 때 닫음)
+void flight_stream(flight_t *f, disk_stream_t *st);
+// 리더: cap이 자랐거나 포기했을 때 호출(따라 읽는 팔로워가 없으면 락 없이 반환)
+void flight_publish(flight_t *f);
+// 리더: 응답이 끝났을 때(캐시 삽입 뒤) 호출. 표에서 빼고 ok면 DONE, 아니면 FAILED. 두 번째 호출부터는 무시
+void flight_end(flight_t *f, int ok);
+// 참조 반납. 마지막이면 버퍼와 함께 해제
+void flight_release(flight_t *f);
+// 블로킹 팔로워: off 뒤로 읽을 것이 생기거나 끝날 때까지 대기. 반환: 상태, *avail: 읽어도 되는 끝
+flight_state_t flight_wait(flight_t *f, size_t off, size_t *avail);
+// 논블로킹 팔로워: 읽을 것이 있으면 1(*st, *avail 채움), 없으면 w를 등록하고 0
+int flight_poll(flight_t *f, size_t off, flight_state_t *st, size_t *avail, flight_waiter_t *w);
+// 등록한 깨움 요청을 취소(이후 w->wake는 호출되지 않음)
+void flight_unwait(flight_t *f, flight_waiter_t *w);
+// 버퍼의 [off, end)를 가리키는 iovec을 최대 max개 채움(복사 없음). 반환: 개수, *bytes: 담은 바이트
+// - 임시 파일에 채우는 flight(disk != NULL)는 iovec 대신 disk->fd의 disk->off + off부터 sendfile로 읽음
+int flight_iov(const flight_t *f, size_t off, size_t end, struct iovec *iov, int max, size_t *bytes);
+void flight_get_stats(flight_stats_t *out);
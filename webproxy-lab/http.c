@@ -0,0 +1,1056 @@
+#include "http.h"
+#include <ctype.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+// 헤더 끝(빈 줄) 다음 위치를 찾는다. "\r\n\r\n"과 "\n\n" 모두 허용, 없으면 0
+static size_t find_head_end(const char *buf, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (buf[i] != '\n')
+            continue;
+        if (i + 1 < len && buf[i + 1] == '\n')
+            return i + 2;
+        if (i + 2 < len && buf[i + 1] == '\r' && buf[i + 2] == '\n')
+            return i + 3;
+    }
+    return 0;
+}
+
+// 한 헤더 줄 [p, end)가 name으로 시작하면 콜론 뒤 공백을 건너뛴 값 시작 위치, 아니면 NULL
+static const char *header_value(const char *p, const char *end, const char *name) {
+    size_t n = strlen(name);
+    if ((size_t)(end - p) <= n || strncasecmp(p, name, n) != 0 || p[n] != ':')
+        return NULL;
+    p += n + 1;
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    return p;
+}
+
+// Connection 값 [v, eol)의 토큰 목록에서 close/keep-alive를 찾아 keep_alive에 반영
+static void connection_tokens(const char *v, const char *eol, int *keep_alive) {
+    for (const char *q = v; q < eol; q++) {
+        if (q + 5 <= eol && !strncasecmp(q, "close", 5))
+            *keep_alive = 0;
+        else if (q + 10 <= eol && !strncasecmp(q, "keep-alive", 10))
+            *keep_alive = 1;
+    }
+}
+
+// 값 [v, eol)에서 줄 끝의 CR/공백을 뗀 끝 위치
+static const char *trim_end(const char *v, const char *eol) {
+    while (eol > v && (eol[-1] == '\r' || eol[-1] == ' ' || eol[-1] == '\t'))
+        eol--;
+    return eol;
+}
+
+// delta-seconds(따옴표 허용). 형식이 틀리면 -1, 아주 큰 값은 2^31로 포화(RFC 9111 1.2.2)
+static long long parse_delta(const char *p, const char *end) {
+    if (p < end && *p == '"')
+        p++;
+    if (p >= end || !isdigit((unsigned char)*p))
+        return -1;
+    long long n = 0;
+    for (; p < end && isdigit((unsigned char)*p); p++)
+        n = n < (1LL << 31) ? n * 10 + (*p - '0') : n;
+    return n < (1LL << 31) ? n : (1LL << 31);
+}
+
+// Cache-Control 값 [v, eol)의 지시자를 cc 비트와 max-age/s-maxage/stale-while-revalidate로(모르는 지시자는 무시)
+// - 필드 이름을 단 private="..."/no-cache="..."도 응답 전체에 적용(보수적으로)
+static void cache_control(const char *v, const char *eol, int *cc, long long *max_age, long long *s_maxage,
+                          long long *swr) {
+    const char *p = v;
+    while (p < eol) {
+        while (p < eol && (*p == ' ' || *p == '\t' || *p == ','))
+            p++;
+        const char *name = p;
+        while (p < eol && *p != '=' && *p != ',' && *p != ' ' && *p != '\t' && *p != '\r')
+            p++;
+        size_t n = (size_t)(p - name);
+        const char *val = p < eol && *p == '=' ? p + 1 : NULL;
+        if (val && val < eol && *val == '"') { // 따옴표 안의 쉼표는 구분자가 아님
+            const char *q = memchr(val + 1, '"', (size_t)(eol - val - 1));
+            p = q ? q + 1 : eol;
+        }
+        while (p < eol && *p != ',')
+            p++;
+#define CC_IS(lit) (n == sizeof(lit) - 1 && !strncasecmp(name, lit, n))
+        if (CC_IS("no-store"))
+            *cc |= HTTP_CC_NO_STORE;
+        else if (CC_IS("no-cache"))
+            *cc |= HTTP_CC_NO_CACHE;
+        else if (CC_IS("private"))
+            *cc |= HTTP_CC_PRIVATE;
+        else if (CC_IS("public"))
+            *cc |= HTTP_CC_PUBLIC;
+        else if (CC_IS("must-revalidate") || CC_IS("proxy-revalidate"))
+            *cc |= HTTP_CC_MUST_REVALIDATE;
+        else if (CC_IS("no-transform"))
+            *cc |= HTTP_CC_NO_TRANSFORM;
+        else if (CC_IS("max-age") && val)
+            *max_age = parse_delta(val, p);
+        else if (CC_IS("s-maxage") && val)
+            *s_maxage = parse_delta(val, p);
+        else if (CC_IS("stale-while-revalidate") && val && swr)
+            *swr = parse_delta(val, p);
+#undef CC_IS
+    }
+}
+
+// Vary 값 [v, end)(줄 끝 공백은 뗀 상태)의 이름들을 소문자로 vary 목록에 덧붙임(여러 줄이면 합침). 넘치거나 *이면 "*"
+static void vary_names(const char *v, const char *end, char *vary) {
+    size_t len = strlen(vary);
+    if (!strcmp(vary, "*"))
+        return;
+    for (const char *p = v; p < end;) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ','))
+            p++;
+        const char *name = p;
+        while (p < end && *p != ',' && *p != ' ' && *p != '\t')
+            p++;
+        size_t n = (size_t)(p - name);
+        if (n == 0)
+            continue;
+        if ((n == 1 && *name == '*') || len + n + 2 > HTTP_VARY_MAX) {
+            strcpy(vary, "*");
+            return;
+        }
+        if (len)
+            vary[len++] = ',';
+        for (size_t i = 0; i < n; i++)
+            vary[len++] = (char)tolower((unsigned char)name[i]);
+        vary[len] = '\0';
+    }
+}
+
+// Content-Type 값 [v, end)가 압축해서 이득인 텍스트 계열인지(text/*, JSON/XML/JavaScript, +json/+xml 구조화 형식)
+static int text_type(const char *v, const char *end) {
+    const char *semi = memchr(v, ';', (size_t)(end - v));
+    end = trim_end(v, semi ? semi : end);
+    size_t n = (size_t)(end - v);
+#define TYPE_IS(lit) (n == sizeof(lit) - 1 && !strncasecmp(v, lit, n))
+#define TYPE_ENDS(lit) (n > sizeof(lit) - 1 && !strncasecmp(end - (sizeof(lit) - 1), lit, sizeof(lit) - 1))
+    return (n > 5 && !strncasecmp(v, "text/", 5)) || TYPE_IS("application/javascript") ||
+           TYPE_IS("application/x-javascript") || TYPE_IS("application/ecmascript") || TYPE_IS("application/json") ||
+           TYPE_IS("application/xml") || TYPE_ENDS("+json") || TYPE_ENDS("+xml");
+#undef TYPE_IS
+#undef TYPE_ENDS
+}
+
+int http_parse_response_head(const char *buf, size_t len, http_response_t *out) {
+    size_t head_len = find_head_end(buf, len);
+    if (!head_len)
+        return 0;
+
+    memset(out, 0, sizeof(*out));
+    out->content_length = -1;
+    out->head_len = head_len;
+    out->max_age = out->s_maxage = out->date = out->expires = out->last_modified = out->swr = -1;
+
+    // 상태줄: "HTTP/x.y SSS ..."
+    if (head_len < 12 || strncmp(buf, "HTTP/", 5) != 0)
+        return -1;
+    const char *sp = memchr(buf, ' ', head_len);
+    if (!sp || !isdigit((unsigned char)sp[1]) || !isdigit((unsigned char)sp[2]) || !isdigit((unsigned char)sp[3]))
+        return -1;
+    out->status = (sp[1] - '0') * 100 + (sp[2] - '0') * 10 + (sp[3] - '0');
+    out->keep_alive = strncmp(buf, "HTTP/1.0", 8) != 0; // 1.1 이상은 기본이 지속 연결
+
+    // 나머지 헤더 줄 순회
+    const char *end = buf + head_len;
+    const char *p = memchr(buf, '\n', head_len) + 1;
+    int text = 0, encoded = 0;
+    while (p < end) {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        const char *eol = nl ? nl : end;
+        const char *v;
+        if ((v = header_value(p, eol, "Content-Length")) != NULL) {
+            char *num_end;
+            long long cl = strtoll(v, &num_end, 10);
+            if (num_end != v && cl >= 0)
+                out->content_length = cl;
+        } else if ((v = header_value(p, eol, "Connection")) != NULL) {
+            connection_tokens(v, eol, &out->keep_alive); // 토큰 목록 중 close/keep-alive만 확인
+        } else if ((v = header_value(p, eol, "Transfer-Encoding")) != NULL) {
+            // 마지막 전송 코딩이 chunked인지만 확인(대소문자 무시)
+            for (const char *q = v; q + 7 <= eol; q++)
+                if (!strncasecmp(q, "chunked", 7))
+                    out->chunked = 1;
+        } else if ((v = header_value(p, eol, "Cache-Control")) != NULL) {
+            cache_control(v, eol, &out->cc, &out->max_age, &out->s_maxage, &out->swr);
+        } else if ((v = header_value(p, eol, "Expires")) != NULL) {
+            long long t = http_parse_date(v, trim_end(v, eol));
+            out->expires = t >= 0 ? t : 0; // "0" 같은 잘못된 값은 이미 만료
+        } else if ((v = header_value(p, eol, "Date")) != NULL) {
+            out->date = http_parse_date(v, trim_end(v, eol));
+        } else if ((v = header_value(p, eol, "Last-Modified")) != NULL) {
+            out->last_modified = http_parse_date(v, trim_end(v, eol));
+        } else if ((v = header_value(p, eol, "Age")) != NULL) {
+            long long a = parse_delta(v, eol);
+            out->age = a > 0 ? a : 0;
+        } else if ((v = header_value(p, eol, "ETag")) != NULL) {
+            const char *e = trim_end(v, eol);
+            if ((size_t)(e - v) < sizeof(out->etag)) {
+                memcpy(out->etag, v, (size_t)(e - v));
+                out->etag[e - v] = '\0';
+            }
+        } else if (header_value(p, eol, "Set-Cookie") != NULL) {
+            out->set_cookie = 1;
+        } else if ((v = header_value(p, eol, "Vary")) != NULL) {
+            vary_names(v, trim_end(v, eol), out->vary);
+        } else if ((v = header_value(p, eol, "Content-Type")) != NULL) {
+            text = text_type(v, eol);
+        } else if ((v = header_value(p, eol, "Content-Encoding")) != NULL) {
+            const char *e = trim_end(v, eol);
+            encoded |= !((size_t)(e - v) == 8 && !strncasecmp(v, "identity", 8));
+        }
+        p = eol + 1;
+    }
+    if (out->chunked) // chunked가 있으면 Content-Length는 무시(RFC 9112 6.3)
+        out->content_length = -1;
+    out->compressible = out->status == 200 && text && !encoded && !(out->cc & HTTP_CC_NO_TRANSFORM);
+    return 1;
+}
+
+size_t http_strip_hop_headers(char *head, size_t head_len) {
+    const char *end = head + head_len;
+    char *nl = memchr(head, '\n', head_len);
+    if (!nl)
+        return head_len;
+    size_t out = (size_t)(nl - head) + 1; // 상태줄은 그대로
+    for (const char *p = nl + 1; p < end;) {
+        const char *e = memchr(p, '\n', (size_t)(end - p));
+        size_t n = e ? (size_t)(e - p) + 1 : (size_t)(end - p);
+        if ((n == 2 && p[0] == '\r') || n == 1) // 빈 줄: 헤더 끝
+            break;
+        if (!header_value(p, p + n, "Connection") && !header_value(p, p + n, "Keep-Alive") &&
+            !header_value(p, p + n, "Proxy-Connection")) {
+            memmove(head + out, p, n); // 앞으로만 당기므로 제자리 압축이 안전
+            out += n;
+        }
+        p += n;
+    }
+    return out;
+}
+
+void http_request_init(http_request_t *req, const char *version) {
+    req->keep_alive = strcmp(version, "HTTP/1.0") != 0;
+    req->has_body = 0;
+    req->cc = 0;
+    req->has_auth = 0;
+    req->conditional = 0;
+    req->has_inm = 0;
+    req->if_none_match[0] = '\0';
+    req->if_modified_since = -1;
+    req->range[0] = '\0';
+    req->if_range[0] = '\0';
+    req->accept_enc = 0;
+}
+
+// Accept-Encoding 값 [v, eol)에서 받아들이는 코딩(HTTP_ENC_*). q=0인 코딩은 빼고, *는 따로 적지 않은 코딩 전부
+static int accept_encoding(const char *v, const char *eol) {
+    int yes = 0, no = 0, star = 0;
+    for (const char *p = v; p < eol;) {
+        while (p < eol && (*p == ' ' || *p == '\t' || *p == ','))
+            p++;
+        const char *name = p;
+        while (p < eol && *p != ',' && *p != ';' && *p != ' ' && *p != '\t' && *p != '\r')
+            p++;
+        size_t n = (size_t)(p - name);
+        const char *next = memchr(p, ',', (size_t)(eol - p));
+        const char *end = next ? next : eol;
+        const char *q = p; // 매개변수 중 q=
+        while (q + 2 < end && !((*q == 'q' || *q == 'Q') && q[1] == '='))
+            q++;
+        int zero = 0; // q=0, q=0.000 ...
+        if (q + 2 < end && q[2] == '0') {
+            zero = 1;
+            for (q += 3; q < end && (*q == '.' || isdigit((unsigned char)*q)); q++)
+                zero &= *q == '.' || *q == '0';
+        }
+        int bit = 0;
+        if ((n == 4 && !strncasecmp(name, "gzip", 4)) || (n == 6 && !strncasecmp(name, "x-gzip", 6)))
+            bit = HTTP_ENC_GZIP;
+        else if (n == 2 && !strncasecmp(name, "br", 2))
+            bit = HTTP_ENC_BR;
+        if (n == 1 && *name == '*')
+            star = !zero;
+        else if (zero)
+            no |= bit;
+        else
+            yes |= bit;
+        p = end;
+    }
+    return (yes | (star ? HTTP_ENC_GZIP | HTTP_ENC_BR : 0)) & ~no;
+}
+
+void http_request_header(http_request_t *req, const char *line, size_t n) {
+    const char *eol = n && line[n - 1] == '\n' ? line + n - 1 : line + n; // 값 끝에서 CR은 trim_end가 뗌
+    const char *v;
+    // 프록시로 보낸 요청이므로 Proxy-Connection도 연결 관리 헤더로 취급(구형 클라이언트)
+    if ((v = header_value(line, eol, "Connection")) != NULL || (v = header_value(line, eol, "Proxy-Connection")) != NULL)
+        connection_tokens(v, eol, &req->keep_alive);
+    else if ((v = header_value(line, eol, "Transfer-Encoding")) != NULL)
+        req->has_body = 1;
+    else if ((v = header_value(line, eol, "Content-Length")) != NULL)
+        req->has_body |= strtoll(v, NULL, 10) != 0;
+    else if ((v = header_value(line, eol, "Cache-Control")) != NULL) {
+        long long max_age = -1, s_maxage = -1;
+        cache_control(v, eol, &req->cc, &max_age, &s_maxage, NULL);
+        if (max_age == 0) // 신선한 사본도 받지 않겠다는 뜻(브라우저 새로고침)
+            req->cc |= HTTP_CC_NO_CACHE;
+    } else if ((v = header_value(line, eol, "Pragma")) != NULL) {
+        for (const char *q = v; q + 8 <= eol; q++)
+            if (!strncasecmp(q, "no-cache", 8))
+                req->cc |= HTTP_CC_NO_CACHE;
+    } else if (header_value(line, eol, "Authorization") != NULL) {
+        req->has_auth = 1;
+    } else if ((v = header_value(line, eol, "If-None-Match")) != NULL) {
+        req->conditional = req->has_inm = 1;
+        const char *e = trim_end(v, eol);
+        size_t len = strlen(req->if_none_match);
+        size_t n = (size_t)(e - v);
+        if (len + n + 2 <= sizeof(req->if_none_match)) { // 넘치는 줄은 버림(맞는 ETag가 줄어 200을 보낼 뿐)
+            if (len)
+                req->if_none_match[len++] = ',';
+            memcpy(req->if_none_match + len, v, n);
+            req->if_none_match[len + n] = '\0';
+        }
+    } else if ((v = header_value(line, eol, "If-Modified-Since")) != NULL) {
+        req->conditional = 1;
+        req->if_modified_since = http_parse_date(v, trim_end(v, eol)); // 해석할 수 없는 날짜는 무시
+    } else if ((v = header_value(line, eol, "Range")) != NULL) {
+        size_t len = (size_t)(trim_end(v, eol) - v);
+        if (len < sizeof(req->range)) { // 너무 긴 값은 무시(전체 응답)
+            memcpy(req->range, v, len);
+            req->range[len] = '\0';
+        }
+    } else if ((v = header_value(line, eol, "Accept-Encoding")) != NULL) {
+        req->accept_enc |= accept_encoding(v, eol);
+    } else if ((v = header_value(line, eol, "If-Range")) != NULL) {
+        size_t len = (size_t)(trim_end(v, eol) - v);
+        if (len >= sizeof(req->if_range)) // 너무 긴 값은 어떤 검증자와도 맞지 않는 값으로(전체 응답)
+            snprintf(req->if_range, sizeof(req->if_range), "W/");
+        else {
+            memcpy(req->if_range, v, len);
+            req->if_range[len] = '\0';
+        }
+    }
+}
+
+// 1~maxd자리 10진수. 반환: 다음 위치, 숫자가 없으면 NULL
+static const char *parse_num(const char *p, const char *end, int maxd, int *out) {
+    int n = 0, d = 0;
+    for (; p < end && d < maxd && isdigit((unsigned char)*p); p++, d++)
+        n = n * 10 + (*p - '0');
+    *out = n;
+    return d ? p : NULL;
+}
+
+// "hh:mm:ss"
+static const char *parse_clock(const char *p, const char *end, int *hh, int *mm, int *ss) {
+    if (!(p = parse_num(p, end, 2, hh)) || p >= end || *p++ != ':' || !(p = parse_num(p, end, 2, mm)) || p >= end ||
+        *p++ != ':')
+        return NULL;
+    return parse_num(p, end, 2, ss);
+}
+
+// 영문 월 약자 -> 1~12, 아니면 0
+static int parse_month(const char *p, const char *end) {
+    static const char names[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    if (end - p < 3)
+        return 0;
+    for (int i = 0; i < 12; i++)
+        if (!strncasecmp(p, names + i * 3, 3))
+            return i + 1;
+    return 0;
+}
+
+// 그레고리력 날짜 -> 1970-01-01부터의 일수(timegm이 필요 없도록 직접 계산)
+static long long days_from_civil(long long y, int m, int d) {
+    y -= m <= 2;
+    long long era = (y >= 0 ? y : y - 399) / 400;
+    long long yoe = y - era * 400;
+    long long doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    long long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+long long http_parse_date(const char *s, const char *end) {
+    const char *p = s;
+    int day, mon, year, hh, mm, ss;
+    while (p < end && isalpha((unsigned char)*p)) // 요일
+        p++;
+    if (p < end && *p == ',')
+        p++;
+    while (p < end && *p == ' ')
+        p++;
+    if (p < end && isdigit((unsigned char)*p)) {
+        // IMF-fixdate "06 Nov 1994 08:49:37 GMT" / RFC 850 "06-Nov-94 08:49:37 GMT"
+        if (!(p = parse_num(p, end, 2, &day)) || p >= end || (*p != ' ' && *p != '-'))
+            return -1;
+        if (!(mon = parse_month(++p, end)))
+            return -1;
+        p += 3;
+        if (p >= end || (*p != ' ' && *p != '-'))
+            return -1;
+        const char *y0 = ++p;
+        if (!(p = parse_num(p, end, 4, &year)) || p >= end || *p++ != ' ')
+            return -1;
+        if (p - y0 == 3) // 두 자리 연도(RFC 850): 50년 규칙 대신 단순히 70 기준
+            year += year < 70 ? 2000 : 1900;
+        if (!(p = parse_clock(p, end, &hh, &mm, &ss)))
+            return -1;
+    } else {
+        // asctime "Nov  6 08:49:37 1994"
+        if (!(mon = parse_month(p, end)))
+            return -1;
+        p += 3;
+        while (p < end && *p == ' ')
+            p++;
+        if (!(p = parse_num(p, end, 2, &day)) || p >= end || *p++ != ' ')
+            return -1;
+        if (!(p = parse_clock(p, end, &hh, &mm, &ss)) || p >= end || *p++ != ' ')
+            return -1;
+        if (!(p = parse_num(p, end, 4, &year)))
+            return -1;
+    }
+    if (day < 1 || day > 31 || hh > 23 || mm > 59 || ss > 60 || year < 1970)
+        return -1;
+    return days_from_civil(year, mon, day) * 86400 + hh * 3600 + mm * 60 + ss;
+}
+
+// 신선도 정보가 없어도 휴리스틱으로 저장할 수 있는 상태 코드(RFC 9110 15.1)
+static int heuristic_status(int status) {
+    switch (status) {
+    case 200: case 203: case 204: case 300: case 301: case 308: case 404: case 405: case 410: case 414: case 501:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+long long http_cache_expiry(const http_response_t *resp, const http_request_t *req, long long now, long long default_ttl) {
+    int validator = resp->etag[0] || resp->last_modified >= 0;
+    if ((resp->cc & (HTTP_CC_NO_STORE | HTTP_CC_PRIVATE)) || (req->cc & HTTP_CC_NO_STORE) || resp->set_cookie ||
+        !strcmp(resp->vary, "*"))
+        return 0;
+    if ((resp->cc & HTTP_CC_NO_CACHE) && !validator) // 쓸 때마다 재검증해야 하는데 검증할 수단이 없음
+        return 0;
+    // 인증한 요청의 응답은 공유해도 된다고 밝힌 경우만(RFC 9111 3.5)
+    if (req->has_auth && resp->s_maxage < 0 && !(resp->cc & (HTTP_CC_PUBLIC | HTTP_CC_MUST_REVALIDATE)))
+        return 0;
+    int explicit_fresh = resp->s_maxage >= 0 || resp->max_age >= 0 || resp->expires >= 0;
+    if (!heuristic_status(resp->status) && !(explicit_fresh && (resp->status == 302 || resp->status == 307)))
+        return 0;
+
+    long long date = resp->date >= 0 ? resp->date : now;
+    long long lifetime;
+    if (resp->cc & HTTP_CC_NO_CACHE)
+        lifetime = 0;
+    else if (resp->s_maxage >= 0)
+        lifetime = resp->s_maxage;
+    else if (resp->max_age >= 0)
+        lifetime = resp->max_age;
+    else if (resp->expires >= 0)
+        lifetime = resp->expires - date;
+    else if (resp->last_modified >= 0 && resp->last_modified < date) // 휴리스틱: 마지막 수정 이후 경과의 10%(최대 하루)
+        lifetime = (date - resp->last_modified) / 10 < 86400 ? (date - resp->last_modified) / 10 : 86400;
+    else if (resp->status == 200 || resp->status == 203 || resp->status == 300 || resp->status == 301 ||
+             resp->status == 308) // 검증자도 없는 성공 응답: 설정한 기본 수명(부정 응답에는 주지 않음)
+        lifetime = default_ttl;
+    else
+        return 0;
+    // 이미 흘러간 나이: Date 기준 경과와 상류 캐시의 Age 중 큰 값(RFC 9111 4.2.3)
+    long long apparent = now > date ? now - date : 0;
+    long long age = apparent > resp->age ? apparent : resp->age;
+    if (lifetime - age > 0)
+        return now + lifetime - age;
+    return validator ? now : 0; // 도착할 때 이미 낡았어도 검증자가 있으면 다음 요청에서 조건부로 되살림
+}
+
+int http_conditional_headers(char *out, size_t cap, const char *head, size_t head_len) {
+    http_response_t r;
+    if (http_parse_response_head(head, head_len + 2, &r) != 1)
+        return 0;
+    size_t len = 0;
+    int n;
+    if (r.etag[0]) {
+        n = snprintf(out, cap, "If-None-Match: %s\r\n", r.etag);
+        if (n < 0 || (size_t)n >= cap)
+            return -1;
+        len = (size_t)n;
+    }
+    if (r.last_modified >= 0) {
+        char date[64];
+        time_t t = (time_t)r.last_modified;
+        struct tm tm;
+        gmtime_r(&t, &tm);
+        strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+        n = snprintf(out + len, cap - len, "If-Modified-Since: %s\r\n", date);
+        if (n < 0 || (size_t)n >= cap - len)
+            return -1;
+        len += (size_t)n;
+    }
+    return (int)len;
+}
+
+void http_merge_304(http_response_t *stored, const http_response_t *fresh) {
+    // Cache-Control은 줄 단위로만 알 수 있으므로 304에 지시자가 하나라도 있으면 통째로 바꿈
+    if (fresh->cc || fresh->max_age >= 0 || fresh->s_maxage >= 0 || fresh->swr >= 0) {
+        stored->cc = fresh->cc;
+        stored->max_age = fresh->max_age;
+        stored->s_maxage = fresh->s_maxage;
+        stored->swr = fresh->swr;
+    }
+    if (fresh->expires >= 0)
+        stored->expires = fresh->expires;
+    if (fresh->last_modified >= 0)
+        stored->last_modified = fresh->last_modified;
+    if (fresh->etag[0])
+        memcpy(stored->etag, fresh->etag, sizeof(stored->etag));
+    stored->date = fresh->date; // 나이는 이번 304 기준으로 다시 잼
+    stored->age = fresh->age;
+}
+
+// 헤더 줄 [p, eol)의 이름 길이(콜론 앞까지). 이름이 없으면 0
+static size_t header_name_len(const char *p, const char *eol) {
+    const char *c = memchr(p, ':', (size_t)(eol - p));
+    return c ? (size_t)(c - p) : 0;
+}
+
+// 304가 새 값을 알려 줘도 저장된 줄을 그대로 둘 헤더(연결 관리, 저장된 본문에 딸린 길이/표현)
+static int merge_excluded(const char *p, const char *eol) {
+    static const char *const names[] = {
+        "Connection", "Keep-Alive",     "Proxy-Connection", "Transfer-Encoding", "TE",           "Trailer",
+        "Upgrade",    "Content-Length", "Content-Range",    "Content-Encoding",  "Content-Type",
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+        if (header_value(p, eol, names[i]))
+            return 1;
+    return 0;
+}
+
+// 304 헤더 줄 [h, end)(빈 줄에서 멈춤)에 이름 name[0..n)인 바꿀 수 있는 줄이 있는지
+static int merge_has(const char *h, const char *end, const char *name, size_t n) {
+    for (const char *p = h; p < end;) {
+        const char *e = memchr(p, '\n', (size_t)(end - p));
+        const char *eol = e ? e : end;
+        if (eol == p || (eol == p + 1 && *p == '\r'))
+            break;
+        if (header_name_len(p, eol) == n && !strncasecmp(p, name, n) && !merge_excluded(p, eol))
+            return 1;
+        p = eol + 1;
+    }
+    return 0;
+}
+
+int http_merge_304_head(char *out, size_t cap, const char *head, size_t head_len, const char *fresh, size_t fresh_len,
+                        long long now) {
+    const char *fend = fresh + fresh_len;
+    const char *fh = memchr(fresh, '\n', fresh_len); // 304의 상태줄은 쓰지 않음
+    if (!fh)
+        return -1;
+    fh++;
+    size_t len = 0;
+    // 1. 저장된 줄 중 304가 바꾸지 않는 것(상태줄 포함). Date/Age는 버리고 304 기준으로 다시 붙임
+    for (const char *p = head, *end = head + head_len; p < end;) {
+        const char *e = memchr(p, '\n', (size_t)(end - p));
+        const char *eol = e ? e : end;
+        size_t ln = (size_t)(eol - p) + (e != NULL);
+        size_t nl = p == head ? 0 : header_name_len(p, eol);
+        int replaced = header_value(p, eol, "Date") || header_value(p, eol, "Age") || (nl && merge_has(fh, fend, p, nl));
+        if (p == head || !replaced) {
+            if (len + ln >= cap)
+                return -1;
+            memcpy(out + len, p, ln);
+            len += ln;
+        }
+        p = eol + 1;
+    }
+    // 2. 304의 줄
+    int has_date = 0;
+    for (const char *p = fh; p < fend;) {
+        const char *e = memchr(p, '\n', (size_t)(fend - p));
+        const char *eol = e ? e : fend;
+        size_t ln = (size_t)(eol - p) + (e != NULL);
+        if (eol == p || (eol == p + 1 && *p == '\r')) // 빈 줄: 헤더 끝
+            break;
+        if (header_name_len(p, eol) && !merge_excluded(p, eol)) {
+            if (len + ln >= cap)
+                return -1;
+            memcpy(out + len, p, ln);
+            len += ln;
+            has_date |= header_value(p, eol, "Date") != NULL;
+        }
+        p = eol + 1;
+    }
+    if (!has_date) { // 방금 검증했으므로 지금이 이 응답의 생성 시각
+        char date[64];
+        time_t t = (time_t)now;
+        struct tm tm;
+        gmtime_r(&t, &tm);
+        strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+        int n = snprintf(out + len, cap - len, "Date: %s\r\n", date);
+        if (n < 0 || (size_t)n >= cap - len)
+            return -1;
+        len += (size_t)n;
+    }
+    return (int)len;
+}
+
+// ETag 약한 비교: W/ 접두어를 떼고 따옴표 포함 opaque-tag가 같은지
+static int etag_weak_eq(const char *a, size_t an, const char *b, size_t bn) {
+    if (an >= 2 && !strncmp(a, "W/", 2)) {
+        a += 2;
+        an -= 2;
+    }
+    if (bn >= 2 && !strncmp(b, "W/", 2)) {
+        b += 2;
+        bn -= 2;
+    }
+    return an == bn && !memcmp(a, b, an);
+}
+
+// If-None-Match 목록 list에 etag(저장된 응답, 없으면 빈 문자열)와 맞는 항목이 있는지. "*"는 무엇이든 맞음
+static int etag_list_match(const char *list, const char *etag) {
+    for (const char *p = list; *p;) {
+        while (*p == ' ' || *p == '\t' || *p == ',')
+            p++;
+        const char *q = p;
+        if (*q == 'W' && q[1] == '/')
+            q += 2;
+        if (*q == '"') { // 따옴표 안의 쉼표는 구분자가 아님
+            const char *close = strchr(q + 1, '"');
+            q = close ? close + 1 : q + strlen(q);
+        }
+        while (*q && *q != ',')
+            q++;
+        const char *e = trim_end(p, q);
+        if (e - p == 1 && *p == '*')
+            return 1;
+        if (e > p && etag[0] && etag_weak_eq(p, (size_t)(e - p), etag, strlen(etag)))
+            return 1;
+        p = q;
+    }
+    return 0;
+}
+
+// 저장된 헤더 줄 head[0..head_len)(빈 줄 제외)에서 검증자만 읽음. 반환: 200 응답이면 1, 아니면 0
+static int stored_validators(const char *head, size_t head_len, char etag[HTTP_ETAG_MAX], long long *last_modified,
+                             long long *date) {
+    etag[0] = '\0';
+    *last_modified = *date = -1;
+    if (head_len < 12 || strncmp(head, "HTTP/", 5) != 0)
+        return 0;
+    const char *end = head + head_len;
+    const char *nl = memchr(head, '\n', head_len);
+    const char *sp = memchr(head, ' ', head_len);
+    if (!nl || !sp || end - sp < 4 || strncmp(sp + 1, "200", 3) != 0)
+        return 0;
+    for (const char *p = nl + 1; p < end;) {
+        const char *e = memchr(p, '\n', (size_t)(end - p));
+        const char *eol = e ? e : end;
+        const char *v;
+        if ((v = header_value(p, eol, "ETag")) != NULL) {
+            const char *t = trim_end(v, eol);
+            if ((size_t)(t - v) < HTTP_ETAG_MAX) {
+                memcpy(etag, v, (size_t)(t - v));
+                etag[t - v] = '\0';
+            }
+        } else if ((v = header_value(p, eol, "Last-Modified")) != NULL) {
+            *last_modified = http_parse_date(v, trim_end(v, eol));
+        } else if ((v = header_value(p, eol, "Date")) != NULL) {
+            *date = http_parse_date(v, trim_end(v, eol));
+        }
+        p = eol + 1;
+    }
+    return 1;
+}
+
+int http_not_modified(const http_request_t *req, const char *head, size_t head_len) {
+    char etag[HTTP_ETAG_MAX];
+    long long last_modified, date;
+    // 200 외의 저장된 응답은 그대로 보냄
+    if (!req->conditional || !stored_validators(head, head_len, etag, &last_modified, &date))
+        return 0;
+    if (req->has_inm)
+        return etag_list_match(req->if_none_match, etag);
+    long long t = last_modified >= 0 ? last_modified : date;
+    return req->if_modified_since >= 0 && t >= 0 && t <= req->if_modified_since;
+}
+
+int http_not_modified_head(char *out, size_t cap, const char *head, size_t head_len) {
+    static const char *const keep[] = {"ETag", "Last-Modified", "Cache-Control", "Expires", "Date", "Vary",
+                                       "Content-Location"};
+    const char *end = head + head_len;
+    const char *nl = memchr(head, '\n', head_len);
+    const char *sp = memchr(head, ' ', head_len);
+    if (!nl || !sp || sp > nl)
+        return -1;
+    int n = snprintf(out, cap, "%.*s 304 Not Modified\r\n", (int)(sp - head), head); // 저장된 응답의 버전 그대로
+    if (n < 0 || (size_t)n >= cap)
+        return -1;
+    size_t len = (size_t)n;
+    for (const char *p = nl + 1; p < end;) {
+        const char *e = memchr(p, '\n', (size_t)(end - p));
+        const char *eol = e ? e : end;
+        size_t ln = (size_t)(eol - p) + (e != NULL);
+        for (size_t i = 0; i < sizeof(keep) / sizeof(keep[0]); i++) {
+            if (!header_value(p, eol, keep[i]))
+                continue;
+            if (len + ln >= cap)
+                return -1;
+            memcpy(out + len, p, ln);
+            len += ln;
+            break;
+        }
+        p = eol + 1;
+    }
+    return (int)len;
+}
+
+int http_range_applies(const http_request_t *req, const char *head, size_t head_len) {
+    char etag[HTTP_ETAG_MAX];
+    long long last_modified, date;
+    if (!req->range[0] || !stored_validators(head, head_len, etag, &last_modified, &date))
+        return 0;
+    if (!req->if_range[0])
+        return 1;
+    if (req->if_range[0] == '"') // 강한 비교: 약한 ETag(W/)는 맞지 않음
+        return etag[0] == '"' && !strcmp(etag, req->if_range);
+    if (!strncmp(req->if_range, "W/", 2))
+        return 0;
+    long long t = http_parse_date(req->if_range, req->if_range + strlen(req->if_range));
+    return t >= 0 && t == last_modified;
+}
+
+// 음이 아닌 10진수 [p, ...). 반환: 다음 위치, 숫자가 없거나 너무 크면 NULL
+static const char *parse_offset(const char *p, long long *out) {
+    long long n = 0;
+    const char *s = p;
+    for (; isdigit((unsigned char)*p); p++) {
+        if (n > (LLONG_MAX - 9) / 10)
+            return NULL;
+        n = n * 10 + (*p - '0');
+    }
+    *out = n;
+    return p > s ? p : NULL;
+}
+
+int http_parse_range(const char *spec, long long len, http_range_t *out) {
+    out->n = 0;
+    if (strncasecmp(spec, "bytes=", 6) != 0)
+        return 0; // 모르는 단위
+    int satisfiable = 0, any = 0;
+    for (const char *p = spec + 6; *p;) {
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (*p == ',') {
+            p++;
+            continue;
+        }
+        long long first, last;
+        if (*p == '-') { // 접미사 범위: 마지막 n바이트
+            long long n;
+            if (!(p = parse_offset(p + 1, &n)))
+                return 0;
+            first = n == 0 ? len : n < len ? len - n : 0; // "-0"은 만족할 수 없는 항목
+            last = len - 1;
+        } else {
+            if (!(p = parse_offset(p, &first)) || *p++ != '-')
+                return 0;
+            last = len - 1;
+            if (isdigit((unsigned char)*p)) {
+                long long l;
+                if (!(p = parse_offset(p, &l)) || l < first)
+                    return 0; // 끝이 시작보다 앞: 헤더 전체가 잘못됨
+                if (l < last)
+                    last = l;
+            }
+        }
+        any = 1;
+        if (first < len) {
+            if (out->n == HTTP_RANGE_MAX)
+                return 0; // 너무 잘게 나눈 요청은 전체로
+            out->first[out->n] = first;
+            out->last[out->n] = last;
+            out->n++;
+            satisfiable = 1;
+        }
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (*p && *p != ',')
+            return 0;
+    }
+    if (!any)
+        return 0;
+    return satisfiable ? 1 : -1;
+}
+
+long long http_range_min_length(const char *spec) {
+    if (strncasecmp(spec, "bytes=", 6) != 0)
+        return 0;
+    long long min = 0;
+    for (const char *p = spec + 6; *p; p++) {
+        long long first;
+        if ((p == spec + 6 || p[-1] == ',' || p[-1] == ' ') && parse_offset(p, &first) && first >= min)
+            min = first + 1; // 접미사 범위("-n")는 숫자 앞이 '-'라 건너뜀
+    }
+    return min;
+}
+
+int http_range_head(char *out, size_t cap, const char *head, size_t head_len, int multipart, char *ctype,
+                    size_t ctype_cap) {
+    const char *end = head + head_len;
+    const char *nl = memchr(head, '\n', head_len);
+    const char *sp = memchr(head, ' ', head_len);
+    if (!nl || !sp || sp > nl)
+        return -1;
+    int n = snprintf(out, cap, "%.*s 206 Partial Content\r\n", (int)(sp - head), head); // 저장된 응답의 버전 그대로
+    if (n < 0 || (size_t)n >= cap)
+        return -1;
+    size_t len = (size_t)n;
+    ctype[0] = '\0';
+    for (const char *p = nl + 1; p < end;) {
+        const char *e = memchr(p, '\n', (size_t)(end - p));
+        const char *eol = e ? e : end;
+        size_t ln = (size_t)(eol - p) + (e != NULL);
+        const char *v;
+        if (multipart && (v = header_value(p, eol, "Content-Type")) != NULL) {
+            size_t vl = (size_t)(trim_end(v, eol) - v);
+            if (vl < ctype_cap) {
+                memcpy(ctype, v, vl);
+                ctype[vl] = '\0';
+            }
+        } else if (!header_value(p, eol, "Content-Length") && !header_value(p, eol, "Content-Range") &&
+                   !header_value(p, eol, "Transfer-Encoding")) {
+            if (len + ln >= cap)
+                return -1;
+            memcpy(out + len, p, ln);
+            len += ln;
+        }
+        p = eol + 1;
+    }
+    return (int)len;
+}
+
+int http_encoded_head(char *out, size_t cap, const char *head, size_t head_len, const char *coding, size_t body_len) {
+    const char *end = head + head_len;
+    char etag[HTTP_ETAG_MAX] = "", vary[HTTP_VARY_MAX] = "", names[HTTP_VARY_MAX] = "";
+    size_t len = 0;
+    for (const char *p = head; p < end;) { // 상태줄은 헤더 이름과 맞지 않아 그대로 복사됨
+        const char *e = memchr(p, '\n', (size_t)(end - p));
+        const char *eol = e ? e : end;
+        size_t ln = (size_t)(eol - p) + (e != NULL);
+        const char *v;
+        if ((v = header_value(p, eol, "ETag")) != NULL) {
+            size_t vl = (size_t)(trim_end(v, eol) - v);
+            if (vl < sizeof(etag)) { // 넘치면 ETag 없이(검증자를 지어내지 않음)
+                memcpy(etag, v, vl);
+                etag[vl] = '\0';
+            }
+        } else if ((v = header_value(p, eol, "Vary")) != NULL) {
+            const char *ve = trim_end(v, eol);
+            size_t vl = (size_t)(ve - v), at = strlen(vary);
+            if (at + vl + 3 > sizeof(vary))
+                return -1;
+            at += (size_t)snprintf(vary + at, sizeof(vary) - at, "%s%.*s", at ? ", " : "", (int)vl, v);
+            vary_names(v, ve, names);
+        } else if (!header_value(p, eol, "Content-Length") && !header_value(p, eol, "Transfer-Encoding") &&
+                   !header_value(p, eol, "Content-Encoding")) {
+            if (len + ln >= cap)
+                return -1;
+            memcpy(out + len, p, ln);
+            len += ln;
+        }
+        p = eol + 1;
+    }
+    int has_ae = strstr(names, "accept-encoding") != NULL;
+    int n = snprintf(out + len, cap - len, "%s%s%s%sVary: %s%s%s\r\nContent-Encoding: %s\r\nContent-Length: %zu\r\n",
+                     etag[0] ? "ETag: " : "", etag[0] && strncmp(etag, "W/", 2) ? "W/" : "", etag,
+                     etag[0] ? "\r\n" : "", vary, vary[0] && !has_ae ? ", " : "", has_ae ? "" : "Accept-Encoding",
+                     coding, body_len);
+    if (n < 0 || (size_t)n >= cap - len)
+        return -1;
+    return (int)(len + (size_t)n);
+}
+
+size_t http_strip_range_headers(char *req, size_t len) {
+    const char *end = req + len;
+    char *nl = memchr(req, '\n', len);
+    if (!nl)
+        return len;
+    size_t out = (size_t)(nl - req) + 1; // 요청 줄은 그대로
+    for (const char *p = nl + 1; p < end;) {
+        const char *e = memchr(p, '\n', (size_t)(end - p));
+        size_t n = e ? (size_t)(e - p) + 1 : (size_t)(end - p);
+        if (!header_value(p, p + n, "Range") && !header_value(p, p + n, "If-Range")) {
+            memmove(req + out, p, n); // 앞으로만 당기므로 제자리 압축이 안전
+            out += n;
+        }
+        p += n;
+    }
+    return out;
+}
+
+int http_vary_key(char *out, size_t cap, const char *url, const char *vary, const char *req, size_t req_len) {
+    int n = snprintf(out, cap, "%s\n", url);
+    if (n < 0 || (size_t)n >= cap)
+        return -1;
+    size_t len = (size_t)n;
+    const char *end = req + req_len;
+    const char *first = memchr(req, '\n', req_len); // 요청 줄 다음부터 헤더
+    for (const char *name = vary; *name;) {
+        const char *comma = strchr(name, ',');
+        size_t nl = comma ? (size_t)(comma - name) : strlen(name);
+        char hname[HTTP_VARY_MAX];
+        memcpy(hname, name, nl);
+        hname[nl] = '\0';
+        const char *v = NULL, *vend = NULL;
+        for (const char *p = first ? first + 1 : end; p < end && !v;) {
+            const char *e = memchr(p, '\n', (size_t)(end - p));
+            const char *eol = e ? e : end;
+            if ((v = header_value(p, eol, hname)) != NULL)
+                vend = trim_end(v, eol);
+            p = eol + 1;
+        }
+        n = snprintf(out + len, cap - len, "%s:%.*s\n", hname, v ? (int)(vend - v) : 0, v ? v : "");
+        if (n < 0 || (size_t)n >= cap - len)
+            return -1;
+        len += (size_t)n;
+        name += nl + (comma != NULL);
+    }
+    return 0;
+}
+
+// chunked 파서 상태
+enum {
+    CH_SIZE,        // 청크 크기(16진수) 읽는 중
+    CH_EXT,         // 크기 뒤 확장/CR, 줄 끝까지 건너뜀
+    CH_DATA,        // 청크 데이터
+    CH_DATA_END,    // 데이터 뒤 CRLF
+    CH_TRAILER,     // 트레일러 줄의 첫 바이트(빈 줄이면 메시지 끝)
+    CH_TRAILER_LINE, // 트레일러 줄 나머지
+    CH_TRAILER_END, // 마지막 빈 줄의 CR 다음 LF
+};
+
+void http_body_init(http_body_t *b, const http_response_t *resp) {
+    memset(b, 0, sizeof(*b));
+    if (!resp) {
+        b->mode = HTTP_BODY_EOF;
+    } else if ((resp->status >= 100 && resp->status < 200) || resp->status == 204 || resp->status == 304) {
+        b->mode = HTTP_BODY_NONE;
+        b->done = 1;
+    } else if (resp->chunked) {
+        b->mode = HTTP_BODY_CHUNKED;
+        b->cstate = CH_SIZE;
+    } else if (resp->content_length >= 0) {
+        b->mode = HTTP_BODY_LENGTH;
+        b->left = resp->content_length;
+        b->done = b->left == 0;
+    } else {
+        b->mode = HTTP_BODY_EOF;
+    }
+}
+
+// 청크 크기 줄이 끝남: 0이면 트레일러로, 아니면 데이터로
+static void chunk_size_done(http_body_t *b) {
+    b->cstate = b->left == 0 ? CH_TRAILER : CH_DATA;
+}
+
+// chunked 본문을 바이트 단위 상태 기계로 따라감(데이터 구간은 한 번에 건너뜀)
+static size_t chunked_consume(http_body_t *b, const char *p, size_t n) {
+    size_t i = 0;
+    while (i < n && !b->done) {
+        if (b->cstate == CH_DATA) {
+            size_t k = (unsigned long long)b->left < n - i ? (size_t)b->left : n - i;
+            i += k;
+            b->left -= (long long)k;
+            if (b->left == 0)
+                b->cstate = CH_DATA_END;
+            continue;
+        }
+        char ch = p[i++];
+        switch (b->cstate) {
+        case CH_SIZE:
+            if (isxdigit((unsigned char)ch)) {
+                if (b->left > (LLONG_MAX >> 4))
+                    goto bad;
+                b->left = b->left * 16 + (isdigit((unsigned char)ch) ? ch - '0' : (tolower(ch) - 'a' + 10));
+            } else if (ch == '\n') {
+                chunk_size_done(b);
+            } else if (ch == ';' || ch == ' ' || ch == '\t' || ch == '\r') {
+                b->cstate = CH_EXT;
+            } else {
+                goto bad;
+            }
+            break;
+        case CH_EXT:
+            if (ch == '\n')
+                chunk_size_done(b);
+            break;
+        case CH_DATA_END:
+            if (ch == '\n') {
+                b->cstate = CH_SIZE;
+                b->left = 0;
+            }
+            break;
+        case CH_TRAILER:
+            if (ch == '\n')
+                b->done = 1;
+            else
+                b->cstate = ch == '\r' ? CH_TRAILER_END : CH_TRAILER_LINE;
+            break;
+        case CH_TRAILER_LINE:
+            if (ch == '\n')
+                b->cstate = CH_TRAILER;
+            break;
+        case CH_TRAILER_END:
+            if (ch == '\n')
+                b->done = 1;
+            else
+                b->cstate = CH_TRAILER_LINE;
+            break;
+        }
+    }
+    return i;
+bad:
+    // 형식이 깨진 chunked: 경계를 믿을 수 없으므로 서버가 닫을 때까지 그대로 중계
+    b->mode = HTTP_BODY_EOF;
+    return n;
+}
+
+size_t http_body_consume(http_body_t *b, const char *p, size_t n) {
+    size_t take;
+    if (b->done) {
+        take = 0;
+    } else if (b->mode == HTTP_BODY_LENGTH) {
+        take = (unsigned long long)b->left < n ? (size_t)b->left : n;
+        b->left -= (long long)take;
+        b->done = b->left == 0;
+    } else if (b->mode == HTTP_BODY_CHUNKED) {
+        take = chunked_consume(b, p, n);
+    } else {
+        take = n;
+    }
+    if (take < n)
+        b->overrun = 1;
+    return take;
+}
+
+size_t http_body_want(const http_body_t *b, size_t cap) {
+    if (b->mode == HTTP_BODY_LENGTH && (unsigned long long)b->left < cap)
+        return (size_t)b->left;
+    return cap;
+}
+
+void http_body_eof(http_body_t *b) {
+    if (b->mode == HTTP_BODY_EOF)
+        b->done = 1;
+}
@@ -0,0 +1,158 @@
+// HTTP 메시지 헤더 파싱 유틸
+// - 중계 중인 원서버 응답의 헤더 블록(상태줄 ~ 빈 줄)을 읽어 캐시/중계 정책에 필요한 값만 뽑아냄
+// - 클라이언트 요청 헤더에서는 연결 유지(keep-alive)와 캐시 사용 판단에 필요한 값만 뽑아냄
+// - 공유 캐시 규칙(RFC 9111): 저장 가능 여부와 신선도 수명(만료 시각), Vary 2차 키, 낡은 응답의 조건부 재검증
+#pragma once
+#include <stddef.h>
+
+#define HTTP_VARY_MAX 256 // Vary 헤더 이름 목록 최대 길이(넘으면 Vary: *처럼 저장하지 않음)
+#define HTTP_ETAG_MAX 128 // 기억할 ETag 최대 길이(넘으면 ETag가 없는 것으로 봄)
+#define HTTP_RANGE_MAX 8        // 한 요청에서 처리할 바이트 범위 최대 개수(넘으면 Range를 무시하고 전체 응답)
+#define HTTP_RANGE_SPEC_MAX 256 // 기억할 Range 헤더 값 최대 길이(넘으면 Range를 무시)
+
+// Cache-Control 지시자 비트
+enum {
+    HTTP_CC_NO_STORE = 1,
+    HTTP_CC_NO_CACHE = 2,        // 응답: 저장해도 매번 재검증해야 함 / 요청: 캐시된 것을 쓰지 말 것
+    HTTP_CC_PRIVATE = 4,
+    HTTP_CC_PUBLIC = 8,
+    HTTP_CC_MUST_REVALIDATE = 16,
+    HTTP_CC_NO_TRANSFORM = 32,   // 응답: 프록시가 내용을 바꾸면 안 됨(압축본을 만들지 않음)
+};
+
+// 압축 코딩 비트(요청의 Accept-Encoding, 압축 계층이 만드는 압축본)
+enum {
+    HTTP_ENC_GZIP = 1,
+    HTTP_ENC_BR = 2,
+};
+
+// 파싱된 응답 헤더 요약
+typedef struct {
+    int status;               // 상태 코드(200, 404 ...)
+    long long content_length; // Content-Length 값, 없으면 -1
+    int chunked;              // Transfer-Encoding: chunked 여부
+    size_t head_len;          // 상태줄부터 빈 줄까지의 바이트 수(바디 시작 오프셋)
+    int keep_alive;           // 응답 뒤에도 연결을 계속 쓸 수 있는지(HTTP/1.1 기본, 1.0은 keep-alive 명시)
+    int cc;                   // Cache-Control 지시자(HTTP_CC_*)
+    long long max_age;        // Cache-Control max-age 초, 없으면 -1
+    long long s_maxage;       // Cache-Control s-maxage 초, 없으면 -1
+    long long date;           // Date(UNIX 초), 없으면 -1
+    long long expires;        // Expires(UNIX 초), 없으면 -1, 해석할 수 없는 값이면 0(이미 만료로 취급)
+    long long last_modified;  // Last-Modified(UNIX 초), 없으면 -1
+    long long age;            // Age 초(없으면 0)
+    long long swr;            // Cache-Control stale-while-revalidate 초, 없으면 -1
+    char etag[HTTP_ETAG_MAX]; // ETag 값(따옴표/W/ 포함 원문), 없으면 빈 문자열
+    int set_cookie;           // Set-Cookie가 있음(사용자별 응답으로 보고 저장하지 않음)
+    char vary[HTTP_VARY_MAX]; // Vary 헤더 이름 목록(소문자, 쉼표로 구분, 공백 없음). "*"이면 저장 불가
+    int compressible;         // 압축본을 만들어도 되는 응답(200, 텍스트 계열 Content-Type, Content-Encoding과 no-transform 없음)
+} http_response_t;
+
+// buf[0..len)의 앞부분을 응답 헤더로 파싱
+// - 반환: 1(빈 줄까지 완결되어 out 채움), 0(아직 빈 줄이 없음), -1(상태줄 형식 오류)
+int http_parse_response_head(const char *buf, size_t len, http_response_t *out);
+
+// 응답 헤더 블록 head[0..head_len)에서 hop-by-hop 연결 관리 헤더(Connection/Keep-Alive/Proxy-Connection)를
+// 제자리에서 지우고 마지막 빈 줄도 뗀 길이를 반환(프록시가 클라 연결에 맞는 Connection 헤더를 다시 붙임)
+size_t http_strip_hop_headers(char *head, size_t head_len);
+
+// 클라이언트 요청에서 연결 관리에 필요한 값
+typedef struct {
+    int keep_alive; // 응답 뒤에도 연결을 계속 쓰길 원하는지(HTTP/1.1 기본, 1.0은 keep-alive 명시)
+    int has_body;   // Content-Length(>0)/Transfer-Encoding이 있는 요청(본문은 전달하지 않으므로 응답 뒤 닫음)
+    int cc;         // Cache-Control 지시자(no-store, no-cache. max-age=0과 Pragma: no-cache도 no-cache로)
+    int has_auth;   // Authorization이 있음(명시적으로 허락한 응답만 공유 캐시에 저장)
+    int conditional; // If-None-Match/If-Modified-Since가 있음(클라이언트가 직접 검증 중)
+    int has_inm;     // If-None-Match가 있음(있으면 If-Modified-Since는 보지 않음)
+    char if_none_match[2 * HTTP_ETAG_MAX]; // If-None-Match 목록(여러 줄은 쉼표로 이음, 넘치는 줄은 버림)
+    long long if_modified_since; // If-Modified-Since(UNIX 초), 없거나 해석할 수 없으면 -1
+    char range[HTTP_RANGE_SPEC_MAX]; // Range 값("bytes=..."), 없거나 너무 길면 빈 문자열
+    char if_range[HTTP_ETAG_MAX];    // If-Range 값(ETag 또는 HTTP-date), 없으면 빈 문자열
+    int accept_enc;                  // Accept-Encoding으로 받아들이는 압축 코딩(HTTP_ENC_*, q=0은 뺌)
+} http_request_t;
+
+// 요청한 바이트 범위(본문 기준, 양 끝 포함). 요청에 나온 순서대로
+typedef struct {
+    int n;
+    long long first[HTTP_RANGE_MAX];
+    long long last[HTTP_RANGE_MAX];
+} http_range_t;
+
+// 요청 라인의 버전으로 기본값을 정함
+void http_request_init(http_request_t *req, const char *version);
+// 요청 헤더 한 줄 line[0..n)을 반영(빈 줄 제외)
+void http_request_header(http_request_t *req, const char *line, size_t n);
+
+// HTTP-date(IMF-fixdate, RFC 850, asctime 형식) [s, end)를 UNIX 초로. 형식이 틀리면 -1
+long long http_parse_date(const char *s, const char *end);
+// 공유 캐시가 이 응답(GET)을 저장해도 되면 만료 시각(UNIX 초), 아니면 0
+// - now: 응답을 받은 시각, default_ttl: 신선도 정보도 Last-Modified도 없는 200류 응답에 줄 수명(0이면 저장 안 함)
+// - 검증자(ETag/Last-Modified)가 있으면 이미 낡은 응답(no-cache, max-age=0 등)도 now를 돌려 저장(조건부 요청으로 재검증)
+// - Vary는 보지 않음(호출자가 2차 키로 처리). Vary: *는 저장 불가
+long long http_cache_expiry(const http_response_t *resp, const http_request_t *req, long long now, long long default_ttl);
+// 저장된 응답 head(헤더 줄 head_len바이트 뒤에 빈 줄이 이어지는 캐시 객체 형식)의 검증자로 조건부 요청 헤더 줄들(If-None-Match, If-Modified-Since)을
+// out에 만듦. 반환: 길이, 검증자가 없으면 0, 넘치면 -1
+int http_conditional_headers(char *out, size_t cap, const char *head, size_t head_len);
+// 304 응답(fresh)이 새로 알려 준 신선도/검증자 헤더로 저장된 응답의 요약(stored)을 갱신(RFC 9111 4.3.4)
+void http_merge_304(http_response_t *stored, const http_response_t *fresh);
+// 저장된 헤더 줄 head[0..head_len)에 304 응답 헤더 블록 fresh[0..fresh_len)(빈 줄 포함)의 헤더를 겹쳐 out에 만듦
+// - 304에 나온 이름의 저장된 줄은 304의 줄로 바꿈. 연결 관리 헤더와 저장된 본문에 딸린 길이/표현 헤더
+//   (Content-Length/Content-Range/Content-Encoding/Content-Type)는 304에 있어도 바꾸지 않음(RFC 9111 3.2)
+// - Date/Age는 304 기준으로 다시 잼(304에 Date가 없으면 now). 빈 줄은 붙이지 않음. 반환: 길이, 넘치면 -1
+int http_merge_304_head(char *out, size_t cap, const char *head, size_t head_len, const char *fresh, size_t fresh_len,
+                        long long now);
+// 클라이언트 조건부 요청(req)을 저장된 응답의 헤더 줄 head[0..head_len)(빈 줄 제외)로 평가(RFC 9110 13.2.2)
+// - 반환: 1이면 304로 답해도 됨(저장된 응답이 200이고 If-None-Match가 약한 비교로 맞거나, 없으면
+//   Last-Modified(없으면 Date)가 If-Modified-Since 이전), 0이면 전체 응답을 보낼 것
+int http_not_modified(const http_request_t *req, const char *head, size_t head_len);
+// 저장된 헤더 줄 head[0..head_len)로 304 응답의 헤더 줄(상태줄 + ETag/Last-Modified/Cache-Control/Expires/Date/
+// Vary/Content-Location)을 out에 만듦. 빈 줄은 붙이지 않음. 반환: 길이, 넘치면 -1
+int http_not_modified_head(char *out, size_t cap, const char *head, size_t head_len);
+// Range 요청(req)에 저장된 응답(헤더 줄 head[0..head_len))의 일부로 답해도 되는지(RFC 9110 14.2, 13.1.5)
+// - 저장된 응답이 200이고, If-Range가 있으면 저장된 강한 ETag나 Last-Modified와 정확히 같을 때만 1
+int http_range_applies(const http_request_t *req, const char *head, size_t head_len);
+// Range 값 spec("bytes=a-b, c-, -n")을 본문 길이 len에 맞춰 잘라 out에
+// - 반환: 1(만족할 수 있는 범위가 하나 이상), 0(형식 오류/범위가 너무 많음: Range를 무시하고 전체 응답),
+//         -1(만족할 수 있는 범위가 없음: 416)
+int http_parse_range(const char *spec, long long len, http_range_t *out);
+// Range 값 spec이 뜻하는 본문 길이의 하한(시작 위치가 적힌 범위 중 가장 뒤의 시작 + 1). 알 수 없으면 0
+long long http_range_min_length(const char *spec);
+// 저장된 헤더 줄 head[0..head_len)로 206 응답의 헤더 줄(상태줄 + 길이/범위 헤더를 뺀 저장 헤더)을 out에 만듦
+// - multipart면 Content-Type도 빼고 그 값을 ctype에(부분마다 붙임, 없으면 빈 문자열). 반환: 길이, 넘치면 -1
+int http_range_head(char *out, size_t cap, const char *head, size_t head_len, int multipart, char *ctype,
+                    size_t ctype_cap);
+// 원서버용 요청 블록 req[0..len)에서 Range/If-Range 줄을 제자리에서 지우고 새 길이를 반환(전체 응답을 받아 채울 때)
+size_t http_strip_range_headers(char *req, size_t len);
+// 저장된 헤더 줄 head[0..head_len)로 압축본(본문 body_len바이트)의 헤더 줄을 out에 만듦. 빈 줄은 붙이지 않음
+// - 길이 헤더를 새 Content-Length로 바꾸고 Content-Encoding: coding을 붙임
+// - ETag는 약한 것으로(바이트가 다른 표현), Vary에는 Accept-Encoding을 더함. 반환: 길이, 넘치면 -1
+int http_encoded_head(char *out, size_t cap, const char *head, size_t head_len, const char *coding, size_t body_len);
+// Vary 2차 키: "url\n이름:값\n..."(값은 요청 헤더 블록 req[0..req_len)에서, 없으면 빈 값). 넘치면 -1
+int http_vary_key(char *out, size_t cap, const char *url, const char *vary, const char *req, size_t req_len);
+
+// 응답 본문의 끝을 찾는 방식(RFC 9112 6.3)
+typedef enum {
+    HTTP_BODY_NONE,    // 본문 없음(1xx/204/304)
+    HTTP_BODY_LENGTH,  // Content-Length 바이트만큼
+    HTTP_BODY_CHUNKED, // chunked 인코딩의 마지막 청크와 트레일러까지
+    HTTP_BODY_EOF,     // 길이 정보 없음: 서버가 닫을 때까지(연결 재사용 불가)
+} http_body_mode_t;
+
+// 중계 중인 응답 본문의 진행 상태. 바이트를 흘려보내며 메시지가 어디서 끝나는지 추적
+typedef struct {
+    http_body_mode_t mode;
+    long long left; // LENGTH: 남은 본문 바이트, CHUNKED: 현재 청크의 남은 데이터 바이트
+    int cstate;     // CHUNKED: 청크 파서 내부 상태
+    int done;       // 메시지 끝까지 받았는지
+    int overrun;    // 메시지 끝 뒤에 바이트가 더 있었는지(연결 재사용 불가)
+} http_body_t;
+
+// GET 응답 헤더로 본문 추적을 시작. resp가 NULL이면(헤더 해석 실패) EOF까지로 취급
+void http_body_init(http_body_t *b, const http_response_t *resp);
+// 서버에서 받은 p[0..n) 중 이 메시지에 속하는 바이트 수를 반환하고 상태를 전진
+// - chunked가 아니면 p는 NULL이어도 됨(splice로 커널 안에서만 옮긴 바이트 계산용)
+// - chunked 형식이 깨지면 EOF 모드로 바꿔 나머지를 모두 메시지로 취급
+size_t http_body_consume(http_body_t *b, const char *p, size_t n);
+// 메시지 경계를 넘지 않고 한 번에 읽어도 되는 최대 바이트(cap 이하)
+size_t http_body_want(const http_body_t *b, size_t cap);
+// 서버가 연결을 닫음: EOF 모드면 정상 완료, 그 외에는 잘린 응답(done은 그대로 0)
+void http_body_eof(http_body_t *b);
@@ -0,0 +1,87 @@
+#define _GNU_SOURCE // pthread_setaffinity_np, CPU_SET 매크로, splice/tee/pipe2, copy_file_range
+#include "osdep.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+
+// sysconf로 온라인 CPU 수 조회
+int os_online_cpus(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+// 호출 스레드의 CPU 마스크를 cpu 하나로 제한
+// - 같은 코어에서 accept/중계가 이어지도록 해 캐시 지역성을 높이는 용도
+int os_pin_thread_to_cpu(int cpu) {
+    cpu_set_t set;
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        errno = EINVAL;
+        return -1;
+    }
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (rc != 0) {
+        errno = rc;
+        return -1;
+    }
+    return 0;
+}
+
+int os_pipe(int fds[2]) {
+    return pipe2(fds, O_CLOEXEC);
+}
+
+// 소켓 <-> 파이프 사이를 커널 페이지 참조만 옮겨 복사 없이 중계
+ssize_t os_splice(int infd, int outfd, size_t len, int nonblock) {
+    unsigned int flags = SPLICE_F_MOVE | (nonblock ? SPLICE_F_NONBLOCK : 0);
+    return splice(infd, NULL, outfd, NULL, len, flags);
+}
+
+// 파이프 -> 파이프 복제. 원본 파이프의 데이터는 그대로 남아 이후 splice로 내보낼 수 있음
+ssize_t os_tee(int infd, int outfd, size_t len, int nonblock) {
+    return tee(infd, outfd, len, nonblock ? SPLICE_F_NONBLOCK : 0);
+}
+
+// 파일 -> 소켓. 디스크 캐시 HIT 본문을 사용자 공간을 거치지 않고 보냄
+ssize_t os_sendfile(int outfd, int infd, off_t *off, size_t len) {
+    return sendfile(outfd, infd, off, len);
+}
+
+// 파일 -> 파일. 디스크 계층이 재검증한 레코드의 본문을 새 위치로 옮길 때(사용자 공간을 거치지 않음)
+int os_copy_range(int infd, off_t inoff, int outfd, off_t outoff, size_t len) {
+    loff_t in = inoff, out = outoff;
+    while (len > 0) {
+        ssize_t n = copy_file_range(infd, &in, outfd, &out, len, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP))
+            break; // 아래 pread/pwrite로
+        if (n <= 0)
+            return -1;
+        len -= (size_t)n;
+    }
+    char buf[64 << 10];
+    while (len > 0) {
+        ssize_t r = pread(infd, buf, len < sizeof(buf) ? len : sizeof(buf), in);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return -1;
+        for (ssize_t done = 0; done < r;) {
+            ssize_t w = pwrite(outfd, buf + done, (size_t)(r - done), out + done);
+            if (w < 0 && errno == EINTR)
+                continue;
+            if (w <= 0)
+                return -1;
+            done += w;
+        }
+        in += r;
+        out += r;
+        len -= (size_t)r;
+    }
+    return 0;
+}
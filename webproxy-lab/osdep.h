@@ -0,0 +1,25 @@
+// 리눅스 전용 확장 API 래퍼
+// - _GNU_SOURCE가 필요한 호출(CPU affinity, splice/tee 등)을 이 번역 단위에 모음
+// - csapp.h의 gai_error 선언이 _GNU_SOURCE 아래의 glibc 선언과 충돌하므로 proxy.c에서 직접 쓰지 않음
+#pragma once
+#include <stddef.h>
+#include <sys/types.h>
+
+#define OS_PIPE_CHUNK (64 << 10) // 파이프 기본 용량. splice 한 번에 옮길 최대 바이트
+
+int os_online_cpus(void);          // 현재 온라인 CPU 수(알 수 없으면 1)
+int os_pin_thread_to_cpu(int cpu); // 호출한 스레드를 cpu번 코어에 고정. 성공 0, 실패 -1(errno 설정)
+int os_pipe(int fds[2]);            // 중계용 파이프 생성(O_CLOEXEC). 성공 0, 실패 -1
+// splice(2): infd -> outfd로 최대 len바이트를 사용자 공간 복사 없이 옮김(둘 중 하나는 파이프)
+// - nonblock이면 파이프 쪽도 막히지 않음(SPLICE_F_NONBLOCK). 소켓 쪽은 소켓 자체의 O_NONBLOCK을 따름
+// - 반환: 옮긴 바이트(0 = infd EOF), 실패 -1(errno). 이 fd 조합을 지원하지 않으면 EINVAL/ENOSYS
+ssize_t os_splice(int infd, int outfd, size_t len, int nonblock);
+// tee(2): 파이프 infd의 앞쪽 최대 len바이트를 소비하지 않고 파이프 outfd로 복제(페이지 참조만 복사)
+// - 반환: 복제한 바이트, 실패 -1(errno). nonblock은 os_splice와 같음
+ssize_t os_tee(int infd, int outfd, size_t len, int nonblock);
+// sendfile(2): 파일 infd의 *off부터 최대 len바이트를 소켓 outfd로 커널 안에서 보냄(*off는 보낸 만큼 전진)
+// - 반환: 보낸 바이트, 실패 -1(errno). 논블로킹 소켓이 가득 차면 EAGAIN
+ssize_t os_sendfile(int outfd, int infd, off_t *off, size_t len);
+// copy_file_range(2): 파일 infd의 inoff부터 len바이트를 파일 outfd의 outoff로 커널 안에서 복사
+// - 이 파일 조합을 지원하지 않으면 pread/pwrite로 옮김. 반환: 성공 0, 실패(원본이 짧음 포함) -1(errno)
+int os_copy_range(int infd, off_t inoff, int outfd, off_t outoff, size_t len);
@@ -1,38 +1,658 @@
-//  CS:APP Proxy Lab - Part 1 (Sequential Proxy)
-//   - 요구사항: HTTP/1.0 기반 GET 프록시, 헤더 재작성(Host/User-Agent/Connection/
-//   Proxy-Connection), 바이너리 안전 응답 중계, 동시성/캐시 없음
+//  CS:APP Proxy Lab - 동시성 캐싱 프록시(Part 1 순차 프록시에서 출발)
+//   - HTTP/1.0·1.1 GET 프록시, 헤더 재작성(Host/User-Agent/Connection/Proxy-Connection), 바이너리 안전 응답 중계
+//   - 동시성 모델(thread/pool/epoll), 샤딩 캐시(+디스크 계층), keep-alive, 재검증 등은 실행 옵션(proxy_options_t)으로 고름
 
 #include "cache.h"  // Part III: 캐시 API(MAX_CACHE_SIZE/MAX_OBJECT_SIZE 포함)
+#include "capbuf.h" // 캐시 후보 누적용 청크 버퍼
+#include "compress.h" // 텍스트 응답의 압축본(gzip/brotli)을 캐시에 함께 둠
 #include "csapp.h"  // RIO(견고한 I/O), 소켓 래퍼(Open_listenfd 등), 에러 처리 매크로 포함
+#include "disk.h"   // 메모리 캐시 뒤의 디스크 계층(세그먼트 파일)
+#include "dns.h"    // 원서버 이름 해석 캐시 + 해석 스레드 풀
+#include "flight.h" // 같은 키 동시 MISS 합치기(single-flight)
+#include "http.h"   // 응답 헤더 파싱(Content-Length 등)
+#include "osdep.h"  // 리눅스 전용 확장(CPU affinity 등) 래퍼
+#include "snapshot.h" // 재시작용 메모리 캐시 스냅샷
+#include "upstream.h" // 원서버 keep-alive 연결 풀
 #include <ctype.h>  // isdigit 등 문자인식 매크로
 #include <errno.h>  // errno 상수
+#include <getopt.h> // getopt_long: 실행 옵션 파싱
+#include <limits.h> // INT_MAX: 정수 옵션 범위
+#include <poll.h>   // poll: keep-alive 연결의 유휴 타임아웃
 #include <signal.h> // sigaction, SIGPIPE 무시 설정
+#include <stdint.h> // SIZE_MAX: 크기 옵션 범위
+#include <sys/uio.h> // writev: 캐시 객체 사이에 연결 헤더를 끼워 복사 없이 전송
 
 // 과제에서 지정한 고정 User-Agent 헤더 문자열
 static const char *user_agent_hdr = "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:10.0.3) "
                                     "Gecko/20120305 Firefox/10.0.3\r\n";
 
-// 연결 정책: 프록시-서버/클라이언트 모두 연결은 요청마다 종료(close)
+// 연결 정책
+// - 클라이언트 쪽은 keep-alive: 응답 헤더의 연결 관리 헤더를 떼고 이 연결에 맞는 Connection 헤더를 다시 붙임
+//   (길이를 알 수 없는 응답, 유휴 타임아웃 -t, 요청 수 상한 -n에 닿으면 close)
+// - 원서버 쪽은 keep-alive 풀을 쓰면 지속 연결, 끄면(-k 0) 과제 명세대로 요청마다 close
 static const char *conn_close_hdr = "Connection: close\r\n";
 static const char *proxy_conn_close_hdr = "Proxy-Connection: close\r\n";
+static const char *conn_keepalive_hdr = "Connection: keep-alive\r\n";
+
+// 응답 중계 결과: 연결을 닫을지, 풀에 돌려줄지, (응답을 한 바이트도 못 받아) 다시 보낼지
+enum { RELAY_CLOSE = 0, RELAY_REUSE = 1, RELAY_RETRY = 2 };
+
+// 동시성 모델: 기본은 연결당 스레드, -m pool이면 고정 워커 풀, -m epoll이면 단일 이벤트 루프(A/B 비교용 플래그)
+enum { PROXY_MODE_THREAD = 0, PROXY_MODE_EPOLL = 1, PROXY_MODE_POOL = 2 };
+
+// 응답 중계 방식: copy는 모든 바이트를 사용자 공간 버퍼로, splice는 캐시하지 않을 응답을 파이프로 복사 없이 중계,
+// tee는 캐시 후보 응답도 클라 쪽은 splice로 보내고 tee로 복제한 파이프에서만 캐시 버퍼로 읽음
+enum { PROXY_RELAY_COPY = 0, PROXY_RELAY_SPLICE = 1, PROXY_RELAY_TEE = 2 };
+
+#define POOL_DEFAULT_WORKERS 16 // 기본 워커 수
+#define POOL_DEFAULT_QUEUE 64   // 기본 큐 깊이
+#define CLIENT_DEFAULT_IDLE 15            // 클라이언트 keep-alive 유휴 타임아웃(초), 0이면 요청마다 close
+#define CLIENT_DEFAULT_MAX_REQUESTS 100   // 클라이언트 연결 하나에서 처리할 최대 요청 수
+#define CONNECT_DEFAULT_TIMEOUT_MS 5000   // 원서버 connect 전체 타임아웃(ms)
+#define CONNECT_DEFAULT_DELAY_MS 250      // happy eyeballs: 다음 후보 주소로 병렬 시도를 시작하기까지의 지연(ms, RFC 8305 권장값)
+#define CACHED_HDR_MAX 96                 // HIT 응답에 끼워 넣는 헤더(Content-Length + Connection) 버퍼
+#define NOT_MODIFIED_MAX 2048             // 클라 조건부 요청에 캐시가 직접 답하는 304 헤더 버퍼(넘치면 전체 응답)
+#define CACHE_DEFAULT_TTL 300             // 신선도 정보도 Last-Modified도 없는 200 응답의 캐시 수명(초)
+#define CACHE_KEY_MAX (MAXLINE + 1024)    // 캐시 키 버퍼(URL + Vary로 고른 요청 헤더 값)
+#define BACKGROUND_WORKERS 4              // 백그라운드 원서버 요청(재검증/범위 채우기) 워커 수
+#define BACKGROUND_QUEUE 64               // 백그라운드 요청 대기열 상한(넘치면 그 요청은 건너뜀)
+
+// 실행 옵션: 명령행(-x/--name)과 설정 파일(-f, "name = value" 줄)이 같은 이름으로 채움
+// - 동시성 모델/캐시 정책/용량 기본값은 과제 원래 동작(연결당 스레드, LRU, 1MiB/100KiB)과 같음
+// - 원래 동작과 다른 기본값: splice 중계(-R), 원서버 keep-alive 30초(-k), 클라이언트 keep-alive 15초(-t),
+//   이름 해석 캐시 60초(-d), 신선도 정보 없는 응답 300초 보관(-L, 원래는 방출될 때까지). README의 "실행 기본값" 참고
+typedef struct {
+    int mode;             // 동시성 모델
+    int pool_workers;     // 워커 풀 크기
+    int pool_depth;       // 연결 큐 깊이
+    int pool_block;       // 큐 포화 시 accept를 멈출지(1) 503으로 거절할지(0)
+    int reactors;         // epoll 모드 이벤트 루프 수
+    int pin_cpu;          // 이벤트 루프를 코어에 고정할지
+    int relay;            // 응답 중계 방식
+    int upstream_idle;    // 원서버 유휴 연결 타임아웃(초), 0이면 keep-alive 풀 끔
+    int upstream_per_host; // host:port당 유휴 연결 수 상한
+    int client_idle;       // 클라이언트 keep-alive 유휴 타임아웃(초), 0이면 요청마다 close
+    int client_max_requests; // 클라이언트 연결당 최대 요청 수
+    int dns_ttl;           // 이름 해석 결과 보관 시간(초), 0이면 캐시하지 않음
+    int dns_neg_ttl;       // 해석 실패 보관 시간(초)
+    int dns_threads;       // 해석 스레드 수
+    int connect_timeout;   // 원서버 connect 타임아웃(ms, 모든 후보 합산)
+    int connect_delay;     // 후보 사이 connect 시작 간격(ms)
+    int default_ttl;       // 신선도 정보가 없는 응답의 캐시 수명(초), 0이면 그런 응답은 저장하지 않음
+    char *disk_dir;        // 디스크 계층 디렉터리(NULL이면 끔)
+    size_t disk_size;      // 디스크 계층 총 예산
+    size_t disk_object_size; // 디스크 계층 단일 객체 최대 크기
+    char *snapshot;        // 캐시 스냅샷 파일(NULL이면 끔)
+    int range_fill;        // Range 요청이 MISS면 그 범위는 원서버에서 중계하고 전체 응답을 뒤에서 받아 캐시에 채울지
+    int compress;          // 캐시에 압축본을 만들 코딩(HTTP_ENC_*), 0이면 끔
+    cache_config_t cache; // 캐시 실행 시 설정
+} proxy_options_t;
+
+static proxy_options_t opts = {
+    .mode = PROXY_MODE_THREAD,
+    .pool_workers = POOL_DEFAULT_WORKERS,
+    .pool_depth = POOL_DEFAULT_QUEUE,
+    .pool_block = 1,
+    .reactors = 1,
+    .pin_cpu = 0,
+    .relay = PROXY_RELAY_SPLICE,
+    .upstream_idle = UPSTREAM_DEFAULT_IDLE,
+    .upstream_per_host = UPSTREAM_DEFAULT_PER_HOST,
+    .client_idle = CLIENT_DEFAULT_IDLE,
+    .client_max_requests = CLIENT_DEFAULT_MAX_REQUESTS,
+    .dns_ttl = DNS_DEFAULT_TTL,
+    .dns_neg_ttl = DNS_DEFAULT_NEG_TTL,
+    .dns_threads = DNS_DEFAULT_THREADS,
+    .connect_timeout = CONNECT_DEFAULT_TIMEOUT_MS,
+    .connect_delay = CONNECT_DEFAULT_DELAY_MS,
+    .default_ttl = CACHE_DEFAULT_TTL,
+    .disk_size = DISK_DEFAULT_SIZE,
+    .disk_object_size = DISK_DEFAULT_OBJECT_SIZE,
+    .cache = {.policy = CACHE_POLICY_LRU, .admission = CACHE_ADMIT_NONE, .max_cache_size = MAX_CACHE_SIZE,
+              .max_object_size = MAX_OBJECT_SIZE, .shards = CACHE_SHARDS},
+};
+
+// Range 요청에 저장된 응답으로 답하는 206/416 응답
+// - 텍스트(상태줄/헤더, multipart 경계와 부분 헤더)와 저장된 본문의 구간을 번갈아 보내는 조각 목록
+// - 본문 구간은 복사하지 않고 메모리 객체면 iovec으로, 디스크 계층이면 sendfile로 보냄
+#define RANGE_PIECES (2 * HTTP_RANGE_MAX + 1)
+typedef struct {
+    int body; // 1이면 본문 구간(off는 본문 시작 기준), 0이면 text 구간
+    size_t off, len;
+} range_piece_t;
+typedef struct {
+    char *text;      // 텍스트 조각을 이어 붙인 버퍼(malloc)
+    size_t text_len;
+    int n;           // 조각 수
+    range_piece_t piece[RANGE_PIECES];
+    size_t total;    // 보낼 전체 바이트
+} range_reply_t;
 
 // 내부 사용 함수 원형 선언
-static void handle_client(int connfd); // 클라이언트 1건 처리(요청 읽기 -> 서버로 전달 -> 응답 중계)
+static int handle_client(int connfd, int *served,
+                         int park); // 클라이언트 연결 처리(keep-alive 동안 요청을 차례로 serve_request)
+static int serve_request(rio_t *rio_client, int connfd, int may_keep); // 요청 1건(읽기 -> 서버로 전달 -> 응답 중계)
 static int parse_request_line(const char *line, char *method, size_t msz, char *uri, size_t usz, char *version,
                               size_t vsz); // "METHOD URI VERSION" 파싱
 static int parse_uri(const char *uri, char *host, size_t hsz, char *path, size_t psz,
                      int *port_out);                       // "http://host[:port]/path" 분해
 static int connect_end_server(const char *host, int port); // 원서버에 TCP connect()
-static int forward_request_headers(rio_t *client_rio, int serverfd, const char *host, int port); // 헤더 재작성/전송
-static void relay_response(int serverfd, int clientfd);                                 // 서버->클라 응답 스트리밍
-static void relay_and_maybe_cache(int serverfd, int clientfd, const char *key);         // 스트리밍 + (조건부)캐시
+static int start_connect(const dns_addr_t *a, int port, int *done); // 후보 주소 하나로 논블로킹 connect 시작
+static int rewrite_request_headers(rio_t *client_rio, char **req, size_t *len, size_t *cap, const char *host,
+                                   int port, http_request_t *creq); // 클라 헤더를 재작성해 요청 버퍼에 추가
+static int format_upstream_line(char *out, size_t cap, const char *path, const char *version); // 원서버용 요청 라인
+static int append_upstream_tail(char **req, size_t *len, size_t *cap); // 고정 헤더 + 연결 관리 헤더 + 빈 줄
+static int relay_body(int serverfd, int clientfd, http_body_t *body, capbuf_t *cap); // 본문을 메시지 끝까지 중계
+static int splice_relay(int serverfd, int clientfd, http_body_t *body); // 파이프를 거쳐 복사 없이 메시지 끝까지 중계
+static int tee_relay(int serverfd, int clientfd, capbuf_t *cap,
+                     http_body_t *body); // splice로 중계하며 tee로 복제한 쪽만 캐시 후보로
+static int relay_and_maybe_cache(int serverfd, int clientfd, const char *key, const char *req, size_t req_len,
+                                 const http_request_t *creq, int *client_keep, flight_t *flight, cache_obj_t *stale,
+                                 const disk_obj_t *dstale); // 스트리밍 + (조건부)캐시 + 팔로워에게 공개
+static int fetch_upstream(const char *host, int port, int clientfd, const char *key, const char *req, size_t req_len,
+                          const http_request_t *creq, int *keep, flight_t *flight, cache_obj_t *stale,
+                          const disk_obj_t *dstale); // 원서버 연결(풀/재시도) + 요청 전송 + relay_and_maybe_cache
+static int add_validators(char **req, size_t *len, size_t *cap, const char *head,
+                          size_t head_len); // 원서버용 요청에 저장된 응답 헤더의 검증자로 조건부 헤더 추가
+static cache_obj_t *refresh_stale(cache_obj_t *obj, const char *key, const char *fresh_head,
+                                  const http_response_t *fresh,
+                                  const http_request_t *creq); // 304를 받은 사본을 새 헤더로 교체
+static char *refresh_disk_stale(const disk_obj_t *d, const char *key, const char *fresh_head,
+                                const http_response_t *fresh, const http_request_t *creq, int keep, size_t *len,
+                                off_t *body_off, size_t *body_len); // 304를 받은 디스크 레코드의 새 헤더 + 다시 쓰기
+static void background_fetch(const char *host, int port, const char *key, const char *req, size_t req_len,
+                             const http_request_t *creq,
+                             cache_obj_t *stale); // 뒤에서 원서버 요청(재검증 또는 Range MISS의 전체 채우기)
+static void print_background_stats(void); // 백그라운드 요청 대기열 통계(SIGUSR1)
+static int cache_lookup(char *key, size_t keycap, const char *req, size_t req_len, const http_request_t *creq,
+                        cache_obj_t **obj_out); // 캐시 조회(받아들이는 압축본 먼저, Vary 표시면 2차 키로 다시)
+static long long capture_policy(const http_response_t *resp, const char *key, const char *req, size_t req_len,
+                                const http_request_t *creq, char *store_key,
+                                size_t keycap); // 저장할지/만료 시각/저장할 키
+static int stored_conn_hdr(char *hdr, size_t hdrcap, int unsized, size_t body_len,
+                           int keep); // 저장된 응답에 끼워 넣을 연결(+길이) 헤더
+static int cached_response_iov(const cache_obj_t *obj, char *hdr, size_t hdrcap, int *keep,
+                               struct iovec iov[3]); // 캐시 객체 + 연결 헤더를 복사 없이 보낼 iovec
+static int disk_read_head(const disk_obj_t *d, char *buf, size_t cap); // 디스크 객체의 헤더 줄 + 빈 줄을 읽음
+static ssize_t disk_response_head(const disk_obj_t *d, char *buf, size_t cap, int *keep, off_t *body_off,
+                                  size_t *body_len); // 디스크 객체의 헤더 + 연결 헤더, sendfile로 보낼 범위
+static size_t not_modified_response(const http_request_t *creq, const char *head, size_t head_len, int keep,
+                                    char *out, size_t cap); // 클라 조건부 요청에 저장된 응답으로 304
+static int range_reply_build(range_reply_t *rr, const http_request_t *creq, const char *head, size_t head_len,
+                             size_t body_len, int chunked, int keep); // Range 요청에 저장된 응답으로 206/416
+static int range_reply_send(int clientfd, const range_reply_t *rr, const char *body, int fd,
+                            off_t body_off); // 206/416 조각을 메모리(writev) 또는 디스크(sendfile)에서 전송
+static char *range_reply_flatten(const range_reply_t *rr, const char *body, int fd,
+                                 off_t body_off); // 206/416 조각을 버퍼 하나로 모음(이벤트 루프의 multipart)
+static int follow_flight(flight_t *f, int clientfd, int http10, int *keep); // 리더가 채우는 응답을 따라 읽어 전송
+static void capture_begin(capbuf_t *cap, const char *key, size_t head_len, const http_response_t *resp,
+                          long long expires); // 캐시 후보 크기 예약(채우는 중 캐시 객체)
+static void capture_feed(capbuf_t *cap, const char *data, size_t n); // 중계한 조각을 캐시 후보로 누적
+static void capture_read(capbuf_t *cap, int fd, size_t n);           // tee 파이프의 n바이트를 캐시 후보로 누적
+static void capture_abandon(capbuf_t *cap);                         // 캐시 후보 누적 포기
+static void capture_commit(capbuf_t *cap, const char *key, size_t head_len, const http_response_t *resp,
+                           http_body_mode_t mode, long long expires); // 완결된 후보를 캐시에 삽입
+static void stamp_freshness(cache_obj_t *obj, const http_response_t *resp,
+                            long long expires); // 캐시 객체에 만료 시각/재검증 정보 기록
 static void clienterror(int fd, int status, const char *shortmsg, const char *longmsg); // 간단한 에러 응답 생성
-static int open_listenfd_s(const char *port);                                           // getaddrinfo 기반 리스닝 소켓
+static int format_clienterror(char *out, size_t cap, int status, const char *shortmsg,
+                              const char *longmsg);                                   // 에러 응답을 버퍼에 작성
+static int is_replaced_header(const char *line); // 프록시가 고정값으로 대체하는 헤더인지
+static int open_listenfd_s(const char *port, int reuseport);                            // getaddrinfo 기반 리스닝 소켓
 static ssize_t writen_all(int fd, const void *buf, size_t n);      // 부분쓰기까지 처리하는 write 루프
+static int writev_all(int fd, struct iovec *iov, int cnt);         // 부분쓰기까지 처리하는 writev 루프
+static int sendfile_all(int outfd, int infd, off_t off, size_t len); // 파일 구간을 끝까지 sendfile
+static size_t iov_advance(struct iovec *iov, int *cnt, size_t n);  // 보낸 n바이트만큼 iovec 배열을 전진
+static int wait_readable(int fd, int timeout_ms);                  // 읽을 데이터가 올 때까지(최대 timeout) 대기
+static ssize_t read_some(int fd, void *buf, size_t n);             // EINTR을 재시도하는 read
 static int read_full_line(rio_t *rp, char **out, size_t *len_out); // 1줄을 끝까지 모아 반환(RIO 사용)
 
 // Part II 동시성 구현부 포함: 연결당 스레드 생성/분리(detached)
 #include "thread.c"
+// Part II-b: epoll 이벤트 루프(논블로킹 상태 기계) 구현부 포함
+#include "reactor.c"
+
+// 관리용 시그널을 처리하는 전용 스레드
+// - 시그널 핸들러 안에서는 stdio/락을 쓸 수 없으므로, 모든 스레드에서 시그널을 막아두고
+//   이 스레드만 sigwait로 동기적으로 받아 평범한 코드로 처리
+// - SIGUSR1: 캐시 통계 출력(LRU/CLOCK, 입장 정책 유무에 따른 적중률 비교용)과 원서버 연결 재사용/이름 해석 통계
+// - 스냅샷 파일(-W)이 있으면 SIGUSR2: 지금 캐시를 스냅샷으로 저장, SIGTERM/SIGINT: 저장한 뒤 종료
+static const cache_config_t *signal_cache_cfg; // 통계 출력 시 표시할 캐시 설정
+
+static void print_cache_stats(void) {
+    cache_stats_t st;
+    cache_get_stats(&st);
+    unsigned long long lookups = st.hits + st.misses;
+    fprintf(stderr,
+            "cache: policy=%s admission=%s hits=%llu misses=%llu hit_ratio=%.2f%% inserts=%llu evictions=%llu "
+            "rejected=%llu filling=%llu expired=%llu stale=%llu bytes=%zu entries=%zu\n",
+            signal_cache_cfg->policy == CACHE_POLICY_CLOCK ? "clock" : "lru",
+            signal_cache_cfg->admission == CACHE_ADMIT_TINYLFU ? "tinylfu" : "none", st.hits, st.misses,
+            lookups ? 100.0 * (double)st.hits / (double)lookups : 0.0, st.inserts, st.evictions, st.rejected, st.filling,
+            st.expired, st.stale, st.bytes, st.entries);
+}
+
+static void print_upstream_stats(void) {
+    upstream_stats_t st;
+    upstream_get_stats(&st);
+    unsigned long long acquires = st.reused + st.misses;
+    fprintf(stderr, "upstream: keepalive=%s reused=%llu new=%llu reuse_ratio=%.2f%% stale=%llu expired=%llu idle=%zu\n",
+            upstream_enabled() ? "on" : "off", st.reused, st.misses,
+            acquires ? 100.0 * (double)st.reused / (double)acquires : 0.0, st.stale, st.expired, st.idle);
+}
+
+static void print_dns_stats(void) {
+    dns_stats_t st;
+    dns_get_stats(&st);
+    unsigned long long lookups = st.hits + st.misses;
+    fprintf(stderr,
+            "dns: hits=%llu misses=%llu hit_ratio=%.2f%% neg_hits=%llu resolves=%llu failures=%llu timeouts=%llu "
+            "avg_ms=%.3f max_ms=%.3f entries=%zu\n",
+            st.hits, st.misses, lookups ? 100.0 * (double)st.hits / (double)lookups : 0.0, st.neg_hits, st.resolves,
+            st.failures, st.timeouts, st.resolves ? (double)st.resolve_us / (double)st.resolves / 1000.0 : 0.0,
+            (double)st.resolve_us_max / 1000.0, st.entries);
+}
+
+static void print_flight_stats(void) {
+    flight_stats_t st;
+    flight_get_stats(&st);
+    unsigned long long misses = st.leaders + st.followers;
+    fprintf(stderr, "flight: leaders=%llu followers=%llu coalesced=%.2f%% failed=%llu active=%zu\n", st.leaders,
+            st.followers, misses ? 100.0 * (double)st.followers / (double)misses : 0.0, st.failed, st.active);
+}
+
+static void print_disk_stats(void) {
+    if (!opts.disk_dir)
+        return;
+    disk_stats_t st;
+    disk_get_stats(&st);
+    unsigned long long lookups = st.hits + st.misses;
+    fprintf(stderr,
+            "disk: hits=%llu misses=%llu hit_ratio=%.2f%% writes=%llu write_bytes=%llu dropped=%llu purged=%llu "
+            "expired=%llu stale=%llu refreshed=%llu bytes=%zu entries=%zu segments=%zu queued=%zu streaming=%zu\n",
+            st.hits, st.misses, lookups ? 100.0 * (double)st.hits / (double)lookups : 0.0, st.writes, st.write_bytes,
+            st.dropped, st.purged, st.expired, st.stale, st.refreshed, st.bytes, st.entries, st.segments, st.queued, st.streaming);
+}
+
+static void print_compress_stats(void) {
+    if (!opts.compress)
+        return;
+    compress_stats_t st;
+    compress_get_stats(&st);
+    fprintf(stderr, "compress: variants=%llu in_bytes=%llu out_bytes=%llu ratio=%.2f%% skipped=%llu dropped=%llu queued=%zu\n",
+            st.variants, st.in_bytes, st.out_bytes,
+            st.in_bytes ? 100.0 * (double)st.out_bytes / (double)st.in_bytes : 0.0, st.skipped, st.dropped, st.queued);
+}
+
+static void save_snapshot(void) {
+    snapshot_result_t res;
+    if (snapshot_save(opts.snapshot, &res) < 0)
+        fprintf(stderr, "snapshot: cannot save %s: %s\n", opts.snapshot, strerror(errno));
+    else
+        fprintf(stderr, "snapshot: saved %zu objects (%zu bytes) to %s in %.1f ms\n", res.objects, res.bytes,
+                opts.snapshot, res.elapsed_ms);
+}
+
+static void *signal_thread_main(void *arg) {
+    sigset_t *set = (sigset_t *)arg;
+    for (;;) {
+        int sig;
+        if (sigwait(set, &sig) != 0)
+            continue;
+        if (sig == SIGUSR1) {
+            print_cache_stats();
+            print_upstream_stats();
+            print_dns_stats();
+            print_flight_stats();
+            print_disk_stats();
+            print_compress_stats();
+            print_background_stats();
+        } else if (sig == SIGUSR2) {
+            save_snapshot();
+        } else if (sig == SIGTERM || sig == SIGINT) {
+            save_snapshot();
+            exit(0);
+        }
+    }
+    return NULL;
+}
+
+// 호출 스레드(main)에서 관리 시그널을 막고 sigwait 스레드를 띄운다
+static int start_signal_thread(const cache_config_t *cfg) {
+    static sigset_t set;
+    pthread_t tid;
+    signal_cache_cfg = cfg;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    if (opts.snapshot) { // 스냅샷이 없으면 SIGTERM/SIGINT는 기본 동작(즉시 종료) 그대로
+        sigaddset(&set, SIGUSR2);
+        sigaddset(&set, SIGTERM);
+        sigaddset(&set, SIGINT);
+    }
+    if (pthread_sigmask(SIG_BLOCK, &set, NULL) != 0) // 이후 생성되는 스레드도 막힌 마스크를 물려받음
+        return -1;
+    if (pthread_create(&tid, NULL, signal_thread_main, &set) != 0)
+        return -1;
+    pthread_detach(tid);
+    return 0;
+}
+
+// 명령행/설정 파일 공용 옵션 표(설정 파일의 키는 긴 옵션 이름과 같음)
+static const struct option long_opts[] = {
+    {"mode", required_argument, NULL, 'm'},
+    {"workers", required_argument, NULL, 'w'},
+    {"queue", required_argument, NULL, 'q'},
+    {"overload", required_argument, NULL, 'o'},
+    {"reactors", required_argument, NULL, 'r'},
+    {"pin-cpu", no_argument, NULL, 'a'},
+    {"cache-policy", required_argument, NULL, 'P'},
+    {"admission", required_argument, NULL, 'A'},
+    {"cache-size", required_argument, NULL, 'C'},
+    {"object-size", required_argument, NULL, 'O'},
+    {"shards", required_argument, NULL, 'S'},
+    {"relay", required_argument, NULL, 'R'},
+    {"upstream-idle", required_argument, NULL, 'k'},
+    {"upstream-pool", required_argument, NULL, 'p'},
+    {"keepalive-timeout", required_argument, NULL, 't'},
+    {"max-requests", required_argument, NULL, 'n'},
+    {"dns-ttl", required_argument, NULL, 'd'},
+    {"dns-negative-ttl", required_argument, NULL, 'e'},
+    {"dns-threads", required_argument, NULL, 'D'},
+    {"connect-timeout", required_argument, NULL, 'c'},
+    {"connect-delay", required_argument, NULL, 'y'},
+    {"default-ttl", required_argument, NULL, 'L'},
+    {"disk-dir", required_argument, NULL, 'T'},
+    {"disk-size", required_argument, NULL, 'B'},
+    {"disk-object-size", required_argument, NULL, 'X'},
+    {"snapshot", required_argument, NULL, 'W'},
+    {"range-fill", no_argument, NULL, 'F'},
+    {"compress", required_argument, NULL, 'Z'},
+    {"config", required_argument, NULL, 'f'},
+    {NULL, 0, NULL, 0},
+};
+static const char *short_opts = "m:w:q:o:r:aP:A:C:O:S:R:k:p:t:n:d:e:D:c:y:L:T:B:X:W:FZ:f:";
+
+// 사용법 출력 후 종료
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options] <listen_port>\n", prog);
+    fprintf(stderr, "  -m, --mode      동시성 모델: thread(연결당 스레드, 기본) | pool(워커 풀) | epoll(이벤트 루프)\n");
+    fprintf(stderr, "  -w, --workers   pool 모드 워커 수 (기본 %d)\n", POOL_DEFAULT_WORKERS);
+    fprintf(stderr, "  -q, --queue     pool 모드 연결 큐 깊이 (기본 %d)\n", POOL_DEFAULT_QUEUE);
+    fprintf(stderr, "  -o, --overload  큐가 가득 찼을 때: block(accept 중단, 기본) | reject(503 응답)\n");
+    fprintf(stderr, "  -r, --reactors  epoll 모드 이벤트 루프 수, 각자 SO_REUSEPORT 리스너 보유 (기본 1, 0=CPU 수)\n");
+    fprintf(stderr, "  -a, --pin-cpu   epoll 모드에서 i번째 이벤트 루프를 i번 CPU에 고정\n");
+    fprintf(stderr, "  -P, --cache-policy  캐시 방출 정책: lru(기본) | clock(HIT가 쓰기 락 없이 참조 비트만 세움)\n");
+    fprintf(stderr, "  -A, --admission     캐시 입장 정책: none(기본) | tinylfu(빈도 스케치로 희생자보다 인기 있을 때만 삽입)\n");
+    fprintf(stderr, "  -C, --cache-size    캐시 총 메모리 예산, 키/메타데이터 포함 (기본 %d, K/M/G 접미사)\n",
+            MAX_CACHE_SIZE);
+    fprintf(stderr, "  -O, --object-size   캐시할 단일 객체 최대 크기 (기본 %d, K/M/G 접미사)\n", MAX_OBJECT_SIZE);
+    fprintf(stderr, "  -S, --shards        캐시 샤드 수 상한 (기본 %d)\n", CACHE_SHARDS);
+    fprintf(stderr, "  -R, --relay         응답 중계: splice(기본, 캐시하지 않을 응답은 파이프로 복사 없이) | copy(항상 버퍼 복사)\n");
+    fprintf(stderr, "                      | tee(캐시 후보도 클라로는 splice, tee로 복제한 파이프에서만 캐시 버퍼로 복사)\n");
+    fprintf(stderr, "  -k, --upstream-idle 원서버 keep-alive 유휴 연결 타임아웃 초 (기본 %d, 0이면 요청마다 close)\n",
+            UPSTREAM_DEFAULT_IDLE);
+    fprintf(stderr, "  -p, --upstream-pool host:port당 보관할 유휴 연결 수 (기본 %d)\n", UPSTREAM_DEFAULT_PER_HOST);
+    fprintf(stderr, "  -t, --keepalive-timeout 클라이언트 keep-alive 유휴 타임아웃 초 (기본 %d, 0이면 요청마다 close)\n",
+            CLIENT_DEFAULT_IDLE);
+    fprintf(stderr, "  -n, --max-requests  클라이언트 연결 하나에서 처리할 최대 요청 수 (기본 %d)\n",
+            CLIENT_DEFAULT_MAX_REQUESTS);
+    fprintf(stderr, "  -d, --dns-ttl       원서버 이름 해석 결과 보관 시간 초 (기본 %d, 0이면 캐시하지 않음)\n", DNS_DEFAULT_TTL);
+    fprintf(stderr, "  -e, --dns-negative-ttl 해석 실패를 기억할 시간 초 (기본 %d)\n", DNS_DEFAULT_NEG_TTL);
+    fprintf(stderr, "  -D, --dns-threads   이름 해석 전용 스레드 수 (기본 %d)\n", DNS_DEFAULT_THREADS);
+    fprintf(stderr, "  -c, --connect-timeout 원서버 connect 타임아웃 ms, 모든 후보 주소 합산 (기본 %d)\n",
+            CONNECT_DEFAULT_TIMEOUT_MS);
+    fprintf(stderr, "  -y, --connect-delay 응답 없는 후보를 두고 다음 주소(IPv6/IPv4 교차)로 병렬 시도할 간격 ms (기본 %d)\n",
+            CONNECT_DEFAULT_DELAY_MS);
+    fprintf(stderr, "  -L, --default-ttl   Cache-Control/Expires/Last-Modified가 없는 200 응답을 캐시에 둘 시간(초, 0이면\n");
+    fprintf(stderr, "                      저장 안 함, 기본 %d). 신선도 정보가 있는 응답은 그 수명을 따름\n", CACHE_DEFAULT_TTL);
+    fprintf(stderr, "  -T, --disk-dir      디스크 계층 디렉터리: 메모리 캐시에서 밀려난 객체와 객체 한도를 넘는 응답을 보관\n");
+    fprintf(stderr, "                      (기본 끔, 재시작하면 세그먼트를 훑어 다시 씀)\n");
+    fprintf(stderr, "  -B, --disk-size     디스크 계층 총 예산 (기본 %d, K/M/G 접미사)\n", DISK_DEFAULT_SIZE);
+    fprintf(stderr, "  -X, --disk-object-size 디스크 계층 단일 객체 최대 크기 (기본 %d, K/M/G 접미사)\n",
+            DISK_DEFAULT_OBJECT_SIZE);
+    fprintf(stderr, "  -W, --snapshot      캐시 스냅샷 파일: 시작할 때 읽어 캐시를 채우고, SIGTERM/SIGINT(종료)와\n");
+    fprintf(stderr, "                      SIGUSR2(즉시)에 지금 캐시를 저장\n");
+    fprintf(stderr, "  -F, --range-fill    Range 요청이 MISS면 그 범위는 원서버에서 그대로 중계하면서 전체 응답을 뒤에서\n");
+    fprintf(stderr, "                      한 번 받아 캐시에 채움(이후 다른 범위는 캐시에서 206)\n");
+    fprintf(stderr, "  -Z, --compress      캐시에 텍스트 응답의 압축본을 함께 두고 Accept-Encoding에 맞춰 보냄:\n");
+    fprintf(stderr, "                      gzip | br | gzip,br | off (기본 off)\n");
+    fprintf(stderr, "  -f, --config    설정 파일: 줄마다 \"긴옵션이름 = 값\", #은 주석. 나온 순서대로 적용\n");
+    fprintf(stderr, "  (실행 중 SIGUSR1을 보내면 캐시 적중률 통계를 stderr로 출력)\n");
+    exit(1);
+}
+
+// "64M", "512k", "1G", "1048576" 같은 크기 문자열을 바이트로(접미사는 2진 단위)
+static int parse_size(const char *s, size_t *out) {
+    char *end;
+    while (isspace((unsigned char)*s))
+        s++;
+    if (!isdigit((unsigned char)*s)) // strtoull은 "-1"을 SIZE_MAX로 받아 주므로 부호는 직접 거름
+        return -1;
+    errno = 0;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (errno || v > SIZE_MAX)
+        return -1;
+    int shift = 0;
+    switch (tolower((unsigned char)*end)) {
+    case 'g':
+        shift = 30;
+        end++;
+        break;
+    case 'm':
+        shift = 20;
+        end++;
+        break;
+    case 'k':
+        shift = 10;
+        end++;
+        break;
+    case '\0':
+        break;
+    default:
+        return -1;
+    }
+    if (*end || v == 0 || v > (SIZE_MAX >> shift)) // 접미사를 곱하면 넘침
+        return -1;
+    *out = (size_t)v << shift;
+    return 0;
+}
+
+// 정수 옵션 값을 [min, max] 범위의 int로. 숫자가 아니거나(뒤에 찌꺼기 포함) 범위를 벗어나면 -1
+static int parse_int(const char *s, long min, long max, int *out) {
+    char *end;
+    errno = 0;
+    long v = strtol(s, &end, 10);
+    if (errno || end == s || *end || v < min || v > max)
+        return -1;
+    *out = (int)v;
+    return 0;
+}
+
+static int load_config_file(const char *path, int depth);
+
+// 옵션 하나를 opts에 반영. 잘못된 값이면 -1
+// - 명령행 getopt 루프와 설정 파일 로더가 함께 사용
+static int apply_option(int opt, const char *arg, int depth) {
+    size_t sz;
+    int n;
+    switch (opt) {
+    case 'm':
+        if (!strcmp(arg, "thread"))
+            opts.mode = PROXY_MODE_THREAD;
+        else if (!strcmp(arg, "epoll"))
+            opts.mode = PROXY_MODE_EPOLL;
+        else if (!strcmp(arg, "pool"))
+            opts.mode = PROXY_MODE_POOL;
+        else
+            return -1;
+        return 0;
+    case 'w':
+        return parse_int(arg, 1, INT_MAX, &opts.pool_workers);
+    case 'q':
+        return parse_int(arg, 1, INT_MAX, &opts.pool_depth);
+    case 'o':
+        if (!strcmp(arg, "block"))
+            opts.pool_block = 1;
+        else if (!strcmp(arg, "reject"))
+            opts.pool_block = 0;
+        else
+            return -1;
+        return 0;
+    case 'r':
+        if (parse_int(arg, 0, INT_MAX, &opts.reactors) < 0)
+            return -1;
+        if (opts.reactors == 0)
+            opts.reactors = os_online_cpus();
+        return 0;
+    case 'a':
+        opts.pin_cpu = 1;
+        return 0;
+    case 'P':
+        if (!strcmp(arg, "lru"))
+            opts.cache.policy = CACHE_POLICY_LRU;
+        else if (!strcmp(arg, "clock"))
+            opts.cache.policy = CACHE_POLICY_CLOCK;
+        else
+            return -1;
+        return 0;
+    case 'A':
+        if (!strcmp(arg, "none"))
+            opts.cache.admission = CACHE_ADMIT_NONE;
+        else if (!strcmp(arg, "tinylfu"))
+            opts.cache.admission = CACHE_ADMIT_TINYLFU;
+        else
+            return -1;
+        return 0;
+    case 'C':
+        if (parse_size(arg, &sz) < 0)
+            return -1;
+        opts.cache.max_cache_size = sz;
+        return 0;
+    case 'O':
+        if (parse_size(arg, &sz) < 0)
+            return -1;
+        opts.cache.max_object_size = sz;
+        return 0;
+    case 'S':
+        if (parse_int(arg, 1, INT_MAX, &n) < 0)
+            return -1;
+        opts.cache.shards = (size_t)n;
+        return 0;
+    case 'R':
+        if (!strcmp(arg, "splice"))
+            opts.relay = PROXY_RELAY_SPLICE;
+        else if (!strcmp(arg, "copy"))
+            opts.relay = PROXY_RELAY_COPY;
+        else if (!strcmp(arg, "tee"))
+            opts.relay = PROXY_RELAY_TEE;
+        else
+            return -1;
+        return 0;
+    case 'k':
+        return parse_int(arg, 0, INT_MAX / 1000, &opts.upstream_idle);
+    case 'p':
+        return parse_int(arg, 1, INT_MAX, &opts.upstream_per_host);
+    case 't':
+        return parse_int(arg, 0, INT_MAX / 1000, &opts.client_idle);
+    case 'n':
+        return parse_int(arg, 1, INT_MAX, &opts.client_max_requests);
+    case 'd':
+        return parse_int(arg, 0, INT_MAX, &opts.dns_ttl);
+    case 'e':
+        return parse_int(arg, 0, INT_MAX, &opts.dns_neg_ttl);
+    case 'D':
+        return parse_int(arg, 1, INT_MAX, &opts.dns_threads);
+    case 'c':
+        return parse_int(arg, 1, INT_MAX, &opts.connect_timeout);
+    case 'y':
+        return parse_int(arg, 0, INT_MAX, &opts.connect_delay);
+    case 'L':
+        return parse_int(arg, 0, INT_MAX, &opts.default_ttl);
+    case 'T':
+        free(opts.disk_dir);
+        opts.disk_dir = strdup(arg);
+        return opts.disk_dir ? 0 : -1;
+    case 'B':
+        if (parse_size(arg, &sz) < 0)
+            return -1;
+        opts.disk_size = sz;
+        return 0;
+    case 'X':
+        if (parse_size(arg, &sz) < 0)
+            return -1;
+        opts.disk_object_size = sz;
+        return 0;
+    case 'W':
+        free(opts.snapshot);
+        opts.snapshot = strdup(arg);
+        return opts.snapshot ? 0 : -1;
+    case 'F':
+        opts.range_fill = 1;
+        return 0;
+    case 'Z': // 쉼표로 구분한 코딩 목록, off면 끔
+        opts.compress = 0;
+        if (!strcmp(arg, "off"))
+            return 0;
+        for (const char *p = arg; *p;) {
+            size_t n = strcspn(p, ",");
+            if (n == 4 && !strncmp(p, "gzip", 4))
+                opts.compress |= HTTP_ENC_GZIP;
+            else if (n == 2 && !strncmp(p, "br", 2))
+                opts.compress |= HTTP_ENC_BR;
+            else
+                return -1;
+            p += n + (p[n] == ',');
+        }
+        return opts.compress ? 0 : -1;
+    case 'f':
+        return load_config_file(arg, depth + 1);
+    default:
+        return -1;
+    }
+}
+
+// 설정 파일을 읽어 한 줄씩 apply_option
+// - 형식: "name = value" 또는 "name value", 값 없는 옵션(pin-cpu)은 이름만 또는 "= 1/yes/true"
+// - 빈 줄과 # 주석 무시, 다른 설정 파일 include(config = ...)는 깊이 4까지
+static int load_config_file(const char *path, int depth) {
+    if (depth > 4) {
+        fprintf(stderr, "config: %s: nested too deeply\n", path);
+        return -1;
+    }
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        fprintf(stderr, "config: cannot open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    char line[MAXLINE];
+    int lineno = 0, rc = 0;
+    while (rc == 0 && fgets(line, sizeof(line), fp)) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash)
+            *hash = '\0';
+        char *name = strtok(line, " \t\r\n=");
+        if (!name)
+            continue; // 빈 줄/주석
+        char *value = strtok(NULL, " \t\r\n=");
+
+        const struct option *o;
+        for (o = long_opts; o->name && strcmp(o->name, name); o++)
+            ;
+        if (!o->name) {
+            fprintf(stderr, "config: %s:%d: unknown option '%s'\n", path, lineno, name);
+            rc = -1;
+        } else if (o->has_arg == no_argument) {
+            if (!value || !strcmp(value, "1") || !strcasecmp(value, "yes") || !strcasecmp(value, "true"))
+                rc = apply_option(o->val, "", depth);
+        } else if (!value || apply_option(o->val, value, depth) < 0) {
+            fprintf(stderr, "config: %s:%d: invalid value for '%s'\n", path, lineno, name);
+            rc = -1;
+        }
+    }
+    fclose(fp);
+    return rc;
+}
 
 // 리스닝 소켓 생성
 // SIGPIPE 무시(클라이언트/서버 조기 종료 시 write에서 죽지 않도록)
@@ -43,11 +663,16 @@ int main(int argc, char **argv) {
     socklen_t clientlen;                // 클라이언트 주소 길이
     struct sockaddr_storage clientaddr; // IPv4/IPv6 겸용 주소 구조체
     struct sigaction sa;                // SIGPIPE 무시 설정용
+    int opt;
 
-    if (argc != 2) { // 포트 인자 필수
-        fprintf(stderr, "Usage: %s <listen_port>\n", argv[0]);
-        exit(1);
+    // 옵션은 나온 순서대로 적용(-f 뒤에 준 명령행 옵션이 설정 파일 값을 덮어씀)
+    while ((opt = getopt_long(argc, argv, short_opts, long_opts, NULL)) != -1) {
+        if (apply_option(opt, optarg ? optarg : "", 0) < 0)
+            usage(argv[0]);
     }
+    if (optind != argc - 1) // 포트 인자 필수
+        usage(argv[0]);
+    const char *port = argv[optind];
     // SIGPIPE : 소켓이 끊어진 상태에서 write 시도 시 프로세스 종료 기본 동작
     // -> 무시하도록 설정. write 오류는 -1 반환과 errno=EPIPE로 알 수 있음
     memset(&sa, 0, sizeof(sa));    // sa 구조체 초기화
@@ -56,14 +681,69 @@ int main(int argc, char **argv) {
     sigaction(SIGPIPE, &sa, NULL); // SIGPIPE에 대해 sa 설정
 
     // 리스닝 시작 전 캐시 초기화
-    cache_init();                        // Part III: 캐시 초기화(다중 리더/단일 라이터 보장)
-    listenfd = open_listenfd_s(argv[1]); // 리스닝 소켓 생성
-    if (listenfd < 0) {                  // 실패 시 에러 출력 후 종료
-        fprintf(stderr, "Error: cannot open listen socket on port %s\n", argv[1]);
+    if (cache_init(&opts.cache) < 0) {   // Part III: 캐시 초기화(다중 리더/단일 라이터 보장)
+        fprintf(stderr, "Error: invalid cache configuration (object size must not exceed cache size)\n");
+        exit(1);
+    }
+    // 재시작 전 캐시를 스냅샷에서 다시 채움(리스닝 전이므로 첫 요청부터 HIT)
+    if (opts.snapshot) {
+        snapshot_result_t res;
+        int rc = snapshot_load(opts.snapshot, &res);
+        if (rc < 0)
+            fprintf(stderr, "snapshot: ignoring %s: %s\n", opts.snapshot, strerror(errno));
+        else if (rc == 0)
+            fprintf(stderr, "snapshot: loaded %zu objects (%zu bytes, %zu skipped) from %s in %.1f ms\n", res.objects,
+                    res.bytes, res.skipped, opts.snapshot, res.elapsed_ms);
+    }
+    upstream_init(opts.upstream_idle, opts.upstream_per_host); // 원서버 keep-alive 풀(0이면 끔)
+    // 관리용 시그널 스레드: 다른 스레드를 만들기 전에 시작해야 모든 스레드가 시그널 마스크를 물려받음
+    if (start_signal_thread(&opts.cache) < 0) {
+        fprintf(stderr, "Error: cannot start signal thread\n");
+        exit(1);
+    }
+    if (dns_init(opts.dns_ttl, opts.dns_neg_ttl, opts.dns_threads) < 0) { // 해석 스레드도 시그널 마스크를 물려받음
+        fprintf(stderr, "Error: cannot start resolver threads\n");
+        exit(1);
+    }
+    // 디스크 계층: 기존 세그먼트로 인덱스를 다시 세운 뒤, 메모리 캐시에서 밀려나는 객체를 넘겨받음
+    if (opts.disk_dir) {
+        if (disk_init(opts.disk_dir, opts.disk_size, opts.disk_object_size) < 0) {
+            fprintf(stderr, "Error: cannot open disk cache directory %s: %s\n", opts.disk_dir, strerror(errno));
+            exit(1);
+        }
+        cache_set_evict_hook(disk_offer);
+    }
+    if (opts.compress && compress_init(opts.compress) < 0) { // 압축 스레드
+        fprintf(stderr, "Error: cannot start compression thread\n");
+        exit(1);
+    }
+    // 이벤트 루프가 여럿이면 각자 같은 포트에 SO_REUSEPORT 리스너를 가짐(커널이 연결을 분배)
+    int multi = opts.mode == PROXY_MODE_EPOLL && opts.reactors > 1;
+    listenfd = open_listenfd_s(port, multi); // 리스닝 소켓 생성
+    if (listenfd < 0) {                      // 실패 시 에러 출력 후 종료
+        fprintf(stderr, "Error: cannot open listen socket on port %s\n", port);
         exit(1);
     }
 
-    for (;;) {                          // 무한 루프: 동시 처리(연결당 스레드 생성)
+    // epoll 모드: 이벤트 루프가 모든 연결의 상태 기계를 진행(반환하지 않음)
+    // - 0번 루프는 이 스레드에서, 나머지는 각자 리스너를 가진 스레드에서 실행
+    if (opts.mode == PROXY_MODE_EPOLL) {
+        if (reactors_start(port, opts.reactors, opts.pin_cpu) < 0)
+            exit(1);
+        if (opts.pin_cpu && os_pin_thread_to_cpu(0) < 0)
+            fprintf(stderr, "reactor 0: cannot pin to cpu 0: %s\n", strerror(errno));
+        reactor_run(listenfd);
+        close(listenfd);
+        return 1; // 이벤트 루프가 빠져나왔다면 초기화 실패
+    }
+
+    // pool 모드: 워커를 미리 만들어 두고 accept 루프는 큐에 넣기만 함
+    if (opts.mode == PROXY_MODE_POOL && pool_start(opts.pool_workers, (size_t)opts.pool_depth) < 0) {
+        fprintf(stderr, "Error: cannot start worker pool\n");
+        exit(1);
+    }
+
+    for (;;) {                          // 무한 루프: 동시 처리(연결당 스레드 생성 또는 워커 풀에 전달)
         clientlen = sizeof(clientaddr); // 주소 버퍼 크기 지정
         do {
             // accept는 시그널로 깨어나면 EINTR 반환 가능 -> 재시도
@@ -75,6 +755,12 @@ int main(int argc, char **argv) {
             continue;
         }
 
+        // 워커 풀: 큐에 넣기만 함(가득 차면 정책에 따라 대기 또는 503 후 닫음)
+        if (opts.mode == PROXY_MODE_POOL) {
+            pool_submit(connfd, 1, opts.pool_block);
+            continue;
+        }
+
         // 연결당 스레드 생성: 스레드 내부에서 handle_client 호출 및 FD 정리
         if (spawn_detached_worker(connfd) != 0) {
             fprintf(stderr, "pthread_create failed: %s\n", strerror(errno));
@@ -87,98 +773,549 @@ int main(int argc, char **argv) {
     return 0;
 }
 
-//  handle_client: 프록시의 핵심 처리
+//  handle_client: 클라이언트 연결 하나를 끝까지 처리(HTTP/1.1 keep-alive, 파이프라이닝)
+//   - 같은 rio_t에서 요청을 차례로 읽어 serve_request로 처리하므로, 한 번에 몰려온(pipelined) 요청도
+//     버퍼에 남은 순서대로 이어서 처리되고 응답도 같은 순서로 나감
+//   - 버퍼가 비어 다음 요청을 기다릴 때만 유휴 타임아웃(-t)을 적용, 요청 수 상한(-n)에 닿으면 그 응답에서 close
+//   - park이면(pool 모드) 그때 바로 읽을 것이 없으면 기다리지 않고 1을 반환(호출자가 연결을 주차장에 맡김).
+//     버퍼가 빈 때만 돌아오므로 주차했다 돌아온 연결은 새 RIO 버퍼로 이어 읽으면 됨
+//   - served: 다음에 처리할 요청 번호(처음 1, 처리할 때마다 늘림). 반환: 1(주차), 0(닫을 것)
+static int handle_client(int connfd, int *served, int park) {
+    rio_t rio_client; // 클라이언트 RIO 버퍼(연결이 살아 있는 동안 요청 사이에 재사용)
+    rio_readinitb(&rio_client, connfd);
+
+    for (;; (*served)++) {
+        if (opts.client_idle > 0 && rio_client.rio_cnt == 0) {
+            int rc = wait_readable(connfd, park ? 0 : opts.client_idle * 1000);
+            if (rc == 0 && park)
+                return 1;
+            if (rc <= 0)
+                return 0; // 유휴 타임아웃/오류
+        }
+        int may_keep = opts.client_idle > 0 && *served < opts.client_max_requests;
+        if (!serve_request(&rio_client, connfd, may_keep))
+            return 0;
+    }
+}
+
+//  serve_request: 요청 1건 처리
 //   - 요청 라인 읽기/검증(GET만)
 //   - 절대 URI 파싱 -> host/port/path 추출
-//   - 원서버 connect
-//   - 서버로 요청라인/헤더 전송(HTTP/1.0으로 다운그레이드 + 헤더 재작성)
-//   - 서버 응답을 바이너리 안전하게 클라이언트로 중계
-static void handle_client(int connfd) {
+//   - 요청 헤더를 끝까지 읽어 원서버용으로 재작성(HIT여도 다음 요청 경계를 위해 끝까지 읽음)
+//   - 캐시 HIT이면 그대로, 아니면 원서버 connect 후 응답을 바이너리 안전하게 클라이언트로 중계
+//   - 반환: 1(응답을 경계까지 보냈고 연결을 유지함), 0(연결 종료)
+//   may_keep : 이번 응답 뒤 연결을 유지해도 되는지(keep-alive 설정과 요청 수 상한)
+static int serve_request(rio_t *rio_client, int connfd, int may_keep) {
     char reqline[MAXLINE];                                // 요청라인 버퍼
     char method[MAXLINE], uri[MAXLINE], version[MAXLINE]; // 파싱된 3요소
     char host[MAXLINE], path[MAXLINE];                    // URI에서 뽑은 host/path
     int port = 80;                                        // URI 포트(기본 80)
-    rio_t rio_client;                                     // 클라이언트 RIO 버퍼
-    int serverfd = -1;                                    // 원서버 소켓 FD
-
-    rio_readinitb(&rio_client, connfd); // 클라 소켓에 대해 RIO 초기화(부분읽기 안전)
+    http_request_t creq;                                  // 클라이언트의 연결 유지 희망 등
 
     // 요청 라인 읽기
-    ssize_t n = rio_readlineb(&rio_client, reqline, sizeof(reqline));
+    ssize_t n = rio_readlineb(rio_client, reqline, sizeof(reqline));
     if (n <= 0) // EOF/오류 -> 조용히 종료(브라우저가 먼저 끊었을 수 있음)
-        return;
+        return 0;
 
     // METHOD URI VERSION 파싱
     if (parse_request_line(reqline, method, sizeof(method), uri, sizeof(uri), version, sizeof(version)) < 0) {
         clienterror(connfd, 400, "Bad Request", "Malformed request line"); // 400
-        return;
+        return 0;
     }
 
     // GET 외 메서드 거부(Part 1 범위)
     if (strcasecmp(method, "GET") != 0) {
         clienterror(connfd, 501, "Not Implemented", "Proxy does not implement this method"); // 501
-        return;
+        return 0;
     }
 
     // 절대 URI만 허용 (http://host[:port]/path)
     if (parse_uri(uri, host, sizeof(host), path, sizeof(path), &port) < 0) {
         clienterror(connfd, 400, "Bad Request", "Only supports absolute HTTP URLs"); // 400
-        return;
+        return 0;
     }
-    // 원 서버에 연결하기 전 먼저 캐시를 확인
-    // 캐시 키 생성: 스킴/호스트/포트/경로를 정규화하여 문자열로 구성
-    char cache_key[MAXLINE];
-    if (snprintf(cache_key, sizeof(cache_key), "http://%s:%d%s", host, port, path) <= 0) {
+    // 캐시 키 생성: 스킴/호스트/포트/경로를 정규화하여 문자열로 구성(Vary 응답이면 조회 때 2차 키로 바뀜)
+    char cache_key[CACHE_KEY_MAX];
+    if (snprintf(cache_key, MAXLINE, "http://%s:%d%s", host, port, path) <= 0) {
         clienterror(connfd, 400, "Bad Request", "Failed to build cache key");
-        return;
+        return 0;
     }
 
-    // 캐시 조회: HIT이면 서버 연결 없이 즉시 전송하고 반환
+    // 원서버로 보낼 요청(요청 라인 + 재작성한 헤더)을 버퍼에 먼저 완성
+    // - 풀에서 꺼낸 연결이 이미 끊겨 있으면 새 연결로 다시 보내야 하므로 스트리밍하지 않고 모아 둠
+    // - 캐시 HIT이어도 헤더를 빈 줄까지 읽어야 같은 연결의 다음 요청을 정확히 찾을 수 있음
+    char *req = NULL;
+    size_t req_len = 0, req_cap = 0;
     {
-        char *cached = NULL;
-        size_t csz = 0;
-        int hit = cache_get(cache_key, &cached, &csz); // 캐시 조회
-        if (hit < 0) {
-            // 캐시 내부 오류는 무시하고 네트워크 경로로 진행
+        char outline[MAXLINE];
+        int len = format_upstream_line(outline, sizeof(outline), path, version);
+        if (len < 0 || (size_t)len >= sizeof(outline) ||
+            rbuf_append(&req, &req_len, &req_cap, outline, (size_t)len) < 0) {
+            free(req);
+            clienterror(connfd, 502, "Bad Gateway", "Failed to write request line");
+            return 0;
+        }
+    }
+    // 헤더 재작성 (Host/User-Agent/Connection/Proxy-Connection 정책)
+    http_request_init(&creq, version);
+    if (rewrite_request_headers(rio_client, &req, &req_len, &req_cap, host, port, &creq) < 0) {
+        free(req);
+        clienterror(connfd, 400, "Bad Request", "Invalid request headers");
+        return 0;
+    }
+    // 요청 본문은 전달하지 않으므로 본문이 딸린 요청 뒤에는 다음 요청 경계를 알 수 없어 연결을 닫음
+    int keep = may_keep && creq.keep_alive && !creq.has_body;
+
+    // 캐시 조회: HIT이면 서버 연결 없이 즉시 전송하고 반환
+    // - 클라이언트가 no-cache(새로고침)를 요청하면 저장된 응답을 쓰지 않고 원서버로(받은 응답은 다시 저장)
+    // - 신선도가 지난 사본은 stale-while-revalidate 안이면 바로 보내고 뒤에서 재검증, 아니면 원서버에 조건부 요청
+    //   (304면 그 사본을 보냄). 클라이언트가 직접 검증 중인 요청은 그대로 원서버로
+    int use_cache = !(creq.cc & HTTP_CC_NO_CACHE);
+    cache_obj_t *stale = NULL; // 조건부 요청으로 재검증 중인 사본(pin)
+    if (use_cache) {
+        cache_obj_t *cached = NULL;
+        int hit = cache_lookup(cache_key, sizeof(cache_key), req, req_len, &creq, &cached); // 캐시 조회
+        if (hit == CACHE_STALE && cached->swr && (long long)time(NULL) < cached->expires + cached->swr) {
+            background_fetch(host, port, cache_key, req, req_len, &creq, cached);
+            hit = 1;
+        } else if (hit == CACHE_STALE) {
+            int v = creq.conditional ? 0 : add_validators(&req, &req_len, &req_cap, cached->data, cached->head_len);
+            if (v > 0)
+                stale = cached;
+            else
+                cache_release(cached);
+            if (v < 0) {
+                free(req);
+                clienterror(connfd, 502, "Bad Gateway", "Failed to write request");
+                return 0;
+            }
+        }
+        char nm[NOT_MODIFIED_MAX];
+        size_t nm_len = 0;
+        range_reply_t rr;
+        if (hit == 1 && atomic_load(&cached->filling)) {
+            cache_release(cached); // 원서버에서 아직 채우는 중: 아래 single-flight로 따라 읽음
+        } else if (hit == 1 &&
+                   (nm_len = not_modified_response(&creq, cached->data, cached->head_len, keep, nm, sizeof(nm)))) {
+            // 클라이언트가 가진 사본이 저장된 것과 같음: 본문 없이 304
+            if (writen_all(connfd, nm, nm_len) < 0)
+                keep = 0;
+            cache_release(cached);
+            free(req);
+            return keep;
+        } else if (hit == 1 && range_reply_build(&rr, &creq, cached->data, cached->head_len,
+                                                 cached->size - cached->head_len - 2, cached->chunked, keep)) {
+            // 요청한 범위만 206으로(본문은 복사 없이 객체를 가리킴)
+            if (range_reply_send(connfd, &rr, cached->data + cached->head_len + 2, -1, 0) < 0)
+                keep = 0;
+            free(rr.text);
+            cache_release(cached);
+            free(req);
+            return keep;
+        } else if (hit == 1 && cached->chunked && !strcmp(version, "HTTP/1.0")) {
+            cache_release(cached); // chunked 본문은 HTTP/1.0 클라이언트에 보낼 수 없으므로 원서버로
         } else if (hit == 1) {
-            // 원서버에 연결하지 않고 캐시에서 가져온 바이트를 그대로 클라이언트 소켓으로 전송
-            (void)writen_all(connfd, cached, csz);
-            free(cached); // cache_get이 복사본을 반환했기 때문에, 사용이 끝나면 해제해야함
-            return;
+            // 원서버에 연결하지 않고 캐시 객체의 바이트를 복사 없이 그대로 클라이언트 소켓으로 전송
+            // (이번 연결의 Connection 헤더만 끼워 넣음)
+            char hdr[CACHED_HDR_MAX];
+            struct iovec iov[3];
+            int cnt = cached_response_iov(cached, hdr, sizeof(hdr), &keep, iov);
+            if (writev_all(connfd, iov, cnt) < 0)
+                keep = 0;
+            cache_release(cached); // pin 해제(방출된 객체였다면 여기서 해제됨)
+            free(req);
+            return keep;
         }
+        // hit < 0: 캐시 내부 오류는 무시하고 네트워크 경로로 진행
     }
 
-    // 원서버 TCP 연결 시도
-    serverfd = connect_end_server(host, port);
-    if (serverfd < 0) {
-        clienterror(connfd, 502, "Bad Gateway", "Failed to connect to end server"); // 502
-        return;
+    // 디스크 계층 조회: 메모리에서 밀려났거나 객체 한도를 넘는 응답을 세그먼트 파일에서 sendfile로 보냄
+    // - 신선도가 지났지만 검증자가 있는 레코드는 메모리 사본처럼 원서버에 조건부 요청(304면 이 레코드의 본문을 보냄)
+    disk_obj_t dstale = {0}; // 조건부 요청으로 재검증 중인 디스크 레코드(세그먼트 pin)
+    if (use_cache && !stale) {
+        disk_obj_t d;
+        int dh = disk_get(cache_key, &d);
+        char head[MAXBUF + CACHED_HDR_MAX];
+        int http10_chunked = dh && d.chunked && !strcmp(version, "HTTP/1.0"); // chunked 본문은 HTTP/1.0 클라이언트에 보낼 수 없음
+        if (dh && d.stale) {
+            int v = 0;
+            if (!creq.conditional && !http10_chunked && disk_read_head(&d, head, sizeof(head)) == 0)
+                v = add_validators(&req, &req_len, &req_cap, head, d.head_len);
+            if (v > 0)
+                dstale = d;
+            else
+                disk_release(&d);
+            if (v < 0) {
+                free(req);
+                clienterror(connfd, 502, "Bad Gateway", "Failed to write request");
+                return 0;
+            }
+        } else if (dh) {
+            off_t body_off;
+            size_t body_len;
+            ssize_t hn = -1;
+            char nm[NOT_MODIFIED_MAX];
+            size_t nm_len = 0;
+            if (!http10_chunked || creq.conditional || creq.range[0])
+                hn = disk_response_head(&d, head, sizeof(head), &keep, &body_off, &body_len);
+            if (hn >= 0 && (nm_len = not_modified_response(&creq, head, d.head_len, keep, nm, sizeof(nm)))) {
+                if (writen_all(connfd, nm, nm_len) < 0) // 본문을 읽지 않고 304
+                    keep = 0;
+                disk_release(&d);
+                free(req);
+                return keep;
+            }
+            range_reply_t rr;
+            if (hn >= 0 && d.head_len &&
+                range_reply_build(&rr, &creq, head, d.head_len, body_len - 2, d.chunked, keep)) {
+                if (range_reply_send(connfd, &rr, NULL, d.fd, body_off + 2) < 0) // 범위만 세그먼트에서 sendfile
+                    keep = 0;
+                free(rr.text);
+                disk_release(&d);
+                free(req);
+                return keep;
+            }
+            if (http10_chunked)
+                hn = -1;
+            if (hn >= 0) {
+                if (writen_all(connfd, head, (size_t)hn) < 0 || sendfile_all(connfd, d.fd, body_off, body_len) < 0)
+                    keep = 0;
+                disk_release(&d);
+                free(req);
+                return keep;
+            }
+            disk_release(&d); // 보낼 수 없으면 MISS처럼 원서버로
+        }
     }
 
-    // 요청 라인 전송: HTTP/1.0으로 다운그레이드(프록시 스펙)
-    {
-        char outline[MAXLINE];
-        int len = snprintf(outline, sizeof(outline), "GET %s HTTP/1.0\r\n", path);
-        // snprintf 실패/버퍼 초과/전송 실패 시 502
-        if (len < 0 || (size_t)len >= sizeof(outline) || writen_all(serverfd, outline, (size_t)len) < 0) {
-            close(serverfd); // 원서버 소켓 닫기
-            clienterror(connfd, 502, "Bad Gateway", "Failed to write request line");
-            return;
+    // 같은 키를 이미 원서버에서 받아 오는 요청이 있으면 그 응답을 따라 읽음(single-flight)
+    // - 리더가 실패했거나 캐시하지 않을 응답이면(아직 보낸 것이 없을 때) 합치지 않고 직접 원서버로
+    // - 재검증은 합치지 않음(304면 나눠 줄 본문이 없음). Range 요청도 합치지 않음(206은 나눠 줄 수 없고,
+    //   따라 읽으면 범위 대신 전체를 받음). -F면 전체 응답은 뒤에서 따로 받아 채움
+    int revalidating = stale || dstale.seg;
+    if (use_cache && !revalidating && creq.range[0] && opts.range_fill)
+        background_fetch(host, port, cache_key, req, req_len, &creq, NULL);
+    int leader = 0;
+    flight_t *flight = revalidating || creq.range[0] ? NULL : flight_join(cache_key, &leader);
+    if (flight && !leader) {
+        int fr = follow_flight(flight, connfd, !strcmp(version, "HTTP/1.0"), &keep);
+        flight_release(flight);
+        flight = NULL;
+        if (fr != 0) {
+            free(req);
+            return fr > 0 ? keep : 0;
         }
     }
 
-    // 헤더 재작성/전송 (Host/User-Agent/Connection/Proxy-Connection 정책)
-    if (forward_request_headers(&rio_client, serverfd, host, port) < 0) {
+    // 요청 전송 후 서버 응답을 클라이언트로 스트리밍(바이너리 안전) + 캐시 후보 누적/삽입
+    int rc = fetch_upstream(host, port, connfd, cache_key, req, req_len, &creq, &keep, flight, stale,
+                            dstale.seg ? &dstale : NULL);
+    free(req);
+    cache_release(stale);
+    disk_release(&dstale);
+    if (flight) { // relay_and_maybe_cache가 끝내지 못한 경우(응답 없음 등)에만 실제로 FAILED 처리
+        flight_end(flight, 0); // 기다리던 팔로워는 각자 원서버로
+        flight_release(flight);
+    }
+    if (rc < 0) {
+        clienterror(connfd, 502, "Bad Gateway", "Failed to connect to end server"); // 502
+        return 0;
+    }
+    if (rc == RELAY_RETRY) { // 원서버가 응답 없이 닫음. 클라에는 아직 아무것도 보내지 않았으므로 502
+        clienterror(connfd, 502, "Bad Gateway", "Empty response from end server");
+        keep = 0;
+    }
+    return keep;
+}
+
+// 원서버 연결: keep-alive 풀에 유휴 연결이 있으면 재사용, 없으면 새로 TCP 연결한 뒤 요청을 보내고 응답을 중계
+// - 풀에서 꺼낸 연결은 블로킹으로 되돌려 씀(중계는 블로킹 소켓을 가정)
+// - 재사용한 연결이 응답 첫 바이트 전에 끊겨 있으면 새 연결로 한 번만 재시도
+// - 응답을 경계까지 다 읽었고 서버도 연결을 유지하겠다면 풀에 반납
+// - 반환: relay_and_maybe_cache 결과(RELAY_RETRY면 빈 응답), -1이면 연결 실패(클라에 아직 아무것도 보내지 않음)
+static int fetch_upstream(const char *host, int port, int clientfd, const char *key, const char *req, size_t req_len,
+                          const http_request_t *creq, int *keep, flight_t *flight, cache_obj_t *stale,
+                          const disk_obj_t *dstale) {
+    int serverfd = upstream_acquire(host, port);
+    if (serverfd >= 0) { // epoll 모드의 백그라운드 요청은 이벤트 루프가 반납한(논블로킹) 연결을 꺼낼 수 있음
+        int flags = fcntl(serverfd, F_GETFL, 0);
+        if (flags < 0 || fcntl(serverfd, F_SETFL, flags & ~O_NONBLOCK) < 0) {
+            close(serverfd);
+            serverfd = -1;
+        }
+    }
+    int reused = serverfd >= 0;
+    if (!reused)
+        serverfd = connect_end_server(host, port);
+    if (serverfd < 0)
+        return -1;
+    int rc;
+    for (;;) {
+        if (writen_all(serverfd, req, req_len) < 0)
+            rc = RELAY_RETRY;
+        else
+            rc = relay_and_maybe_cache(serverfd, clientfd, key, req, req_len, creq, keep, flight, stale, dstale);
+        if (rc != RELAY_RETRY || !reused)
+            break;
+        // 원서버가 유휴 연결을 닫은 경합
         close(serverfd);
-        clienterror(connfd, 400, "Bad Request", "Invalid request headers");
-        return;
+        reused = 0;
+        serverfd = connect_end_server(host, port);
+        if (serverfd < 0)
+            break;
+    }
+    if (serverfd >= 0) {
+        if (rc == RELAY_REUSE)
+            upstream_release(host, port, serverfd);
+        else
+            close(serverfd);
     }
+    return rc;
+}
 
-    // 서버 응답을 클라이언트로 스트리밍(바이너리 안전) + 캐시 후보 누적/삽입
-    relay_and_maybe_cache(serverfd, connfd, cache_key);
+// 신선도가 지난 사본(캐시 객체나 디스크 레코드)의 헤더 줄 head에 있는 검증자(ETag/Last-Modified)로
+// 원서버용 요청(빈 줄로 끝남)에 조건부 헤더를 덧붙임
+// - 반환: 덧붙인 바이트 수, 0이면 검증자 없음(요청은 그대로), -1이면 메모리 부족
+static int add_validators(char **req, size_t *len, size_t *cap, const char *head, size_t head_len) {
+    char cond[2 * HTTP_ETAG_MAX + 128];
+    int n = http_conditional_headers(cond, sizeof(cond), head, head_len);
+    if (n <= 0 || *len < 2)
+        return n < 0 ? -1 : 0;
+    *len -= 2; // 마지막 빈 줄 앞에 끼워 넣음
+    if (rbuf_append(req, len, cap, cond, (size_t)n) < 0 || rbuf_append(req, len, cap, "\r\n", 2) < 0)
+        return -1;
+    return n;
+}
 
-    // 원서버 소켓 정리
-    close(serverfd);
+// 재검증 성공(304): 저장된 헤더에 304의 헤더(fresh_head, 빈 줄까지)를 겹친 새 사본을 만들어 교체(RFC 9111 4.3.4)
+// - 본문은 그대로 복사. Date/Cache-Control 등이 새것이라 이 사본을 받은 하위 캐시도 신선하게 봄
+//   (만료 시각만 옮기면 옛 Date가 나가 브라우저가 HIT마다 다시 재검증함)
+// - 반환: 보낼 새 사본(pin, 다 보내면 cache_release). NULL이면 obj를 그대로 보낼 것(새 사본을 만들지 못하면
+//   만료 시각만 제자리에서 갱신하고, 갱신한 정보로도 더는 저장할 수 없으면(no-store 등) 캐시에서 거둠)
+static cache_obj_t *refresh_stale(cache_obj_t *obj, const char *key, const char *fresh_head,
+                                  const http_response_t *fresh, const http_request_t *creq) {
+    http_response_t stored;
+    if (http_parse_response_head(obj->data, obj->head_len + 2, &stored) != 1)
+        return NULL;
+    http_merge_304(&stored, fresh);
+    long long now = (long long)time(NULL);
+    long long expires = http_cache_expiry(&stored, creq, now, opts.default_ttl);
+    if (!expires) {
+        cache_remove_obj(key, obj);
+        compress_forget(key);
+        return NULL;
+    }
+    size_t cap = obj->head_len + fresh->head_len + 64; // Date를 지어 붙일 몫
+    size_t body_len = obj->size - obj->head_len - 2;
+    char *head = malloc(cap);
+    int hn = head ? http_merge_304_head(head, cap, obj->data, obj->head_len, fresh_head, fresh->head_len, now) : -1;
+    cache_obj_t *nobj = hn > 0 ? cache_obj_alloc((size_t)hn + 2 + body_len) : NULL;
+    if (!nobj) {
+        free(head);
+        atomic_store(&obj->expires, expires);
+        return NULL;
+    }
+    memcpy(nobj->data, head, (size_t)hn);
+    memcpy(nobj->data + hn, "\r\n", 2);
+    memcpy(nobj->data + hn + 2, obj->data + obj->head_len + 2, body_len);
+    free(head);
+    nobj->head_len = (size_t)hn;
+    nobj->chunked = obj->chunked;
+    nobj->unsized = obj->unsized;
+    stamp_freshness(nobj, &stored, expires);
+    cache_retain(nobj); // 호출자 몫
+    compress_forget(key); // 옛 헤더(와 옛 만료 시각)로 만든 압축본은 새 사본으로 다시
+    compress_offer(key, nobj);
+    cache_put_obj(key, nobj);
+    return nobj;
+}
+
+// 디스크 계층 레코드의 재검증 성공(304): refresh_stale과 같이 저장된 헤더에 304의 헤더를 겹친 새 헤더를 만들고,
+// 레코드를 그 헤더로 다시 쓰도록 쓰기 스레드에 넘김(본문은 메모리로 읽지 않고 세그먼트끼리 복사)
+// - 갱신한 정보로도 더는 저장할 수 없으면(no-store 등) 레코드를 인덱스에서 뺌. 새 헤더를 만들지 못하면 저장된 헤더 그대로
+// - 반환: 보낼 헤더(+ 이번 연결 헤더, malloc, 길이 *len). 빈 줄과 본문은 세그먼트의 *body_off부터 *body_len바이트를
+//   sendfile. NULL이면 저장된 헤더를 읽지 못함
+static char *refresh_disk_stale(const disk_obj_t *d, const char *key, const char *fresh_head,
+                                const http_response_t *fresh, const http_request_t *creq, int keep, size_t *len,
+                                off_t *body_off, size_t *body_len) {
+    size_t cap = d->head_len + fresh->head_len + 64 + CACHED_HDR_MAX; // Date를 지어 붙일 몫 + 연결 헤더
+    char *old = malloc(d->head_len + 2);
+    char *head = old ? malloc(cap) : NULL;
+    http_response_t stored;
+    if (!head || disk_read_head(d, old, d->head_len + 2) < 0 ||
+        http_parse_response_head(old, d->head_len + 2, &stored) != 1) {
+        free(old);
+        free(head);
+        return NULL;
+    }
+    http_merge_304(&stored, fresh);
+    long long now = (long long)time(NULL);
+    long long expires = http_cache_expiry(&stored, creq, now, opts.default_ttl);
+    int hn = http_merge_304_head(head, cap - CACHED_HDR_MAX, old, d->head_len, fresh_head, fresh->head_len, now);
+    if (hn <= 0) {
+        memcpy(head, old, d->head_len);
+        hn = (int)d->head_len;
+    } else if (expires) {
+        disk_refresh(key, d, head, (size_t)hn, expires);
+    }
+    if (!expires)
+        disk_remove(key, d);
+    free(old);
+    hn += stored_conn_hdr(head + hn, cap - (size_t)hn, d->unsized, d->size - d->head_len - 2, keep);
+    *len = (size_t)hn;
+    *body_off = d->off + (off_t)d->head_len;
+    *body_len = d->size - d->head_len;
+    return head;
+}
+
+// 백그라운드 원서버 요청(클라이언트 요청과 무관하게 받아 캐시에만 담음)
+// - stale-while-revalidate: 낡은 사본의 검증자로 조건부 요청
+// - Range MISS 채우기(-F): Range를 뗀 전체 요청
+typedef struct background_job {
+    char host[MAXLINE];
+    int port;
+    char key[CACHE_KEY_MAX];
+    char *req;
+    size_t req_len;
+    http_request_t creq;
+    cache_obj_t *stale; // 재검증할 사본(pin), 전체 채우기면 NULL
+    flight_t *flight;   // 같은 키의 요청을 하나로(리더만 돌림)
+    struct background_job *next;
+} background_job_t;
+
+// 백그라운드 요청은 요청마다 스레드를 띄우지 않고 고정 워커(BACKGROUND_WORKERS)가 유한 대기열에서 꺼내 처리
+// - 처음 쓰일 때 워커를 띄움. 대기열이 차 있으면 그 요청은 건너뜀(낡은 사본은 그대로 보내고 다음 요청이 다시 시도)
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;           // 대기열에 일이 생김
+    background_job_t *head, *tail;  // 대기열(들어온 순서)
+    size_t queued;                  // 대기 중인 요청 수(BACKGROUND_QUEUE 이하)
+    int workers;                    // 띄운 워커 수(0이면 모두 건너뜀)
+    unsigned long long done;        // 처리한 요청 수
+    unsigned long long skipped;     // 대기열이 차서 건너뛴 요청 수
+} background = {.lock = PTHREAD_MUTEX_INITIALIZER, .ready = PTHREAD_COND_INITIALIZER};
+static pthread_once_t background_once = PTHREAD_ONCE_INIT;
+
+static void *background_main(void *arg) {
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&background.lock);
+        while (!background.head)
+            pthread_cond_wait(&background.ready, &background.lock);
+        background_job_t *job = background.head;
+        background.head = job->next;
+        if (!background.head)
+            background.tail = NULL;
+        background.queued--;
+        pthread_mutex_unlock(&background.lock);
+
+        int keep = 0;
+        // 클라이언트 없이(clientfd -1) 캐시에만 담음. 담을 수 없는 응답이면 본문을 받지 않고 연결을 끊음
+        fetch_upstream(job->host, job->port, -1, job->key, job->req, job->req_len, &job->creq, &keep, job->flight,
+                       job->stale, NULL);
+        flight_end(job->flight, 0); // 새 200을 받았다면 이미 끝남(no-op)
+        flight_release(job->flight);
+        cache_release(job->stale);
+        free(job->req);
+        free(job);
+
+        pthread_mutex_lock(&background.lock);
+        background.done++;
+        pthread_mutex_unlock(&background.lock);
+    }
+    return NULL;
+}
+
+static void background_start(void) {
+    for (int i = 0; i < BACKGROUND_WORKERS; i++) {
+        pthread_t tid;
+        int rc = pthread_create(&tid, NULL, background_main, NULL);
+        if (rc != 0) {
+            fprintf(stderr, "background: pthread_create failed: %s\n", strerror(rc));
+            break;
+        }
+        pthread_detach(tid);
+        background.workers++;
+    }
+}
+
+// 대기열에 넣음. 차 있거나 워커가 없으면 -1(job은 호출자 몫으로 남음)
+static int background_push(background_job_t *job) {
+    pthread_once(&background_once, background_start);
+    pthread_mutex_lock(&background.lock);
+    if (!background.workers || background.queued >= BACKGROUND_QUEUE) {
+        background.skipped++;
+        pthread_mutex_unlock(&background.lock);
+        return -1;
+    }
+    job->next = NULL;
+    if (background.tail)
+        background.tail->next = job;
+    else
+        background.head = job;
+    background.tail = job;
+    background.queued++;
+    pthread_cond_signal(&background.ready);
+    pthread_mutex_unlock(&background.lock);
+    return 0;
+}
+
+static void print_background_stats(void) {
+    pthread_mutex_lock(&background.lock);
+    if (background.workers)
+        fprintf(stderr, "background: workers=%d done=%llu skipped=%llu queued=%zu\n", background.workers,
+                background.done, background.skipped, background.queued);
+    pthread_mutex_unlock(&background.lock);
+}
+
+// 응답을 보낸(또는 보내는) 요청 뒤에서 같은 키를 받아 오도록 백그라운드 대기열에 넣음(이미 받아 오는 중이면 맡김)
+// - stale이 있으면 재검증: 304면 사본의 만료 시각만 갱신, 200이면 새 응답으로 교체
+// - 없으면 요청에서 Range/If-Range를 떼고 전체 응답을 받아 캐시(크면 디스크 계층)에 채움.
+//   범위의 시작만 봐도 담을 수 있는 가장 큰 객체보다 크면(디스크 계층이 꺼져 있는 큰 동영상 탐색 등) 시작하지 않음
+// - 대기열이 차 있거나 실패하면 건너뜀(다음 요청이 다시 시도)
+static void background_fetch(const char *host, int port, const char *key, const char *req, size_t req_len,
+                             const http_request_t *creq, cache_obj_t *stale) {
+    if (!stale) {
+        size_t max = cache_max_object_size();
+        if (opts.disk_dir && opts.disk_object_size > max)
+            max = opts.disk_object_size;
+        if (http_range_min_length(creq->range) > (long long)max)
+            return;
+    }
+    int leader = 0;
+    flight_t *flight = flight_join(key, &leader);
+    if (!flight)
+        return;
+    if (!leader) {
+        flight_release(flight);
+        return;
+    }
+    background_job_t *job = calloc(1, sizeof(*job));
+    size_t cap = 0;
+    int ok = job && strlen(host) < sizeof(job->host) && strlen(key) < sizeof(job->key) &&
+             rbuf_append(&job->req, &job->req_len, &cap, req, req_len) == 0;
+    if (ok && stale)
+        ok = add_validators(&job->req, &job->req_len, &cap, stale->data, stale->head_len) > 0;
+    else if (ok)
+        job->req_len = http_strip_range_headers(job->req, job->req_len);
+    if (ok) {
+        strcpy(job->host, host);
+        strcpy(job->key, key);
+        job->port = port;
+        job->creq = *creq;
+        job->stale = stale;
+        job->flight = flight;
+        if (stale)
+            cache_retain(stale);
+        if (background_push(job) == 0)
+            return;
+        cache_release(stale);
+    }
+    if (job)
+        free(job->req);
+    free(job);
+    flight_end(flight, 0);
+    flight_release(flight);
 }
 
 // parse_request_line: METHOD URI VERSION를 공백 구분으로 파싱
@@ -253,12 +1390,14 @@ static int parse_uri(const char *uri, char *host, size_t hsz, char *path, size_t
     return 0;
 }
 
-// forward_request_headers: 클라이언트 헤더를 서버로 전달(필수 헤더 재작성)
+// rewrite_request_headers: 클라이언트 헤더를 원서버용으로 재작성해 요청 버퍼 req에 이어붙임
 //  - 필터링: User-Agent / Connection / Proxy-Connection -> 무시 후 나중에 고정값 추가
 //  - Host: 있으면 그대로 전달, 없으면 생성해서 추가
-//  - 나머지 헤더는 그대로 서버로 전달
-//  - 마지막에 강제 헤더(User-Agent/Connection/Proxy-Connection) + 빈 줄 전송
-static int forward_request_headers(rio_t *client_rio, int serverfd, const char *host, int port) {
+//  - 나머지 헤더는 그대로 전달
+//  - 마지막에 강제 헤더(User-Agent/연결 관리) + 빈 줄
+//  - 지나가는 헤더에서 클라이언트 연결 유지 희망/요청 본문 유무를 creq에 기록
+static int rewrite_request_headers(rio_t *client_rio, char **req, size_t *len, size_t *cap, const char *host,
+                                   int port, http_request_t *creq) {
     int saw_host = 0; // Host 헤더를 봤는지
 
     for (;;) {
@@ -275,26 +1414,12 @@ static int forward_request_headers(rio_t *client_rio, int serverfd, const char *
             break;
         }
 
-        // Host:는 원본 유지(있으면 전달, saw_host=1)
-        if (!strncasecmp(line, "Host:", 5)) {
+        if (!strncasecmp(line, "Host:", 5)) // Host:는 원본 유지
             saw_host = 1;
-            if (writen_all(serverfd, line, linelen) < 0) {
-                free(line);
-                return -1;
-            }
-            free(line);
-            continue;
-        }
-
-        // User-Agent / Connection / Proxy-Connection 은 제거
-        if (!strncasecmp(line, "User-Agent:", 11) || !strncasecmp(line, "Connection:", 11) ||
-            !strncasecmp(line, "Proxy-Connection:", 17)) {
-            free(line);
-            continue; // 나중에 고정 헤더로 대체 전송
-        }
+        http_request_header(creq, line, linelen);
 
-        // 그 외 헤더는 수정 없이 그대로 서버로 전달
-        if (writen_all(serverfd, line, linelen) < 0) {
+        // User-Agent / Connection / Proxy-Connection 은 제거(나중에 고정 헤더로 대체), 그 외는 그대로
+        if (!is_replaced_header(line) && rbuf_append(req, len, cap, line, linelen) < 0) {
             free(line);
             return -1;
         }
@@ -304,97 +1429,753 @@ static int forward_request_headers(rio_t *client_rio, int serverfd, const char *
     // Host가 없었다면 생성해서 추가(포트가 80이 아니면 host:port)
     if (!saw_host) {
         char hosthdr[MAXLINE];
-        int len = (port == 80) ? snprintf(hosthdr, sizeof(hosthdr), "Host: %s\r\n", host)
-                               : snprintf(hosthdr, sizeof(hosthdr), "Host: %s:%d\r\n", host, port);
-        if (len < 0 || (size_t)len >= sizeof(hosthdr))
-            return -1;
-        if (writen_all(serverfd, hosthdr, (size_t)len) < 0)
+        int n = (port == 80) ? snprintf(hosthdr, sizeof(hosthdr), "Host: %s\r\n", host)
+                             : snprintf(hosthdr, sizeof(hosthdr), "Host: %s:%d\r\n", host, port);
+        if (n < 0 || (size_t)n >= sizeof(hosthdr) || rbuf_append(req, len, cap, hosthdr, (size_t)n) < 0)
             return -1;
     }
+    return append_upstream_tail(req, len, cap);
+}
 
-    // 고정/강제 헤더 3종 전송 (과제 명세)
-    // 1. User-Agent
-    // 2. Connection: close
-    // 3. Proxy-Connection: close
-    if (writen_all(serverfd, user_agent_hdr, strlen(user_agent_hdr)) < 0)
-        return -1;
-    if (writen_all(serverfd, conn_close_hdr, strlen(conn_close_hdr)) < 0)
+// 원서버로 보낼 요청 라인
+// - keep-alive 풀을 끄면 과제 명세대로 HTTP/1.0(+ Connection: close)
+// - 풀을 쓰면 클라이언트 버전을 따름: HTTP/1.1 클라이언트는 HTTP/1.1(지속 연결 기본, chunked 응답 가능),
+//   HTTP/1.0 클라이언트에게는 chunked를 보내면 안 되므로 HTTP/1.0 + Connection: keep-alive
+static int format_upstream_line(char *out, size_t cap, const char *path, const char *version) {
+    const char *v = upstream_enabled() && !strcmp(version, "HTTP/1.1") ? "HTTP/1.1" : "HTTP/1.0";
+    return snprintf(out, cap, "GET %s %s\r\n", path, v);
+}
+
+// 헤더 끝부분: 고정 User-Agent + 연결 관리 헤더 + 빈 줄
+static int append_upstream_tail(char **req, size_t *len, size_t *cap) {
+    if (rbuf_append(req, len, cap, user_agent_hdr, strlen(user_agent_hdr)) < 0)
         return -1;
-    if (writen_all(serverfd, proxy_conn_close_hdr, strlen(proxy_conn_close_hdr)) < 0)
+    if (upstream_enabled()) {
+        if (rbuf_append(req, len, cap, conn_keepalive_hdr, strlen(conn_keepalive_hdr)) < 0)
+            return -1;
+    } else if (rbuf_append(req, len, cap, conn_close_hdr, strlen(conn_close_hdr)) < 0 ||
+               rbuf_append(req, len, cap, proxy_conn_close_hdr, strlen(proxy_conn_close_hdr)) < 0) {
         return -1;
+    }
+    return rbuf_append(req, len, cap, "\r\n", 2);
+}
 
-    // 헤더 종료 빈 줄
-    if (writen_all(serverfd, "\r\n", 2) < 0)
-        return -1;
+// is_replaced_header: 클라이언트가 보낸 값을 버리고 프록시 고정값으로 대체할 헤더인지 판별
+//  - User-Agent / Connection / Proxy-Connection
+static int is_replaced_header(const char *line) {
+    return !strncasecmp(line, "User-Agent:", 11) || !strncasecmp(line, "Connection:", 11) ||
+           !strncasecmp(line, "Proxy-Connection:", 17);
+}
 
+// relay_body: 응답 헤더 뒤 본문을 메시지 끝(body->done)까지 클라이언트로 중계(바이너리 안전)
+//  - chunked가 아니면 tee/splice 모드에 따라 커널 안에서만 옮기고, chunked는 청크 경계를 봐야 하므로 복사 루프
+//  - 복사 루프 중 캐시 누적을 포기하면(한도 초과) 그 시점부터 splice로 전환
+//  - clientfd가 -1이면(백그라운드 요청) 캐시 후보에만 모으고, 누적을 포기하면 거기서 멈춤(-1)
+//  - 반환: 0(메시지 끝까지 중계), -1(어느 한쪽이 끊기거나 응답이 잘림)
+static int relay_body(int serverfd, int clientfd, http_body_t *body, capbuf_t *cap) {
+    char buf[MAXBUF]; // 복사 루프용 전송 버퍼(MAXBUF는 csapp.h 정의)
+    int zerocopy = clientfd >= 0 && body->mode != HTTP_BODY_CHUNKED && opts.relay != PROXY_RELAY_COPY;
+
+    // tee 모드: 클라로는 splice, 캐시 후보는 tee 파이프에서만 읽음. 쓸 수 없으면 아래 복사 루프로 이어감
+    if (zerocopy && opts.relay == PROXY_RELAY_TEE && !cap->abandoned) {
+        int rc = tee_relay(serverfd, clientfd, cap, body);
+        if (rc != 1)
+            return rc;
+    }
+    while (!body->done) {
+        if (zerocopy && cap->abandoned) { // 캐시하지 않을 응답: 나머지는 복사 없이
+            int rc = splice_relay(serverfd, clientfd, body);
+            if (rc != 1)
+                return rc;
+            zerocopy = 0; // splice 불가 -> 복사 루프로 계속
+        }
+        if (clientfd < 0 && cap->abandoned)
+            return -1;
+        ssize_t n = read_some(serverfd, buf, http_body_want(body, sizeof(buf)));
+        if (n < 0)
+            return -1;
+        if (n == 0) { // 서버가 닫음: 길이 정보 없는 응답이면 정상 끝, 아니면 잘린 응답
+            http_body_eof(body);
+            return body->done ? 0 : -1;
+        }
+        size_t take = http_body_consume(body, buf, (size_t)n); // 메시지 뒤 잉여 바이트는 버림(overrun 표시)
+        if (clientfd >= 0 && writen_all(clientfd, buf, take) < 0)
+            return -1; // 클라 조기 종료같은 상황이면 탈출
+        capture_feed(cap, buf, take); // 한도를 넘으면 capbuf가 누적을 포기하고 청크 반납
+    }
     return 0;
 }
 
-// relay_response: 원서버의 응답을 클라이언트로 그대로 복사(바이너리 안전)
-//  - RIO의 rio_readnb는 "정확히 n바이트 이하"를 읽어주며, 내부 버퍼로 부분읽기 안전
-//  - writen_all은 부분쓰기 발생 시 끝까지 재시도
-static void relay_response(int serverfd, int clientfd) {
-    rio_t rio_server; // 서버 소켓용 RIO
-    char buf[MAXBUF]; // 큰 전송 버퍼(MAXBUF는 csapp.h 정의)
-    ssize_t n;
-
-    rio_readinitb(&rio_server, serverfd); // 서버 FD로 RIO 초기화
+// 서버 -> 파이프 -> 클라로 메시지 끝까지 splice
+// - 바이트가 rio_buf/스택 버퍼를 거치지 않으므로 큰 응답(sample.mp4 등)에서 사용자 공간 복사 2회가 사라짐
+// - Content-Length 응답은 본문 경계를 넘지 않도록 남은 길이만큼만 요청(다음 응답을 미리 삼키지 않음)
+// - 반환: 0(메시지 끝까지 중계), -1(한쪽이 끊기거나 잘림), 1(splice를 쓸 수 없음. 파이프가 비어 있을 때만
+//   반환하므로 호출자가 복사 루프로 이어가도 바이트 손실 없음)
+static int splice_relay(int serverfd, int clientfd, http_body_t *body) {
+    int p[2];
+    if (os_pipe(p) < 0)
+        return 1;
+    int rc = 0;
+    while (rc == 0 && !body->done) {
+        ssize_t n = os_splice(serverfd, p[1], http_body_want(body, OS_PIPE_CHUNK), 0);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            rc = (errno == EINVAL || errno == ENOSYS) ? 1 : -1; // 1: 이 fd 조합은 splice 불가
+            break;
+        }
+        if (n == 0) { // 서버 EOF
+            http_body_eof(body);
+            rc = body->done ? 0 : -1;
+            break;
+        }
+        http_body_consume(body, NULL, (size_t)n);
+        // 파이프에 들어온 만큼 클라로 모두 내보냄
+        for (ssize_t left = n; left > 0;) {
+            ssize_t w = os_splice(p[0], clientfd, (size_t)left, 0);
+            if (w < 0 && errno == EINTR)
+                continue;
+            if (w <= 0) { // 클라 조기 종료
+                rc = -1;
+                break;
+            }
+            left -= w;
+        }
+    }
+    close(p[0]);
+    close(p[1]);
+    return rc;
+}
 
-    // EOF까지 반복(HTTP/1.0 close 정책이므로 서버가 닫을 때까지)
-    while ((n = rio_readnb(&rio_server, buf, sizeof(buf))) > 0) {
-        if (writen_all(clientfd, buf, (size_t)n) < 0) {
-            break; // 클라 조기 종료같은 상황이면 탈출
+// 서버 -> 파이프 A -> 클라로 splice하면서, 캐시 후보인 동안에는 A를 파이프 B로 tee해 B만 캐시 버퍼로 읽음
+// - 클라 쪽은 사용자 공간 복사 0회, 캐시 쪽만 B -> 청크 복사 1회(tee 자체는 페이지 참조만 복제)
+// - 누적을 포기하면(한도 초과) 그 뒤로는 tee 없이 splice만
+// - 반환: splice_relay와 같음. 1은 A가 빈 상태에서만 반환하므로 cap에는 클라로 보낸 바이트가 빠짐없이 들어 있음
+static int tee_relay(int serverfd, int clientfd, capbuf_t *cap, http_body_t *body) {
+    int a[2], b[2];
+    if (os_pipe(a) < 0)
+        return 1;
+    if (os_pipe(b) < 0) {
+        close(a[0]);
+        close(a[1]);
+        return 1;
+    }
+    int rc = 0;
+    while (rc == 0 && !body->done) {
+        ssize_t n = os_splice(serverfd, a[1], http_body_want(body, OS_PIPE_CHUNK), 0);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            rc = (errno == EINVAL || errno == ENOSYS) ? 1 : -1;
+            break;
+        }
+        if (n == 0) { // 서버 EOF
+            http_body_eof(body);
+            rc = body->done ? 0 : -1;
+            break;
+        }
+        http_body_consume(body, NULL, (size_t)n);
+        // 비어 있던 B로 방금 들어온 n바이트를 복제(A는 그대로 남음)
+        int teed = 0;
+        if (!cap->abandoned) {
+            teed = os_tee(a[0], b[1], (size_t)n, 0) == n;
+            if (!teed)
+                capture_abandon(cap); // 일부만 복제되면 캐시 후보가 어긋나므로 포기하고 중계만 계속
+        }
+        // 클라로 먼저 내보낸 뒤 캐시 쪽을 채움(클라 지연 우선)
+        for (ssize_t left = n; left > 0;) {
+            ssize_t w = os_splice(a[0], clientfd, (size_t)left, 0);
+            if (w < 0 && errno == EINTR)
+                continue;
+            if (w <= 0) { // 클라 조기 종료
+                rc = -1;
+                break;
+            }
+            left -= w;
         }
+        if (teed)
+            capture_read(cap, b[0], (size_t)n);
     }
+    close(a[0]);
+    close(a[1]);
+    close(b[0]);
+    close(b[1]);
+    return rc;
 }
 
-// 원서버에서 받은 응답을 클라이언트로 스트리밍하면서 전체 크기가 한도(100KiB)이하일 때만 캐시에 저장
+// 원서버에서 받은 응답을 클라이언트로 스트리밍하면서 전체 크기가 한도 이하일 때만 캐시에 저장
+// - 응답 헤더를 먼저 받아 본문 경계(Content-Length/chunked/EOF)를 정하고, 경계까지만 읽음
+// - 응답 헤더의 연결 관리 헤더는 떼고 클라이언트 연결에 맞는 Connection 헤더를 붙여 보냄
+//   (캐시에는 뗀 상태로 저장하고 HIT 때 다시 붙임)
+// - 반환: RELAY_REUSE(메시지를 경계까지 다 읽었고 서버도 연결 유지 -> 풀에 반납 가능),
+//         RELAY_RETRY(응답을 한 바이트도 받지 못함 -> 재사용한 연결이었다면 새 연결로 재시도), RELAY_CLOSE
 // serverfd : 원서버와 연결된 소켓 fd
-// clientfd : 클라이언트와 연결된 소켓 fd
-// key : 캐시 식별자(정규화된 URI 문자열)
-static void relay_and_maybe_cache(int serverfd, int clientfd, const char *key) {
-    rio_t rio_server; // rio 상태 객체
-    char buf[MAXBUF]; // 서버에서 읽은 데이터를 담을 임시 버퍼
-    ssize_t n;        // 매번 읽은 바이트 수를 받는 변수
-
-    // 캐시 후보 버퍼를 한 번에 최대 크리고 확보
-    char *obj = (char *)malloc(MAX_OBJECT_SIZE);
-    size_t cap = obj ? MAX_OBJECT_SIZE : 0; // 올바르게 크기가 할당되었는지
-    size_t used = 0;                        // 현재까지 후보 버퍼 사용량
-    int caching = obj != NULL;              // 캐싱 가능 여부 플래그. 후보 버퍼의 메모리가 할당되어야 함
-
-    Rio_readinitb(&rio_server, serverfd); // 원서버 소켓에 대해 rio 초기화
-
-    // 서버에서 가용한 만큼 읽기를 반복
-    while ((n = rio_readnb(&rio_server, buf, sizeof(buf))) > 0) {
-        // 방금 읽은 바이트를 즉시 클라이언트로 전송. 0 미만이 나오면 끊긴 것
-        if (writen_all(clientfd, buf, (size_t)n) < 0) {
+// clientfd : 클라이언트와 연결된 소켓 fd. -1이면 클라이언트 없이 캐시에만 담음(백그라운드 요청):
+//            담을 수 없는 응답이 되는 즉시 나머지 본문을 받지 않고 RELAY_CLOSE
+// key : 조회한 캐시 식별자(정규화된 URI 문자열, Vary 표시가 있었으면 2차 키)
+// req/req_len/creq : 원서버로 보낸 요청과 그 요약(저장 정책과 Vary 2차 키 계산용)
+// client_keep : 입력은 클라 연결을 유지하고 싶은지, 출력은 응답을 경계까지 보내 실제로 유지할 수 있는지
+// flight : 이 요청이 리더인 single-flight(NULL이면 단독). 캐시 후보를 flight 버퍼에 모아 팔로워에게 공개
+// stale : 조건부 요청으로 재검증 중인 저장된 사본(NULL이면 일반 요청). 304면 신선도를 갱신하고 이 사본을 보냄
+// dstale : stale 대신 재검증 중인 디스크 계층 레코드(세그먼트 pin은 호출자 몫). 304면 본문을 세그먼트에서 보냄
+static int relay_and_maybe_cache(int serverfd, int clientfd, const char *key, const char *req, size_t req_len,
+                                 const http_request_t *creq, int *client_keep, flight_t *flight, cache_obj_t *stale,
+                                 const disk_obj_t *dstale) {
+    char buf[MAXBUF];      // 응답 헤더(+ 함께 도착한 본문 앞부분)를 모으는 버퍼(rio를 거치지 않고 바로 read)
+    size_t len = 0;        // buf에 모은 길이
+    http_response_t resp;  // 파싱한 응답 헤더
+    http_body_t body;      // 본문 경계 추적
+    capbuf_t own;          // 캐시 후보 버퍼. 바이트가 도착할 때만 청크를 잡음
+    capbuf_t *cap = flight ? &flight->cap : &own; // 리더면 팔로워가 따라 읽는 flight 버퍼에 모음
+    int hr = 0, eof = 0;
+
+    // 1. 응답 헤더를 빈 줄까지 받음(버퍼를 넘는 헤더는 해석하지 않고 예전처럼 EOF까지 중계)
+    for (;;) {
+        ssize_t n = read_some(serverfd, buf + len, sizeof(buf) - len);
+        if (n <= 0) {
+            if (len == 0)
+                return RELAY_RETRY;
+            eof = n == 0;
             break;
         }
-        // 캐시 후보 버퍼를 쓰고 있는 경우에만 시도
-        if (caching) {
-            // 현재 누적된 크기 + 새로 읽은 크기가 최대 용량 cap을 넘지 않으면
-            if (used + (size_t)n <= cap) {
-                memcpy(obj + used, buf, (size_t)n); // 후보 버퍼에 그대로 이어붙임
-                used += (size_t)n;                  // 사용량도 갱신
-            } else {                                // 최대 용량 초과 시 더이상 캐시하지 않음
-                caching = 0;
+        len += (size_t)n;
+        if ((hr = http_parse_response_head(buf, len, &resp)) != 0 || len == sizeof(buf))
+            break;
+    }
+    http_body_init(&body, hr == 1 ? &resp : NULL);
+    capbuf_init(cap, cache_max_object_size()); // 실행 시 설정한 단일 객체 한도
+    cap->owner = flight;
+    int rc;
+    size_t hl = 0; // 연결 관리 헤더를 뗀 헤더 줄 길이(캐시 객체의 head_len)
+    char store_key[CACHE_KEY_MAX]; // 응답을 저장할 키
+    long long expires = 0;         // 저장할 응답의 만료 시각(0이면 저장하지 않음)
+
+    // 재검증 성공(304): 저장된 사본을 304의 헤더로 갱신하고 그 바이트를 보냄(본문을 다시 받지 않음)
+    if (hr == 1 && (stale || dstale) && resp.status == 304) {
+        capture_abandon(cap);
+        if (flight) // 따라 읽던 팔로워는 각자 원서버로
+            flight_head(flight, 0, 0, 0);
+        else
+            capbuf_free(cap);
+        if (dstale) {
+            size_t hn;
+            off_t body_off;
+            size_t body_len;
+            char *head = refresh_disk_stale(dstale, key, buf, &resp, creq, *client_keep, &hn, &body_off, &body_len);
+            if (!head) // 저장된 헤더도 읽지 못함: 보낼 것이 없으니 연결을 닫음
+                *client_keep = 0;
+            else if (clientfd >= 0 &&
+                     (writen_all(clientfd, head, hn) < 0 || sendfile_all(clientfd, dstale->fd, body_off, body_len) < 0))
+                *client_keep = 0;
+            free(head);
+            return resp.keep_alive && len == resp.head_len ? RELAY_REUSE : RELAY_CLOSE;
+        }
+        cache_obj_t *refreshed = refresh_stale(stale, key, buf, &resp, creq);
+        char hdr[CACHED_HDR_MAX];
+        struct iovec iov[3];
+        int cnt = cached_response_iov(refreshed ? refreshed : stale, hdr, sizeof(hdr), client_keep, iov);
+        if (clientfd >= 0 && writev_all(clientfd, iov, cnt) < 0)
+            *client_keep = 0;
+        cache_release(refreshed);
+        return resp.keep_alive && len == resp.head_len ? RELAY_REUSE : RELAY_CLOSE;
+    }
+
+    // 2. 헤더와 함께 온 부분을 클라이언트로 전송하고 캐시 후보로 누적
+    if (hr == 1) {
+        char *body_part = buf + resp.head_len;
+        size_t bl = http_body_consume(&body, body_part, len - resp.head_len);
+        hl = http_strip_hop_headers(buf, resp.head_len); // 앞쪽 헤더만 제자리에서 줄어듦(body_part는 그대로)
+        // 길이를 알 수 없는 응답은 서버가 닫는 것으로 끝나므로 클라 연결도 닫아야 경계가 전달됨
+        *client_keep = *client_keep && body.mode != HTTP_BODY_EOF;
+        const char *conn = *client_keep ? conn_keepalive_hdr : conn_close_hdr;
+        struct iovec iov[4] = {{buf, hl}, {(void *)conn, strlen(conn)}, {"\r\n", 2}, {body_part, bl}};
+        rc = clientfd >= 0 ? writev_all(clientfd, iov, 4) : 0;
+        expires = capture_policy(&resp, key, req, req_len, creq, store_key, sizeof(store_key));
+        if (expires)
+            capture_begin(cap, store_key, hl, &resp, expires);
+        else
+            capture_abandon(cap); // 저장하지 않을 응답: 팔로워는 각자 원서버로, 본문은 splice로
+        capture_feed(cap, buf, hl);
+        capture_feed(cap, "\r\n", 2);
+        capture_feed(cap, body_part, bl);
+    } else { // 헤더를 해석하지 못함: 원본 그대로 EOF까지 중계하고 클라 연결도 닫음(저장 규칙을 알 수 없어 캐시 안 함)
+        *client_keep = 0;
+        rc = clientfd >= 0 && writen_all(clientfd, buf, len) < 0 ? -1 : 0;
+        capture_abandon(cap);
+    }
+    if (clientfd < 0 && cap->abandoned) // 받을 사람도 담을 곳도 없음(크기 한도 초과, 저장 불가)
+        rc = -1;
+    if (flight) // 헤더까지 버퍼에 넣었으니 기다리던 팔로워가 보내기 시작할 수 있음
+        flight_head(flight, hl, body.mode == HTTP_BODY_CHUNKED, hr == 1 && body.mode == HTTP_BODY_EOF);
+    if (eof)
+        http_body_eof(&body);
+    // 3. 나머지 본문을 메시지 끝까지
+    if (rc == 0 && !body.done)
+        rc = relay_body(serverfd, clientfd, &body, cap);
+    // 원서버가 응답을 끝까지 보냈을 때만 캐시에 삽입. 중간에 끊긴 응답은 담지 않음
+    if (rc == 0 && body.done && expires)
+        capture_commit(cap, store_key, hl, &resp, body.mode, expires);
+    if (flight) // 캐시에 넣은 뒤 표에서 빠짐(이후 요청은 HIT). 버퍼는 마지막 팔로워가 놓을 때 반납
+        flight_end(flight, rc == 0 && body.done);
+    else
+        capbuf_free(cap); // 청크는 풀로 반납
+    if (rc < 0 || !body.done)
+        *client_keep = 0;
+
+    int reusable = rc == 0 && body.done && body.mode != HTTP_BODY_EOF && !body.overrun && hr == 1 && resp.keep_alive;
+    return reusable ? RELAY_REUSE : RELAY_CLOSE;
+}
+
+// 응답 헤더를 본 직후 호출: Content-Length가 있으면 전체 크기(헤더 줄 head_len + 빈 줄 + 본문)를 미리 알려
+// 정확한 크기로 한 번만 할당(한도를 넘는 응답은 아예 할당하지 않고 포기)
+// - single-flight 리더면 청크 대신 캐시 객체를 바로 잡아 "채우는 중"으로 먼저 캐시에 넣고 그 data에 채움
+//   (같은 키를 조회한 요청은 flight를 따라 읽고, 완성되면 복사 없이 그대로 HIT)
+// - 메모리 객체 한도는 넘지만 디스크 계층이 받을 수 있는 크기면 메모리에 모으지 않고 디스크 계층 임시 파일에
+//   받는 대로 씀(팔로워는 그 파일을 따라 읽고, 완성되면 capture_commit이 쓰기 스레드에 넘겨 세그먼트로 들임)
+static void capture_begin(capbuf_t *cap, const char *key, size_t head_len, const http_response_t *resp,
+                          long long expires) {
+    if (resp->content_length < 0 || resp->chunked)
+        return;
+    size_t total = head_len + 2 + (size_t)resp->content_length;
+    if (total > cap->limit && cap->owner) {
+        disk_stream_t *st = disk_stream_open(key, total, head_len, expires, resp->etag[0] || resp->last_modified >= 0);
+        if (st) {
+            cap->limit = total;
+            flight_stream(cap->owner, st); // flight가 임시 파일을 가짐(팔로워가 다 읽을 때까지)
+            return;
+        }
+    }
+    cache_obj_t *obj = cap->owner && total <= cap->limit ? cache_obj_alloc(total) : NULL;
+    if (!obj) {
+        capbuf_expect(cap, total);
+        return;
+    }
+    obj->head_len = head_len;
+    stamp_freshness(obj, resp, expires);
+    atomic_store(&obj->filling, 1);
+    flight_fill(cap->owner, obj); // flight가 참조 하나(채우는 동안 + 팔로워가 읽는 동안)
+    cache_put_obj(key, obj);      // 호출자 몫 참조는 캐시로(입장 거절이면 flight 몫만 남음)
+}
+
+// 중계한 응답 조각을 캐시 후보 버퍼에 누적(single-flight 리더면 팔로워에게 공개)
+static void capture_feed(capbuf_t *cap, const char *data, size_t n) {
+    capbuf_append(cap, data, n);
+    if (cap->owner)
+        flight_publish(cap->owner);
+}
+
+// tee로 복제한 파이프에서 n바이트를 청크로 바로 읽어 누적(tee 경로의 유일한 복사)
+static void capture_read(capbuf_t *cap, int fd, size_t n) {
+    capbuf_read(cap, fd, n);
+    if (cap->owner)
+        flight_publish(cap->owner);
+}
+
+// 캐시 후보 누적을 포기(따라 읽던 팔로워에게도 알림)
+static void capture_abandon(capbuf_t *cap) {
+    capbuf_abandon(cap);
+    if (cap->owner)
+        flight_publish(cap->owner);
+}
+
+// 응답을 끝까지 받은 뒤 호출: 누적을 포기하지 않았고 Content-Length와 길이가 맞으면
+// 청크들을 캐시 객체 하나로 모아(복사 1회) 캐시에 넘김
+// head_len/mode는 HIT 때 연결 헤더를 끼워 넣을 위치와 본문 경계 방식, expires는 capture_policy가 정한 만료 시각
+static void capture_commit(capbuf_t *cap, const char *key, size_t head_len, const http_response_t *resp,
+                           http_body_mode_t mode, long long expires) {
+    if (cap->fd >= 0) { // 디스크 계층 임시 파일에 받은 응답: 다 받았으면 쓰기 스레드가 세그먼트로 들임
+        disk_stream_t *st = ((flight_t *)cap->owner)->disk;
+        if (!cap->abandoned && cap->len == st->size)
+            disk_stream_commit(st);
+        return;
+    }
+    if (cap->ext) { // 채우는 중으로 이미 캐시에 넣은 객체: 완성 표시는 flight_end가 함
+        cache_obj_t *obj = ((flight_t *)cap->owner)->obj;
+        if (cap->abandoned || cap->len != obj->size)
+            return;
+        compress_forget(key); // 이전 응답의 압축본은 거두고 새로 만듦
+        compress_offer(key, obj);
+        return;
+    }
+    if (cap->abandoned || cap->len == 0 || (cap->expect && cap->len != cap->expect))
+        return;
+    cache_obj_t *obj = cache_obj_alloc(cap->len);
+    if (!obj)
+        return;
+    capbuf_copyout(cap, obj->data);
+    obj->head_len = head_len;
+    obj->chunked = mode == HTTP_BODY_CHUNKED;
+    obj->unsized = head_len && mode == HTTP_BODY_EOF;
+    stamp_freshness(obj, resp, expires);
+    compress_forget(key);
+    compress_offer(key, obj); // 큐가 참조를 따로 가짐
+    cache_put_obj(key, obj);
+}
+
+// 캐시 객체에 capture_policy가 정한 만료 시각과, 만료 뒤 재검증에 필요한 정보(검증자 유무, stale-while-revalidate)를 기록
+static void stamp_freshness(cache_obj_t *obj, const http_response_t *resp, long long expires) {
+    obj->expires = expires;
+    obj->revalidate = resp->etag[0] || resp->last_modified >= 0;
+    obj->swr = resp->swr > 0 ? (unsigned)resp->swr : 0;
+    obj->compressible = resp->compressible;
+}
+
+// 캐시 조회. URL 키에 Vary 표시 객체가 있으면 이번 요청 헤더(req)로 2차 키를 만들어 key에 덮어쓰고 다시 조회
+// - key: 입력은 URL 키, 출력은 실제로 조회한 키(디스크 계층/single-flight/저장에 그대로 씀)
+// - 압축 계층이 켜져 있으면 클라이언트가 받아들이는(creq->accept_enc) 압축본을 먼저 찾고(HIT면 key는 압축본 키),
+//   없어서 원래 응답을 HIT하면 압축본을 만들도록 넘김
+// - 반환: cache_get과 같음(표시 객체 자체는 돌려주지 않음)
+static int cache_lookup(char *key, size_t keycap, const char *req, size_t req_len, const http_request_t *creq,
+                        cache_obj_t **obj_out) {
+    if (compress_lookup(key, keycap, creq->accept_enc, obj_out))
+        return 1;
+    int hit = cache_get(key, obj_out);
+    if (hit == 1 && !(*obj_out)->vary && creq->accept_enc && !atomic_load(&(*obj_out)->filling))
+        compress_offer(key, *obj_out);
+    if (hit != 1 || !(*obj_out)->vary)
+        return hit;
+    cache_obj_t *marker = *obj_out;
+    char names[HTTP_VARY_MAX], url[MAXLINE];
+    size_t n = marker->size < sizeof(names) ? marker->size : sizeof(names) - 1;
+    memcpy(names, marker->data, n);
+    names[n] = '\0';
+    cache_release(marker);
+    *obj_out = NULL;
+    snprintf(url, sizeof(url), "%s", key);
+    if (http_vary_key(key, keycap, url, names, req, req_len) < 0) {
+        snprintf(key, keycap, "%s", url); // 2차 키가 너무 김: URL 키로 원서버에 가고 저장하지 않음(capture_policy)
+        return 0;
+    }
+    if (compress_lookup(key, keycap, creq->accept_enc, obj_out))
+        return 1;
+    hit = cache_get(key, obj_out);
+    if (hit == 1 && (*obj_out)->vary) { // 2차 키 자리에 표시 객체가 있을 수 없지만 방어적으로
+        cache_release(*obj_out);
+        *obj_out = NULL;
+        return 0;
+    }
+    if (hit == 1 && creq->accept_enc && !atomic_load(&(*obj_out)->filling))
+        compress_offer(key, *obj_out);
+    return hit;
+}
+
+// 응답 헤더를 본 직후: 공유 캐시 규칙(http_cache_expiry)으로 저장할지와 만료 시각을 정하고 저장할 키를 store_key에
+// - 반환: 만료 시각(UNIX 초), 저장하지 않으면 0
+// - Vary가 있으면 원서버로 보낸 요청 헤더로 만든 2차 키에만 저장. 조회한 키가 그 2차 키가 아니면(표시를 처음 봄/
+//   목록이 바뀜) URL 키에 Vary 표시 객체만 넣고 이번 응답은 저장하지 않음. single-flight는 URL 키로 합쳤으므로
+//   이번 응답을 다른 요청 헤더를 가진 팔로워에게 나눠 줄 수 없기 때문(다음 요청부터 2차 키로 조회/저장)
+// - Vary가 없는데 2차 키로 조회했으면 URL 키에 저장(표시 객체를 대체)
+static long long capture_policy(const http_response_t *resp, const char *key, const char *req, size_t req_len,
+                                const http_request_t *creq, char *store_key, size_t keycap) {
+    long long expires = http_cache_expiry(resp, creq, (long long)time(NULL), opts.default_ttl);
+    if (!expires)
+        return 0;
+    const char *nl = strchr(key, '\n');
+    size_t url_len = nl ? (size_t)(nl - key) : strlen(key);
+    if (url_len >= MAXLINE)
+        return 0;
+    char url[MAXLINE];
+    memcpy(url, key, url_len);
+    url[url_len] = '\0';
+    if (!resp->vary[0]) {
+        snprintf(store_key, keycap, "%s", url);
+        return expires;
+    }
+    if (http_vary_key(store_key, keycap, url, resp->vary, req, req_len) < 0)
+        return 0;
+    if (!strcmp(store_key, key))
+        return expires;
+    size_t n = strlen(resp->vary);
+    cache_obj_t *marker = cache_obj_alloc(n);
+    if (marker) {
+        memcpy(marker->data, resp->vary, n);
+        marker->vary = 1;
+        marker->expires = expires;
+        cache_put_obj(url, marker);
+    }
+    return 0;
+}
+
+// 캐시 객체를 클라이언트로 보낼 iovec 구성(obj->data를 복사 없이 가리킴)
+// - 저장된 헤더 줄 끝(head_len)에 이번 연결의 Connection 헤더를 끼워 넣고,
+//   길이 헤더 없이 저장된 응답이면 Content-Length도 붙여 연결을 유지할 수 있게 함
+// - 헤더를 해석하지 못한 원본은 그대로 보내고 연결을 닫음(*keep = 0)
+// - 반환: iovec 개수
+static int cached_response_iov(const cache_obj_t *obj, char *hdr, size_t hdrcap, int *keep, struct iovec iov[3]) {
+    if (obj->head_len == 0) {
+        *keep = 0;
+        iov[0] = (struct iovec){(void *)obj->data, obj->size};
+        return 1;
+    }
+    // 저장된 본문은 head_len 뒤 빈 줄(2바이트) 다음부터
+    int n = stored_conn_hdr(hdr, hdrcap, obj->unsized, obj->size - obj->head_len - 2, *keep);
+    iov[0] = (struct iovec){(void *)obj->data, obj->head_len};
+    iov[1] = (struct iovec){hdr, (size_t)n};
+    iov[2] = (struct iovec){(void *)(obj->data + obj->head_len), obj->size - obj->head_len};
+    return 3;
+}
+
+// 클라이언트 조건부 요청(If-None-Match/If-Modified-Since)을 저장된 헤더 줄 head[0..head_len)로 평가해
+// 맞으면 본문 없는 304(저장된 검증자/신선도 헤더 + 이번 연결의 Connection + 빈 줄)를 out에
+// - 반환: 길이, 전체 응답을 보내야 하면(조건부가 아님, 맞지 않음, 200이 아닌 저장 응답, 넘침) 0
+static size_t not_modified_response(const http_request_t *creq, const char *head, size_t head_len, int keep,
+                                    char *out, size_t cap) {
+    if (!creq->conditional || head_len == 0 || !http_not_modified(creq, head, head_len))
+        return 0;
+    int n = http_not_modified_head(out, cap, head, head_len);
+    if (n < 0)
+        return 0;
+    int m = snprintf(out + n, cap - (size_t)n, "%s\r\n", keep ? conn_keepalive_hdr : conn_close_hdr);
+    if (m < 0 || (size_t)m >= cap - (size_t)n)
+        return 0;
+    return (size_t)n + (size_t)m;
+}
+
+// multipart/byteranges 부분 하나의 머리(앞 부분과의 CRLF + 경계 + Content-Type + Content-Range + 빈 줄)
+static int range_part_head(char *out, size_t cap, int first, const char *boundary, const char *ctype, long long from,
+                           long long to, size_t body_len) {
+    return snprintf(out, cap, "%s--%s\r\n%s%s%sContent-Range: bytes %lld-%lld/%zu\r\n\r\n", first ? "" : "\r\n",
+                    boundary, ctype[0] ? "Content-Type: " : "", ctype, ctype[0] ? "\r\n" : "", from, to, body_len);
+}
+
+static int range_text(range_reply_t *rr, size_t *cap, const char *s, size_t n) {
+    if (rbuf_append(&rr->text, &rr->text_len, cap, s, n) < 0)
+        return -1;
+    rr->piece[rr->n++] = (range_piece_t){0, rr->text_len - n, n};
+    rr->total += n;
+    return 0;
+}
+
+// Range 요청(creq)을 저장된 응답(헤더 줄 head[0..head_len), 본문 body_len바이트)으로 평가해 보낼 조각을 rr에
+// - 범위 하나: 206 + Content-Range, 여럿: 206 multipart/byteranges, 만족할 수 없으면 416
+// - 반환: 1(다 보낸 뒤 rr->text를 free), 0(Range가 없거나 무시: 전체 응답. chunked로 저장된 본문,
+//   200이 아닌 응답, If-Range 불일치, 형식 오류, 메모리 부족)
+static int range_reply_build(range_reply_t *rr, const http_request_t *creq, const char *head, size_t head_len,
+                             size_t body_len, int chunked, int keep) {
+    static atomic_ulong seq; // multipart 경계를 응답마다 다르게
+    memset(rr, 0, sizeof(*rr));
+    http_range_t rg;
+    int pr;
+    if (!creq->range[0] || chunked || !http_range_applies(creq, head, head_len) ||
+        (pr = http_parse_range(creq->range, (long long)body_len, &rg)) == 0)
+        return 0;
+    const char *conn = keep ? conn_keepalive_hdr : conn_close_hdr;
+    char line[MAXLINE], ctype[256], boundary[64];
+    size_t cap = 0;
+    int n;
+    if (pr < 0) {
+        n = snprintf(line, sizeof(line),
+                     "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */%zu\r\nContent-Length: 0\r\n%s\r\n",
+                     body_len, conn);
+        if (range_text(rr, &cap, line, (size_t)n) < 0)
+            goto fail;
+        return 1;
+    }
+    char *hb = malloc(MAXBUF);
+    int hn = hb ? http_range_head(hb, MAXBUF, head, head_len, rg.n > 1, ctype, sizeof(ctype)) : -1;
+    if (hn < 0 || range_text(rr, &cap, hb, (size_t)hn) < 0) {
+        free(hb);
+        goto fail;
+    }
+    free(hb);
+    size_t content = 0;
+    if (rg.n == 1) {
+        content = (size_t)(rg.last[0] - rg.first[0] + 1);
+        n = snprintf(line, sizeof(line), "Content-Range: bytes %lld-%lld/%zu\r\nContent-Length: %zu\r\n%s\r\n",
+                     rg.first[0], rg.last[0], body_len, content, conn);
+    } else {
+        snprintf(boundary, sizeof(boundary), "proxy-range-%lx-%lx", (unsigned long)time(NULL),
+                 (unsigned long)atomic_fetch_add(&seq, 1));
+        for (int i = 0; i < rg.n; i++) // 전체 길이를 먼저 알아야 Content-Length를 씀
+            content += (size_t)range_part_head(line, sizeof(line), i == 0, boundary, ctype, rg.first[i], rg.last[i],
+                                               body_len) +
+                       (size_t)(rg.last[i] - rg.first[i] + 1);
+        content += strlen(boundary) + 8; // "\r\n--" 경계 "--\r\n"
+        n = snprintf(line, sizeof(line),
+                     "Content-Type: multipart/byteranges; boundary=%s\r\nContent-Length: %zu\r\n%s\r\n", boundary,
+                     content, conn);
+    }
+    // 헤더 끝은 앞 조각에 이어 붙임(조각 수를 아낌)
+    if (rbuf_append(&rr->text, &rr->text_len, &cap, line, (size_t)n) < 0)
+        goto fail;
+    rr->piece[0].len += (size_t)n;
+    rr->total += (size_t)n;
+    for (int i = 0; i < rg.n; i++) {
+        if (rg.n > 1) {
+            n = range_part_head(line, sizeof(line), i == 0, boundary, ctype, rg.first[i], rg.last[i], body_len);
+            if (range_text(rr, &cap, line, (size_t)n) < 0)
+                goto fail;
+        }
+        size_t len = (size_t)(rg.last[i] - rg.first[i] + 1);
+        rr->piece[rr->n++] = (range_piece_t){1, (size_t)rg.first[i], len};
+        rr->total += len;
+    }
+    if (rg.n > 1) {
+        n = snprintf(line, sizeof(line), "\r\n--%s--\r\n", boundary);
+        if (range_text(rr, &cap, line, (size_t)n) < 0)
+            goto fail;
+    }
+    return 1;
+fail:
+    free(rr->text);
+    rr->text = NULL;
+    return 0;
+}
+
+// range_reply_build로 만든 조각을 보냄. 본문 구간은 body(메모리 객체의 본문 시작)가 있으면 writev로,
+// 없으면 디스크 세그먼트 fd의 body_off부터 sendfile로. 반환: 0, 보내다 실패하면 -1
+static int range_reply_send(int clientfd, const range_reply_t *rr, const char *body, int fd, off_t body_off) {
+    if (body) {
+        struct iovec iov[RANGE_PIECES];
+        for (int i = 0; i < rr->n; i++)
+            iov[i] = (struct iovec){(void *)((rr->piece[i].body ? body : rr->text) + rr->piece[i].off),
+                                    rr->piece[i].len};
+        return writev_all(clientfd, iov, rr->n);
+    }
+    for (int i = 0; i < rr->n; i++) {
+        int rc = rr->piece[i].body ? sendfile_all(clientfd, fd, body_off + (off_t)rr->piece[i].off, rr->piece[i].len)
+                                   : (writen_all(clientfd, rr->text + rr->piece[i].off, rr->piece[i].len) < 0 ? -1 : 0);
+        if (rc < 0)
+            return -1;
+    }
+    return 0;
+}
+
+// range_reply_build로 만든 조각을 rr->total바이트 버퍼 하나로 모음(본문은 body에서 복사, 없으면 fd에서 pread)
+// 반환: malloc한 버퍼, 실패하면 NULL
+static char *range_reply_flatten(const range_reply_t *rr, const char *body, int fd, off_t body_off) {
+    char *buf = malloc(rr->total ? rr->total : 1);
+    size_t at = 0;
+    for (int i = 0; buf && i < rr->n; i++) {
+        size_t off = rr->piece[i].off, len = rr->piece[i].len;
+        if (!rr->piece[i].body)
+            memcpy(buf + at, rr->text + off, len);
+        else if (body)
+            memcpy(buf + at, body + off, len);
+        else {
+            for (size_t got = 0; got < len;) {
+                ssize_t n = pread(fd, buf + at + got, len - got, body_off + (off_t)(off + got));
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0) {
+                    free(buf);
+                    return NULL;
+                }
+                got += (size_t)n;
             }
         }
+        at += len;
     }
-    // 응답을 끝까지 받아 누적한 총 크기가 0보다 크고
-    // 초과 없이 모두 담았을 경우 캐시에 삽입
-    if (caching && used > 0) {
-        cache_put(key, obj, used);
+    return buf;
+}
+
+// 디스크 계층 객체의 헤더 줄과 뒤따르는 빈 줄(head_len + 2바이트)을 세그먼트에서 buf로 읽음
+// - 반환: 0, 헤더를 해석하지 못한 원본이거나 buf보다 크거나 읽지 못하면 -1
+static int disk_read_head(const disk_obj_t *d, char *buf, size_t cap) {
+    if (d->head_len == 0 || d->head_len + 2 > cap)
+        return -1;
+    size_t got = 0;
+    while (got < d->head_len + 2) {
+        ssize_t r = pread(d->fd, buf + got, d->head_len + 2 - got, d->off + (off_t)got);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return -1;
+        got += (size_t)r;
     }
-    free(obj); // 캐시 후보 임시 버퍼 해제
+    return 0;
 }
 
-// clienterror: 간단한 HTML 에러 응답 생성 및 전송
-//  - 상태줄/헤더/바디를 만들어 클라이언트에 보냄
-static void clienterror(int fd, int status, const char *shortmsg, const char *longmsg) {
-    char body[MAXBUF]; // HTML 본문 버퍼
-    char hdr[MAXLINE]; // 상태줄+헤더 버퍼
+// 디스크 계층 객체를 보낼 준비: 저장된 헤더 줄을 buf로 읽어 연결 헤더를 붙이고(cached_response_iov와 같은 규칙),
+// 뒤따르는 빈 줄 + 본문은 세그먼트 파일에서 sendfile로 보낼 범위로 알려 줌
+// - 헤더를 해석하지 못한 원본은 전체를 sendfile로 보내고 연결을 닫음(*keep = 0, 반환 0)
+// - 반환: buf에 채운 길이, 헤더가 buf보다 크거나 읽지 못하면 -1
+static ssize_t disk_response_head(const disk_obj_t *d, char *buf, size_t cap, int *keep, off_t *body_off,
+                                  size_t *body_len) {
+    if (d->head_len == 0) {
+        *keep = 0;
+        *body_off = d->off;
+        *body_len = d->size;
+        return 0;
+    }
+    if (d->head_len + CACHED_HDR_MAX > cap || disk_read_head(d, buf, cap) < 0)
+        return -1;
+    int n = stored_conn_hdr(buf + d->head_len, cap - d->head_len, d->unsized, d->size - d->head_len - 2, *keep);
+    *body_off = d->off + (off_t)d->head_len;
+    *body_len = d->size - d->head_len;
+    return (ssize_t)(d->head_len + (size_t)n);
+}
+
+// 저장된 응답(캐시 객체/flight 버퍼)의 헤더 줄 끝에 끼워 넣을 헤더: 이번 연결의 Connection과,
+// 길이 헤더 없이 저장된 응답이면 Content-Length(연결을 유지할 수 있게). 반환: 길이
+static int stored_conn_hdr(char *hdr, size_t hdrcap, int unsized, size_t body_len, int keep) {
+    int n = 0;
+    if (unsized)
+        n = snprintf(hdr, hdrcap, "Content-Length: %zu\r\n", body_len);
+    n += snprintf(hdr + n, hdrcap - (size_t)n, "%s", keep ? conn_keepalive_hdr : conn_close_hdr);
+    return n;
+}
+
+// follow_flight: 같은 키를 받아 오는 리더의 flight 버퍼를 따라 읽어 클라이언트로 전송(원서버 요청 없음)
+//  - 버퍼는 캐시 객체와 같은 형식이므로 HIT처럼 헤더 줄 끝에 이번 연결의 Connection 헤더만 끼워 넣음
+//  - 길이를 아는 응답은 리더가 채우는 대로, 나머지는 끝까지 채워진 뒤 보냄(flight_wait가 구분)
+//  - 리더가 디스크 계층 임시 파일에 채우는 응답은 그 파일에서 sendfile로 보냄
+//  - 반환: 1(응답을 보냄), 0(아무것도 보내지 않음: 리더 실패/캐시 불가/HTTP 1.0에 chunked -> 직접 원서버로),
+//          -1(보내던 중 실패, 연결 종료)
+static int follow_flight(flight_t *f, int clientfd, int http10, int *keep) {
+    char hdr[CACHED_HDR_MAX];
+    struct iovec iov[16];
+    size_t off = 0, avail;
+    int started = 0;
+
+    for (;;) {
+        flight_state_t st = flight_wait(f, off, &avail);
+        if (st == FLIGHT_FAILED)
+            return started ? -1 : 0;
+        if (!started) { // 메타데이터는 헤더 공개(FLIGHT_STREAM) 뒤로 바뀌지 않음
+            if (f->chunked && http10)
+                return 0;
+            started = 1;
+            if (f->head_len == 0) { // 헤더를 해석하지 못한 원본: 그대로 보내고 닫음
+                *keep = 0;
+            } else {
+                int n = stored_conn_hdr(hdr, sizeof(hdr), f->unsized, avail - f->head_len - 2, *keep);
+                if (f->disk) {
+                    if (sendfile_all(clientfd, f->disk->fd, f->disk->off, f->head_len) < 0 ||
+                        writen_all(clientfd, hdr, (size_t)n) < 0)
+                        return -1;
+                } else {
+                    size_t bytes;
+                    int cnt = flight_iov(f, 0, f->head_len, iov, 15, &bytes);
+                    iov[cnt++] = (struct iovec){hdr, (size_t)n};
+                    if (writev_all(clientfd, iov, cnt) < 0)
+                        return -1;
+                }
+                off = f->head_len;
+            }
+        }
+        if (f->disk && off < avail) {
+            if (sendfile_all(clientfd, f->disk->fd, f->disk->off + (off_t)off, avail - off) < 0)
+                return -1;
+            off = avail;
+        }
+        while (off < avail) {
+            size_t bytes;
+            int cnt = flight_iov(f, off, avail, iov, 16, &bytes);
+            if (writev_all(clientfd, iov, cnt) < 0)
+                return -1;
+            off += bytes;
+        }
+        if (st == FLIGHT_DONE)
+            return 1;
+    }
+}
+
+// format_clienterror: 간단한 HTML 에러 응답(상태줄/헤더/바디)을 out 버퍼에 작성
+//  - 반환: 작성한 바이트 수, 실패/버퍼 부족 시 -1
+//  - 블로킹 경로(clienterror)와 이벤트 루프(reactor.c)가 함께 사용
+static int format_clienterror(char *out, size_t cap, int status, const char *shortmsg, const char *longmsg) {
+    char body[MAXLINE]; // HTML 본문 버퍼
 
     // HTML 본문 구성
     int bodylen = snprintf(body, sizeof(body),
@@ -403,65 +2184,123 @@ static void clienterror(int fd, int status, const char *shortmsg, const char *lo
                            "%d %s<br>%s"
                            "</body></html>",
                            status, shortmsg, longmsg ? longmsg : "");
-    if (bodylen < 0) // snprintf 실패
-        return;
+    if (bodylen < 0 || (size_t)bodylen >= sizeof(body)) // snprintf 실패
+        return -1;
 
-    // 상태줄/헤더 구성(HTTP/1.0, close)
-    int len = snprintf(hdr, sizeof(hdr),
+    // 상태줄/헤더 구성(HTTP/1.0, close) 뒤에 본문을 이어붙임
+    int len = snprintf(out, cap,
                        "HTTP/1.0 %d %s\r\n"
                        "Content-type: text/html\r\n"
                        "Connection: close\r\n"
-                       "Content-length: %d\r\n\r\n",
-                       status, shortmsg, bodylen);
+                       "Content-length: %d\r\n\r\n%s",
+                       status, shortmsg, bodylen, body);
+    if (len < 0 || (size_t)len >= cap)
+        return -1;
+    return len;
+}
+
+// clienterror: 간단한 HTML 에러 응답 생성 및 전송
+//  - 상태줄/헤더/바디를 만들어 클라이언트에 보냄
+static void clienterror(int fd, int status, const char *shortmsg, const char *longmsg) {
+    char msg[MAXBUF]; // 상태줄+헤더+본문 버퍼
+
+    int len = format_clienterror(msg, sizeof(msg), status, shortmsg, longmsg);
     if (len < 0)
         return;
 
     // 전송
-    writen_all(fd, hdr, (size_t)len);
-    writen_all(fd, body, (size_t)bodylen);
+    writen_all(fd, msg, (size_t)len);
 }
 
-// connect_end_server: DNS 해석 + TCP connect
-//  - getaddrinfo로 (IPv4/IPv6) 후보 목록을 받고 차례대로 connect 시도
-//  - 성공하면 그 소켓 FD 반환, 실패하면 -1
-static int connect_end_server(const char *host, int port) {
-    int clientfd = -1; // 성공하면 이 FD 반환. 소켓 fd
-    // hints : getaddrinfo 호출 시 원하는 조건을 지정하는 입력 구조체
-    // listp : getaddrinfo가 돌려주는 결과 리스트의 시작 포인터 (여러 연결 후보 주소들)
-    struct addrinfo hints, *listp = NULL, *p;
-    char portstr[16]; // 포트 번호를 문자열로 담는 버퍼
-    int rc;           // 함수 호출의 반환 코드를 임시로 보관하는 변수
-
-    memset(&hints, 0, sizeof(hints));                // hints 구조체 초기화
-    hints.ai_socktype = SOCK_STREAM;                 // TCP
-    hints.ai_flags = AI_ADDRCONFIG | AI_NUMERICSERV; // 로컬 주소 구성 고려, 서비스는 숫자(포트)
+// start_connect: 후보 주소 하나로 논블로킹 connect 시작
+//  - 반환: 소켓 FD(진행 중이거나 이미 연결됨, *done = 1이면 즉시 연결), 바로 실패하면 -1
+static int start_connect(const dns_addr_t *a, int port, int *done) {
+    struct sockaddr_storage ss; // 포트를 붙인 connect용 주소
+    socklen_t len = dns_sockaddr(a, port, &ss);
+    int fd = socket(a->family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    int rc = connect(fd, (struct sockaddr *)&ss, len);
+    if (rc < 0 && errno != EINPROGRESS) {
+        close(fd);
+        return -1;
+    }
+    *done = (rc == 0);
+    return fd;
+}
 
-    snprintf(portstr, sizeof(portstr), "%d", port); // 포트 번호 문자열로 변환
+// connect_end_server: DNS 해석 + TCP connect (happy eyeballs, RFC 8305)
+//  - 이름 해석 캐시에서 (IPv6/IPv4 교차 정렬된) 후보 목록을 받아 논블로킹 connect를 시작하고,
+//    connect_delay 안에 끝나지 않으면 다음 후보를 병렬로 더 띄움(실패하면 지연 없이 바로 다음 후보)
+//  - 가장 먼저 연결된 소켓을 블로킹으로 되돌려 반환하고 나머지는 닫음
+//  - 모든 후보가 실패하거나 connect_timeout이 지나면 -1
+static int connect_end_server(const char *host, int port) {
+    dns_result_t res;                   // 해석된 후보 주소 목록(포트 없음)
+    struct pollfd pfd[DNS_MAX_ADDRS];   // 진행 중인 시도
+    int nfly = 0, next = 0, winner = -1; // 진행 중 수, 다음 후보 번호, 연결된 FD
 
-    rc = getaddrinfo(host, portstr, &hints, &listp); // DNS 해석
-    if (rc != 0)                                     // DNS/AI 에러
+    if (dns_resolve(host, &res) < 0) // 캐시 적중이면 즉시, 아니면 해석 스레드 결과를 기다림
         return -1;
 
-    for (p = listp; p != NULL; p = p->ai_next) {                         // 후보 주소 순회
-        clientfd = socket(p->ai_family, p->ai_socktype, p->ai_protocol); // 소켓 생성
-        if (clientfd < 0)
-            continue; // 생성 실패 → 다음 후보
+    long long now = reactor_now_ms();
+    long long deadline = now + opts.connect_timeout; // 전체 타임아웃
+    long long next_at = now;                         // 다음 후보를 띄울 시각
+    while (winner < 0) {
+        // 진행 중인 시도가 없거나 지연이 지났으면 다음 후보 시작
+        if (next < res.n && (nfly == 0 || now >= next_at)) {
+            int done = 0;
+            int fd = start_connect(&res.addr[next++], port, &done);
+            if (fd < 0)
+                continue; // 바로 실패 → 기다리지 않고 다음 후보
+            if (done) {
+                winner = fd;
+                break;
+            }
+            pfd[nfly++] = (struct pollfd){.fd = fd, .events = POLLOUT};
+            next_at = now + opts.connect_delay;
+            continue;
+        }
+        if (nfly == 0 || now >= deadline) // 후보 소진 또는 타임아웃
+            break;
 
-        if (connect(clientfd, p->ai_addr, p->ai_addrlen) == 0) {
-            break; // 연결 성공
+        long long until = (next < res.n && next_at < deadline) ? next_at : deadline;
+        int rc = poll(pfd, (nfds_t)nfly, (int)(until - now));
+        if (rc < 0 && errno != EINTR)
+            break;
+        for (int i = 0; rc > 0 && i < nfly; i++) {
+            if (!pfd[i].revents)
+                continue;
+            int err = 0;
+            socklen_t elen = sizeof(err);
+            if (getsockopt(pfd[i].fd, SOL_SOCKET, SO_ERROR, &err, &elen) == 0 && err == 0) {
+                winner = pfd[i].fd; // 먼저 연결된 쪽이 이김
+                pfd[i] = pfd[--nfly];
+                break;
+            }
+            close(pfd[i].fd); // 실패한 시도는 정리하고 다음 후보를 바로 띄움
+            pfd[i--] = pfd[--nfly];
+            next_at = 0;
         }
-        close(clientfd); // 실패 시 닫고 다음 후보
-        clientfd = -1;
+        now = reactor_now_ms();
     }
 
-    freeaddrinfo(listp); // 할당 해제
-    return clientfd;     // 성공 FD 또는 -1
+    for (int i = 0; i < nfly; i++) // 진 시도 정리
+        close(pfd[i].fd);
+    if (winner >= 0) { // 이후 RIO/splice 중계는 블로킹 소켓을 가정
+        int flags = fcntl(winner, F_GETFL, 0);
+        if (flags < 0 || fcntl(winner, F_SETFL, flags & ~O_NONBLOCK) < 0) {
+            close(winner);
+            winner = -1;
+        }
+    }
+    return winner; // 성공 FD 또는 -1
 }
 
 // open_listenfd_s: getaddrinfo 기반 리스닝 소켓 생성
 // - AI_PASSIVE로 서버 소켓 바인드 주소 획득
 // - SO_REUSEADDR로 빠른 재바인드 허용
-static int open_listenfd_s(const char *port) {
+// - reuseport != 0이면 SO_REUSEPORT도 설정해 같은 포트에 리스너를 여러 개 바인드(멀티 이벤트 루프용)
+static int open_listenfd_s(const char *port, int reuseport) {
     int listenfd = -1;
     struct addrinfo hints, *listp = NULL, *p;
     int optval = 1;
@@ -490,6 +2329,11 @@ static int open_listenfd_s(const char *port) {
 
         // TIME_WAIT 등에서 빠르게 재사용
         setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
+        if (reuseport && setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)) < 0) {
+            close(listenfd);
+            listenfd = -1;
+            continue;
+        }
 
         if (bind(listenfd, p->ai_addr, p->ai_addrlen) == 0) { // 바인드 성공
             if (listen(listenfd, LISTENQ) == 0) {             // 리슨 성공
@@ -505,6 +2349,71 @@ static int open_listenfd_s(const char *port) {
     return listenfd; // 성공 FD 또는 -1
 }
 
+// iov[0..*cnt)에서 이미 보낸 n바이트를 건너뛰도록 배열을 앞으로 당김. 남은 바이트 수를 반환
+static size_t iov_advance(struct iovec *iov, int *cnt, size_t n) {
+    int i = 0;
+    while (i < *cnt && n >= iov[i].iov_len)
+        n -= iov[i++].iov_len;
+    if (i < *cnt) {
+        iov[i].iov_base = (char *)iov[i].iov_base + n;
+        iov[i].iov_len -= n;
+    }
+    memmove(iov, iov + i, (size_t)(*cnt - i) * sizeof(*iov));
+    *cnt -= i;
+    size_t left = 0;
+    for (i = 0; i < *cnt; i++)
+        left += iov[i].iov_len;
+    return left;
+}
+
+// writev_all: 여러 조각을 한 번의 시스템 호출로 보내되, 부분쓰기/시그널 중단은 writen_all처럼 처리
+// (iov 배열은 진행에 따라 변경됨)
+static int writev_all(int fd, struct iovec *iov, int cnt) {
+    while (cnt > 0) {
+        ssize_t w = writev(fd, iov, cnt);
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (iov_advance(iov, &cnt, (size_t)w) == 0)
+            break;
+    }
+    return 0;
+}
+
+// sendfile_all: 파일 infd의 [off, off + len)을 소켓으로 끝까지 보냄(부분 전송/시그널 중단 처리)
+static int sendfile_all(int outfd, int infd, off_t off, size_t len) {
+    while (len > 0) {
+        ssize_t w = os_sendfile(outfd, infd, &off, len);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0) // 0: 파일이 예상보다 짧음(잘림)
+            return -1;
+        len -= (size_t)w;
+    }
+    return 0;
+}
+
+// 읽을 데이터(또는 EOF)가 올 때까지 최대 timeout_ms 대기. 1: 읽기 가능, 0: 타임아웃, -1: 오류
+static int wait_readable(int fd, int timeout_ms) {
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    int rc;
+    do {
+        rc = poll(&pfd, 1, timeout_ms);
+    } while (rc < 0 && errno == EINTR);
+    return rc;
+}
+
+// read_some: 시그널로 중단된 read만 재시도. 반환은 read와 같음(0 = EOF)
+static ssize_t read_some(int fd, void *buf, size_t n) {
+    ssize_t r;
+    do {
+        r = read(fd, buf, n);
+    } while (r < 0 && errno == EINTR);
+    return r;
+}
+
 // writen_all: write의 부분쓰기/시그널 중단을 모두 처리하는 보장된 쓰기
 //  - write는 커널 버퍼 여유 등에 따라 일부만 쓰고 돌아올 수 있음 → 남은 만큼 반복
 //  - EINTR(시그널로 중단) 시 재시도
@@ -0,0 +1,1497 @@
+// Part II-b: epoll 기반 이벤트 루프(reactor) 유닛
+// - 이 파일도 proxy.c에서 텍스트로 포함(#include "reactor.c")되어 같은 번역 단위로 컴파일
+// - 설계: 논블로킹 소켓 + edge-triggered epoll, 연결마다 작은 상태 기계를 힙에 두고 진행
+//   (요청 헤더 수신 -> 캐시 조회 -> 이름 해석 -> 원서버 connect -> 요청 전송 -> 응답 중계 -> keep-alive면 다시 요청 헤더 수신)
+//   같은 키를 다른 연결이 이미 받아 오는 중이면 원서버 대신 그 flight 버퍼를 따라 읽음(RC_FOLLOW)
+// - 연결당 스레드/스택이 없으므로 동시 연결 수가 늘어도 메모리는 연결 구조체 + 버퍼만큼만 증가
+
+#include <sys/epoll.h>
+
+#define REACTOR_MAX_EVENTS 256        // epoll_wait 한 번에 받아올 최대 이벤트 수
+#define REACTOR_MAX_HEAD (64 << 10)   // 요청 헤더 최대 크기(넘으면 400)
+#define REACTOR_HEAD_SLACK 64         // 응답 헤더에 Connection 헤더를 다시 붙일 여유(중계 버퍼 = MAXBUF + 여유)
+
+// 연결 상태 기계의 단계
+typedef enum {
+    RC_READ_HEAD, // 클라이언트 요청 헤더(빈 줄까지) 수신 중
+    RC_RESOLVE,   // 원서버 이름을 해석 스레드가 찾는 중(완료 통지 파이프로 깨어남)
+    RC_CONNECT,   // 원서버 논블로킹 connect 진행 중(후보 주소 여럿을 시차를 두고 병렬 시도)
+    RC_SEND_REQ,  // 재작성한 요청을 원서버로 전송 중
+    RC_RELAY,     // 원서버 응답을 클라이언트로 중계 중
+    RC_FLUSH,     // 준비된 응답(캐시 HIT/에러 페이지)을 보냄. HIT이고 keep-alive면 다음 요청으로
+    RC_FOLLOW,    // 같은 키의 리더가 채우는 flight 버퍼를 따라 읽어 보냄(깨움 우편함으로 깨어남)
+    RC_CLOSED,    // 정리 완료, 이번 epoll 배치가 끝나면 해제
+} rconn_state_t;
+
+typedef struct rconn rconn_t;
+typedef struct reactor reactor_t;
+
+// epoll에 data.ptr로 등록되는 끝점. 같은 연결의 클라/서버 소켓을 구분하기 위해 사용
+typedef struct {
+    rconn_t *conn; // 소속 연결
+    int fd;        // 소켓 FD(-1이면 없음)
+    uint32_t ev;   // 마지막으로 관찰한 epoll 이벤트 비트(connect 완료 판정용)
+} rend_t;
+
+struct rconn {
+    rend_t client;       // 클라이언트 끝점
+    rend_t server;       // 원서버 끝점
+    rconn_state_t state; // 현재 단계
+
+    char *in;      // 요청 헤더 누적 버퍼
+    size_t in_len; // 누적 길이
+    size_t in_cap; // 용량
+
+    char *out;      // 보낼 바이트(RC_SEND_REQ: 서버로 보낼 요청, RC_FLUSH: 클라로 보낼 에러 페이지)
+    size_t out_len; // 전체 길이
+    size_t out_off; // 이미 보낸 길이
+
+    cache_obj_t *hit;       // 캐시 HIT으로 pin한 객체(복사 없이 iov가 가리킴)
+    cache_obj_t *stale;     // 조건부 요청으로 재검증 중인 사본(pin, 304면 hit으로 옮겨 보냄)
+    struct iovec iov[3];    // RC_FLUSH로 보낼 조각(HIT: 헤더 + 연결 헤더 + 본문, 에러: out)
+    int iovcnt;             // 남은 조각 수
+    char hit_hdr[CACHED_HDR_MAX]; // HIT 응답에 끼워 넣는 Connection(+Content-Length) 헤더
+    disk_obj_t dsk;         // 디스크 계층 HIT(dsk.seg != NULL이면 세그먼트 pin, iov 뒤에 sendfile로 보냄)
+                            // dsk.stale이면 조건부 요청으로 재검증 중(304면 rconn_revalidated가 보냄)
+    off_t dsk_off;          // 다음에 보낼 세그먼트 파일 위치
+    size_t dsk_left;        // 남은 sendfile 바이트
+
+    int keep;            // 이번 응답 뒤 클라이언트 연결을 유지할지
+    int requests;        // 이 연결에서 받은 요청 수(-n 상한)
+    long long idle_deadline; // 요청 헤더를 다 받아야 하는 시각(ms, CLOCK_MONOTONIC)
+    rconn_t *idle_prev;  // 요청 대기 목록(마감 시각 순) 링크
+    rconn_t *idle_next;
+    int idle;            // 요청 대기 목록에 들어 있는지
+
+    dns_result_t addrs;       // 원서버 주소 후보(해석 중에는 해석 스레드가 채움)
+    int addr_next;            // 다음에 시도할 connect 후보 번호(= 지금까지 띄운 시도 수)
+    rend_t att[DNS_MAX_ADDRS]; // 후보 주소별 connect 시도 끝점(addrs와 같은 번호, fd -1이면 끝남)
+    int inflight;             // 진행 중인 connect 시도 수
+    long long conn_next_at;   // 다음 후보로 시도를 더 띄울 시각(ms)
+    long long conn_deadline;  // connect 전체 마감 시각(ms)
+    rconn_t *conn_prev;       // connect 진행 중 목록 링크
+    rconn_t *conn_next;
+    int connecting;           // connect 진행 중 목록에 들어 있는지
+    int dns_pending;          // 해석 완료 통지를 기다리는 중(그동안은 닫혀도 해제하지 않음)
+    char *up_host;            // 원서버 호스트(strdup, 풀 반납/재연결용)
+    int up_port;              // 원서버 포트
+    int reused;               // server.fd를 keep-alive 풀에서 꺼냈는지(응답 첫 바이트 전 끊기면 한 번 재시도)
+
+    char *buf;      // 서버->클라 중계 버퍼(MAXBUF, RC_RELAY 진입 시 할당)
+    size_t buf_len; // 버퍼에 담긴 길이
+    size_t buf_off; // 클라로 보낸 길이
+    int head_done;  // 응답 헤더를 받아 본문 경계를 정했는지(그 전까지 buf에 헤더를 모으기만 함)
+    size_t hl;      // 연결 관리 헤더를 뗀 응답 헤더 줄 길이(캐시 객체의 head_len)
+    http_response_t resp; // 파싱한 응답 헤더
+    http_body_t body;     // 본문 경계 추적(body.done이면 응답 끝)
+    int reusable;         // 응답 끝에서 원서버 연결을 풀에 반납할 수 있는지
+
+    int splicing;   // 1: 캐시하지 않을 응답이라 파이프로 splice 중계 중(pipefd 유효), -1: splice 불가로 복사 경로 고정
+    int pipefd[2];  // 서버 -> 파이프 -> 클라 splice용 파이프
+    size_t pipe_len; // 파이프에 들어 있는(아직 클라로 못 보낸) 바이트
+    int teeing;     // tee 모드: teefd가 열려 있고, 캐시 후보인 동안 pipefd를 teefd로 복제
+    int teefd[2];   // 캐시 후보 쪽 복제 파이프
+
+    char *key;      // 캐시 키(strdup). 응답 헤더를 본 뒤에는 저장할 키(capture_policy)로 바뀜
+    long long expires; // 저장할 응답의 만료 시각(0이면 저장하지 않음)
+    http_request_t creq; // 클라이언트 요청 요약(저장 정책용, 원서버로 보낸 요청 자체는 응답 헤더까지 out에 남음)
+    capbuf_t cap_own; // 단독 요청의 캐시 후보 누적 버퍼(청크 단위로 필요할 때만 할당)
+    capbuf_t *cap;    // 쓰는 캐시 후보 버퍼(리더면 flight 버퍼, 아니면 cap_own)
+
+    flight_t *flight;     // 참여 중인 single-flight(리더 또는 팔로워, 없으면 NULL)
+    int leader;           // flight의 리더인지(팔로워면 RC_FOLLOW)
+    int http10;           // 클라이언트가 HTTP/1.0(chunked 응답을 따라 읽을 수 없음)
+    flight_waiter_t fw;   // 팔로워의 깨움 요청(우편함으로 전달)
+    flight_state_t fol_state; // 팔로워가 마지막으로 본 flight 상태
+    size_t fol_avail;     // 그때 읽어도 되던 끝
+    size_t fol_off;       // 클라로 보낸 flight 버퍼 위치(끼워 넣은 헤더 제외)
+    size_t fol_batch;     // 지금 iov에 담긴 flight 바이트(다 보내면 fol_off에 더함)
+    int fol_started;      // 응답을 보내기 시작했는지(그 뒤로는 리더가 실패해도 원서버로 갈 수 없음)
+    reactor_t *reactor;   // 소속 이벤트 루프(다른 루프의 리더가 깨울 때 우편함 위치)
+    rconn_t *mb_next;     // 깨움 우편함 링크
+    int mb_queued;        // 우편함에 들어 있는지(mb_lock 보호, 그동안은 닫혀도 해제하지 않음)
+
+    rconn_t *next_dead; // 지연 해제 리스트 링크
+};
+
+struct reactor {
+    int epfd;       // epoll 인스턴스
+    int listenfd;   // 리스닝 소켓
+    rconn_t *dead;  // 이번 배치에서 닫힌 연결(배치가 끝난 뒤 해제)
+    rconn_t *idle_head; // 요청 헤더를 기다리는 연결(들어온 순서 = 마감 시각 순, 앞에서부터 만료)
+    rconn_t *idle_tail;
+    rconn_t *connecting; // connect 진행 중인 연결(타이머 시각이 제각각이라 매 배치 훑어봄, 보통 몇 개 안 됨)
+    int dns_pipe[2]; // 이름 해석 완료 통지 파이프(해석 스레드가 rconn_t 포인터를 씀)
+    rend_t dns_end;  // 통지 파이프 읽기 끝의 epoll 끝점(conn은 NULL)
+    pthread_mutex_t mb_lock; // 깨움 우편함 보호(다른 스레드의 리더가 넣음)
+    rconn_t *mb_head;        // flight 버퍼가 자라 깨워야 할 팔로워
+    int mb_pipe[2];          // 우편함 초인종 파이프(양 끝 논블로킹, 바이트 값은 의미 없음)
+    rend_t mb_end;           // 초인종 읽기 끝의 epoll 끝점(conn은 NULL)
+};
+
+// 단조 시계 기준 현재 시각(ms)
+static long long reactor_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// 요청 헤더 대기 목록에 넣음: 유휴 타임아웃 안에 다음 요청 헤더가 완성되지 않으면 닫힘
+// (마감 시각이 모두 "지금 + 같은 타임아웃"이므로 꼬리에 붙이기만 해도 정렬이 유지됨)
+static void rconn_idle_add(reactor_t *r, rconn_t *c) {
+    if (c->idle || opts.client_idle <= 0)
+        return;
+    c->idle_deadline = reactor_now_ms() + (long long)opts.client_idle * 1000;
+    c->idle_prev = r->idle_tail;
+    c->idle_next = NULL;
+    if (r->idle_tail)
+        r->idle_tail->idle_next = c;
+    else
+        r->idle_head = c;
+    r->idle_tail = c;
+    c->idle = 1;
+}
+
+static void rconn_idle_remove(reactor_t *r, rconn_t *c) {
+    if (!c->idle)
+        return;
+    if (c->idle_prev)
+        c->idle_prev->idle_next = c->idle_next;
+    else
+        r->idle_head = c->idle_next;
+    if (c->idle_next)
+        c->idle_next->idle_prev = c->idle_prev;
+    else
+        r->idle_tail = c->idle_prev;
+    c->idle = 0;
+}
+
+// connect 진행 중 목록(happy eyeballs 지연/타임아웃 타이머용)
+static void rconn_connect_add(reactor_t *r, rconn_t *c) {
+    if (c->connecting)
+        return;
+    c->conn_prev = NULL;
+    c->conn_next = r->connecting;
+    if (r->connecting)
+        r->connecting->conn_prev = c;
+    r->connecting = c;
+    c->connecting = 1;
+}
+
+static void rconn_connect_remove(reactor_t *r, rconn_t *c) {
+    if (!c->connecting)
+        return;
+    if (c->conn_prev)
+        c->conn_prev->conn_next = c->conn_next;
+    else
+        r->connecting = c->conn_next;
+    if (c->conn_next)
+        c->conn_next->conn_prev = c->conn_prev;
+    c->connecting = 0;
+}
+
+// 진행 중인 connect 시도를 모두 닫고 목록에서 뺌(epoll에서도 자동 제거)
+static void rconn_connect_abort(reactor_t *r, rconn_t *c) {
+    for (int i = 0; i < c->addr_next; i++) {
+        if (c->att[i].fd >= 0) {
+            close(c->att[i].fd);
+            c->att[i].fd = -1;
+        }
+    }
+    c->inflight = 0;
+    rconn_connect_remove(r, c);
+}
+
+// 이 연결의 다음 connect 타이머 시각: 남은 후보가 있으면 다음 시도 시각, 아니면 전체 마감
+static long long rconn_connect_timer(const rconn_t *c) {
+    if (c->addr_next < c->addrs.n && c->conn_next_at < c->conn_deadline)
+        return c->conn_next_at;
+    return c->conn_deadline;
+}
+
+// FD를 논블로킹으로 전환
+static int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0)
+        return -1;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+// 동적 버퍼 뒤에 n바이트를 이어붙임(필요 시 두 배씩 확장)
+static int rbuf_append(char **buf, size_t *len, size_t *cap, const void *data, size_t n) {
+    if (*len + n > *cap) {
+        size_t ncap = (*cap == 0) ? 1024 : *cap * 2;
+        while (ncap < *len + n)
+            ncap *= 2;
+        char *tmp = realloc(*buf, ncap);
+        if (!tmp)
+            return -1;
+        *buf = tmp;
+        *cap = ncap;
+    }
+    memcpy(*buf + *len, data, n);
+    *len += n;
+    return 0;
+}
+
+// splice/tee 파이프를 닫음
+static void rconn_close_pipes(rconn_t *c) {
+    close(c->pipefd[0]);
+    close(c->pipefd[1]);
+    if (c->teeing) {
+        close(c->teefd[0]);
+        close(c->teefd[1]);
+        c->teeing = 0;
+    }
+}
+
+// 닫힌 연결을 지연 해제 리스트로(같은 배치 안에 이 연결의 다른 끝점 이벤트가 남아 있을 수 있으므로 즉시 free하지 않음)
+//  - 해석 스레드가 아직 c->addrs에 쓰고 통지할 예정이거나 깨움 우편함에 들어 있으면, 그쪽에서 꺼낼 때 다시 호출
+static void rconn_reap(reactor_t *r, rconn_t *c) {
+    if (c->dns_pending)
+        return;
+    pthread_mutex_lock(&r->mb_lock);
+    int queued = c->mb_queued; // 닫힐 때 깨움 요청을 취소했으므로 이후 새로 들어오지 않음
+    pthread_mutex_unlock(&r->mb_lock);
+    if (queued)
+        return;
+    c->next_dead = r->dead;
+    r->dead = c;
+}
+
+// single-flight에서 빠짐: 리더면 끝을 알리고(ok가 아니면 팔로워는 FAILED), 팔로워면 깨움 요청을 취소한 뒤 참조 반납
+static void rconn_flight_drop(rconn_t *c, int ok) {
+    if (!c->flight)
+        return;
+    if (c->leader)
+        flight_end(c->flight, ok);
+    else
+        flight_unwait(c->flight, &c->fw);
+    flight_release(c->flight);
+    c->flight = NULL;
+    c->leader = 0;
+    c->cap = &c->cap_own;
+}
+
+// flight 버퍼가 자랐을 때 리더 쪽 스레드가 flight 락 안에서 부름: 팔로워를 소속 루프의 우편함에 넣고 초인종
+static void rconn_flight_wake(void *arg) {
+    rconn_t *c = arg;
+    reactor_t *r = c->reactor;
+    pthread_mutex_lock(&r->mb_lock);
+    if (!c->mb_queued) {
+        c->mb_queued = 1;
+        c->mb_next = r->mb_head;
+        r->mb_head = c;
+    }
+    pthread_mutex_unlock(&r->mb_lock);
+    char b = 1;
+    if (write(r->mb_pipe[1], &b, 1) < 0) { // EAGAIN: 이미 읽지 않은 초인종이 있으므로 루프가 깨어남
+    }
+}
+
+// 연결 정리: FD를 닫고(epoll에서도 자동 제거) 버퍼를 해제, 구조체는 지연 해제 리스트로
+static void rconn_close(reactor_t *r, rconn_t *c) {
+    if (c->state == RC_CLOSED)
+        return;
+    rconn_idle_remove(r, c);
+    rconn_connect_abort(r, c);
+    if (c->client.fd >= 0)
+        close(c->client.fd);
+    if (c->server.fd >= 0)
+        close(c->server.fd);
+    if (c->hit) // 빌린 캐시 객체 버퍼는 free하지 않고 pin만 해제
+        cache_release(c->hit);
+    cache_release(c->stale);
+    disk_release(&c->dsk);
+    free(c->in);
+    free(c->out);
+    free(c->buf);
+    free(c->key);
+    free(c->up_host);
+    rconn_flight_drop(c, 0);
+    capbuf_free(c->cap);
+    if (c->splicing > 0)
+        rconn_close_pipes(c);
+    c->state = RC_CLOSED;
+    rconn_reap(r, c);
+}
+
+// 준비된 응답(에러 페이지 등)을 out에 복사하고 RC_FLUSH로 전환(보낸 뒤 연결 종료)
+static int rconn_reply(rconn_t *c, const char *data, size_t n) {
+    free(c->out);
+    c->out = malloc(n ? n : 1);
+    if (!c->out)
+        return -1;
+    memcpy(c->out, data, n);
+    c->out_len = n;
+    c->out_off = 0;
+    c->iov[0] = (struct iovec){c->out, n};
+    c->iovcnt = 1;
+    c->keep = 0;
+    c->state = RC_FLUSH;
+    return 1;
+}
+
+// 에러 응답을 만들어 RC_FLUSH로 전환(리더였다면 기다리던 팔로워는 각자 원서버로)
+static int rconn_error(rconn_t *c, int status, const char *shortmsg, const char *longmsg) {
+    char msg[MAXBUF];
+    rconn_flight_drop(c, 0);
+    int len = format_clienterror(msg, sizeof(msg), status, shortmsg, longmsg);
+    if (len < 0)
+        return -1;
+    return rconn_reply(c, msg, (size_t)len);
+}
+
+// 클라 조건부 요청에 저장된 헤더 줄 head[0..head_len)로 304를 만들 수 있으면 out에 담아 RC_FLUSH로(1), 아니면 0
+static int rconn_not_modified(rconn_t *c, const char *head, size_t head_len) {
+    if (!c->creq.conditional)
+        return 0;
+    char *nm = malloc(NOT_MODIFIED_MAX);
+    size_t n = nm ? not_modified_response(&c->creq, head, head_len, c->keep, nm, NOT_MODIFIED_MAX) : 0;
+    if (n == 0) {
+        free(nm);
+        return 0;
+    }
+    free(c->out); // 원서버용 요청은 필요 없음
+    c->out = nm;
+    c->out_len = n;
+    c->out_off = 0;
+    c->iov[0] = (struct iovec){nm, n};
+    c->iovcnt = 1;
+    c->state = RC_FLUSH;
+    return 1;
+}
+
+// Range 요청에 저장된 응답(헤더 줄 head[0..head_len), 본문 body_len바이트)의 일부로 답할 수 있으면 206/416을
+// 준비해 RC_FLUSH로(1), 전체 응답을 보내야 하면 0, 메모리 부족이면 -1
+// - 범위 하나는 복사 없이: 메모리 객체(body)면 iov가 객체를 가리키고(호출자가 c->hit으로 pin 유지),
+//   디스크 계층이면 세그먼트의 body_off부터 그 구간만 sendfile
+// - 여러 범위(multipart)는 조각을 out 하나로 모음
+static int rconn_range(rconn_t *c, const char *head, size_t head_len, size_t body_len, int chunked, const char *body,
+                       off_t body_off) {
+    range_reply_t rr;
+    if (!c->creq.range[0] || !range_reply_build(&rr, &c->creq, head, head_len, body_len, chunked, c->keep))
+        return 0;
+    c->dsk_left = 0;
+    c->iovcnt = 1;
+    if (rr.n > 2) {
+        char *flat = range_reply_flatten(&rr, body, c->dsk.fd, body_off);
+        free(rr.text);
+        if (!flat)
+            return -1;
+        free(c->out);
+        c->out = flat;
+        c->out_len = rr.total;
+        c->iov[0] = (struct iovec){flat, rr.total};
+    } else {
+        free(c->out);
+        c->out = rr.text;
+        c->out_len = rr.text_len;
+        c->iov[0] = (struct iovec){rr.text, rr.piece[0].len};
+        if (rr.n == 2 && body)
+            c->iov[c->iovcnt++] = (struct iovec){(void *)(body + rr.piece[1].off), rr.piece[1].len};
+        else if (rr.n == 2) {
+            c->dsk_off = body_off + (off_t)rr.piece[1].off;
+            c->dsk_left = rr.piece[1].len;
+        }
+    }
+    c->out_off = 0;
+    c->state = RC_FLUSH;
+    return 1;
+}
+
+// 헤더 끝(빈 줄) 위치를 찾는다. 찾으면 빈 줄까지 포함한 길이, 없으면 0
+static size_t find_head_end(const char *buf, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (buf[i] != '\n')
+            continue;
+        if (i + 1 < len && buf[i + 1] == '\n') // "\n\n"
+            return i + 2;
+        if (i + 2 < len && buf[i + 1] == '\r' && buf[i + 2] == '\n') // "\n\r\n"
+            return i + 3;
+    }
+    return 0;
+}
+
+// 수신한 요청 헤더 블록을 원서버용 요청으로 재작성한다
+//  - rewrite_request_headers와 같은 정책: Host 유지/보정, UA/Connection/Proxy-Connection 고정
+//  - 지나가는 헤더에서 클라이언트 연결 유지 희망/요청 본문 유무를 creq에 기록
+static int build_upstream_request(rconn_t *c, const char *head, size_t head_len, const char *host, int port,
+                                  const char *path, const char *version, http_request_t *creq) {
+    char line[MAXLINE];
+    size_t cap = 0;
+    int saw_host = 0;
+
+    int len = format_upstream_line(line, sizeof(line), path, version);
+    if (len < 0 || (size_t)len >= sizeof(line) || rbuf_append(&c->out, &c->out_len, &cap, line, (size_t)len) < 0)
+        return -1;
+
+    // 요청 라인 다음 줄부터 빈 줄 직전까지 한 줄씩 처리
+    const char *p = memchr(head, '\n', head_len);
+    const char *end = head + head_len;
+    for (p = p ? p + 1 : end; p < end;) {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        size_t n = nl ? (size_t)(nl - p) + 1 : (size_t)(end - p);
+        if ((n == 2 && p[0] == '\r') || n == 1) // 빈 줄: 헤더 종료
+            break;
+        if (!strncasecmp(p, "Host:", 5))
+            saw_host = 1;
+        http_request_header(creq, p, n);
+        if (!is_replaced_header(p) && rbuf_append(&c->out, &c->out_len, &cap, p, n) < 0)
+            return -1;
+        p += n;
+    }
+
+    if (!saw_host) {
+        len = (port == 80) ? snprintf(line, sizeof(line), "Host: %s\r\n", host)
+                           : snprintf(line, sizeof(line), "Host: %s:%d\r\n", host, port);
+        if (len < 0 || (size_t)len >= sizeof(line) || rbuf_append(&c->out, &c->out_len, &cap, line, (size_t)len) < 0)
+            return -1;
+    }
+    if (append_upstream_tail(&c->out, &c->out_len, &cap) < 0)
+        return -1;
+    c->out_off = 0;
+    return 0;
+}
+
+// 해석된 후보 주소로 connect 단계 시작(첫 시도는 RC_CONNECT에서 바로 띄움)
+static int rconn_start_connect(reactor_t *r, rconn_t *c) {
+    long long now = reactor_now_ms();
+    c->addr_next = 0;
+    c->inflight = 0;
+    c->conn_next_at = now;
+    c->conn_deadline = now + opts.connect_timeout;
+    c->state = RC_CONNECT;
+    rconn_connect_add(r, c);
+    return 1;
+}
+
+// 연결된 시도 i를 원서버 끝점으로 삼고 나머지 시도를 닫은 뒤 RC_SEND_REQ로
+static int rconn_connect_won(reactor_t *r, rconn_t *c, int i) {
+    int fd = c->att[i].fd;
+    c->att[i].fd = -1;
+    rconn_connect_abort(r, c);
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, .data.ptr = &c->server};
+    if (epoll_ctl(r->epfd, EPOLL_CTL_MOD, fd, &ev) < 0) { // 이후 이벤트는 server 끝점으로
+        close(fd);
+        return -1;
+    }
+    c->server.fd = fd;
+    c->server.ev = 0;
+    c->state = RC_SEND_REQ;
+    return 1;
+}
+
+// 다음 후보 주소로 connect 시도를 하나 더 띄움
+//  - 반환: 1(즉시 연결됨, RC_SEND_REQ), 0(시도 추가 또는 바로 실패, inflight로 구분), -1(연결 종료)
+static int rconn_launch(reactor_t *r, rconn_t *c) {
+    int i = c->addr_next++;
+    rend_t *a = &c->att[i];
+    int done = 0;
+    a->conn = c;
+    a->fd = -1;
+    a->ev = 0;
+    int fd = start_connect(&c->addrs.addr[i], c->up_port, &done);
+    if (fd < 0)
+        return 0;
+    struct epoll_event ev = {.events = EPOLLOUT | EPOLLET, .data.ptr = a};
+    if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        close(fd);
+        return 0;
+    }
+    a->fd = fd;
+    c->inflight++;
+    return done ? rconn_connect_won(r, c, i) : 0;
+}
+
+// RC_CONNECT: happy eyeballs(RFC 8305) 방식으로 후보 주소에 connect
+//  - 결과가 나온 시도를 SO_ERROR로 확인해 먼저 연결된 쪽이 이기고, 실패한 시도는 닫음
+//  - 진행 중인 시도가 없거나 connect_delay가 지나면 다음 후보(IPv6/IPv4 교차)를 병렬로 더 띄움
+//  - 후보가 모두 실패하거나 connect_timeout이 지나면 502
+static int rconn_connecting(reactor_t *r, rconn_t *c) {
+    long long now = reactor_now_ms();
+    for (int i = 0; i < c->addr_next; i++) {
+        rend_t *a = &c->att[i];
+        if (a->fd < 0 || !(a->ev & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+            continue; // 끝났거나 아직 결과 없음
+        a->ev = 0;
+        int err = 0;
+        socklen_t elen = sizeof(err);
+        if (getsockopt(a->fd, SOL_SOCKET, SO_ERROR, &err, &elen) < 0)
+            err = errno;
+        if (err == 0) {
+            struct sockaddr_storage peer;
+            socklen_t plen = sizeof(peer);
+            if (getpeername(a->fd, (struct sockaddr *)&peer, &plen) == 0)
+                return rconn_connect_won(r, c, i);
+            continue; // 같은 배치에 남은 이전 FD의 이벤트: 아직 진행 중
+        }
+        close(a->fd);
+        a->fd = -1;
+        c->inflight--;
+        c->conn_next_at = now; // 실패하면 지연 없이 다음 후보
+    }
+    while (c->addr_next < c->addrs.n && (c->inflight == 0 || now >= c->conn_next_at)) {
+        int before = c->inflight;
+        int rc = rconn_launch(r, c);
+        if (rc != 0)
+            return rc;
+        if (c->inflight > before) // 바로 실패한 후보는 지연 없이 다음으로
+            c->conn_next_at = now + opts.connect_delay;
+    }
+    if (c->inflight == 0 || now >= c->conn_deadline) {
+        rconn_connect_abort(r, c);
+        return rconn_error(c, 502, "Bad Gateway", "Failed to connect to end server");
+    }
+    return 0;
+}
+
+// 원서버 이름을 해석해 첫 후보로 connect 시작
+//  - 이름 캐시에 있으면 바로 connect, 없으면 해석 스레드에 맡기고 RC_RESOLVE에서 완료 통지를 기다림
+//    (이벤트 루프는 getaddrinfo로 막히지 않음)
+static int rconn_resolve(reactor_t *r, rconn_t *c) {
+    switch (dns_resolve_async(c->up_host, &c->addrs, r->dns_pipe[1], c)) {
+    case DNS_PENDING:
+        c->dns_pending = 1;
+        c->state = RC_RESOLVE;
+        return 0;
+    case DNS_OK:
+        return rconn_start_connect(r, c);
+    default:
+        return rconn_error(c, 502, "Bad Gateway", "Failed to connect to end server");
+    }
+}
+
+// RC_RESOLVE: 통지가 오기 전에는 대기, 왔으면 결과(addrs)로 connect 시작
+static int rconn_resolved(reactor_t *r, rconn_t *c) {
+    if (c->dns_pending)
+        return 0;
+    if (c->addrs.n == 0)
+        return rconn_error(c, 502, "Bad Gateway", "Failed to connect to end server");
+    return rconn_start_connect(r, c);
+}
+
+// 풀에서 꺼낸 연결이 응답 첫 바이트 전에 끊김(원서버가 유휴 연결을 닫은 경합): 새 연결로 요청을 다시 보냄
+//  - 요청 버퍼(out)는 응답 헤더가 올 때까지 보관하므로 처음부터 다시 전송
+static int rconn_retry(reactor_t *r, rconn_t *c) {
+    c->reused = 0;
+    c->out_off = 0;
+    c->buf_len = c->buf_off = 0;
+    if (c->server.fd >= 0) { // 이전 서버 소켓 정리(epoll에서도 자동 제거)
+        close(c->server.fd);
+        c->server.fd = -1;
+    }
+    return rconn_resolve(r, c);
+}
+
+// 원서버에서 받아 옴: keep-alive 풀에 유휴 연결이 있으면 바로 요청 전송, 없으면 이름 해석 후 connect
+static int rconn_fetch(reactor_t *r, rconn_t *c) {
+    // keep-alive 풀에 유휴 연결이 있으면 connect 없이 바로 요청 전송
+    int fd = upstream_acquire(c->up_host, c->up_port);
+    if (fd >= 0) {
+        struct epoll_event ev = {.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, .data.ptr = &c->server};
+        if (set_nonblocking(fd) == 0 && epoll_ctl(r->epfd, EPOLL_CTL_ADD, fd, &ev) == 0) {
+            c->server.fd = fd;
+            c->server.ev = 0;
+            c->reused = 1;
+            c->state = RC_SEND_REQ;
+            return 1;
+        }
+        close(fd);
+    }
+
+    // 이름 해석 후 첫 후보로 connect 시작
+    return rconn_resolve(r, c);
+}
+
+// 요청 헤더가 모두 도착했을 때: 파싱/검증 -> 캐시 조회 -> 원서버 connect 시작
+//  - c->in에서 이번 요청 헤더만 떼어 내고, 뒤에 이어 온(pipelined) 바이트는 다음 요청용으로 남김
+static int rconn_start_request(reactor_t *r, rconn_t *c, size_t head_len) {
+    char reqline[MAXLINE];
+    char method[MAXLINE], uri[MAXLINE], version[MAXLINE];
+    char host[MAXLINE], path[MAXLINE];
+    int port = 80;
+    http_request_t creq;
+
+    rconn_idle_remove(r, c); // 요청 헤더 완성: 유휴 타임아웃 해제
+    c->requests++;
+
+    // 첫 줄(요청 라인)만 떼어 C 문자열로
+    const char *nl = memchr(c->in, '\n', head_len);
+    size_t l = nl ? (size_t)(nl - c->in) + 1 : head_len;
+    if (l >= sizeof(reqline))
+        return rconn_error(c, 400, "Bad Request", "Malformed request line");
+    memcpy(reqline, c->in, l);
+    reqline[l] = '\0';
+
+    if (parse_request_line(reqline, method, sizeof(method), uri, sizeof(uri), version, sizeof(version)) < 0)
+        return rconn_error(c, 400, "Bad Request", "Malformed request line");
+    if (strcasecmp(method, "GET") != 0)
+        return rconn_error(c, 501, "Not Implemented", "Proxy does not implement this method");
+    if (parse_uri(uri, host, sizeof(host), path, sizeof(path), &port) < 0)
+        return rconn_error(c, 400, "Bad Request", "Only supports absolute HTTP URLs");
+
+    char cache_key[CACHE_KEY_MAX];
+    if (snprintf(cache_key, MAXLINE, "http://%s:%d%s", host, port, path) <= 0)
+        return rconn_error(c, 400, "Bad Request", "Failed to build cache key");
+
+    http_request_init(&creq, version);
+    if (build_upstream_request(c, c->in, head_len, host, port, path, version, &creq) < 0)
+        return rconn_error(c, 400, "Bad Request", "Invalid request headers");
+    // 헤더 원문은 더 이상 필요 없음. 다음 요청의 앞부분이 이미 와 있으면 앞으로 당겨 둠
+    memmove(c->in, c->in + head_len, c->in_len - head_len);
+    c->in_len -= head_len;
+    // 요청 본문은 전달하지 않으므로 본문이 딸린 요청 뒤에는 다음 요청 경계를 알 수 없어 연결을 닫음
+    c->keep = opts.client_idle > 0 && c->requests < opts.client_max_requests && creq.keep_alive && !creq.has_body;
+
+    // 캐시 HIT이면 원서버 없이 바로 응답(chunked 본문은 HTTP/1.0 클라이언트에 보낼 수 없으므로 원서버로)
+    // - 클라이언트가 no-cache를 요청하면 저장된 응답을 쓰지 않음(Vary 표시면 2차 키로 다시 조회)
+    // - 신선도가 지난 사본은 serve_request와 같은 규칙(stale-while-revalidate면 보내고 뒤에서 재검증, 아니면 조건부 요청)
+    c->creq = creq;
+    int use_cache = !(creq.cc & HTTP_CC_NO_CACHE);
+    int rc;
+    if (use_cache) {
+        cache_obj_t *cached = NULL;
+        int hit = cache_lookup(cache_key, sizeof(cache_key), c->out, c->out_len, &creq, &cached);
+        if (hit == CACHE_STALE && cached->swr && (long long)time(NULL) < cached->expires + cached->swr) {
+            background_fetch(host, port, cache_key, c->out, c->out_len, &creq, cached);
+            hit = 1;
+        } else if (hit == CACHE_STALE) {
+            size_t cap = c->out_len;
+            int v = creq.conditional ? 0 : add_validators(&c->out, &c->out_len, &cap, cached->data, cached->head_len);
+            if (v > 0)
+                c->stale = cached;
+            else
+                cache_release(cached);
+            if (v < 0)
+                return rconn_error(c, 502, "Bad Gateway", "Failed to write request");
+        }
+        if (hit == 1) {
+            if (atomic_load(&cached->filling)) {
+                cache_release(cached); // 채우는 중이면 아래 single-flight로 따라 읽음
+            } else if (rconn_not_modified(c, cached->data, cached->head_len)) {
+                cache_release(cached); // 클라이언트 사본이 저장된 것과 같음: 본문 없이 304
+                return 1;
+            } else if ((rc = rconn_range(c, cached->data, cached->head_len, cached->size - cached->head_len - 2,
+                                         cached->chunked, cached->data + cached->head_len + 2, 0)) != 0) {
+                if (rc < 0) {
+                    cache_release(cached);
+                    return -1;
+                }
+                c->hit = cached; // 다 보낼 때까지 pin 유지
+                return 1;
+            } else if (cached->chunked && !strcmp(version, "HTTP/1.0")) {
+                cache_release(cached);
+            } else {
+                free(c->out); // 원서버용 요청은 필요 없음
+                c->out = NULL;
+                c->out_len = 0;
+                c->hit = cached; // 다 보낼 때까지 pin 유지
+                c->iovcnt = cached_response_iov(cached, c->hit_hdr, sizeof(c->hit_hdr), &c->keep, c->iov);
+                c->state = RC_FLUSH;
+                return 1;
+            }
+        }
+    }
+    // 디스크 계층 HIT: 헤더 줄(+연결 헤더)은 out에 읽어 두고, 본문은 RC_FLUSH에서 세그먼트 파일로부터 sendfile
+    // - 신선도가 지났지만 검증자가 있는 레코드는 pin한 채 조건부 요청(serve_request와 같은 규칙)
+    int dh = use_cache && !c->stale && disk_get(cache_key, &c->dsk);
+    int http10_chunked = dh && c->dsk.chunked && !strcmp(version, "HTTP/1.0");
+    if (dh && c->dsk.stale) {
+        char *head = NULL;
+        int v = 0;
+        if (!creq.conditional && !http10_chunked && (head = malloc(c->dsk.head_len + 2)) &&
+            disk_read_head(&c->dsk, head, c->dsk.head_len + 2) == 0) {
+            size_t cap = c->out_len;
+            v = add_validators(&c->out, &c->out_len, &cap, head, c->dsk.head_len);
+        }
+        free(head);
+        if (v <= 0)
+            disk_release(&c->dsk);
+        if (v < 0)
+            return rconn_error(c, 502, "Bad Gateway", "Failed to write request");
+    } else if (dh) {
+        char *head = NULL;
+        ssize_t hn = -1;
+        if ((!http10_chunked || creq.conditional || creq.range[0]) && (head = malloc(c->dsk.head_len + CACHED_HDR_MAX)))
+            hn = disk_response_head(&c->dsk, head, c->dsk.head_len + CACHED_HDR_MAX, &c->keep, &c->dsk_off,
+                                    &c->dsk_left);
+        if (hn >= 0 && rconn_not_modified(c, head, c->dsk.head_len)) { // 본문을 읽지 않고 304
+            free(head);
+            disk_release(&c->dsk);
+            c->dsk_left = 0;
+            return 1;
+        }
+        if (hn >= 0 && c->dsk.head_len &&
+            (rc = rconn_range(c, head, c->dsk.head_len, c->dsk_left - 2, c->dsk.chunked, NULL, c->dsk_off + 2)) != 0) {
+            free(head); // 범위만 세그먼트에서 sendfile(multipart는 out에 모아 둠)
+            return rc;
+        }
+        if (http10_chunked)
+            hn = -1;
+        if (hn >= 0) {
+            free(c->out); // 원서버용 요청은 필요 없음
+            c->out = head;
+            c->out_len = (size_t)hn;
+            c->iov[0] = (struct iovec){head, (size_t)hn};
+            c->iovcnt = hn > 0;
+            c->state = RC_FLUSH;
+            return 1;
+        }
+        free(head);
+        disk_release(&c->dsk); // 보낼 수 없으면 MISS처럼 원서버로
+        c->dsk_left = 0;
+    }
+
+    c->key = strdup(cache_key);
+    if (!c->key)
+        return -1;
+    c->up_host = strdup(host);
+    c->up_port = port;
+    if (!c->up_host)
+        return -1;
+    c->http10 = !strcmp(version, "HTTP/1.0");
+
+    // 같은 키를 이미 받아 오는 연결(리더)이 있으면 원서버 대신 그 응답을 따라 읽음(single-flight)
+    // - 재검증과 Range 요청은 합치지 않음(serve_request와 같은 규칙). -F면 전체 응답은 뒤에서 따로 받아 채움
+    int revalidating = c->stale || c->dsk.seg;
+    if (use_cache && !revalidating && creq.range[0] && opts.range_fill)
+        background_fetch(host, port, cache_key, c->out, c->out_len, &creq, NULL);
+    int leader = 0;
+    c->flight = revalidating || creq.range[0] ? NULL : flight_join(cache_key, &leader);
+    c->leader = leader;
+    if (c->flight && !leader) {
+        c->fol_off = c->fol_avail = c->fol_batch = 0;
+        c->fol_started = 0;
+        c->state = RC_FOLLOW;
+        return 1;
+    }
+    return rconn_fetch(r, c);
+}
+
+// RC_READ_HEAD: EAGAIN까지 읽으며 빈 줄을 찾는다
+static int rconn_read_head(reactor_t *r, rconn_t *c) {
+    for (;;) {
+        char tmp[4096];
+        ssize_t n = read(c->client.fd, tmp, sizeof(tmp));
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 0; // 더 올 때까지 대기
+            return -1;
+        }
+        if (n == 0) // 헤더가 끝나기 전에 클라이언트가 닫음
+            return -1;
+        // 이전 누적분 끝의 최대 2바이트와 경계에 걸친 빈 줄도 찾을 수 있도록 조금 앞에서부터 검색
+        size_t scan = c->in_len > 2 ? c->in_len - 2 : 0;
+        if (rbuf_append(&c->in, &c->in_len, &c->in_cap, tmp, (size_t)n) < 0)
+            return -1;
+        size_t end = find_head_end(c->in + scan, c->in_len - scan);
+        if (end)
+            return rconn_start_request(r, c, scan + end);
+        if (c->in_len > REACTOR_MAX_HEAD)
+            return rconn_error(c, 400, "Bad Request", "Request header too large");
+    }
+}
+
+// out 버퍼를 fd로 EAGAIN 전까지 전송. 다 보냈으면 1, 막혔으면 0, 에러면 -1
+static int rconn_flush_out(rconn_t *c, int fd) {
+    while (c->out_off < c->out_len) {
+        ssize_t w = write(fd, c->out + c->out_off, c->out_len - c->out_off);
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 0;
+            return -1;
+        }
+        c->out_off += (size_t)w;
+    }
+    return 1;
+}
+
+// RC_SEND_REQ: 재작성한 요청을 서버로 전송, 끝나면 RC_RELAY로
+//  - 요청 버퍼는 응답 헤더가 도착할 때까지 남겨 둠(재사용한 연결이 끊겨 있으면 다시 보내야 하므로)
+static int rconn_send_request(reactor_t *r, rconn_t *c) {
+    int rc = rconn_flush_out(c, c->server.fd);
+    if (rc < 0 && c->reused)
+        return rconn_retry(r, c);
+    if (rc <= 0)
+        return rc;
+
+    if (!c->buf) { // 버퍼는 keep-alive 연결의 요청 사이에 재사용
+        c->buf = malloc(MAXBUF + REACTOR_HEAD_SLACK);
+        if (!c->buf)
+            return -1;
+    }
+    // relay_and_maybe_cache와 같은 캐시 후보 버퍼(아직 비어 있음). 리더면 팔로워가 따라 읽는 flight 버퍼
+    c->cap = c->flight ? &c->flight->cap : &c->cap_own;
+    capbuf_init(c->cap, cache_max_object_size());
+    c->cap->owner = c->flight;
+    c->buf_len = c->buf_off = 0;
+    c->state = RC_RELAY;
+    return 1;
+}
+
+// 응답 헤더를 다 받았을 때(hr: http_parse_response_head 결과, 1이 아니면 EOF까지 중계): 본문 경계를 정하고
+// 헤더와 함께 온 본문 앞부분만 남긴 뒤 캐시 후보/zero-copy 경로를 준비
+//  - 헤더의 연결 관리 헤더는 버퍼 안에서 떼고 클라 연결에 맞는 Connection 헤더를 다시 붙임
+//    (relay_and_maybe_cache와 같은 규칙. 캐시에는 뗀 상태로 저장)
+static void rconn_begin_body(rconn_t *c, int hr) {
+    c->head_done = 1;
+    http_body_init(&c->body, hr == 1 ? &c->resp : NULL);
+    c->buf_off = 0;
+    c->reusable = hr == 1 && c->resp.keep_alive && c->body.mode != HTTP_BODY_EOF;
+    if (hr == 1) {
+        size_t head_len = c->resp.head_len;
+        size_t bl = http_body_consume(&c->body, c->buf + head_len, c->buf_len - head_len);
+        c->hl = http_strip_hop_headers(c->buf, head_len);
+        // 길이를 알 수 없는 응답은 서버가 닫는 것으로 끝나므로 클라 연결도 닫아야 경계가 전달됨
+        c->keep = c->keep && c->body.mode != HTTP_BODY_EOF;
+        const char *conn = c->keep ? conn_keepalive_hdr : conn_close_hdr;
+        size_t cl = strlen(conn);
+        // [헤더 줄][Connection][빈 줄][본문 앞부분]으로 재배치(늘어나는 양은 REACTOR_HEAD_SLACK 이내)
+        char *body_part = c->buf + c->hl + cl + 2;
+        memmove(body_part, c->buf + head_len, bl);
+        memcpy(c->buf + c->hl, conn, cl);
+        memcpy(c->buf + c->hl + cl, "\r\n", 2);
+        c->buf_len = c->hl + cl + 2 + bl;
+        char store_key[CACHE_KEY_MAX];
+        c->expires = capture_policy(&c->resp, c->key, c->out, c->out_len, &c->creq, store_key, sizeof(store_key));
+        char *k = c->expires ? strdup(store_key) : NULL;
+        if (k) {
+            free(c->key);
+            c->key = k;
+            capture_begin(c->cap, c->key, c->hl, &c->resp, c->expires);
+        } else {
+            c->expires = 0;
+            capture_abandon(c->cap); // 저장하지 않을 응답: 팔로워는 각자 원서버로, 본문은 splice로
+        }
+        capture_feed(c->cap, c->buf, c->hl);
+        capture_feed(c->cap, "\r\n", 2);
+        capture_feed(c->cap, body_part, bl);
+    } else {
+        c->keep = 0;
+        c->hl = 0;
+        c->expires = 0;
+        capture_abandon(c->cap);
+    }
+    free(c->out); // 저장 정책까지 정했으니 요청 버퍼 해제(더 이상 재전송할 일도 없음)
+    c->out = NULL;
+    c->out_len = c->out_off = 0;
+    if (c->flight) // 헤더까지 버퍼에 넣었으니 팔로워가 보내기 시작할 수 있음
+        flight_head(c->flight, c->hl, c->body.mode == HTTP_BODY_CHUNKED, hr == 1 && c->body.mode == HTTP_BODY_EOF);
+
+    // chunked는 청크 경계를 봐야 하므로 복사 경로. 그 외에는 모드에 따라 파이프로 중계
+    if (c->body.done || c->body.mode == HTTP_BODY_CHUNKED || opts.relay == PROXY_RELAY_COPY)
+        return;
+    if (opts.relay == PROXY_RELAY_TEE && !c->cap->abandoned) {
+        // tee 모드: 파이프 두 개로 중계(클라 쪽 splice, 캐시 쪽 tee). 못 만들면 복사 경로
+        if (os_pipe(c->pipefd) < 0)
+            return;
+        if (os_pipe(c->teefd) < 0) {
+            close(c->pipefd[0]);
+            close(c->pipefd[1]);
+            return;
+        }
+        c->splicing = c->teeing = 1;
+        c->pipe_len = 0;
+    } else if (c->cap->abandoned && os_pipe(c->pipefd) == 0) {
+        c->splicing = 1;
+        c->pipe_len = 0;
+    }
+}
+
+// keep-alive: 응답 하나를 다 보낸 연결을 요청 단위 상태만 지우고 다시 RC_READ_HEAD로
+//  - 파이프라이닝으로 다음 요청 헤더가 이미 c->in에 다 와 있으면 곧바로 처리
+static int rconn_next_request(reactor_t *r, rconn_t *c) {
+    if (c->hit) {
+        cache_release(c->hit);
+        c->hit = NULL;
+    }
+    cache_release(c->stale);
+    c->stale = NULL;
+    disk_release(&c->dsk);
+    c->dsk_left = 0;
+    free(c->out);
+    c->out = NULL;
+    c->out_len = c->out_off = 0;
+    c->iovcnt = 0;
+    free(c->key);
+    c->key = NULL;
+    free(c->up_host);
+    c->up_host = NULL;
+    rconn_connect_abort(r, c);
+    c->addr_next = c->addrs.n = 0;
+    if (c->server.fd >= 0) { // 풀에 반납하지 못한 원서버 연결
+        close(c->server.fd);
+        c->server.fd = -1;
+    }
+    c->server.ev = 0;
+    rconn_flight_drop(c, 0);
+    capbuf_free(c->cap);
+    if (c->splicing > 0)
+        rconn_close_pipes(c);
+    c->splicing = 0;
+    c->head_done = c->reused = c->reusable = 0;
+    c->buf_len = c->buf_off = 0;
+    c->state = RC_READ_HEAD;
+
+    rconn_idle_add(r, c);
+    size_t end = find_head_end(c->in, c->in_len);
+    if (end)
+        return rconn_start_request(r, c, end);
+    return 1; // 소켓에 남은 바이트는 rconn_read_head가 EAGAIN까지 읽음(ET라 새 이벤트가 오지 않을 수 있음)
+}
+
+// 응답을 경계까지 다 중계함: 캐시 삽입 후, 원서버가 연결을 유지하겠다면 epoll에서 빼서 풀에 반납
+static int rconn_finish_response(reactor_t *r, rconn_t *c) {
+    if (c->expires) // 한도 안에서 끝까지 담은 경우에만 실제로 삽입됨
+        capture_commit(c->cap, c->key, c->hl, &c->resp, c->body.mode, c->expires);
+    rconn_flight_drop(c, 1); // 캐시에 넣은 뒤 표에서 빠짐(버퍼는 마지막 팔로워가 놓을 때 반납)
+    if (c->reusable && !c->body.overrun && c->server.fd >= 0) {
+        epoll_ctl(r->epfd, EPOLL_CTL_DEL, c->server.fd, NULL);
+        upstream_release(c->up_host, c->up_port, c->server.fd);
+        c->server.fd = -1;
+    }
+    return c->keep ? rconn_next_request(r, c) : -1;
+}
+
+// 재검증 성공(304): 사본을 304의 헤더로 갱신하고 원서버 연결을 정리한 뒤 갱신한 사본을 HIT처럼 RC_FLUSH로 보냄
+// - 디스크 레코드면 새 헤더는 out에, 본문은 디스크 HIT처럼 세그먼트에서 sendfile
+static int rconn_revalidated(reactor_t *r, rconn_t *c) {
+    cache_obj_t *refreshed = NULL;
+    char *head = NULL;
+    size_t hn = 0;
+    if (c->stale)
+        refreshed = refresh_stale(c->stale, c->key, c->buf, &c->resp, &c->creq);
+    else
+        head = refresh_disk_stale(&c->dsk, c->key, c->buf, &c->resp, &c->creq, c->keep, &hn, &c->dsk_off,
+                                  &c->dsk_left);
+    capbuf_free(c->cap); // 재검증은 flight 없이 단독(아직 아무것도 담지 않음)
+    if (c->resp.keep_alive && c->buf_len == c->resp.head_len) { // 본문 없는 304 뒤에 남은 바이트가 없으면 반납
+        epoll_ctl(r->epfd, EPOLL_CTL_DEL, c->server.fd, NULL);
+        upstream_release(c->up_host, c->up_port, c->server.fd);
+    } else {
+        close(c->server.fd);
+    }
+    c->server.fd = -1;
+    free(c->out);
+    c->out = NULL;
+    c->out_len = c->out_off = 0;
+    if (!c->stale) {
+        if (!head) // 저장된 헤더도 읽지 못함: 보낼 것이 없으니 연결을 닫음
+            return -1;
+        c->out = head;
+        c->out_len = hn;
+        c->iov[0] = (struct iovec){head, hn};
+        c->iovcnt = 1;
+        c->state = RC_FLUSH;
+        return 1;
+    }
+    c->hit = c->stale;
+    c->stale = NULL;
+    if (refreshed) {
+        cache_release(c->hit);
+        c->hit = refreshed;
+    }
+    c->iovcnt = cached_response_iov(c->hit, c->hit_hdr, sizeof(c->hit_hdr), &c->keep, c->iov);
+    c->state = RC_FLUSH;
+    return 1;
+}
+
+// RC_FLUSH: 준비된 조각(iov)과 디스크 HIT 본문(sendfile)을 클라로 EAGAIN 전까지 전송. 다 보냈으면 keep-alive에 따라 다음 요청 또는 종료
+static int rconn_flush_reply(reactor_t *r, rconn_t *c) {
+    while (c->iovcnt > 0) {
+        ssize_t w = writev(c->client.fd, c->iov, c->iovcnt);
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 0;
+            return -1;
+        }
+        iov_advance(c->iov, &c->iovcnt, (size_t)w);
+    }
+    while (c->dsk_left > 0) { // 디스크 HIT 본문
+        ssize_t w = os_sendfile(c->client.fd, c->dsk.fd, &c->dsk_off, c->dsk_left);
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 0;
+            return -1;
+        }
+        if (w == 0) // 세그먼트가 예상보다 짧음
+            return -1;
+        c->dsk_left -= (size_t)w;
+    }
+    return c->keep ? rconn_next_request(r, c) : -1;
+}
+
+// RC_RELAY(splice): 파이프에 남은 바이트를 클라로 먼저 비우고, 비면 서버에서 파이프로 다시 채운다
+//  - 파이프 한 개(OS_PIPE_CHUNK)가 버퍼 역할을 하므로 MAXBUF 복사 경로와 같은 흐름 제어
+//  - 본문 경계를 넘지 않도록 남은 길이만큼만 채움(다음 응답을 파이프로 삼키지 않음)
+//  - 반환: rconn_step 규약(0 대기, -1 종료) + 1(응답 끝까지 비웠거나 splice 불가. 어느 쪽이든 파이프는 빈 상태)
+static int rconn_splice(rconn_t *c) {
+    for (;;) {
+        while (c->pipe_len > 0) {
+            ssize_t w = os_splice(c->pipefd[0], c->client.fd, c->pipe_len, 1);
+            if (w < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    return 0; // 클라 소켓이 다시 쓰기 가능해질 때까지 대기
+                return -1;    // 클라 조기 종료
+            }
+            c->pipe_len -= (size_t)w;
+        }
+        if (c->body.done)
+            return 1;
+        ssize_t n = os_splice(c->server.fd, c->pipefd[1], http_body_want(&c->body, OS_PIPE_CHUNK), 1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 0;
+            if (errno == EINVAL || errno == ENOSYS) {
+                rconn_close_pipes(c);
+                c->splicing = -1;
+                return 1;
+            }
+            return -1;
+        }
+        if (n == 0) { // 서버 EOF: 길이 정보 없는 응답이면 정상 끝, 아니면 잘린 응답
+            http_body_eof(&c->body);
+            if (!c->body.done)
+                return -1;
+            continue;
+        }
+        http_body_consume(&c->body, NULL, (size_t)n);
+        c->pipe_len += (size_t)n;
+        // 파이프는 방금까지 비어 있었으므로 새로 들어온 n바이트만 캐시 쪽으로 복제
+        if (c->teeing && !c->cap->abandoned) {
+            if (os_tee(c->pipefd[0], c->teefd[1], (size_t)n, 1) == n)
+                capture_read(c->cap, c->teefd[0], (size_t)n);
+            else
+                capture_abandon(c->cap);
+        }
+    }
+}
+
+// RC_RELAY: 클라이언트로 보낼 게 남았으면 먼저 보내고, 비면 서버에서 다시 읽는다
+//  - 클라가 느려 EAGAIN이면 서버 읽기도 멈춰 버퍼가 한 칸(MAXBUF)을 넘지 않도록 흐름 제어
+//  - 응답 헤더가 완성될 때까지는 buf에 모으기만 하고, 이후로는 본문 경계까지만 읽음
+static int rconn_relay(reactor_t *r, rconn_t *c) {
+    for (;;) {
+        while (c->buf_off < c->buf_len && c->head_done) {
+            ssize_t w = write(c->client.fd, c->buf + c->buf_off, c->buf_len - c->buf_off);
+            if (w < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    return 0; // 클라 소켓이 다시 쓰기 가능해질 때까지 대기
+                return -1;    // 클라 조기 종료
+            }
+            c->buf_off += (size_t)w;
+        }
+        if (c->splicing > 0) {
+            int rc = rconn_splice(c);
+            if (rc <= 0)
+                return rc;
+        }
+        if (c->head_done && c->body.done)
+            return rconn_finish_response(r, c);
+
+        char *dst = c->head_done ? c->buf : c->buf + c->buf_len;
+        size_t room = c->head_done ? http_body_want(&c->body, MAXBUF) : MAXBUF - c->buf_len;
+        ssize_t n = read(c->server.fd, dst, room);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 0;
+            if (!c->head_done && c->buf_len == 0 && c->reused)
+                return rconn_retry(r, c);
+            return -1;
+        }
+        if (!c->head_done) {
+            if (n == 0 && c->buf_len == 0) { // 응답 없이 닫힘: 재사용한 연결이면 재시도, 아니면 502
+                if (c->reused)
+                    return rconn_retry(r, c);
+                return rconn_error(c, 502, "Bad Gateway", "Empty response from end server");
+            }
+            c->buf_len += (size_t)n;
+            int hr = http_parse_response_head(c->buf, c->buf_len, &c->resp);
+            if (n > 0 && hr == 0 && c->buf_len < MAXBUF)
+                continue; // 헤더가 아직 덜 옴
+            if (hr == 1 && (c->stale || c->dsk.seg) && c->resp.status == 304)
+                return rconn_revalidated(r, c);
+            rconn_begin_body(c, hr); // 버퍼를 넘는 헤더나 헤더 도중 EOF는 해석 없이 EOF까지 중계
+            if (n == 0)
+                http_body_eof(&c->body);
+            continue;
+        }
+        if (n == 0) { // 서버 EOF: 길이 정보 없는 응답이면 정상 끝, 아니면 잘린 응답
+            http_body_eof(&c->body);
+            if (!c->body.done)
+                return -1;
+            continue;
+        }
+        size_t take = http_body_consume(&c->body, c->buf, (size_t)n); // 메시지 뒤 잉여 바이트는 버림
+        c->buf_len = take;
+        c->buf_off = 0;
+        capture_feed(c->cap, c->buf, take); // 한도 초과 시 capbuf가 알아서 포기/반납
+        // 캐시하지 않을 응답이면 버퍼에 남은 조각을 보낸 뒤부터 파이프로 복사 없이 중계
+        if (c->cap->abandoned && !c->splicing && c->body.mode != HTTP_BODY_CHUNKED && opts.relay != PROXY_RELAY_COPY &&
+            os_pipe(c->pipefd) == 0) {
+            c->splicing = 1;
+            c->pipe_len = 0;
+        }
+    }
+}
+
+// RC_FOLLOW: 리더가 채우는 flight 버퍼를 공개된 만큼 클라로 보내고, 따라잡으면 깨움 요청을 걸고 대기
+//  - follow_flight(블로킹 모델)와 같은 규칙: 헤더 줄 끝에 이번 연결의 Connection 헤더를 끼워 넣음
+//  - 보내기 전에 리더가 실패했거나(캐시 불가 포함) chunked를 HTTP/1.0에 보내야 하면 직접 원서버로
+//  - 리더가 디스크 계층 임시 파일에 채우는 응답은 조각을 iov 대신 그 파일 구간(dsk_off/dsk_left)으로 sendfile
+static int rconn_follow(reactor_t *r, rconn_t *c) {
+    flight_t *f = c->flight;
+    for (;;) {
+        while (c->dsk_left > 0) { // 파일 구간이 iov(끼워 넣을 Connection 헤더)보다 앞
+            ssize_t w = os_sendfile(c->client.fd, f->disk->fd, &c->dsk_off, c->dsk_left);
+            if (w < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    return 0;
+                return -1;
+            }
+            if (w == 0)
+                return -1;
+            c->dsk_left -= (size_t)w;
+        }
+        while (c->iovcnt > 0) {
+            ssize_t w = writev(c->client.fd, c->iov, c->iovcnt);
+            if (w < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    return 0; // 클라 소켓이 다시 쓰기 가능해질 때까지 대기
+                return -1;
+            }
+            iov_advance(c->iov, &c->iovcnt, (size_t)w);
+        }
+        c->fol_off += c->fol_batch;
+        c->fol_batch = 0;
+        if (c->fol_off < c->fol_avail) { // 다음 조각: 헤더 줄까지는 따로 끊어 Connection 헤더를 붙임
+            int in_head = c->fol_off < f->head_len;
+            size_t end = in_head ? f->head_len : c->fol_avail;
+            if (f->disk) {
+                c->dsk_off = f->disk->off + (off_t)c->fol_off;
+                c->dsk_left = c->fol_batch = end - c->fol_off;
+                c->iovcnt = 0;
+            } else {
+                c->iovcnt = flight_iov(f, c->fol_off, end, c->iov, in_head ? 2 : 3, &c->fol_batch);
+            }
+            if (in_head && c->fol_off + c->fol_batch == f->head_len)
+                c->iov[c->iovcnt++] = (struct iovec){c->hit_hdr, strlen(c->hit_hdr)};
+            continue;
+        }
+        if (c->fol_state == FLIGHT_DONE) {
+            rconn_flight_drop(c, 1);
+            return c->keep ? rconn_next_request(r, c) : -1;
+        }
+        if (!flight_poll(f, c->fol_off, &c->fol_state, &c->fol_avail, &c->fw))
+            return 0; // 리더가 더 채우면 우편함으로 깨어남
+        if (c->fol_state == FLIGHT_FAILED || (!c->fol_started && f->chunked && c->http10)) {
+            if (c->fol_started)
+                return -1; // 이미 보낸 응답은 잇지 못하므로 닫음(클라는 잘린 응답을 알아챔)
+            rconn_flight_drop(c, 0);
+            return rconn_fetch(r, c);
+        }
+        if (!c->fol_started) { // 메타데이터는 헤더 공개 뒤로 바뀌지 않음
+            c->fol_started = 1;
+            if (f->head_len == 0) // 헤더를 해석하지 못한 원본: 그대로 보내고 닫음
+                c->keep = 0;
+            else
+                stored_conn_hdr(c->hit_hdr, sizeof(c->hit_hdr), f->unsized, c->fol_avail - f->head_len - 2, c->keep);
+        }
+    }
+}
+
+// 연결이 더 진행할 수 없을 때까지(EAGAIN) 상태 기계를 돌린다
+//  - 각 단계 함수는 1(다음 단계로 진행), 0(이벤트 대기), -1(연결 종료)을 반환
+static void rconn_step(reactor_t *r, rconn_t *c) {
+    int rc = 1;
+    while (rc > 0) {
+        switch (c->state) {
+        case RC_READ_HEAD:
+            rc = rconn_read_head(r, c);
+            break;
+        case RC_RESOLVE:
+            rc = rconn_resolved(r, c);
+            break;
+        case RC_CONNECT:
+            rc = rconn_connecting(r, c);
+            break;
+        case RC_SEND_REQ:
+            rc = rconn_send_request(r, c);
+            break;
+        case RC_RELAY:
+            rc = rconn_relay(r, c);
+            break;
+        case RC_FLUSH:
+            rc = rconn_flush_reply(r, c);
+            break;
+        case RC_FOLLOW:
+            rc = rconn_follow(r, c);
+            break;
+        case RC_CLOSED:
+            return;
+        }
+    }
+    if (rc < 0)
+        rconn_close(r, c);
+}
+
+// 리스닝 소켓이 읽기 가능: EAGAIN까지 accept하여 연결 상태 기계를 만든다(ET이므로 끝까지)
+static void reactor_accept(reactor_t *r) {
+    for (;;) {
+        int connfd = accept(r->listenfd, NULL, NULL);
+        if (connfd < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                fprintf(stderr, "accept error: %s\n", strerror(errno));
+            return;
+        }
+        rconn_t *c = set_nonblocking(connfd) == 0 ? calloc(1, sizeof(*c)) : NULL;
+        if (!c) {
+            close(connfd);
+            continue;
+        }
+        c->client.conn = c->server.conn = c;
+        c->client.fd = connfd;
+        c->cap = &c->cap_own;
+        c->reactor = r;
+        c->fw.wake = rconn_flight_wake;
+        c->fw.arg = c;
+        c->server.fd = -1;
+        c->state = RC_READ_HEAD;
+        struct epoll_event ev = {.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, .data.ptr = &c->client};
+        if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, connfd, &ev) < 0) {
+            close(connfd);
+            free(c);
+            continue;
+        }
+        rconn_idle_add(r, c); // 첫 요청 헤더에도 같은 타임아웃
+        rconn_step(r, c); // 이미 도착한 데이터가 있을 수 있으므로 바로 한 번 진행
+    }
+}
+
+// 이름 해석 완료 통지: 파이프에서 연결 포인터를 EAGAIN까지 꺼내 각 연결을 이어서 진행
+//  - 해석 중에 닫힌 연결은 여기서야 지연 해제 리스트로 보냄
+static void reactor_dns_done(reactor_t *r) {
+    rconn_t *tokens[64];
+    for (;;) {
+        ssize_t n = read(r->dns_pipe[0], tokens, sizeof(tokens));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+        // 해석 스레드는 포인터 하나씩 write(PIPE_BUF 이하라 원자적)하므로 항상 포인터 크기의 배수
+        for (size_t i = 0; i < (size_t)n / sizeof(tokens[0]); i++) {
+            rconn_t *c = tokens[i];
+            c->dns_pending = 0;
+            if (c->state == RC_CLOSED)
+                rconn_reap(r, c);
+            else
+                rconn_step(r, c);
+        }
+    }
+}
+
+// 깨움 우편함: 초인종을 비우고 우편함의 팔로워를 하나씩 꺼내 이어서 진행
+//  - 우편함에 든 채 닫힌 연결은 여기서야 지연 해제 리스트로 보냄
+static void reactor_mailbox(reactor_t *r) {
+    char drain[64];
+    while (read(r->mb_pipe[0], drain, sizeof(drain)) > 0 || errno == EINTR) {
+    }
+    for (;;) {
+        pthread_mutex_lock(&r->mb_lock);
+        rconn_t *c = r->mb_head;
+        if (c) {
+            r->mb_head = c->mb_next;
+            c->mb_queued = 0;
+        }
+        pthread_mutex_unlock(&r->mb_lock);
+        if (!c)
+            return;
+        if (c->state == RC_CLOSED)
+            rconn_reap(r, c);
+        else
+            rconn_step(r, c);
+    }
+}
+
+// 이벤트 루프 본체: listenfd를 논블로킹으로 바꾸고 영원히 epoll_wait
+//  - 초기화 실패 시에만 -1로 반환
+static int reactor_run(int listenfd) {
+    reactor_t r = {.epfd = -1, .listenfd = listenfd, .dead = NULL, .idle_head = NULL, .idle_tail = NULL, .connecting = NULL,
+                   .mb_lock = PTHREAD_MUTEX_INITIALIZER, .mb_head = NULL};
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+
+    if (set_nonblocking(listenfd) < 0)
+        return -1;
+    r.epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (r.epfd < 0)
+        return -1;
+    struct epoll_event lev = {.events = EPOLLIN | EPOLLET, .data.ptr = NULL}; // NULL = 리스닝 소켓
+    if (epoll_ctl(r.epfd, EPOLL_CTL_ADD, listenfd, &lev) < 0) {
+        close(r.epfd);
+        return -1;
+    }
+    // 해석 완료 통지 파이프: 읽기 끝만 논블로킹(쓰기 끝은 해석 스레드가 막혀도 되므로 블로킹 유지)
+    if (os_pipe(r.dns_pipe) < 0) {
+        close(r.epfd);
+        return -1;
+    }
+    r.dns_end.conn = NULL;
+    r.dns_end.fd = r.dns_pipe[0];
+    struct epoll_event dev = {.events = EPOLLIN | EPOLLET, .data.ptr = &r.dns_end};
+    if (set_nonblocking(r.dns_pipe[0]) < 0 || epoll_ctl(r.epfd, EPOLL_CTL_ADD, r.dns_pipe[0], &dev) < 0) {
+        close(r.dns_pipe[0]);
+        close(r.dns_pipe[1]);
+        close(r.epfd);
+        return -1;
+    }
+    // 깨움 우편함 초인종: 리더 쪽 스레드는 flight 락을 쥔 채 쓰므로 쓰기 끝도 논블로킹
+    r.mb_end.conn = NULL;
+    if (os_pipe(r.mb_pipe) < 0) {
+        close(r.epfd);
+        return -1;
+    }
+    r.mb_end.fd = r.mb_pipe[0];
+    struct epoll_event mev = {.events = EPOLLIN | EPOLLET, .data.ptr = &r.mb_end};
+    if (set_nonblocking(r.mb_pipe[0]) < 0 || set_nonblocking(r.mb_pipe[1]) < 0 ||
+        epoll_ctl(r.epfd, EPOLL_CTL_ADD, r.mb_pipe[0], &mev) < 0) {
+        close(r.mb_pipe[0]);
+        close(r.mb_pipe[1]);
+        close(r.epfd);
+        return -1;
+    }
+
+    for (;;) {
+        // 요청을 기다리는 연결과 connect 중인 연결이 있으면 가장 이른 타이머 시각까지만 대기
+        long long wake = r.idle_head ? r.idle_head->idle_deadline : -1;
+        for (rconn_t *c = r.connecting; c; c = c->conn_next) {
+            long long t = rconn_connect_timer(c);
+            if (wake < 0 || t < wake)
+                wake = t;
+        }
+        int timeout = -1;
+        if (wake >= 0) {
+            long long wait = wake - reactor_now_ms();
+            timeout = wait < 0 ? 0 : (int)wait + 1;
+        }
+        int n = epoll_wait(r.epfd, events, REACTOR_MAX_EVENTS, timeout);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "epoll_wait error: %s\n", strerror(errno));
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            rend_t *ep = events[i].data.ptr;
+            if (!ep) {
+                reactor_accept(&r);
+                continue;
+            }
+            if (ep == &r.dns_end) {
+                reactor_dns_done(&r);
+                continue;
+            }
+            if (ep == &r.mb_end) {
+                reactor_mailbox(&r);
+                continue;
+            }
+            rconn_t *c = ep->conn;
+            if (c->state == RC_CLOSED) // 같은 배치에서 이미 닫힌 연결
+                continue;
+            ep->ev |= events[i].events;
+            rconn_step(&r, c);
+        }
+        // 유휴 타임아웃: 마감 시각이 지난 연결을 앞에서부터 닫음
+        long long now = reactor_now_ms();
+        while (r.idle_head && r.idle_head->idle_deadline <= now)
+            rconn_close(&r, r.idle_head);
+        // connect 타이머: 다음 후보를 띄울 때가 됐거나 마감이 지난 연결을 진행
+        for (rconn_t *c = r.connecting, *next; c; c = next) {
+            next = c->conn_next;
+            if (rconn_connect_timer(c) <= now)
+                rconn_step(&r, c);
+        }
+        // 배치 처리가 끝났으니 닫힌 연결 구조체를 해제
+        while (r.dead) {
+            rconn_t *c = r.dead;
+            r.dead = c->next_dead;
+            free(c);
+        }
+    }
+    close(r.epfd);
+    return -1;
+}
+
+// ---------------------------------------------------------------------------
+// 멀티 이벤트 루프(-m epoll -r N)
+// - 루프마다 SO_REUSEPORT 리스너와 epoll 인스턴스를 따로 가지므로 accept가 한 코어에 몰리지 않고,
+//   커널이 분배한 연결은 accept한 루프(코어)에서 중계까지 끝남(루프 간 공유 상태는 캐시뿐)
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    int listenfd; // 이 루프 전용 리스너
+    int cpu;      // 고정할 CPU(-1이면 고정 안 함)
+} reactor_arg_t;
+
+static void *reactor_thread_main(void *arg) {
+    reactor_arg_t a = *(reactor_arg_t *)arg;
+    free(arg);
+    if (a.cpu >= 0 && os_pin_thread_to_cpu(a.cpu) < 0)
+        fprintf(stderr, "reactor: cannot pin to cpu %d: %s\n", a.cpu, strerror(errno));
+    reactor_run(a.listenfd);
+    fprintf(stderr, "reactor on cpu %d exited\n", a.cpu);
+    close(a.listenfd);
+    return NULL;
+}
+
+// 1..n-1번 이벤트 루프를 스레드로 띄운다(0번은 호출자가 직접 reactor_run)
+// - 리스너는 모두 여기서(메인 스레드) 열어 바인드 실패를 시작 시점에 보고
+static int reactors_start(const char *port, int n, int pin) {
+    int ncpu = os_online_cpus();
+    for (int i = 1; i < n; i++) {
+        int fd = open_listenfd_s(port, 1);
+        if (fd < 0) {
+            fprintf(stderr, "Error: cannot open SO_REUSEPORT listener %d on port %s\n", i, port);
+            return -1;
+        }
+        reactor_arg_t *a = malloc(sizeof(*a));
+        if (!a) {
+            close(fd);
+            return -1;
+        }
+        a->listenfd = fd;
+        a->cpu = pin ? i % ncpu : -1;
+        pthread_t tid;
+        int rc = pthread_create(&tid, NULL, reactor_thread_main, a);
+        if (rc != 0) {
+            fprintf(stderr, "reactor: pthread_create failed: %s\n", strerror(rc));
+            free(a);
+            close(fd);
+            return -1;
+        }
+        pthread_detach(tid);
+    }
+    return 0;
+}
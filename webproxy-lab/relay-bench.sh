@@ -0,0 +1,113 @@
+#!/bin/bash
+#
+# relay-bench.sh - 응답 중계 방식(-R copy | splice | tee)별 처리량과 프록시 CPU 사용량 비교
+#
+#     10KB / 100KB / 10MB 객체를 tiny로 서비스하고, 요청마다 다른 URL(심볼릭 링크)을
+#     써서 모두 캐시 MISS가 되도록 한 뒤 프록시를 거쳐 순차로 받는다.
+#     단일 객체 한도를 16MB로 올려 세 크기 모두 캐시 후보가 되게 하므로
+#       copy   : 클라로 복사 + 캐시 버퍼로 복사(기존 memcpy 경로)
+#       splice : 캐시 후보는 copy와 같음(한도 초과 응답만 splice)
+#       tee    : 클라로는 splice, 캐시 쪽만 tee 파이프에서 1회 복사
+#     를 비교하게 된다.
+#
+#     usage: ./relay-bench.sh [추가 프록시 옵션...]   ex) ./relay-bench.sh -m epoll
+#
+
+HOME_DIR=`pwd`
+TINY_DIR="./tiny"
+BENCH_DIR="bench.tmp"                 # tiny 디렉터리 아래 임시 객체/링크
+MODES="copy splice tee"
+SIZES="10k:10240:500 100k:102400:300 10m:10485760:20" # 이름:바이트:요청 수
+PROXY_OPTS="-O 16M -C 64M"
+CLK_TCK=`getconf CLK_TCK`
+
+#
+# cleanup - 띄운 서버를 정리하고 임시 파일 삭제
+#
+function cleanup {
+    [ -n "${proxy_pid}" ] && kill ${proxy_pid} 2> /dev/null
+    [ -n "${tiny_pid}" ] && kill ${tiny_pid} 2> /dev/null
+    rm -rf ${TINY_DIR}/${BENCH_DIR} ${curl_cfg}
+}
+trap 'cleanup; exit 1' INT TERM
+
+#
+# cpu_ticks - 프로세스가 지금까지 쓴 user+sys CPU 틱
+# usage: cpu_ticks <pid>
+#
+function cpu_ticks {
+    # comm에 공백이 있을 수 있으므로 ')' 뒤부터 센다(utime = 14번째, stime = 15번째 필드)
+    sed 's/.*) //' /proc/$1/stat | awk '{print $12 + $13}'
+}
+
+#
+# now - 소수점 초 단위 현재 시각
+#
+function now {
+    date +%s.%N
+}
+
+if [ ! -x ./proxy -o ! -x ${TINY_DIR}/tinyserver ]; then
+    echo "Error: build first (make)"
+    exit 1
+fi
+
+# 크기별 원본 객체와 요청마다 다른 URL이 되도록 심볼릭 링크 생성
+mkdir -p ${TINY_DIR}/${BENCH_DIR}
+for spec in ${SIZES}; do
+    IFS=: read name bytes reqs <<< "${spec}"
+    head -c ${bytes} /dev/urandom > ${TINY_DIR}/${BENCH_DIR}/obj_${name}.bin
+    mkdir -p ${TINY_DIR}/${BENCH_DIR}/${name}
+    for i in `seq 1 ${reqs}`; do
+        ln -sf ../obj_${name}.bin ${TINY_DIR}/${BENCH_DIR}/${name}/l${i}
+    done
+done
+curl_cfg=`mktemp`
+
+printf "%-7s %-5s %6s %10s %12s\n" "relay" "size" "reqs" "MB/s" "cpu_ms/req"
+for mode in ${MODES}; do
+    tiny_port=`./free-port.sh`
+    cd ${TINY_DIR}
+    ./tinyserver ${tiny_port} > /dev/null 2>&1 &
+    tiny_pid=$!
+    cd ${HOME_DIR}
+    proxy_port=`./free-port.sh`
+    while [ "${proxy_port}" == "${tiny_port}" ]; do
+        proxy_port=`expr ${proxy_port} + 1`
+    done
+    ./proxy -R ${mode} ${PROXY_OPTS} "$@" ${proxy_port} > /dev/null 2>&1 &
+    proxy_pid=$!
+    sleep 1
+
+    for spec in ${SIZES}; do
+        IFS=: read name bytes reqs <<< "${spec}"
+        # curl 한 프로세스로 순차 요청(프로세스 기동 비용을 측정에서 제외)
+        echo "proxy = \"http://localhost:${proxy_port}\"" > ${curl_cfg}
+        for i in `seq 1 ${reqs}`; do
+            echo "url = \"http://localhost:${tiny_port}/${BENCH_DIR}/${name}/l${i}\"" >> ${curl_cfg}
+            echo "output = \"/dev/null\"" >> ${curl_cfg}
+        done
+        t0=`now`
+        c0=`cpu_ticks ${proxy_pid}`
+        curl --silent --config ${curl_cfg}
+        c1=`cpu_ticks ${proxy_pid}`
+        t1=`now`
+        # 마지막으로 캐시에 들어간 객체가 원본과 같은지 확인(HIT 경로로 검증)
+        curl --silent --proxy http://localhost:${proxy_port} --output ${curl_cfg}.out \
+            http://localhost:${tiny_port}/${BENCH_DIR}/${name}/l${reqs}
+        cmp -s ${curl_cfg}.out ${TINY_DIR}/${BENCH_DIR}/obj_${name}.bin || echo "Error: ${mode}/${name} body mismatch"
+        rm -f ${curl_cfg}.out
+        awk -v m=${mode} -v n=${name} -v r=${reqs} -v b=${bytes} -v t0=${t0} -v t1=${t1} \
+            -v c=$((c1 - c0)) -v hz=${CLK_TCK} 'BEGIN {
+                printf "%-7s %-5s %6d %10.1f %12.3f\n", m, n, r, r * b / (t1 - t0) / 1048576, c * 1000.0 / hz / r
+            }'
+    done
+
+    kill ${proxy_pid} ${tiny_pid} 2> /dev/null
+    wait ${proxy_pid} ${tiny_pid} 2> /dev/null
+    proxy_pid=""
+    tiny_pid=""
+done
+
+cleanup
+exit 0
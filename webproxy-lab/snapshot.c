@@ -0,0 +1,251 @@
+#include "snapshot.h"
+#include "cache.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SNAP_MAGIC "PXYSNAP2" // 파일 머리 표시(형식이 바뀌면 숫자를 올림)
+#define SNAP_REC_MAGIC 0x43524e53u // 레코드 시작 표시("SNRC")
+#define SNAP_FLAG_CHUNKED 1u
+#define SNAP_FLAG_UNSIZED 2u
+#define SNAP_FLAG_VARY 4u // Vary 표시 객체
+#define SNAP_FLAG_REVALIDATE 8u // 검증자가 있어 만료 뒤에도 재검증해 쓸 수 있음
+#define SNAP_FLAG_COMPRESSIBLE 16u // 압축본을 만들어도 되는 원래 응답
+#define SNAP_FLAG_VARIANT 32u // 압축 계층이 만든 압축본
+#define SNAP_WRITE_BUF (1 << 20) // 쓰기 stdio 버퍼
+
+// 파일 머리
+typedef struct {
+    char magic[8];
+    uint64_t count;   // 레코드 수
+    uint64_t created; // 저장 시각(UNIX 초)
+    uint64_t check;   // 이 필드를 0으로 둔 머리의 체크섬
+} snap_hdr_t;
+
+// 레코드 머리(뒤에 키 key_len바이트, 응답 바이트 size바이트가 이어짐)
+typedef struct {
+    uint32_t magic;
+    uint32_t key_len;
+    uint64_t size;
+    uint64_t head_len;
+    int64_t expires; // 신선도 만료 시각(UNIX 초, 0이면 없음)
+    uint32_t flags;
+    uint32_t swr; // stale-while-revalidate 초
+    uint64_t check; // 이 필드를 0으로 둔 레코드 머리 + 키 + 데이터의 체크섬
+} snap_rec_t;
+
+// 저장할 엔트리 하나(캐시 락 밖에서 쓰도록 참조를 올려 모아 둠)
+typedef struct {
+    char *key;
+    cache_obj_t *obj;
+} snap_item_t;
+
+typedef struct {
+    snap_item_t *items;
+    size_t n, cap;
+    int oom;
+} snap_list_t;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+}
+
+// 8바이트씩 섞는 64비트 체크섬(바이트 단위 FNV보다 빠르게 전체 데이터를 검증)
+static uint64_t sum_update(uint64_t h, const void *p, size_t n) {
+    const unsigned char *s = p;
+    while (n >= 8) {
+        uint64_t w;
+        memcpy(&w, s, 8);
+        h = (h ^ w) * 0x100000001b3ull;
+        h ^= h >> 29;
+        s += 8;
+        n -= 8;
+    }
+    while (n--)
+        h = (h ^ *s++) * 0x100000001b3ull;
+    return h;
+}
+
+#define SUM_INIT 0xcbf29ce484222325ull
+
+static uint64_t rec_check(snap_rec_t rec, const char *key, const char *data) {
+    rec.check = 0;
+    uint64_t h = sum_update(SUM_INIT, &rec, sizeof(rec));
+    h = sum_update(h, key, rec.key_len);
+    return sum_update(h, data, rec.size);
+}
+
+static uint64_t hdr_check(snap_hdr_t hdr) {
+    hdr.check = 0;
+    return sum_update(SUM_INIT, &hdr, sizeof(hdr));
+}
+
+static void collect(const char *key, cache_obj_t *obj, void *arg) {
+    snap_list_t *l = arg;
+    if (l->oom)
+        return;
+    if (l->n == l->cap) {
+        size_t ncap = l->cap ? l->cap * 2 : 256;
+        snap_item_t *p = realloc(l->items, ncap * sizeof(*p));
+        if (!p) {
+            l->oom = 1;
+            return;
+        }
+        l->items = p;
+        l->cap = ncap;
+    }
+    char *k = strdup(key);
+    if (!k) {
+        l->oom = 1;
+        return;
+    }
+    cache_retain(obj);
+    l->items[l->n++] = (snap_item_t){k, obj};
+}
+
+// 모은 엔트리를 fp에 머리 + 레코드로 씀. 성공 1
+static int write_items(FILE *fp, const snap_list_t *l, snapshot_result_t *res) {
+    snap_hdr_t hdr = {.count = l->n, .created = (uint64_t)time(NULL)};
+    memcpy(hdr.magic, SNAP_MAGIC, sizeof(hdr.magic));
+    hdr.check = hdr_check(hdr);
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1)
+        return 0;
+    for (size_t i = 0; i < l->n; i++) {
+        const char *key = l->items[i].key;
+        const cache_obj_t *obj = l->items[i].obj;
+        snap_rec_t rec = {.magic = SNAP_REC_MAGIC,
+                          .key_len = (uint32_t)strlen(key),
+                          .size = obj->size,
+                          .head_len = obj->head_len,
+                          .expires = obj->expires,
+                          .swr = obj->swr,
+                          .flags = (obj->chunked ? SNAP_FLAG_CHUNKED : 0) | (obj->unsized ? SNAP_FLAG_UNSIZED : 0) |
+                                   (obj->vary ? SNAP_FLAG_VARY : 0) | (obj->revalidate ? SNAP_FLAG_REVALIDATE : 0) |
+                                   (obj->compressible ? SNAP_FLAG_COMPRESSIBLE : 0) |
+                                   (obj->variant ? SNAP_FLAG_VARIANT : 0)};
+        rec.check = rec_check(rec, key, obj->data);
+        if (fwrite(&rec, sizeof(rec), 1, fp) != 1 || fwrite(key, 1, rec.key_len, fp) != rec.key_len ||
+            fwrite(obj->data, 1, obj->size, fp) != obj->size)
+            return 0;
+        res->bytes += obj->size;
+    }
+    return fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+}
+
+int snapshot_save(const char *path, snapshot_result_t *res) {
+    double t0 = now_ms();
+    memset(res, 0, sizeof(*res));
+    snap_list_t l = {0};
+    cache_foreach(collect, &l); // 락은 엔트리를 모으는 동안만. 파일 쓰기는 락 밖에서
+
+    char tmp[4096];
+    int rc = -1;
+    FILE *fp;
+    if (l.oom) {
+        errno = ENOMEM;
+    } else if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) {
+        errno = ENAMETOOLONG;
+    } else if ((fp = fopen(tmp, "wb"))) {
+        setvbuf(fp, NULL, _IOFBF, SNAP_WRITE_BUF);
+        int ok = write_items(fp, &l, res);
+        if (fclose(fp) != 0)
+            ok = 0;
+        if (ok && rename(tmp, path) == 0) { // 다 쓴 뒤에만 바꿔 치움(이전 스냅샷은 그때까지 온전)
+            res->objects = l.n;
+            rc = 0;
+        } else {
+            int e = errno;
+            unlink(tmp);
+            errno = e;
+        }
+    }
+    for (size_t i = 0; i < l.n; i++) {
+        free(l.items[i].key);
+        cache_release(l.items[i].obj);
+    }
+    free(l.items);
+    res->elapsed_ms = now_ms() - t0;
+    return rc;
+}
+
+int snapshot_load(const char *path, snapshot_result_t *res) {
+    double t0 = now_ms();
+    memset(res, 0, sizeof(*res));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return errno == ENOENT ? 1 : -1;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(snap_hdr_t)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    size_t len = (size_t)st.st_size;
+    const char *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+    madvise((void *)map, len, MADV_SEQUENTIAL);
+
+    snap_hdr_t hdr;
+    memcpy(&hdr, map, sizeof(hdr));
+    if (memcmp(hdr.magic, SNAP_MAGIC, sizeof(hdr.magic)) || hdr_check(hdr) != hdr.check) {
+        munmap((void *)map, len);
+        errno = EINVAL;
+        return -1;
+    }
+    size_t max_obj = cache_max_object_size();
+    long long now = (long long)time(NULL);
+    size_t off = sizeof(hdr);
+    for (uint64_t i = 0; i < hdr.count && len - off >= sizeof(snap_rec_t); i++) {
+        snap_rec_t rec;
+        memcpy(&rec, map + off, sizeof(rec));
+        size_t room = len - off - sizeof(rec);
+        if (rec.magic != SNAP_REC_MAGIC || rec.key_len == 0 || rec.key_len > room || rec.size > room - rec.key_len ||
+            rec.head_len > rec.size)
+            break;
+        const char *key = map + off + sizeof(rec);
+        const char *data = key + rec.key_len;
+        off += sizeof(rec) + rec.key_len + rec.size;
+        if (rec_check(rec, key, data) != rec.check || memchr(key, '\0', rec.key_len)) {
+            res->skipped++;
+            break; // 이후 경계도 믿을 수 없음
+        }
+        int fresh = rec.expires == 0 || rec.expires > now || (rec.flags & SNAP_FLAG_REVALIDATE);
+        char *k = fresh && rec.size <= max_obj ? strndup(key, rec.key_len) : NULL;
+        cache_obj_t *obj = k ? cache_obj_alloc(rec.size) : NULL;
+        if (!obj) { // 저장한 뒤 신선도가 지났거나 지금 설정의 객체 한도를 넘음(또는 메모리 부족)
+            free(k);
+            res->skipped++;
+            continue;
+        }
+        memcpy(obj->data, data, rec.size);
+        obj->head_len = rec.head_len;
+        obj->chunked = (rec.flags & SNAP_FLAG_CHUNKED) != 0;
+        obj->unsized = (rec.flags & SNAP_FLAG_UNSIZED) != 0;
+        obj->vary = (rec.flags & SNAP_FLAG_VARY) != 0;
+        obj->revalidate = (rec.flags & SNAP_FLAG_REVALIDATE) != 0;
+        obj->compressible = (rec.flags & SNAP_FLAG_COMPRESSIBLE) != 0;
+        obj->variant = (rec.flags & SNAP_FLAG_VARIANT) != 0;
+        obj->swr = rec.swr;
+        obj->expires = rec.expires;
+        cache_put_obj(k, obj);
+        free(k);
+        res->objects++;
+        res->bytes += rec.size;
+    }
+    if (res->objects + res->skipped < hdr.count) // 잘린 파일
+        res->skipped = hdr.count - res->objects;
+    munmap((void *)map, len);
+    res->elapsed_ms = now_ms() - t0;
+    return 0;
+}
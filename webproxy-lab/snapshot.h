@@ -0,0 +1,21 @@
+// 메모리 캐시 스냅샷(재시작 뒤 빈 캐시로 원서버에 몰리지 않도록)
+// - 저장: 완성된 캐시 엔트리(키 + 응답 메타데이터 + 응답 바이트)를 한 파일에 이어 씀. 샤드별로 오래된 것부터라
+//   다시 넣으면 LRU 순서가 유지됨. 임시 파일에 쓰고 fsync 뒤 rename하므로 도중에 죽어도 이전 스냅샷은 온전함
+// - 읽기: 파일을 mmap해 레코드마다 체크섬(헤더 + 키 + 데이터)을 확인하고 캐시 객체로 복사해 삽입
+//   망가진 레코드를 만나면 거기서 멈추고 앞의 것만 씀
+// - 메모리 캐시만 담음(디스크 계층은 세그먼트 파일 자체가 재시작에 살아남음)
+#pragma once
+#include <stddef.h>
+
+// 저장/읽기 결과(로그 출력용)
+typedef struct {
+    size_t objects;   // 저장/삽입한 객체 수
+    size_t bytes;     // 응답 바이트 합
+    size_t skipped;   // 읽기: 검증에 실패했거나 신선도가 지났거나(검증자 없이) 한도를 넘어 버린 레코드 수
+    double elapsed_ms; // 걸린 시간
+} snapshot_result_t;
+
+// 지금 메모리 캐시의 완성된 엔트리를 path에 저장. 성공 0, 실패 -1(errno)
+int snapshot_save(const char *path, snapshot_result_t *res);
+// path의 스냅샷을 캐시에 다시 넣음(cache_init 뒤). 파일이 없으면 1, 성공 0, 형식이 틀리면 -1
+int snapshot_load(const char *path, snapshot_result_t *res);
@@ -11,7 +11,8 @@ static void *proxy_thread_main(void *arg) {
     thread_arg_t *a = (thread_arg_t *)arg; // 전달 인자 캐스팅
     int connfd = a->connfd;                // FD 로컬 복사
     free(a);                               // 인자 구조체 해제
-    handle_client(connfd);                 // 요청 처리
+    int served = 1;                        // 이 연결에서 처리할 요청 번호
+    handle_client(connfd, &served, 0);     // 요청 처리(keep-alive 동안 이 스레드가 기다림)
     close(connfd);                         // 연결 종료
     return NULL;                           // 반환값 없음
 }
@@ -33,3 +34,218 @@ static int spawn_detached_worker(int connfd) {
     }
     return 0; // 성공
 }
+
+// ---------------------------------------------------------------------------
+// 고정 크기 워커 풀 + 유한 연결 큐(-m pool)
+// - 설계: 시작 시 워커를 미리 만들어 두고, accept 루프(생산자)가 connfd를 유한 큐에 넣으면
+//   워커(소비자)가 꺼내 handle_client를 수행. 스레드 수와 대기 연결 수가 모두 상한을 가짐
+// - 큐가 가득 찼을 때: block(accept를 멈춰 커널 backlog로 역압) 또는 reject(즉시 503 응답)
+// - keep-alive 연결이 요청 사이에서 쉬는 동안은 워커를 붙잡지 않고 주차 스레드(epoll)에 맡김(아래)
+// ---------------------------------------------------------------------------
+
+#include <sys/epoll.h>
+
+// 큐 항목: 연결과 그 연결에서 다음에 처리할 요청 번호(주차했다 돌아온 연결도 -n 상한을 이어서 셈)
+typedef struct {
+    int fd;
+    int served;
+} pool_conn_t;
+
+// connfd 원형 큐(생산자-소비자)
+typedef struct {
+    pool_conn_t *items;       // 원형 버퍼
+    size_t cap;               // 큐 깊이
+    size_t head;              // 다음에 꺼낼 위치
+    size_t count;             // 현재 대기 중인 연결 수
+    pthread_mutex_t lock;     // 큐 보호
+    pthread_cond_t not_empty; // 워커가 기다리는 조건: 꺼낼 연결이 생김
+    pthread_cond_t not_full;  // accept 루프가 기다리는 조건(block 정책): 빈 칸이 생김
+} conn_queue_t;
+
+static conn_queue_t conn_queue = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .not_empty = PTHREAD_COND_INITIALIZER,
+    .not_full = PTHREAD_COND_INITIALIZER,
+};
+
+static int pool_submit(int connfd, int served, int block);
+
+// 유휴 keep-alive 연결 주차장
+// - 워커가 다음 요청을 유휴 타임아웃(-t) 동안 기다리면 느린 클라이언트 몇이 워커를 모두 붙잡으므로,
+//   버퍼가 빈 채로 다음 요청을 기다려야 하는 연결은 주차 스레드의 epoll에 넣고 워커는 큐로 돌아감
+// - 읽을 것이 오면 주차 스레드가 연결 큐에 다시 넣고(이미 받아들인 연결이라 block 정책), 마감이 지나면 닫음
+// - 마감 시각이 모두 "지금 + 같은 타임아웃"이므로 꼬리에 붙이기만 해도 마감 순 정렬이 유지됨
+typedef struct parked {
+    int fd;
+    int served;          // 돌아가서 처리할 요청 번호
+    long long deadline;  // 유휴 마감 시각(ms, CLOCK_MONOTONIC)
+    struct parked *prev;
+    struct parked *next;
+} parked_t;
+
+static struct {
+    int epfd;             // -1이면 주차하지 않음(워커가 직접 기다림)
+    pthread_mutex_t lock; // 목록 보호(워커가 넣고 주차 스레드가 뺌)
+    parked_t *head;       // 마감이 가장 이른 연결
+    parked_t *tail;
+} parking = {.epfd = -1, .lock = PTHREAD_MUTEX_INITIALIZER};
+
+static long long parking_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void parking_unlink(parked_t *p) { // parking.lock 보유
+    if (p->prev)
+        p->prev->next = p->next;
+    else
+        parking.head = p->next;
+    if (p->next)
+        p->next->prev = p->prev;
+    else
+        parking.tail = p->prev;
+}
+
+// 연결을 주차장에 넣음. 실패(메모리 부족 등)하면 -1(호출자가 닫음)
+static int park_conn(int connfd, int served) {
+    parked_t *p = malloc(sizeof(*p));
+    if (!p)
+        return -1;
+    p->fd = connfd;
+    p->served = served;
+    p->deadline = parking_now_ms() + (long long)opts.client_idle * 1000;
+    p->next = NULL;
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT, .data.ptr = p};
+    pthread_mutex_lock(&parking.lock); // 이벤트가 목록에 들어가기 전에 오지 않도록 등록도 락 안에서
+    p->prev = parking.tail;
+    if (parking.tail)
+        parking.tail->next = p;
+    else
+        parking.head = p;
+    parking.tail = p;
+    int rc = epoll_ctl(parking.epfd, EPOLL_CTL_ADD, connfd, &ev);
+    if (rc < 0)
+        parking_unlink(p);
+    pthread_mutex_unlock(&parking.lock);
+    if (rc < 0)
+        free(p);
+    return rc;
+}
+
+// 주차 스레드: 읽을 것이 온 연결은 큐로 돌려보내고, 마감이 지난 연결은 닫음
+// - 목록이 비어 있을 때도 1초마다 깨어남(새로 들어온 연결의 마감은 그보다 늦음)
+static void *parking_main(void *arg) {
+    (void)arg;
+    struct epoll_event evs[64];
+    for (;;) {
+        pthread_mutex_lock(&parking.lock);
+        long long wait = parking.head ? parking.head->deadline - parking_now_ms() : 1000;
+        pthread_mutex_unlock(&parking.lock);
+        int n = epoll_wait(parking.epfd, evs, 64, wait < 0 ? 0 : (int)wait);
+        for (int i = 0; i < n; i++) {
+            parked_t *p = evs[i].data.ptr;
+            pthread_mutex_lock(&parking.lock);
+            parking_unlink(p);
+            pthread_mutex_unlock(&parking.lock);
+            epoll_ctl(parking.epfd, EPOLL_CTL_DEL, p->fd, NULL);
+            pool_submit(p->fd, p->served, 1); // EOF/에러여도 워커가 읽어 보고 닫음
+            free(p);
+        }
+        long long now = parking_now_ms();
+        parked_t *expired = NULL;
+        pthread_mutex_lock(&parking.lock);
+        while (parking.head && parking.head->deadline <= now) {
+            parked_t *p = parking.head;
+            parking_unlink(p);
+            p->next = expired;
+            expired = p;
+        }
+        pthread_mutex_unlock(&parking.lock);
+        while (expired) { // 닫기는 락 밖에서
+            parked_t *p = expired;
+            expired = p->next;
+            epoll_ctl(parking.epfd, EPOLL_CTL_DEL, p->fd, NULL);
+            close(p->fd);
+            free(p);
+        }
+    }
+    return NULL;
+}
+
+// 워커 본체: 큐에서 connfd를 꺼내 처리하고, 다음 요청을 기다려야 하면 주차, 아니면 닫기를 영원히 반복
+static void *pool_worker_main(void *arg) {
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&conn_queue.lock);
+        while (conn_queue.count == 0) // 가짜 깨어남(spurious wakeup)에 대비해 while
+            pthread_cond_wait(&conn_queue.not_empty, &conn_queue.lock);
+        pool_conn_t c = conn_queue.items[conn_queue.head];
+        conn_queue.head = (conn_queue.head + 1) % conn_queue.cap;
+        conn_queue.count--;
+        pthread_cond_signal(&conn_queue.not_full); // 막혀 있던 accept 루프를 깨움
+        pthread_mutex_unlock(&conn_queue.lock);
+
+        int park = parking.epfd >= 0;
+        if (handle_client(c.fd, &c.served, park) && park_conn(c.fd, c.served) == 0)
+            continue;  // 주차장이 연결을 가짐
+        close(c.fd); // 연결 종료
+    }
+    return NULL;
+}
+
+// 큐를 할당하고 워커 nworkers개를 미리 생성(detach)
+// - 클라이언트 keep-alive(-t)가 켜져 있으면 주차 스레드도 띄움(못 띄우면 워커가 직접 기다림)
+// - 워커를 하나도 만들지 못하면 -1
+static int pool_start(int nworkers, size_t depth) {
+    conn_queue.items = (pool_conn_t *)malloc(depth * sizeof(pool_conn_t));
+    if (!conn_queue.items)
+        return -1;
+    conn_queue.cap = depth;
+    conn_queue.head = conn_queue.count = 0;
+
+    if (opts.client_idle > 0 && (parking.epfd = epoll_create1(EPOLL_CLOEXEC)) >= 0) {
+        pthread_t tid;
+        int rc = pthread_create(&tid, NULL, parking_main, NULL);
+        if (rc != 0) {
+            fprintf(stderr, "pool: cannot start parking thread: %s\n", strerror(rc));
+            close(parking.epfd);
+            parking.epfd = -1;
+        } else {
+            pthread_detach(tid);
+        }
+    }
+
+    int started = 0;
+    for (int i = 0; i < nworkers; i++) {
+        pthread_t tid;
+        int rc = pthread_create(&tid, NULL, pool_worker_main, NULL);
+        if (rc != 0) {
+            fprintf(stderr, "pool: pthread_create failed: %s\n", strerror(rc));
+            break;
+        }
+        pthread_detach(tid);
+        started++;
+    }
+    return started > 0 ? 0 : -1;
+}
+
+// accept한(또는 주차했다 읽을 것이 온) connfd를 큐에 넣는다. served는 그 연결에서 처리할 요청 번호
+// - block != 0: 큐가 빌 때까지 대기(그동안 accept가 멈춰 새 연결은 커널 backlog에 쌓임)
+// - block == 0: 가득 차 있으면 503을 보내고 닫은 뒤 -1
+static int pool_submit(int connfd, int served, int block) {
+    pthread_mutex_lock(&conn_queue.lock);
+    if (conn_queue.count == conn_queue.cap && !block) {
+        pthread_mutex_unlock(&conn_queue.lock);
+        clienterror(connfd, 503, "Service Unavailable", "Proxy is overloaded, try again later");
+        close(connfd);
+        return -1;
+    }
+    while (conn_queue.count == conn_queue.cap)
+        pthread_cond_wait(&conn_queue.not_full, &conn_queue.lock);
+    conn_queue.items[(conn_queue.head + conn_queue.count) % conn_queue.cap] = (pool_conn_t){connfd, served};
+    conn_queue.count++;
+    pthread_cond_signal(&conn_queue.not_empty); // 대기 중인 워커 하나를 깨움
+    pthread_mutex_unlock(&conn_queue.lock);
+    return 0;
+}
@@ -0,0 +1,207 @@
+#include "upstream.h"
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define UPSTREAM_BUCKETS 64 // host:port 해시 버킷 수(원서버 수는 많지 않다고 가정)
+
+// 유휴 연결 하나
+typedef struct {
+    int fd;
+    time_t since; // 풀에 들어온 시각(단조 시계, 초)
+} upstream_idle_t;
+
+// host:port 하나의 유휴 연결 스택. 가장 최근에 돌려받은 연결부터 재사용(살아 있을 확률이 높음)
+typedef struct upstream_host {
+    char *host;
+    int port;
+    upstream_idle_t *idle; // [0]이 가장 오래된 것
+    int n;                 // 보관 중인 수
+    struct upstream_host *next;
+} upstream_host_t;
+
+// pool_lock 안에서 버리기로 한 연결. 락을 놓은 뒤에 닫음(close가 느려도 다른 스레드가 풀을 기다리지 않게)
+// - 한 번에 버리는 수는 보관 중인 전체 유휴 수 + 돌려받은 1개를 넘지 않음
+typedef struct {
+    int fd[UPSTREAM_MAX_IDLE + 1];
+    int n;
+} upstream_doomed_t;
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static upstream_host_t *buckets[UPSTREAM_BUCKETS];
+static int idle_timeout;     // 초, 0이면 비활성
+static int max_per_host;     // host:port당 최대 유휴 수
+static size_t total_idle;    // 전체 유휴 수
+static time_t last_sweep;    // 마지막 전체 만료 검사 시각
+static upstream_stats_t stats;
+
+static time_t now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+// FNV-1a(host) ^ port
+static unsigned bucket_of(const char *host, int port) {
+    unsigned h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)host; *p; p++)
+        h = (h ^ *p) * 16777619u;
+    return (h ^ (unsigned)port) % UPSTREAM_BUCKETS;
+}
+
+static void free_host(upstream_host_t *h) {
+    free(h->host);
+    free(h->idle);
+    free(h);
+}
+
+// host:port 항목을 찾고, create면 없을 때 만든다(pool_lock 보유 상태)
+static upstream_host_t *find_host(const char *host, int port, int create) {
+    upstream_host_t **pp = &buckets[bucket_of(host, port)];
+    for (upstream_host_t *h = *pp; h; h = h->next)
+        if (h->port == port && !strcmp(h->host, host))
+            return h;
+    if (!create)
+        return NULL;
+    upstream_host_t *h = calloc(1, sizeof(*h));
+    if (!h)
+        return NULL;
+    h->host = strdup(host);
+    h->idle = malloc(sizeof(upstream_idle_t) * (size_t)max_per_host);
+    if (!h->host || !h->idle) {
+        free_host(h);
+        return NULL;
+    }
+    h->port = port;
+    h->next = *pp;
+    *pp = h;
+    return h;
+}
+
+// 모아 둔 연결을 닫음(pool_lock 밖)
+static void close_doomed(const upstream_doomed_t *d) {
+    for (int i = 0; i < d->n; i++)
+        close(d->fd[i]);
+}
+
+// 유휴 시간이 지난 연결을 오래된 쪽(스택 바닥)부터 d로 옮김(pool_lock 보유 상태)
+static void expire_host(upstream_host_t *h, time_t now, upstream_doomed_t *d) {
+    int k = 0;
+    while (k < h->n && now - h->idle[k].since >= idle_timeout)
+        d->fd[d->n++] = h->idle[k++].fd;
+    if (k == 0)
+        return;
+    memmove(h->idle, h->idle + k, sizeof(upstream_idle_t) * (size_t)(h->n - k));
+    h->n -= k;
+    total_idle -= (size_t)k;
+    stats.expired += (unsigned long long)k;
+}
+
+// 다시 찾지 않는 원서버의 연결도 닫히도록 1초에 한 번 전체를 훑음(pool_lock 보유 상태)
+// - 유휴 연결이 하나도 남지 않은 host:port 항목은 풀어 줌(본 적 있는 원서버 수만큼 항목이 쌓이지 않게)
+static void sweep(time_t now, upstream_doomed_t *d) {
+    if (now == last_sweep)
+        return;
+    last_sweep = now;
+    for (int i = 0; i < UPSTREAM_BUCKETS; i++) {
+        upstream_host_t **pp = &buckets[i];
+        while (*pp) {
+            upstream_host_t *h = *pp;
+            expire_host(h, now, d);
+            if (h->n == 0) {
+                *pp = h->next;
+                free_host(h);
+            } else {
+                pp = &h->next;
+            }
+        }
+    }
+}
+
+// 유휴 연결이 아직 쓸 만한지: 읽을 것이 있으면(FIN/RST 또는 요청하지 않은 바이트) 버림
+static int healthy(int fd) {
+    struct pollfd p = {.fd = fd, .events = POLLIN};
+    return poll(&p, 1, 0) == 0;
+}
+
+void upstream_init(int idle_sec, int per_host) {
+    idle_timeout = idle_sec > 0 ? idle_sec : 0;
+    max_per_host = per_host > 0 ? per_host : UPSTREAM_DEFAULT_PER_HOST;
+}
+
+int upstream_enabled(void) {
+    return idle_timeout > 0;
+}
+
+int upstream_acquire(const char *host, int port) {
+    if (!idle_timeout)
+        return -1;
+    int fd = -1;
+    upstream_doomed_t d;
+    d.n = 0;
+    time_t now = now_sec();
+    pthread_mutex_lock(&pool_lock);
+    sweep(now, &d);
+    upstream_host_t *h = find_host(host, port, 0);
+    if (h)
+        expire_host(h, now, &d);
+    while (h && h->n > 0) {
+        int cand = h->idle[--h->n].fd;
+        total_idle--;
+        if (healthy(cand)) {
+            fd = cand;
+            break;
+        }
+        d.fd[d.n++] = cand;
+        stats.stale++;
+    }
+    if (fd >= 0)
+        stats.reused++;
+    else
+        stats.misses++;
+    pthread_mutex_unlock(&pool_lock);
+    close_doomed(&d);
+    return fd;
+}
+
+void upstream_release(const char *host, int port, int fd) {
+    if (fd < 0)
+        return;
+    if (!idle_timeout) {
+        close(fd);
+        return;
+    }
+    upstream_doomed_t d;
+    d.n = 0;
+    time_t now = now_sec();
+    pthread_mutex_lock(&pool_lock);
+    sweep(now, &d);
+    upstream_host_t *h = total_idle < UPSTREAM_MAX_IDLE ? find_host(host, port, 1) : NULL;
+    if (h && h->n == max_per_host) { // 가득 찼으면 가장 오래된 것을 밀어냄
+        d.fd[d.n++] = h->idle[0].fd;
+        memmove(h->idle, h->idle + 1, sizeof(upstream_idle_t) * (size_t)(h->n - 1));
+        h->n--;
+        total_idle--;
+    }
+    if (h) {
+        h->idle[h->n].fd = fd;
+        h->idle[h->n].since = now;
+        h->n++;
+        total_idle++;
+        fd = -1;
+    }
+    pthread_mutex_unlock(&pool_lock);
+    close_doomed(&d);
+    if (fd >= 0)
+        close(fd);
+}
+
+void upstream_get_stats(upstream_stats_t *out) {
+    pthread_mutex_lock(&pool_lock);
+    *out = stats;
+    out->idle = total_idle;
+    pthread_mutex_unlock(&pool_lock);
+}
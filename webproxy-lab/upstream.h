@@ -0,0 +1,29 @@
+// 원서버 keep-alive 연결 풀
+// - 응답을 끝까지(Content-Length/chunked 경계) 받은 원서버 소켓을 host:port별 유휴 목록에 보관했다가
+//   같은 원서버로 가는 다음 요청에 재사용해 getaddrinfo + TCP 핸드셰이크를 건너뜀
+// - 유휴 시간이 지난 소켓과 꺼낼 때 이미 닫혔거나 읽을 바이트가 남아 있는 소켓(health check)은 버림
+// - fd의 블로킹 여부는 보관하지 않음: 꺼내는 쪽이 자기 모델에 맞게 설정(epoll 모드에서도 백그라운드 요청 스레드는 블로킹)
+#pragma once
+#include <stddef.h>
+
+#define UPSTREAM_DEFAULT_IDLE 30    // 기본 유휴 타임아웃(초), 0이면 풀을 쓰지 않음
+#define UPSTREAM_DEFAULT_PER_HOST 8 // host:port당 보관할 최대 유휴 연결 수
+#define UPSTREAM_MAX_IDLE 1024      // 전체 유휴 연결 수 상한(fd 고갈 방지)
+
+// 재사용 효과 확인용 누적 통계
+typedef struct {
+    unsigned long long reused;  // 풀에서 꺼내 재사용한 횟수
+    unsigned long long misses;  // 풀이 비어 새로 연결해야 했던 횟수
+    unsigned long long stale;   // health check에 걸려 버린 연결 수
+    unsigned long long expired; // 유휴 타임아웃으로 닫은 연결 수
+    size_t idle;                // 현재 보관 중인 유휴 연결 수
+} upstream_stats_t;
+
+// 풀 설정. idle_sec이 0이면 비활성(acquire는 항상 -1, release는 항상 close)
+void upstream_init(int idle_sec, int per_host);
+int upstream_enabled(void);
+// host:port로 쓸 수 있는 유휴 연결을 꺼냄. 없으면 -1(호출자가 새로 connect)
+int upstream_acquire(const char *host, int port);
+// 응답을 경계까지 다 읽은 연결을 돌려줌. 자리가 없거나 비활성이면 닫음
+void upstream_release(const char *host, int port, int fd);
+void upstream_get_stats(upstream_stats_t *out);